@@ -0,0 +1,232 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* dict-serialize-bm: cost of putting an xattr dict on the wire and
+ * taking it off again, the way protocol/client and protocol/server do for
+ * getxattr replies.
+ *
+ * Both modes serialize with dict_allocate_and_serialize() and encode a
+ * gfs3_getxattr_rsp with xdr_serialize_generic(), then decode it with
+ * xdr_to_generic(). "copy" unserializes with dict_unserialize(), "owned"
+ * with dict_unserialize_owned(). Reported are the best ns per reply out of
+ * a few rounds for each direction.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "dict.h"
+#include "xdr-generic.h"
+#include "glusterfs3-xdr.h"
+
+#define BM_ITERATIONS   (1 << 16)
+#define BM_ROUNDS       5       /* best of */
+#define BM_WIRE_SIZE    (256 * 1024)
+
+struct bm_payload {
+        const char *name;
+        int         count;
+        int         size;
+};
+
+static struct bm_payload bm_payloads[] = {
+        {"afr-xattrop", 4, 12},
+        {"acl", 2, 124},
+        {"gfid2path", 8, 80},
+        {"user-4k", 4, 4096},
+        {"user-64k", 1, 65536},
+};
+
+static char bm_wire[BM_WIRE_SIZE];
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static dict_t *
+bm_build (struct bm_payload *payload)
+{
+        dict_t *dict = NULL;
+        char    key[64];
+        char   *value = NULL;
+        int     i = 0;
+
+        dict = dict_new ();
+        for (i = 0; i < payload->count; i++) {
+                snprintf (key, sizeof (key), "trusted.bm.%s.%d",
+                          payload->name, i);
+                value = GF_MALLOC (payload->size, gf_common_mt_char);
+                memset (value, 'a' + i, payload->size);
+                if (dict_set_dynptr (dict, key, value, payload->size)) {
+                        fprintf (stderr, "dict_set failed\n");
+                        exit (1);
+                }
+        }
+
+        return dict;
+}
+
+static ssize_t
+bm_encode (dict_t *dict)
+{
+        gfs3_getxattr_rsp  rsp = {0, };
+        struct iovec       iov = {bm_wire, BM_WIRE_SIZE};
+        ssize_t            ret = 0;
+
+        ret = dict_allocate_and_serialize (dict, &rsp.dict.dict_val,
+                                           &rsp.dict.dict_len);
+        if (ret < 0)
+                return ret;
+
+        ret = xdr_serialize_generic (iov, &rsp,
+                                     (xdrproc_t)xdr_gfs3_getxattr_rsp);
+        GF_FREE (rsp.dict.dict_val);
+
+        return ret;
+}
+
+static dict_t *
+bm_decode (ssize_t len, int owned)
+{
+        gfs3_getxattr_rsp  rsp  = {0, };
+        struct iovec       iov  = {bm_wire, len};
+        dict_t            *dict = NULL;
+        int                ret  = -1;
+
+        if (xdr_to_generic (iov, &rsp,
+                            (xdrproc_t)xdr_gfs3_getxattr_rsp) < 0)
+                goto out;
+
+        dict = dict_new ();
+        if (owned) {
+                ret = dict_unserialize_owned (rsp.dict.dict_val,
+                                              rsp.dict.dict_len, &dict);
+                rsp.dict.dict_val = NULL;
+        } else {
+                ret = dict_unserialize (rsp.dict.dict_val, rsp.dict.dict_len,
+                                        &dict);
+        }
+out:
+        free (rsp.dict.dict_val);
+        free (rsp.xdata.xdata_val);
+        if (ret && dict) {
+                dict_unref (dict);
+                dict = NULL;
+        }
+
+        return dict;
+}
+
+static int
+bm_check_pair (dict_t *d, char *k, data_t *v, void *tmp)
+{
+        data_t *other = NULL;
+
+        other = dict_get ((dict_t *)tmp, k);
+        if (!other || other->len != v->len ||
+            memcmp (other->data, v->data, v->len)) {
+                fprintf (stderr, "%s differs after a round trip\n", k);
+                exit (1);
+        }
+
+        return 0;
+}
+
+static void
+bm_run (struct bm_payload *payload, int owned)
+{
+        dict_t   *dict    = NULL;
+        dict_t   *decoded = NULL;
+        ssize_t   len     = 0;
+        uint64_t  start   = 0;
+        uint64_t  elapsed = 0;
+        uint64_t  best_enc = UINT64_MAX;
+        uint64_t  best_dec = UINT64_MAX;
+        int       i       = 0;
+        int       j       = 0;
+
+        dict = bm_build (payload);
+
+        len = bm_encode (dict);
+        decoded = bm_decode (len, owned);
+        if (len < 0 || !decoded ||
+            decoded->count != dict->count) {
+                fprintf (stderr, "%s does not survive a round trip\n",
+                         payload->name);
+                exit (1);
+        }
+        dict_foreach (dict, bm_check_pair, decoded);
+        dict_unref (decoded);
+
+        for (i = 0; i < BM_ROUNDS; i++) {
+                start = bm_now_ns ();
+                for (j = 0; j < BM_ITERATIONS; j++)
+                        len = bm_encode (dict);
+                elapsed = bm_now_ns () - start;
+                if (elapsed < best_enc)
+                        best_enc = elapsed;
+
+                start = bm_now_ns ();
+                for (j = 0; j < BM_ITERATIONS; j++)
+                        dict_unref (bm_decode (len, owned));
+                elapsed = bm_now_ns () - start;
+                if (elapsed < best_dec)
+                        best_dec = elapsed;
+        }
+
+        printf ("%-12s %-9s %8zd %10.1f %10.1f\n", payload->name,
+                owned ? "owned" : "copy", len,
+                (double)best_enc / BM_ITERATIONS,
+                (double)best_dec / BM_ITERATIONS);
+
+        dict_unref (dict);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        int              i   = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+        if (!ctx->dict_pool || !ctx->dict_pair_pool || !ctx->dict_data_pool) {
+                fprintf (stderr, "failed to create dict pools\n");
+                return 1;
+        }
+
+        printf ("%-12s %-9s %8s %10s %10s\n", "payload", "mode", "bytes",
+                "ns/encode", "ns/decode");
+        for (i = 0; i < sizeof (bm_payloads) / sizeof (bm_payloads[0]); i++) {
+                bm_run (&bm_payloads[i], 0);
+                bm_run (&bm_payloads[i], 1);
+        }
+
+        return 0;
+}
@@ -0,0 +1,202 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* dict-xdata-bm: cost of building, querying and tearing down the xdata
+ * dicts fops carry around.
+ *
+ * Each payload is built with dict_new()/dict_set_*(), every key is looked
+ * up once with dict_get(), then the dict is dropped. Reported are the
+ * best ns per dict out of a few rounds, the malloc()/calloc()/realloc()
+ * calls and the objects taken from the mem-pools per dict.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "dict.h"
+
+#define BM_ITERATIONS   (1 << 18)
+#define BM_ROUNDS       5       /* best of */
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static uint64_t bm_allocs;
+static uint64_t bm_pool_gets;
+static void *(*bm_mem_get) (struct mem_pool *mem_pool);
+
+void *
+malloc (size_t size)
+{
+        bm_allocs++;
+        return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+        bm_allocs++;
+        return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+        bm_allocs++;
+        return __libc_realloc (ptr, size);
+}
+
+void *
+mem_get (struct mem_pool *mem_pool)
+{
+        bm_pool_gets++;
+        return bm_mem_get (mem_pool);
+}
+
+struct bm_payload {
+        const char *name;
+        char       *keys[16];
+};
+
+static struct bm_payload bm_payloads[] = {
+        /* what a lookup asks posix for */
+        {"lookup", {"gfid-req", GLUSTERFS_INODELK_COUNT,
+                    GLUSTERFS_ENTRYLK_COUNT, GLUSTERFS_POSIXLK_COUNT,
+                    GLUSTERFS_PARENT_ENTRYLK, GF_REQUEST_LINK_COUNT_XDATA,
+                    NULL}},
+        /* afr pending changelog of a replica 3 xattrop */
+        {"afr-xattrop", {"trusted.afr.vol-client-0",
+                         "trusted.afr.vol-client-1",
+                         "trusted.afr.vol-client-2", GF_AFR_DIRTY, NULL}},
+        /* ec update of a 4+2 volume */
+        {"ec-xattrop", {"trusted.ec.version", "trusted.ec.size",
+                        "trusted.ec.dirty", NULL}},
+        {"internal-fop", {GLUSTERFS_INTERNAL_FOP_KEY, NULL}},
+        /* readdirp xattr requests go beyond the inline pairs */
+        {"readdirp-12", {"gfid-req", GFID_XATTR_KEY, QUOTA_SIZE_KEY,
+                         GF_SELINUX_XATTR_KEY, "trusted.glusterfs.dht",
+                         "trusted.glusterfs.dht.linkto",
+                         "trusted.afr.vol-client-0",
+                         "trusted.afr.vol-client-1",
+                         "trusted.afr.vol-client-2", GF_AFR_DIRTY,
+                         "user.swift.metadata", "security.capability",
+                         NULL}},
+};
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t
+bm_round (struct bm_payload *payload)
+{
+        dict_t   *dict  = NULL;
+        uint64_t  start = 0;
+        int       i     = 0;
+        int       j     = 0;
+
+        start = bm_now_ns ();
+        for (i = 0; i < BM_ITERATIONS; i++) {
+                dict = dict_new ();
+                for (j = 0; payload->keys[j]; j++) {
+                        if (dict_set_int32 (dict, payload->keys[j], j)) {
+                                fprintf (stderr, "dict_set failed\n");
+                                exit (1);
+                        }
+                }
+                for (j = 0; payload->keys[j]; j++) {
+                        if (!dict_get (dict, payload->keys[j])) {
+                                fprintf (stderr, "%s not found\n",
+                                         payload->keys[j]);
+                                exit (1);
+                        }
+                }
+                dict_unref (dict);
+        }
+
+        return bm_now_ns () - start;
+}
+
+static void
+bm_run (struct bm_payload *payload)
+{
+        uint64_t elapsed = 0;
+        uint64_t best    = UINT64_MAX;
+        uint64_t allocs  = 0;
+        uint64_t gets    = 0;
+        int      keys    = 0;
+        int      i       = 0;
+
+        for (keys = 0; payload->keys[keys]; keys++)
+                ;
+
+        allocs = bm_allocs;
+        gets = bm_pool_gets;
+        for (i = 0; i < BM_ROUNDS; i++) {
+                elapsed = bm_round (payload);
+                if (elapsed < best)
+                        best = elapsed;
+        }
+        allocs = bm_allocs - allocs;
+        gets = bm_pool_gets - gets;
+
+        printf ("%-14s %4d %10.1f %8.2f %8.2f\n", payload->name, keys,
+                (double)best / BM_ITERATIONS,
+                (double)allocs / (BM_ROUNDS * BM_ITERATIONS),
+                (double)gets / (BM_ROUNDS * BM_ITERATIONS));
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        int              i   = 0;
+
+        bm_mem_get = dlsym (RTLD_NEXT, "mem_get");
+        if (!bm_mem_get) {
+                fprintf (stderr, "mem_get not found\n");
+                return 1;
+        }
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+        if (!ctx->dict_pool || !ctx->dict_pair_pool || !ctx->dict_data_pool) {
+                fprintf (stderr, "failed to create dict pools\n");
+                return 1;
+        }
+
+        printf ("%-14s %4s %10s %8s %8s\n", "payload", "keys", "ns/dict",
+                "mallocs", "pool");
+        for (i = 0; i < sizeof (bm_payloads) / sizeof (bm_payloads[0]); i++)
+                bm_run (&bm_payloads[i]);
+
+        return 0;
+}
@@ -0,0 +1,232 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* ec-code-bm: encode and decode throughput of the disperse galois field
+ * code for 4+2, 8+3 and 16+4 volumes, with the precompiled C code and with
+ * every dynamic code generator this cpu supports. Decoding always uses the
+ * last fragments, so that as many redundancy fragments as possible take
+ * part in it.
+ *
+ * The result of each generator is checked against the C code, and every
+ * decode against the original data.
+ *
+ * This is built from a configured source tree together with the sources
+ * of the ec xlator, see the README.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+
+#include "ec-method.h"
+#include "ec-code.h"
+
+#define BM_SIZE         (4 * 1024 * 1024)
+#define BM_SECONDS      1
+
+static const char *bm_gens[] = {
+        "none", "x64", "sse", "avx", "avx512", "neon", NULL
+};
+
+static struct {
+        uint32_t fragments;
+        uint32_t redundancy;
+} bm_configs[] = {
+        { 4, 2 },
+        { 8, 3 },
+        { 16, 4 },
+        { 0, 0 }
+};
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *
+bm_alloc (size_t size)
+{
+        void *ptr = NULL;
+
+        if (posix_memalign (&ptr, 64, size) != 0) {
+                fprintf (stderr, "out of memory\n");
+                exit (1);
+        }
+
+        return ptr;
+}
+
+static double
+bm_encode (ec_matrix_list_t *list, uint32_t nodes, size_t size, uint8_t *in,
+           uint8_t **out)
+{
+        void     *ptrs[nodes];
+        uint64_t  start = 0;
+        uint64_t  elapsed = 0;
+        uint64_t  bytes = 0;
+        uint32_t  i = 0;
+
+        start = bm_now_ns ();
+        do {
+                for (i = 0; i < nodes; i++)
+                        ptrs[i] = out[i];
+                ec_method_encode (list, size, in, ptrs);
+                bytes += size;
+                elapsed = bm_now_ns () - start;
+        } while (elapsed < BM_SECONDS * 1000000000ULL);
+
+        return bytes * 1e9 / elapsed / (1024 * 1024);
+}
+
+static double
+bm_decode (ec_matrix_list_t *list, uint32_t fragments, uint32_t nodes,
+           size_t size, uint8_t **frags, uint8_t *out)
+{
+        void      *ptrs[fragments];
+        uint32_t   rows[fragments];
+        uintptr_t  mask = 0;
+        uint64_t   start = 0;
+        uint64_t   elapsed = 0;
+        uint64_t   bytes = 0;
+        uint32_t   i = 0;
+
+        for (i = 0; i < fragments; i++) {
+                rows[i] = nodes - fragments + i + 1;
+                ptrs[i] = frags[rows[i] - 1];
+                mask |= 1ULL << (rows[i] - 1);
+        }
+
+        start = bm_now_ns ();
+        do {
+                if (ec_method_decode (list, size / fragments, mask, rows,
+                                      ptrs, out) != 0) {
+                        fprintf (stderr, "decode failed\n");
+                        exit (1);
+                }
+                bytes += size;
+                elapsed = bm_now_ns () - start;
+        } while (elapsed < BM_SECONDS * 1000000000ULL);
+
+        return bytes * 1e9 / elapsed / (1024 * 1024);
+}
+
+static void
+bm_run (xlator_t *xl, uint32_t fragments, uint32_t redundancy)
+{
+        ec_matrix_list_t  list;
+        ec_code_gen_t    *gen = NULL;
+        uint32_t          nodes = fragments + redundancy;
+        size_t            size = 0;
+        uint8_t          *in = NULL;
+        uint8_t          *out = NULL;
+        uint8_t          *ref[nodes];
+        uint8_t          *frags[nodes];
+        double            enc = 0;
+        double            dec = 0;
+        uint32_t          i = 0;
+        int               g = 0;
+
+        size = BM_SIZE - BM_SIZE % (EC_METHOD_CHUNK_SIZE * fragments);
+        in = bm_alloc (size);
+        out = bm_alloc (size);
+        for (i = 0; i < size; i++)
+                in[i] = random ();
+        for (i = 0; i < nodes; i++) {
+                ref[i] = bm_alloc (size / fragments);
+                frags[i] = bm_alloc (size / fragments);
+        }
+
+        for (g = 0; bm_gens[g] != NULL; g++) {
+                /* "none" is the precompiled C code, the rest are skipped
+                 * when they are not built in or not supported, in which
+                 * case ec_code_detect() picks another one. */
+                if (g != 0) {
+                        gen = ec_code_detect (xl, bm_gens[g]);
+                        if ((gen == NULL) || strcmp (gen->name, bm_gens[g]))
+                                continue;
+                }
+
+                memset (&list, 0, sizeof (list));
+                if (ec_method_init (xl, &list, fragments, nodes, nodes * 2,
+                                    bm_gens[g]) != 0) {
+                        fprintf (stderr, "ec_method_init failed\n");
+                        exit (1);
+                }
+
+                enc = bm_encode (&list, nodes, size, in,
+                                 (g == 0) ? ref : frags);
+                if (g != 0) {
+                        for (i = 0; i < nodes; i++) {
+                                if (memcmp (ref[i], frags[i],
+                                            size / fragments) != 0) {
+                                        fprintf (stderr, "%s: fragment %u "
+                                                 "differs from the C code\n",
+                                                 bm_gens[g], i);
+                                        exit (1);
+                                }
+                        }
+                }
+
+                memset (out, 0, size);
+                dec = bm_decode (&list, fragments, nodes, size, ref, out);
+                if (memcmp (in, out, size) != 0) {
+                        fprintf (stderr, "%s: decoded data differs\n",
+                                 bm_gens[g]);
+                        exit (1);
+                }
+
+                printf ("%2u+%-2u %-8s %12.0f %12.0f\n", fragments,
+                        redundancy, (g == 0) ? "c" : bm_gens[g], enc, dec);
+
+                ec_method_fini (&list);
+        }
+
+        for (i = 0; i < nodes; i++) {
+                free (ref[i]);
+                free (frags[i]);
+        }
+        free (in);
+        free (out);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        xlator_t        *xl = NULL;
+        int              i = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        xl = THIS;
+        xl->ctx = ctx;
+
+        printf ("%-5s %-8s %12s %12s\n", "conf", "code", "encode MB/s",
+                "decode MB/s");
+        for (i = 0; bm_configs[i].fragments != 0; i++)
+                bm_run (xl, bm_configs[i].fragments, bm_configs[i].redundancy);
+
+        return 0;
+}
@@ -0,0 +1,156 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* inode-lookup-bm: inode table lookup throughput with 1 to 16 threads.
+ *
+ * 64k inodes are linked into one directory. Every thread then resolves
+ * random entries the way a brick does for each fop: inode_grep() by name
+ * or inode_find() by gfid, inode_ref() and inode_unref() around the
+ * "fop", and a final inode_unref(). This runs once with all inodes held
+ * active (open fds, in-flight fops) and once with them idle on the lru
+ * list.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "inode.h"
+
+#define BM_INODES       65536
+#define BM_LOOKUPS      (1 << 20)       /* per thread */
+#define BM_MAX_THREADS  16
+
+static xlator_t          bm_xl;
+static glusterfs_graph_t bm_graph;
+static inode_table_t    *bm_table;
+static char              bm_names[BM_INODES][32];
+static uuid_t            bm_gfids[BM_INODES];
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *
+bm_lookup (void *arg)
+{
+        unsigned int  seed  = (unsigned long)arg;
+        inode_t      *inode = NULL;
+        int           idx   = 0;
+        int           i     = 0;
+
+        THIS = &bm_xl;
+
+        for (i = 0; i < BM_LOOKUPS; i++) {
+                idx = rand_r (&seed) % BM_INODES;
+                if (i & 1)
+                        inode = inode_find (bm_table, bm_gfids[idx]);
+                else
+                        inode = inode_grep (bm_table, bm_table->root,
+                                            bm_names[idx]);
+                if (!inode) {
+                        fprintf (stderr, "%s not found\n", bm_names[idx]);
+                        exit (1);
+                }
+
+                inode_ref (inode);
+                inode_unref (inode);
+                inode_unref (inode);
+        }
+
+        return NULL;
+}
+
+static void
+bm_run (const char *mode, int nthreads)
+{
+        pthread_t threads[BM_MAX_THREADS];
+        uint64_t  start = 0;
+        uint64_t  elapsed = 0;
+        long      i = 0;
+
+        start = bm_now_ns ();
+        for (i = 0; i < nthreads; i++)
+                pthread_create (&threads[i], NULL, bm_lookup, (void *)i);
+        for (i = 0; i < nthreads; i++)
+                pthread_join (threads[i], NULL);
+        elapsed = bm_now_ns () - start;
+
+        printf ("%-8s %-8d %12.0f\n", mode, nthreads,
+                (double)nthreads * BM_LOOKUPS * 1e9 / elapsed);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        inode_t         *held[BM_INODES];
+        inode_t         *inode = NULL;
+        struct iatt      iatt = {0, };
+        int              threads[] = {1, 2, 4, 8, 16};
+        int              i = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        bm_graph.xl_count = 1;
+        bm_xl.name = "inode-lookup-bm";
+        bm_xl.ctx = ctx;
+        bm_xl.graph = &bm_graph;
+        THIS = &bm_xl;
+
+        bm_table = inode_table_new (BM_INODES * 2, &bm_xl);
+        if (!bm_table) {
+                fprintf (stderr, "failed to create inode table\n");
+                return 1;
+        }
+
+        iatt.ia_type = IA_IFREG;
+        for (i = 0; i < BM_INODES; i++) {
+                snprintf (bm_names[i], sizeof (bm_names[i]), "file-%d", i);
+                gf_uuid_generate (bm_gfids[i]);
+                gf_uuid_copy (iatt.ia_gfid, bm_gfids[i]);
+
+                inode = inode_new (bm_table);
+                held[i] = inode_link (inode, bm_table->root, bm_names[i],
+                                      &iatt);
+                inode_lookup (held[i]);
+                inode_unref (inode);
+        }
+
+        printf ("%-8s %-8s %12s\n", "inodes", "threads", "lookups/s");
+        for (i = 0; i < sizeof (threads) / sizeof (threads[0]); i++)
+                bm_run ("active", threads[i]);
+
+        for (i = 0; i < BM_INODES; i++)
+                inode_unref (held[i]);
+
+        for (i = 0; i < sizeof (threads) / sizeof (threads[0]); i++)
+                bm_run ("lru", threads[i]);
+
+        inode_table_destroy (bm_table);
+        return 0;
+}
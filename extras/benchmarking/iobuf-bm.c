@@ -0,0 +1,111 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* iobuf-bm: iobuf_get2()/iobuf_unref() throughput from 1 to 16 threads.
+ *
+ * Each thread keeps a few iobufs in flight the way a brick does while
+ * reading and writing, mixing 128KB payloads with small 512 byte and 8KB
+ * requests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "iobuf.h"
+
+#define BM_ITERATIONS   (1 << 20)       /* per thread */
+#define BM_INFLIGHT     4
+#define BM_MAX_THREADS  16
+
+static struct iobuf_pool *bm_pool;
+static size_t             bm_sizes[] = {128 * 1024, 512, 128 * 1024, 8192};
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *
+bm_worker (void *arg)
+{
+        struct iobuf *inflight[BM_INFLIGHT] = {NULL, };
+        int           slot = 0;
+        int           i = 0;
+
+        for (i = 0; i < BM_ITERATIONS; i++) {
+                slot = i % BM_INFLIGHT;
+                if (inflight[slot])
+                        iobuf_unref (inflight[slot]);
+
+                inflight[slot] = iobuf_get2 (bm_pool, bm_sizes[i % 4]);
+                if (!inflight[slot]) {
+                        fprintf (stderr, "iobuf_get2 failed\n");
+                        exit (1);
+                }
+        }
+
+        for (slot = 0; slot < BM_INFLIGHT; slot++)
+                iobuf_unref (inflight[slot]);
+
+        return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        pthread_t        threads[BM_MAX_THREADS];
+        int              counts[] = {1, 2, 4, 8, 16};
+        uint64_t         start = 0;
+        uint64_t         elapsed = 0;
+        long             i = 0;
+        long             j = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        bm_pool = iobuf_pool_new ();
+        if (!bm_pool) {
+                fprintf (stderr, "failed to create iobuf pool\n");
+                return 1;
+        }
+
+        printf ("%-8s %14s\n", "threads", "ns/get+put");
+        for (i = 0; i < sizeof (counts) / sizeof (counts[0]); i++) {
+                start = bm_now_ns ();
+                for (j = 0; j < counts[i]; j++)
+                        pthread_create (&threads[j], NULL, bm_worker, NULL);
+                for (j = 0; j < counts[i]; j++)
+                        pthread_join (threads[j], NULL);
+                elapsed = bm_now_ns () - start;
+
+                printf ("%-8d %14.1f\n", counts[i],
+                        (double)elapsed / ((uint64_t)counts[i] *
+                                           BM_ITERATIONS));
+        }
+
+        iobuf_pool_destroy (bm_pool);
+        return 0;
+}
@@ -0,0 +1,193 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* ioc-scan-bm: hit ratio of the io-cache page cache on a working set that
+ * fits in the cache (a VM image read at random), alone and while a large
+ * file is read sequentially next to it (a backup), and page lookups per
+ * second.
+ *
+ * Pages are looked up and created the way ioc_dispatch_requests() does,
+ * and filled right away instead of being read from a child xlator.
+ *
+ * This is built from a configured source tree together with the sources
+ * of the io-cache xlator, see the README.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "iobuf.h"
+
+#include "io-cache.h"
+#include "ioc-mem-types.h"
+
+#define BM_CACHE_SIZE   (32 * 1024 * 1024)
+#define BM_PAGE_SIZE    (128 * 1024)
+#define BM_HOT_PAGES    192             /* 24MB of the 32MB cache */
+#define BM_SCAN_PAGES   (64 * 1024)     /* 8GB */
+#define BM_ROUNDS       200000
+
+static struct iobuf_pool *bm_iobuf_pool;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static ioc_inode_t *
+bm_inode (ioc_table_t *table)
+{
+        inode_t *inode = NULL;
+
+        inode = GF_CALLOC (1, sizeof (*inode), gf_common_mt_inode_t);
+        gf_uuid_generate (inode->gfid);
+
+        return ioc_inode_create (table, inode, 1);
+}
+
+/* returns 1 on a hit */
+static int
+bm_read (ioc_inode_t *ioc_inode, off_t offset)
+{
+        ioc_table_t  *table = ioc_inode->table;
+        ioc_page_t   *page  = NULL;
+        struct iobuf *iobuf = NULL;
+        size_t        added = 0;
+
+        ioc_inode_lock (ioc_inode);
+        {
+                page = __ioc_page_get (ioc_inode, offset);
+                if (page == NULL) {
+                        page = __ioc_page_create (ioc_inode, offset);
+
+                        iobuf = iobuf_get2 (bm_iobuf_pool, table->page_size);
+                        page->iobref = iobref_new ();
+                        iobref_add (page->iobref, iobuf);
+                        iobuf_unref (iobuf);
+
+                        page->vector = GF_CALLOC (1, sizeof (struct iovec),
+                                                  gf_ioc_mt_iovec);
+                        page->vector->iov_base = iobuf->ptr;
+                        page->vector->iov_len = table->page_size;
+                        page->count = 1;
+                        page->size = table->page_size;
+                        page->ready = 1;
+
+                        added = iobref_size (page->iobref);
+                }
+        }
+        ioc_inode_unlock (ioc_inode);
+
+        if (added == 0)
+                return 1;
+
+        GF_ATOMIC_ADD (table->cache_used, added);
+        if (ioc_need_prune (table))
+                ioc_prune (table);
+
+        return 0;
+}
+
+static void
+bm_run (ioc_table_t *table, const char *name, int scan_per_hot)
+{
+        ioc_inode_t *hot       = NULL;
+        ioc_inode_t *scan      = NULL;
+        uint64_t     hot_hits  = 0;
+        uint64_t     scan_hits = 0;
+        uint64_t     lookups   = 0;
+        uint64_t     start     = 0;
+        uint64_t     elapsed   = 0;
+        off_t        scan_off  = 0;
+        int64_t      ghosts    = 0;
+        int          i         = 0;
+        int          j         = 0;
+
+        hot = bm_inode (table);
+        scan = bm_inode (table);
+
+        /* the working set is in use before the scan starts */
+        for (i = 0; i < 2 * BM_HOT_PAGES; i++)
+                bm_read (hot, (off_t)(i % BM_HOT_PAGES) * BM_PAGE_SIZE);
+
+        ghosts = GF_ATOMIC_GET (table->ghost_hits);
+        start = bm_now_ns ();
+        for (i = 0; i < BM_ROUNDS; i++) {
+                hot_hits += bm_read (hot, (off_t)(random () % BM_HOT_PAGES)
+                                          * BM_PAGE_SIZE);
+                lookups++;
+                for (j = 0; j < scan_per_hot; j++) {
+                        scan_hits += bm_read (scan, scan_off);
+                        scan_off = (scan_off + BM_PAGE_SIZE)
+                                   % ((off_t)BM_SCAN_PAGES * BM_PAGE_SIZE);
+                        lookups++;
+                }
+        }
+        elapsed = bm_now_ns () - start;
+
+        printf ("%-12s %10.1f%% %10.1f%% %14.0f %10"PRId64"\n", name,
+                100.0 * hot_hits / BM_ROUNDS,
+                scan_per_hot ? 100.0 * scan_hits / BM_ROUNDS / scan_per_hot
+                             : 0.0,
+                lookups * 1e9 / elapsed,
+                GF_ATOMIC_GET (table->ghost_hits) - ghosts);
+
+        ioc_inode_flush (hot);
+        ioc_inode_flush (scan);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx   = NULL;
+        ioc_table_t     *table = NULL;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        bm_iobuf_pool = iobuf_pool_new ();
+
+        table = GF_CALLOC (1, sizeof (*table), gf_ioc_mt_ioc_table_t);
+        table->xl = THIS;
+        table->page_size = BM_PAGE_SIZE;
+        table->cache_size = BM_CACHE_SIZE;
+        INIT_LIST_HEAD (&table->inodes);
+        INIT_LIST_HEAD (&table->priority_list);
+        pthread_mutex_init (&table->table_lock, NULL);
+        ioc_log2_page_size = log_base2 (BM_PAGE_SIZE);
+
+        if (ioc_shards_init (table) != 0) {
+                fprintf (stderr, "ioc_shards_init failed\n");
+                return 1;
+        }
+
+        printf ("%-12s %11s %11s %14s %10s\n", "workload", "hot hits",
+                "scan hits", "lookups/s", "ghost hits");
+        bm_run (table, "hot", 0);
+        bm_run (table, "hot+scan", 4);
+        bm_run (table, "hot+scan16", 16);
+
+        return 0;
+}
@@ -0,0 +1,252 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* iot-bm: small file ops/s through performance/io-threads with 1 to 64
+ * worker threads.
+ *
+ * io-threads is loaded on top of a stand-in for posix that lstat()s one of
+ * a few thousand files in a scratch directory for every stat it gets.
+ * BM_INFLIGHT stats are kept in flight, each completion winds the next
+ * one, so the numbers show what queueing through io-threads costs next to
+ * a cheap brick side operation. The last run lets adaptive-threads pick
+ * the thread count between 1 and 64 and shows where it settled.
+ *
+ * io-threads.so is loaded from XLATORDIR, so it is the installed one that
+ * gets measured.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "defaults.h"
+#include "call-stub.h"
+
+#define BM_FILES        4096
+#define BM_INFLIGHT     256
+#define BM_OPS          (1 << 20)
+
+static char          bm_dir[] = "/tmp/iot-bm.XXXXXX";
+static xlator_t      bm_posix;
+static xlator_list_t bm_child = {&bm_posix, NULL};
+static gf_atomic_t   bm_done;
+static gf_atomic_t   bm_issued;
+
+static int bm_wind (xlator_t *iot, int idx);
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+bm_stat (call_frame_t *frame, xlator_t *this, loc_t *loc, dict_t *xdata)
+{
+        struct stat  st = {0, };
+        struct iatt  iatt = {0, };
+        int          ret = 0;
+
+        ret = lstat (loc->path, &st);
+        if (ret == 0)
+                iatt_from_stat (&iatt, &st);
+
+        STACK_UNWIND_STRICT (stat, frame, ret, ret ? errno : 0, &iatt, NULL);
+        return 0;
+}
+
+static struct xlator_fops bm_posix_fops = {
+        .stat = bm_stat,
+};
+
+static struct xlator_cbks bm_posix_cbks;
+
+static int
+bm_stat_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+             int32_t op_ret, int32_t op_errno, struct iatt *buf,
+             dict_t *xdata)
+{
+        xlator_t *iot = cookie;
+
+        STACK_DESTROY (frame->root);
+
+        if (op_ret) {
+                fprintf (stderr, "stat failed: %s\n", strerror (op_errno));
+                exit (1);
+        }
+
+        GF_ATOMIC_INC (bm_done);
+        if (GF_ATOMIC_INC (bm_issued) <= BM_OPS)
+                bm_wind (iot, GF_ATOMIC_GET (bm_done) % BM_FILES);
+
+        return 0;
+}
+
+static int
+bm_wind (xlator_t *iot, int idx)
+{
+        static char   paths[BM_FILES][64];
+        call_frame_t *frame = NULL;
+        loc_t         loc = {0, };
+
+        if (!paths[idx][0])
+                snprintf (paths[idx], sizeof (paths[idx]), "%s/file-%d",
+                          bm_dir, idx);
+
+        frame = create_frame (iot, iot->ctx->pool);
+        if (!frame) {
+                fprintf (stderr, "create_frame failed\n");
+                exit (1);
+        }
+
+        loc.path = paths[idx];
+        STACK_WIND_COOKIE (frame, bm_stat_cbk, iot, iot, iot->fops->stat,
+                           &loc, NULL);
+        return 0;
+}
+
+static void
+bm_run (glusterfs_ctx_t *ctx, int threads, int adaptive)
+{
+        xlator_t   *iot = NULL;
+        dict_t     *state = NULL;
+        int32_t     settled = 0;
+        char        count[16];
+        uint64_t    start   = 0;
+        uint64_t    elapsed = 0;
+        int         i       = 0;
+
+        iot = GF_CALLOC (1, sizeof (*iot), gf_common_mt_xlator_t);
+        iot->name = "iot-bm";
+        iot->ctx = ctx;
+        iot->options = dict_new ();
+        iot->children = &bm_child;
+        if (xlator_set_type (iot, "performance/io-threads")) {
+                fprintf (stderr, "cannot load io-threads\n");
+                exit (1);
+        }
+
+        snprintf (count, sizeof (count), "%d", threads);
+        if (dict_set_str (iot->options, "thread-count", count) ||
+            dict_set_str (iot->options, "high-prio-threads", count) ||
+            dict_set_str (iot->options, "adaptive-threads",
+                          adaptive ? "on" : "off")) {
+                fprintf (stderr, "dict_set failed\n");
+                exit (1);
+        }
+
+        THIS = iot;
+        if (xlator_init (iot)) {
+                fprintf (stderr, "cannot init io-threads\n");
+                exit (1);
+        }
+
+        GF_ATOMIC_INIT (bm_done, 0);
+        GF_ATOMIC_INIT (bm_issued, BM_INFLIGHT);
+
+        start = bm_now_ns ();
+
+        for (i = 0; i < BM_INFLIGHT; i++)
+                bm_wind (iot, i % BM_FILES);
+
+        while (GF_ATOMIC_GET (bm_done) < BM_OPS)
+                usleep (1000);
+
+        elapsed = bm_now_ns () - start;
+
+        if (adaptive) {
+                state = dict_new ();
+                if (iot->dumpops->priv_to_dict (iot, state) ||
+                    dict_get_int32 (state, "current_threads_count",
+                                    &settled)) {
+                        fprintf (stderr, "no adaptive-threads state\n");
+                        exit (1);
+                }
+                dict_unref (state);
+                printf ("%-8s %12.0f (settled on %d threads)\n", "adaptive",
+                        (double)BM_OPS * 1e9 / elapsed, settled);
+        } else {
+                printf ("%-8d %12.0f\n", threads,
+                        (double)BM_OPS * 1e9 / elapsed);
+        }
+
+        iot->fini (iot);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        char             path[64];
+        int              counts[] = {1, 2, 4, 8, 16, 32, 64};
+        int              fd = -1;
+        int              i = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+        ctx->stub_mem_pool = mem_pool_new (call_stub_t, 1024);
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+
+        bm_posix.name = "posix-bm";
+        bm_posix.ctx = ctx;
+        bm_posix.fops = &bm_posix_fops;
+        bm_posix.cbks = &bm_posix_cbks;
+
+        if (!mkdtemp (bm_dir)) {
+                perror ("mkdtemp");
+                return 1;
+        }
+        for (i = 0; i < BM_FILES; i++) {
+                snprintf (path, sizeof (path), "%s/file-%d", bm_dir, i);
+                fd = open (path, O_CREAT | O_WRONLY, 0644);
+                if (fd < 0) {
+                        perror ("open");
+                        return 1;
+                }
+                close (fd);
+        }
+
+        printf ("%-8s %12s\n", "threads", "stats/s");
+        for (i = 0; i < sizeof (counts) / sizeof (counts[0]); i++)
+                bm_run (ctx, counts[i], 0);
+        bm_run (ctx, 64, 1);
+
+        for (i = 0; i < BM_FILES; i++) {
+                snprintf (path, sizeof (path), "%s/file-%d", bm_dir, i);
+                unlink (path);
+        }
+        rmdir (bm_dir);
+
+        return 0;
+}
@@ -0,0 +1,195 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* mdc-xattr-bm: memory md-cache takes to cache the selinux label and posix
+ * ACLs of many inodes, when few distinct labels and ACLs are in use as is
+ * usual, and cached xattr lookups per second with all of them cached.
+ *
+ * The xattrs are set the way a lookup or readdirp reply sets them. The
+ * optional argument is the md-cache-size option.
+ *
+ * This is built from a configured source tree together with the sources
+ * of the md-cache xlator, see the README.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "inode.h"
+#include "glusterfs-acl.h"
+
+#define BM_INODES       200000
+#define BM_LABELS       16
+#define BM_ACLS         8
+
+extern struct volume_options options[];
+extern int init (xlator_t *this);
+extern int mdc_inode_xatt_set (xlator_t *this, inode_t *inode, dict_t *dict);
+extern int mdc_inode_xatt_get (xlator_t *this, inode_t *inode, dict_t **dict);
+
+static xlator_t          bm_child;
+static xlator_list_t     bm_children = {&bm_child, NULL};
+static glusterfs_graph_t bm_graph = {.xl_count = 1};
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long
+bm_rss (void)
+{
+        FILE *fp    = NULL;
+        long  pages = 0;
+        long  rss   = 0;
+
+        fp = fopen ("/proc/self/statm", "r");
+        if (!fp)
+                return 0;
+        if (fscanf (fp, "%ld %ld", &pages, &rss) != 2)
+                rss = 0;
+        fclose (fp);
+
+        return rss * sysconf (_SC_PAGESIZE);
+}
+
+/* what a lookup reply carries for inode n */
+static dict_t *
+bm_reply (int n)
+{
+        dict_t *dict  = NULL;
+        char    label[64];
+        char    acl[44];
+
+        dict = dict_new ();
+
+        snprintf (label, sizeof (label),
+                  "system_u:object_r:container_file_t:s0:c%d,c%d",
+                  n % BM_LABELS, 100 + n % BM_LABELS);
+        if (dict_set_dynstr_with_alloc (dict, "security.selinux", label))
+                return NULL;
+
+        memset (acl, 0, sizeof (acl));
+        acl[0] = 2;
+        acl[8] = n % BM_ACLS;
+        if (dict_set_bin (dict, POSIX_ACL_ACCESS_XATTR,
+                          gf_memdup (acl, sizeof (acl)), sizeof (acl)))
+                return NULL;
+
+        return dict;
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t    *ctx     = NULL;
+        xlator_t           *mdc     = NULL;
+        volume_opt_list_t  *vol_opt = NULL;
+        inode_table_t      *itable  = NULL;
+        inode_t           **inodes  = NULL;
+        dict_t             *dict    = NULL;
+        long                rss     = 0;
+        long                used    = 0;
+        uint64_t            start   = 0;
+        uint64_t            elapsed = 0;
+        int                 hits    = 0;
+        int                 i       = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->dict_pool = mem_pool_new (dict_t, 1024);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 4096);
+        ctx->dict_data_pool = mem_pool_new (data_t, 4096);
+
+        bm_child.name = "brick-bm";
+        bm_child.ctx = ctx;
+
+        mdc = GF_CALLOC (1, sizeof (*mdc), gf_common_mt_xlator_t);
+        mdc->name = "mdc-bm";
+        mdc->type = "performance/md-cache";
+        mdc->ctx = ctx;
+        mdc->graph = &bm_graph;
+        mdc->children = &bm_children;
+        mdc->options = dict_new ();
+        INIT_LIST_HEAD (&mdc->volume_options);
+        vol_opt = GF_CALLOC (1, sizeof (*vol_opt), gf_common_mt_char);
+        vol_opt->given_opt = options;
+        list_add_tail (&vol_opt->list, &mdc->volume_options);
+
+        if (dict_set_str (mdc->options, "md-cache-timeout", "60") ||
+            dict_set_str (mdc->options, "cache-selinux", "on") ||
+            dict_set_str (mdc->options, "cache-posix-acl", "on") ||
+            (argc > 1 &&
+             dict_set_str (mdc->options, "md-cache-size", argv[1]))) {
+                fprintf (stderr, "dict_set failed\n");
+                return 1;
+        }
+
+        THIS = mdc;
+        if (init (mdc)) {
+                fprintf (stderr, "cannot init md-cache\n");
+                return 1;
+        }
+
+        itable = inode_table_new (BM_INODES, mdc);
+        inodes = calloc (BM_INODES, sizeof (*inodes));
+        for (i = 0; i < BM_INODES; i++) {
+                inodes[i] = inode_new (itable);
+                gf_uuid_generate (inodes[i]->gfid);
+        }
+
+        /* the replies are freed once cached, as they would be */
+        rss = bm_rss ();
+        for (i = 0; i < BM_INODES; i++) {
+                dict = bm_reply (i);
+                if (!dict) {
+                        fprintf (stderr, "cannot build reply\n");
+                        return 1;
+                }
+                mdc_inode_xatt_set (mdc, inodes[i], dict);
+                dict_unref (dict);
+        }
+        used = bm_rss () - rss;
+
+        start = bm_now_ns ();
+        for (i = 0; i < BM_INODES; i++) {
+                dict = NULL;
+                if ((mdc_inode_xatt_get (mdc, inodes[i], &dict) == 0) &&
+                    dict && dict_get (dict, "security.selinux"))
+                        hits++;
+                if (dict)
+                        dict_unref (dict);
+        }
+        elapsed = bm_now_ns () - start;
+
+        printf ("%-10s %12s %12s %10s %12s\n", "inodes", "memory MB",
+                "bytes/inode", "cached", "gets/s");
+        printf ("%-10d %12.1f %12.0f %9.1f%% %12.0f\n", BM_INODES,
+                used / 1048576.0, (double)used / BM_INODES,
+                100.0 * hits / BM_INODES, BM_INODES * 1e9 / elapsed);
+
+        return 0;
+}
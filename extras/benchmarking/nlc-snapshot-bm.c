@@ -0,0 +1,267 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* nlc-snapshot-bm: negative lookups nl-cache answers right after a remount,
+ * with and without a snapshot of the cache saved on unmount, while some of
+ * the directories were changed in between. Also the time taken to save and
+ * load the snapshot, and its size.
+ *
+ * A client looks up names missing in many directories, the way a build or
+ * a search path does, then unmounts and mounts again and looks them all up
+ * once more. The optional argument is the directory for the snapshot.
+ *
+ * This is built from a configured source tree together with the sources
+ * of the nl-cache xlator, see the README.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "inode.h"
+
+#include "nl-cache.h"
+
+#define BM_DIRS         5000
+#define BM_NAMES        20              /* missing names per directory */
+#define BM_CHANGED      10              /* % of dirs changed while unmounted */
+
+extern struct volume_options options[];
+extern int init (xlator_t *this);
+
+static xlator_t          bm_child;
+static xlator_list_t     bm_children = {&bm_child, NULL};
+static uint64_t          bm_gfid_seq;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* gfids are random, but generating real ones costs more than the cache */
+static void
+bm_gfid (uuid_t gfid)
+{
+        uint64_t h = ++bm_gfid_seq * 0x9e3779b97f4a7c15ULL;
+
+        memcpy (&gfid[0], &h, sizeof (h));
+        h = (h ^ (h >> 31)) * 0xbf58476d1ce4e5b9ULL;
+        memcpy (&gfid[8], &h, sizeof (h));
+}
+
+static xlator_t *
+bm_mount (glusterfs_ctx_t *ctx, const char *dir)
+{
+        xlator_t           *nlc     = NULL;
+        glusterfs_graph_t  *graph   = NULL;
+        volume_opt_list_t  *vol_opt = NULL;
+
+        nlc = GF_CALLOC (1, sizeof (*nlc), gf_common_mt_xlator_t);
+        graph = GF_CALLOC (1, sizeof (*graph), gf_common_mt_glusterfs_graph_t);
+        nlc->name = "nlc-bm";
+        nlc->type = "performance/nl-cache";
+        nlc->ctx = ctx;
+        nlc->graph = graph;
+        graph->top = nlc;
+        nlc->children = &bm_children;
+        nlc->options = dict_new ();
+        INIT_LIST_HEAD (&nlc->volume_options);
+        vol_opt = GF_CALLOC (1, sizeof (*vol_opt), gf_common_mt_char);
+        vol_opt->given_opt = options;
+        list_add_tail (&vol_opt->list, &nlc->volume_options);
+
+        if ((dir && dict_set_str (nlc->options, "nl-cache-snapshot-dir",
+                                  (char *)dir)) ||
+            dict_set_str (nlc->options, "nl-cache-timeout", "600") ||
+            dict_set_str (nlc->options, "nl-cache-limit", "256MB")) {
+                fprintf (stderr, "dict_set failed\n");
+                exit (1);
+        }
+
+        nlc->itable = inode_table_new (0, nlc);
+
+        THIS = nlc;
+        if (init (nlc)) {
+                fprintf (stderr, "cannot init nl-cache\n");
+                exit (1);
+        }
+
+        return nlc;
+}
+
+/* what a lookup of directory d replies, times as of generation gen */
+static void
+bm_dir_iatt (struct iatt *buf, uuid_t *gfids, int d, int gen)
+{
+        memset (buf, 0, sizeof (*buf));
+        gf_uuid_copy (buf->ia_gfid, gfids[d]);
+        buf->ia_type = IA_IFDIR;
+        buf->ia_ctime = buf->ia_mtime = 1500000000 + gen;
+        buf->ia_ctime_nsec = buf->ia_mtime_nsec = d;
+}
+
+static inode_t **
+bm_dirs (xlator_t *nlc, uuid_t *gfids)
+{
+        inode_t    **dirs = NULL;
+        inode_t     *root = NULL;
+        struct iatt  buf  = {0, };
+        char         name[32];
+        int          d    = 0;
+
+        dirs = calloc (BM_DIRS, sizeof (*dirs));
+        root = nlc->itable->root;
+        for (d = 0; d < BM_DIRS; d++) {
+                bm_dir_iatt (&buf, gfids, d, 0);
+                snprintf (name, sizeof (name), "dir%d", d);
+                dirs[d] = inode_new (nlc->itable);
+                dirs[d] = inode_link (dirs[d], root, name, &buf);
+                inode_lookup (dirs[d]);
+        }
+
+        return dirs;
+}
+
+static int
+bm_lookups (xlator_t *nlc, inode_t **dirs)
+{
+        loc_t  loc  = {0, };
+        char   name[32];
+        int    hits = 0;
+        int    d    = 0;
+        int    n    = 0;
+
+        for (d = 0; d < BM_DIRS; d++) {
+                loc.parent = dirs[d];
+                loc.name = name;
+                for (n = 0; n < BM_NAMES; n++) {
+                        snprintf (name, sizeof (name), "missing-%d.h", n);
+                        if (nlc_is_negative_lookup (nlc, &loc))
+                                hits++;
+                }
+        }
+
+        return hits;
+}
+
+static void
+bm_remount (glusterfs_ctx_t *ctx, uuid_t *gfids, const char *dir,
+            const char *label)
+{
+        xlator_t    *nlc      = NULL;
+        inode_t    **dirs     = NULL;
+        struct iatt  buf      = {0, };
+        uint64_t     start    = 0;
+        uint64_t     load     = 0;
+        int          hits     = 0;
+        int          d        = 0;
+
+        start = bm_now_ns ();
+        nlc = bm_mount (ctx, dir);
+        load = bm_now_ns () - start;
+
+        dirs = bm_dirs (nlc, gfids);
+
+        /* the path walk looks up every directory before its names */
+        for (d = 0; d < BM_DIRS; d++) {
+                bm_dir_iatt (&buf, gfids, d, (d % 100 < BM_CHANGED));
+                nlc_snapshot_seed (nlc, dirs[d], &buf);
+        }
+
+        hits = bm_lookups (nlc, dirs);
+
+        printf ("%-18s %9.1f%% %12.1f\n", label,
+                100.0 * hits / (BM_DIRS * BM_NAMES), load / 1e6);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t    *ctx      = NULL;
+        xlator_t           *nlc      = NULL;
+        inode_t           **dirs     = NULL;
+        uuid_t             *gfids    = NULL;
+        struct iatt         buf      = {0, };
+        struct stat         st       = {0, };
+        char                name[32];
+        char                path[PATH_MAX];
+        const char         *dir      = "/tmp";
+        uint64_t            start    = 0;
+        uint64_t            save     = 0;
+        int                 d        = 0;
+        int                 n        = 0;
+
+        if (argc > 1)
+                dir = argv[1];
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+
+        bm_child.name = "brick-bm";
+        bm_child.ctx = ctx;
+
+        gfids = calloc (BM_DIRS, sizeof (*gfids));
+        for (d = 0; d < BM_DIRS; d++)
+                bm_gfid (gfids[d]);
+
+        /* the first mount looks up each directory, then finds every name
+           in it missing */
+        nlc = bm_mount (ctx, dir);
+        dirs = bm_dirs (nlc, gfids);
+        for (d = 0; d < BM_DIRS; d++) {
+                bm_dir_iatt (&buf, gfids, d, 0);
+                nlc_dir_stamp (nlc, dirs[d], &buf);
+                for (n = 0; n < BM_NAMES; n++) {
+                        snprintf (name, sizeof (name), "missing-%d.h", n);
+                        nlc_dir_add_ne (nlc, dirs[d], name);
+                }
+        }
+
+        start = bm_now_ns ();
+        nlc_snapshot_save (nlc);
+        save = bm_now_ns () - start;
+
+        snprintf (path, sizeof (path), "%s/%s.snapshot", dir, nlc->name);
+        if (stat (path, &st)) {
+                fprintf (stderr, "no snapshot in %s\n", path);
+                return 1;
+        }
+        printf ("%d dirs x %d missing names, %d%% of dirs changed\n",
+                BM_DIRS, BM_NAMES, BM_CHANGED);
+        printf ("snapshot: %.1f KB, saved in %.1f ms\n\n", st.st_size / 1024.0,
+                save / 1e6);
+
+        printf ("%-18s %10s %12s\n", "remount", "cached", "init ms");
+        bm_remount (ctx, gfids, NULL, "cold");
+        bm_remount (ctx, gfids, dir, "from snapshot");
+
+        unlink (path);
+
+        return 0;
+}
@@ -0,0 +1,273 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* posix-dirfd-bm: creates and lookups per second at the bottom of a 10
+ * level deep directory tree on a storage/posix brick, with the directory fd
+ * cache on and off.
+ *
+ * Like the fops coming from protocol/server, every create and lookup names
+ * its entry by the gfid of the parent and a basename, so posix has to turn
+ * the gfid of the deepest directory back into a path each time. Without
+ * the cache that means following the handle symlinks of all ten levels.
+ *
+ * storage/posix is loaded from XLATORDIR. A scratch brick is made under
+ * /tmp, which has to support trusted.* xattrs, so this has to run as root.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <ftw.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "defaults.h"
+#include "inode.h"
+#include "fd.h"
+
+#define BM_DEPTH        10
+#define BM_FILES        (1 << 13)
+#define BM_LOOKUPS      (1 << 16)
+
+static glusterfs_graph_t bm_graph = {.xl_count = 1};
+static int32_t bm_op_ret;
+static int32_t bm_op_errno;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bm_check (const char *fop, const char *name)
+{
+        if (bm_op_ret < 0) {
+                fprintf (stderr, "%s of %s failed: %s\n", fop, name,
+                         strerror (bm_op_errno));
+                exit (1);
+        }
+}
+
+static int32_t
+bm_mkdir_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+              int32_t op_ret, int32_t op_errno, inode_t *inode,
+              struct iatt *buf, struct iatt *preparent,
+              struct iatt *postparent, dict_t *xdata)
+{
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int32_t
+bm_create_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+               int32_t op_ret, int32_t op_errno, fd_t *fd, inode_t *inode,
+               struct iatt *buf, struct iatt *preparent,
+               struct iatt *postparent, dict_t *xdata)
+{
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int32_t
+bm_lookup_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+               int32_t op_ret, int32_t op_errno, inode_t *inode,
+               struct iatt *buf, dict_t *xdata, struct iatt *postparent)
+{
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int
+bm_remove (const char *path, const struct stat *st, int flag,
+           struct FTW *ftw)
+{
+        return remove (path);
+}
+
+static call_frame_t *
+bm_frame (xlator_t *xl)
+{
+        call_frame_t *frame = NULL;
+
+        frame = create_frame (xl, xl->ctx->pool);
+        if (!frame) {
+                fprintf (stderr, "create_frame failed\n");
+                exit (1);
+        }
+
+        return frame;
+}
+
+static dict_t *
+bm_gfid_req (uuid_t gfid)
+{
+        dict_t *xdata = NULL;
+
+        gf_uuid_generate (gfid);
+        xdata = dict_new ();
+        if (!xdata || dict_set_gfuuid (xdata, "gfid-req", gfid, true)) {
+                fprintf (stderr, "dict_set failed\n");
+                exit (1);
+        }
+
+        return xdata;
+}
+
+static void
+bm_loc (loc_t *loc, inode_table_t *itable, uuid_t pargfid, char *name)
+{
+        memset (loc, 0, sizeof (*loc));
+        loc->inode = inode_new (itable);
+        loc->path = gf_strdup (name);
+        loc->name = loc->path;
+        gf_uuid_copy (loc->pargfid, pargfid);
+}
+
+static void
+bm_run (glusterfs_ctx_t *ctx, const char *cache_size)
+{
+        xlator_t      *xl = NULL;
+        inode_table_t *itable = NULL;
+        dict_t        *xdata = NULL;
+        fd_t          *fd = NULL;
+        loc_t          loc = {0, };
+        char           brick[] = "/tmp/posix-dirfd-bm.XXXXXX";
+        char           names[BM_FILES][16];
+        char           dirs[BM_DEPTH][16];
+        uuid_t         pargfid = {0, 0, 0, 0, 0, 0, 0, 0,
+                                  0, 0, 0, 0, 0, 0, 0, 1};
+        uuid_t         gfid = {0, };
+        uint64_t       start = 0;
+        uint64_t       create_ns = 0;
+        uint64_t       lookup_ns = 0;
+        int            i = 0;
+
+        if (!mkdtemp (brick)) {
+                perror ("mkdtemp");
+                exit (1);
+        }
+
+        xl = GF_CALLOC (1, sizeof (*xl), gf_common_mt_xlator_t);
+        xl->name = "posix-bm";
+        xl->ctx = ctx;
+        xl->graph = &bm_graph;
+        xl->options = dict_new ();
+        if (xlator_set_type (xl, "storage/posix")) {
+                fprintf (stderr, "cannot load storage/posix\n");
+                exit (1);
+        }
+
+        if (dict_set_str (xl->options, "directory", brick) ||
+            dict_set_str (xl->options, "health-check-interval", "0") ||
+            dict_set_str (xl->options, "dirfd-cache-size",
+                          (char *)cache_size)) {
+                fprintf (stderr, "dict_set failed\n");
+                exit (1);
+        }
+
+        THIS = xl;
+        if (xlator_init (xl)) {
+                fprintf (stderr, "cannot init storage/posix on %s\n", brick);
+                exit (1);
+        }
+        itable = inode_table_new (BM_FILES, xl);
+
+        for (i = 0; i < BM_DEPTH; i++) {
+                snprintf (dirs[i], sizeof (dirs[i]), "dir-%d", i);
+                bm_loc (&loc, itable, pargfid, dirs[i]);
+                xdata = bm_gfid_req (gfid);
+                STACK_WIND (bm_frame (xl), bm_mkdir_cbk, xl, xl->fops->mkdir,
+                            &loc, 0755, 0, xdata);
+                bm_check ("mkdir", dirs[i]);
+                dict_unref (xdata);
+                loc_wipe (&loc);
+                gf_uuid_copy (pargfid, gfid);
+        }
+
+        start = bm_now_ns ();
+        for (i = 0; i < BM_FILES; i++) {
+                snprintf (names[i], sizeof (names[i]), "file-%d", i);
+                bm_loc (&loc, itable, pargfid, names[i]);
+                xdata = bm_gfid_req (gfid);
+                fd = fd_create (loc.inode, 0);
+                STACK_WIND (bm_frame (xl), bm_create_cbk, xl,
+                            xl->fops->create, &loc, O_RDWR, 0644, 0, fd,
+                            xdata);
+                bm_check ("create", names[i]);
+                fd_unref (fd);
+                dict_unref (xdata);
+                loc_wipe (&loc);
+        }
+        create_ns = bm_now_ns () - start;
+
+        start = bm_now_ns ();
+        for (i = 0; i < BM_LOOKUPS; i++) {
+                bm_loc (&loc, itable, pargfid, names[i % BM_FILES]);
+                STACK_WIND (bm_frame (xl), bm_lookup_cbk, xl,
+                            xl->fops->lookup, &loc, NULL);
+                bm_check ("lookup", loc.name);
+                loc_wipe (&loc);
+        }
+        lookup_ns = bm_now_ns () - start;
+
+        printf ("%-16s %12.0f %12.0f\n", cache_size,
+                (double)BM_FILES * 1e9 / create_ns,
+                (double)BM_LOOKUPS * 1e9 / lookup_ns);
+
+        /* the janitor thread of posix keeps running, so the xlator is left
+           in place and only the brick goes */
+        if (nftw (brick, bm_remove, 16, FTW_DEPTH | FTW_PHYS))
+                fprintf (stderr, "could not remove %s\n", brick);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+
+        printf ("%-16s %12s %12s\n", "dirfd-cache-size", "creates/s",
+                "lookups/s");
+        bm_run (ctx, "0");
+        bm_run (ctx, "1024");
+
+        return 0;
+}
@@ -0,0 +1,372 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* posix-fsync-bm: fsyncs per second that storage/posix completes for
+ * BM_WRITERS threads that each write 4k and fdatasync() it, over and over,
+ * the way VMs on an image volume do. Once with all of them writing their
+ * own part of one file, once with a file each, with batch-fsync-mode
+ * "none" (every fsync on its own) and "group-commit".
+ *
+ * storage/posix is loaded from XLATORDIR. A scratch brick is made under
+ * /tmp, which has to be on a real disk for the numbers to mean anything,
+ * and support trusted.* xattrs, so this has to run as root.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <ftw.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "defaults.h"
+#include "inode.h"
+#include "fd.h"
+#include "iobuf.h"
+#include "call-stub.h"
+
+#define BM_WRITERS      16
+#define BM_ROUNDS       200     /* write+fsync per writer */
+
+struct bm_writer {
+        xlator_t        *xl;
+        fd_t            *fd;
+        off_t            offset;
+        pthread_mutex_t  lock;
+        pthread_cond_t   cond;
+        int              done;
+        int32_t          op_ret;
+        int32_t          op_errno;
+        uint32_t         batch;         /* biggest batch seen */
+};
+
+static glusterfs_graph_t bm_graph = {.xl_count = 1};
+static int32_t           bm_op_ret;
+static int32_t           bm_op_errno;
+static struct iobuf     *bm_iobuf;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bm_check (const char *fop)
+{
+        if (bm_op_ret < 0) {
+                fprintf (stderr, "%s failed: %s\n", fop,
+                         strerror (bm_op_errno));
+                exit (1);
+        }
+}
+
+static void
+bm_done (struct bm_writer *w, int32_t op_ret, int32_t op_errno)
+{
+        pthread_mutex_lock (&w->lock);
+        {
+                w->op_ret = op_ret;
+                w->op_errno = op_errno;
+                w->done = 1;
+                pthread_cond_signal (&w->cond);
+        }
+        pthread_mutex_unlock (&w->lock);
+}
+
+static void
+bm_wait (struct bm_writer *w, const char *fop)
+{
+        pthread_mutex_lock (&w->lock);
+        {
+                while (!w->done)
+                        pthread_cond_wait (&w->cond, &w->lock);
+                w->done = 0;
+        }
+        pthread_mutex_unlock (&w->lock);
+
+        if (w->op_ret < 0) {
+                fprintf (stderr, "%s failed: %s\n", fop,
+                         strerror (w->op_errno));
+                exit (1);
+        }
+}
+
+static int32_t
+bm_create_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+               int32_t op_ret, int32_t op_errno, fd_t *fd, inode_t *inode,
+               struct iatt *buf, struct iatt *preparent,
+               struct iatt *postparent, dict_t *xdata)
+{
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int32_t
+bm_writev_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+               int32_t op_ret, int32_t op_errno, struct iatt *prebuf,
+               struct iatt *postbuf, dict_t *xdata)
+{
+        STACK_DESTROY (frame->root);
+        bm_done (cookie, op_ret, op_errno);
+        return 0;
+}
+
+static int32_t
+bm_fsync_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+              int32_t op_ret, int32_t op_errno, struct iatt *prebuf,
+              struct iatt *postbuf, dict_t *xdata)
+{
+        struct bm_writer *w = cookie;
+        uint32_t          batch = 0;
+
+        if (xdata &&
+            dict_get_uint32 (xdata, GLUSTERFS_FSYNC_BATCH_SIZE, &batch) == 0 &&
+            batch > w->batch)
+                w->batch = batch;
+
+        STACK_DESTROY (frame->root);
+        bm_done (w, op_ret, op_errno);
+        return 0;
+}
+
+static int
+bm_remove (const char *path, const struct stat *st, int flag,
+           struct FTW *ftw)
+{
+        return remove (path);
+}
+
+static call_frame_t *
+bm_frame (xlator_t *xl)
+{
+        call_frame_t *frame = NULL;
+
+        frame = create_frame (xl, xl->ctx->pool);
+        if (!frame) {
+                fprintf (stderr, "create_frame failed\n");
+                exit (1);
+        }
+
+        return frame;
+}
+
+static void
+bm_mode (xlator_t *xl, const char *mode)
+{
+        dict_t *options = NULL;
+
+        options = dict_copy_with_ref (xl->options, NULL);
+        if (dict_set_str (options, "batch-fsync-mode", (char *)mode) ||
+            xl->reconfigure (xl, options)) {
+                fprintf (stderr, "cannot set batch-fsync-mode to %s\n", mode);
+                exit (1);
+        }
+        dict_unref (options);
+}
+
+static fd_t *
+bm_create (xlator_t *xl, inode_table_t *itable, const char *name)
+{
+        loc_t   loc   = {0, };
+        dict_t *xdata = NULL;
+        fd_t   *fd    = NULL;
+        uuid_t  root  = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+        uuid_t  gfid  = {0, };
+
+        loc.inode = inode_new (itable);
+        loc.path = gf_strdup (name);
+        loc.name = loc.path;
+        gf_uuid_copy (loc.pargfid, root);
+        gf_uuid_generate (gfid);
+        xdata = dict_new ();
+        if (!xdata || dict_set_gfuuid (xdata, "gfid-req", gfid, true)) {
+                fprintf (stderr, "dict_set failed\n");
+                exit (1);
+        }
+
+        fd = fd_create (loc.inode, 0);
+        STACK_WIND (bm_frame (xl), bm_create_cbk, xl, xl->fops->create, &loc,
+                    O_RDWR, 0644, 0, fd, xdata);
+        bm_check ("create");
+        gf_uuid_copy (loc.inode->gfid, gfid);
+        loc.inode->ia_type = IA_IFREG;
+
+        dict_unref (xdata);
+        loc_wipe (&loc);
+
+        return fd;
+}
+
+static void *
+bm_writer (void *data)
+{
+        struct bm_writer *w      = data;
+        struct iobref    *iobref = NULL;
+        struct iovec      iov    = {0, };
+        int               i      = 0;
+
+        iobref = iobref_new ();
+        iobref_add (iobref, bm_iobuf);
+        iov.iov_base = bm_iobuf->ptr;
+        iov.iov_len = 4096;
+
+        for (i = 0; i < BM_ROUNDS; i++) {
+                STACK_WIND_COOKIE (bm_frame (w->xl), bm_writev_cbk, w, w->xl,
+                                   w->xl->fops->writev, w->fd, &iov, 1,
+                                   w->offset + i * 4096, 0, iobref, NULL);
+                bm_wait (w, "writev");
+
+                STACK_WIND_COOKIE (bm_frame (w->xl), bm_fsync_cbk, w, w->xl,
+                                   w->xl->fops->fsync, w->fd, 1, NULL);
+                bm_wait (w, "fsync");
+        }
+
+        iobref_unref (iobref);
+        return NULL;
+}
+
+static void
+bm_run (xlator_t *xl, fd_t **fds, int shared, const char *mode)
+{
+        struct bm_writer writers[BM_WRITERS];
+        pthread_t        threads[BM_WRITERS];
+        uint64_t         start   = 0;
+        uint64_t         elapsed = 0;
+        uint32_t         batch   = 0;
+        int              i       = 0;
+
+        bm_mode (xl, mode);
+
+        memset (writers, 0, sizeof (writers));
+        start = bm_now_ns ();
+
+        for (i = 0; i < BM_WRITERS; i++) {
+                writers[i].xl = xl;
+                writers[i].fd = shared ? fds[0] : fds[i];
+                writers[i].offset = shared ? i * BM_ROUNDS * 4096 : 0;
+                pthread_mutex_init (&writers[i].lock, NULL);
+                pthread_cond_init (&writers[i].cond, NULL);
+                if (pthread_create (&threads[i], NULL, bm_writer,
+                                    &writers[i])) {
+                        perror ("pthread_create");
+                        exit (1);
+                }
+        }
+
+        for (i = 0; i < BM_WRITERS; i++) {
+                pthread_join (threads[i], NULL);
+                if (writers[i].batch > batch)
+                        batch = writers[i].batch;
+        }
+
+        elapsed = bm_now_ns () - start;
+
+        printf ("%-13s %-7s %12.0f %10u\n", mode,
+                shared ? "shared" : "private",
+                (double)BM_WRITERS * BM_ROUNDS * 1e9 / elapsed, batch);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        xlator_t        *xl = NULL;
+        inode_table_t   *itable = NULL;
+        fd_t            *fds[BM_WRITERS];
+        char             brick[] = "/tmp/posix-fsync-bm.XXXXXX";
+        char             name[32];
+        const char      *modes[] = {"none", "group-commit"};
+        int              shared = 0;
+        int              m = 0;
+        int              i = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+        ctx->stub_mem_pool = mem_pool_new (call_stub_t, 1024);
+        ctx->iobuf_pool = iobuf_pool_new ();
+
+        if (!mkdtemp (brick)) {
+                perror ("mkdtemp");
+                return 1;
+        }
+
+        xl = GF_CALLOC (1, sizeof (*xl), gf_common_mt_xlator_t);
+        xl->name = "posix-bm";
+        xl->ctx = ctx;
+        xl->graph = &bm_graph;
+        xl->options = dict_new ();
+        if (xlator_set_type (xl, "storage/posix")) {
+                fprintf (stderr, "cannot load storage/posix\n");
+                return 1;
+        }
+
+        if (dict_set_str (xl->options, "directory", brick) ||
+            dict_set_str (xl->options, "health-check-interval", "0")) {
+                fprintf (stderr, "dict_set failed\n");
+                return 1;
+        }
+
+        THIS = xl;
+        if (xlator_init (xl)) {
+                fprintf (stderr, "cannot init storage/posix on %s\n", brick);
+                return 1;
+        }
+        itable = inode_table_new (64, xl);
+
+        for (i = 0; i < BM_WRITERS; i++) {
+                snprintf (name, sizeof (name), "image-%d", i);
+                fds[i] = bm_create (xl, itable, name);
+        }
+
+        bm_iobuf = iobuf_get_page_aligned (ctx->iobuf_pool, 4096, 4096);
+        memset (bm_iobuf->ptr, 'x', 4096);
+
+        printf ("%-13s %-7s %12s %10s\n", "mode", "files", "fsyncs/s",
+                "max batch");
+        for (shared = 1; shared >= 0; shared--) {
+                for (m = 0; m < sizeof (modes) / sizeof (modes[0]); m++)
+                        bm_run (xl, fds, shared, modes[m]);
+        }
+
+        bm_mode (xl, "none");
+        iobuf_unref (bm_iobuf);
+        for (i = 0; i < BM_WRITERS; i++)
+                fd_unref (fds[i]);
+
+        if (nftw (brick, bm_remove, 16, FTW_DEPTH | FTW_PHYS))
+                fprintf (stderr, "could not remove %s\n", brick);
+
+        return 0;
+}
@@ -0,0 +1,421 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* posix-io-bm: a small fio for a storage/posix brick. Random 4k reads and
+ * writes and sequential 128k reads on one 256MB file, buffered and
+ * O_DIRECT, with the synchronous fops, linux-aio and io_uring.
+ *
+ * BM_DEPTH requests are kept in flight: the main thread winds a new one
+ * whenever one completes. The synchronous fops complete before the wind
+ * returns, so they only ever have one in flight, which is what a brick
+ * thread doing the fop gets too. Engines posix was built without are
+ * reported as such. Pass "sqpoll" to have the io_uring polled by a kernel
+ * thread.
+ *
+ * storage/posix is loaded from XLATORDIR. A scratch brick is made under
+ * /tmp, which has to support trusted.* xattrs, so this has to run as root.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <ftw.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "defaults.h"
+#include "inode.h"
+#include "fd.h"
+#include "iobuf.h"
+
+#define BM_FILE_SIZE    (256ULL << 20)
+#define BM_DEPTH        32
+#define BM_BYTES        (128ULL << 20)  /* moved by every job */
+
+struct bm_job {
+        const char *name;
+        int         write;
+        int         random;
+        size_t      block;
+};
+
+static struct bm_job bm_jobs[] = {
+        {"randread",  0, 1, 4096},
+        {"randwrite", 1, 1, 4096},
+        {"seqread",   0, 0, 131072},
+};
+
+static glusterfs_graph_t bm_graph = {.xl_count = 1};
+static int32_t           bm_op_ret;
+static int32_t           bm_op_errno;
+static pthread_mutex_t   bm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    bm_cond = PTHREAD_COND_INITIALIZER;
+static int               bm_inflight;
+static int               bm_failed;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bm_check (const char *fop)
+{
+        if (bm_op_ret < 0) {
+                fprintf (stderr, "%s failed: %s\n", fop,
+                         strerror (bm_op_errno));
+                exit (1);
+        }
+}
+
+static void
+bm_done (call_frame_t *frame, int32_t op_ret, int32_t op_errno)
+{
+        STACK_DESTROY (frame->root);
+
+        pthread_mutex_lock (&bm_lock);
+        {
+                if (op_ret < 0 && !bm_failed)
+                        bm_failed = op_errno;
+                bm_inflight--;
+                pthread_cond_signal (&bm_cond);
+        }
+        pthread_mutex_unlock (&bm_lock);
+}
+
+static int32_t
+bm_create_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+               int32_t op_ret, int32_t op_errno, fd_t *fd, inode_t *inode,
+               struct iatt *buf, struct iatt *preparent,
+               struct iatt *postparent, dict_t *xdata)
+{
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int32_t
+bm_open_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+             int32_t op_ret, int32_t op_errno, fd_t *fd, dict_t *xdata)
+{
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int32_t
+bm_readv_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+              int32_t op_ret, int32_t op_errno, struct iovec *vector,
+              int32_t count, struct iatt *stbuf, struct iobref *iobref,
+              dict_t *xdata)
+{
+        bm_done (frame, op_ret, op_errno);
+        return 0;
+}
+
+static int32_t
+bm_writev_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+               int32_t op_ret, int32_t op_errno, struct iatt *prebuf,
+               struct iatt *postbuf, dict_t *xdata)
+{
+        bm_done (frame, op_ret, op_errno);
+        return 0;
+}
+
+static int
+bm_remove (const char *path, const struct stat *st, int flag,
+           struct FTW *ftw)
+{
+        return remove (path);
+}
+
+static call_frame_t *
+bm_frame (xlator_t *xl)
+{
+        call_frame_t *frame = NULL;
+
+        frame = create_frame (xl, xl->ctx->pool);
+        if (!frame) {
+                fprintf (stderr, "create_frame failed\n");
+                exit (1);
+        }
+
+        return frame;
+}
+
+static void
+bm_engine (xlator_t *xl, const char *aio, const char *uring)
+{
+        dict_t *options = NULL;
+
+        options = dict_copy_with_ref (xl->options, NULL);
+        if (dict_set_str (options, "linux-aio", (char *)aio) ||
+            dict_set_str (options, "io-uring", (char *)uring) ||
+            xl->reconfigure (xl, options)) {
+                fprintf (stderr, "cannot switch to linux-aio %s, io-uring "
+                         "%s\n", aio, uring);
+                exit (1);
+        }
+        dict_unref (options);
+}
+
+static fd_t *
+bm_open (xlator_t *xl, inode_t *inode, int flags)
+{
+        loc_t  loc = {0, };
+        fd_t  *fd  = NULL;
+
+        loc.inode = inode_ref (inode);
+        gf_uuid_copy (loc.gfid, inode->gfid);
+        fd = fd_create (inode, 0);
+        STACK_WIND (bm_frame (xl), bm_open_cbk, xl, xl->fops->open, &loc,
+                    flags, fd, NULL);
+        bm_check ("open");
+        loc_wipe (&loc);
+
+        return fd;
+}
+
+static double
+bm_run (xlator_t *xl, fd_t *fd, struct bm_job *job, struct iobuf *iobuf)
+{
+        struct iobref *iobref  = NULL;
+        struct iovec   iov     = {0, };
+        uint64_t       blocks  = 0;
+        uint64_t       ops     = 0;
+        uint64_t       start   = 0;
+        uint64_t       elapsed = 0;
+        uint64_t       seed    = 88172645463325252ULL;
+        off_t          offset  = 0;
+        uint64_t       i       = 0;
+
+        blocks = BM_FILE_SIZE / job->block;
+        ops = BM_BYTES / job->block;
+
+        iobref = iobref_new ();
+        iobref_add (iobref, iobuf);
+        iov.iov_base = iobuf->ptr;
+        iov.iov_len = job->block;
+
+        bm_failed = 0;
+        start = bm_now_ns ();
+
+        for (i = 0; i < ops; i++) {
+                pthread_mutex_lock (&bm_lock);
+                {
+                        while (bm_inflight >= BM_DEPTH)
+                                pthread_cond_wait (&bm_cond, &bm_lock);
+                        bm_inflight++;
+                }
+                pthread_mutex_unlock (&bm_lock);
+
+                if (job->random) {
+                        seed ^= seed << 13;
+                        seed ^= seed >> 7;
+                        seed ^= seed << 17;
+                        offset = (seed % blocks) * job->block;
+                } else {
+                        offset = (i % blocks) * job->block;
+                }
+
+                if (job->write)
+                        STACK_WIND (bm_frame (xl), bm_writev_cbk, xl,
+                                    xl->fops->writev, fd, &iov, 1, offset, 0,
+                                    iobref, NULL);
+                else
+                        STACK_WIND (bm_frame (xl), bm_readv_cbk, xl,
+                                    xl->fops->readv, fd, job->block, offset,
+                                    0, NULL);
+        }
+
+        pthread_mutex_lock (&bm_lock);
+        {
+                while (bm_inflight)
+                        pthread_cond_wait (&bm_cond, &bm_lock);
+        }
+        pthread_mutex_unlock (&bm_lock);
+
+        elapsed = bm_now_ns () - start;
+        iobref_unref (iobref);
+
+        if (bm_failed) {
+                fprintf (stderr, "%s failed: %s\n", job->name,
+                         strerror (bm_failed));
+                exit (1);
+        }
+
+        return (double)ops * 1e9 / elapsed;
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        xlator_t        *xl = NULL;
+        inode_table_t   *itable = NULL;
+        inode_t         *inode = NULL;
+        dict_t          *xdata = NULL;
+        fd_t            *fd = NULL;
+        struct iobuf    *iobuf = NULL;
+        loc_t            loc = {0, };
+        char             brick[] = "/tmp/posix-io-bm.XXXXXX";
+        char             path[64];
+        char            *chunk = NULL;
+        uuid_t           root = {0, 0, 0, 0, 0, 0, 0, 0,
+                                 0, 0, 0, 0, 0, 0, 0, 1};
+        uuid_t           gfid = {0, };
+        const char      *engines[][3] = {
+                {"sync",      "off", "off"},
+                {"linux-aio", "on",  "off"},
+                {"io_uring",  "off", "on"},
+        };
+        void            *sync_readv = NULL;
+        double           iops = 0;
+        int              direct = 0;
+        int              e = 0;
+        int              j = 0;
+        int              out = -1;
+        off_t            off = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+        ctx->iobuf_pool = iobuf_pool_new ();
+
+        if (!mkdtemp (brick)) {
+                perror ("mkdtemp");
+                return 1;
+        }
+
+        xl = GF_CALLOC (1, sizeof (*xl), gf_common_mt_xlator_t);
+        xl->name = "posix-bm";
+        xl->ctx = ctx;
+        xl->graph = &bm_graph;
+        xl->options = dict_new ();
+        if (xlator_set_type (xl, "storage/posix")) {
+                fprintf (stderr, "cannot load storage/posix\n");
+                return 1;
+        }
+
+        if (dict_set_str (xl->options, "directory", brick) ||
+            dict_set_str (xl->options, "health-check-interval", "0") ||
+            dict_set_str (xl->options, "io-uring-sqpoll",
+                          (argc > 1 && strcmp (argv[1], "sqpoll") == 0) ?
+                          "on" : "off")) {
+                fprintf (stderr, "dict_set failed\n");
+                return 1;
+        }
+
+        THIS = xl;
+        if (xlator_init (xl)) {
+                fprintf (stderr, "cannot init storage/posix on %s\n", brick);
+                return 1;
+        }
+        itable = inode_table_new (16, xl);
+        sync_readv = xl->fops->readv;
+
+        memset (&loc, 0, sizeof (loc));
+        loc.inode = inode_new (itable);
+        loc.path = gf_strdup ("data");
+        loc.name = loc.path;
+        gf_uuid_copy (loc.pargfid, root);
+        gf_uuid_generate (gfid);
+        xdata = dict_new ();
+        if (!xdata || dict_set_gfuuid (xdata, "gfid-req", gfid, true)) {
+                fprintf (stderr, "dict_set failed\n");
+                return 1;
+        }
+        fd = fd_create (loc.inode, 0);
+        STACK_WIND (bm_frame (xl), bm_create_cbk, xl, xl->fops->create, &loc,
+                    O_RDWR, 0644, 0, fd, xdata);
+        bm_check ("create");
+        fd_unref (fd);
+        dict_unref (xdata);
+        inode = inode_ref (loc.inode);
+        gf_uuid_copy (inode->gfid, gfid);
+        inode->ia_type = IA_IFREG;
+        loc_wipe (&loc);
+
+        /* fill it behind the back of posix, only the data matters */
+        snprintf (path, sizeof (path), "%s/data", brick);
+        out = open (path, O_WRONLY);
+        chunk = malloc (1 << 20);
+        memset (chunk, 'x', 1 << 20);
+        for (off = 0; out >= 0 && off < BM_FILE_SIZE; off += 1 << 20) {
+                if (pwrite (out, chunk, 1 << 20, off) != 1 << 20)
+                        break;
+        }
+        if (out < 0 || off < BM_FILE_SIZE || fsync (out)) {
+                perror (path);
+                return 1;
+        }
+        close (out);
+        free (chunk);
+
+        iobuf = iobuf_get_page_aligned (ctx->iobuf_pool, 131072, 4096);
+
+        printf ("%-10s %-10s %-7s %10s %10s\n", "engine", "job", "mode",
+                "IOPS", "MB/s");
+        for (e = 0; e < sizeof (engines) / sizeof (engines[0]); e++) {
+                bm_engine (xl, engines[e][1], engines[e][2]);
+                if (e > 0 && xl->fops->readv == sync_readv) {
+                        printf ("%-10s not built or not available\n",
+                                engines[e][0]);
+                        continue;
+                }
+
+                for (direct = 0; direct < 2; direct++) {
+                        fd = bm_open (xl, inode,
+                                      O_RDWR | (direct ? O_DIRECT : 0));
+                        for (j = 0; j < sizeof (bm_jobs) / sizeof (bm_jobs[0]);
+                             j++) {
+                                iops = bm_run (xl, fd, &bm_jobs[j], iobuf);
+                                printf ("%-10s %-10s %-7s %10.0f %10.1f\n",
+                                        engines[e][0], bm_jobs[j].name,
+                                        direct ? "direct" : "buffered", iops,
+                                        iops * bm_jobs[j].block / 1e6);
+                        }
+                        fd_unref (fd);
+                }
+        }
+
+        bm_engine (xl, "off", "off");
+        iobuf_unref (iobuf);
+        inode_unref (inode);
+
+        if (nftw (brick, bm_remove, 16, FTW_DEPTH | FTW_PHYS))
+                fprintf (stderr, "could not remove %s\n", brick);
+
+        return 0;
+}
@@ -0,0 +1,360 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* posix-readdirp-bm: entries per second that storage/posix returns from
+ * readdirp on a directory of 100k files, with 0 to 8 readdirp-threads.
+ *
+ * Each readdirp asks for the xattrs DHT and AFR ask for, so every entry
+ * costs an lstat() and a handful of getxattr()s. The directory is read
+ * start to end in 128k replies. Pass "cold" to drop the kernel caches
+ * before every pass; that is where parallel filling matters most on
+ * real disks.
+ *
+ * storage/posix is loaded from XLATORDIR. A scratch brick is made under
+ * /tmp, which has to support trusted.* xattrs, so this has to run as root.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <ftw.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "defaults.h"
+#include "inode.h"
+#include "fd.h"
+
+#define BM_ENTRIES      100000
+#define BM_REPLY_SIZE   (128 * 1024)
+
+static glusterfs_graph_t bm_graph = {.xl_count = 1};
+static int32_t           bm_op_ret;
+static int32_t           bm_op_errno;
+static off_t             bm_last_off;
+
+static char *bm_xattrs[] = {
+        "trusted.glusterfs.dht.linkto",
+        "trusted.afr.vol-client-0",
+        "trusted.afr.vol-client-1",
+        "trusted.afr.dirty",
+        "security.selinux",
+        NULL
+};
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bm_check (const char *fop)
+{
+        if (bm_op_ret < 0) {
+                fprintf (stderr, "%s failed: %s\n", fop,
+                         strerror (bm_op_errno));
+                exit (1);
+        }
+}
+
+static int32_t
+bm_mkdir_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+              int32_t op_ret, int32_t op_errno, inode_t *inode,
+              struct iatt *buf, struct iatt *preparent,
+              struct iatt *postparent, dict_t *xdata)
+{
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int32_t
+bm_create_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+               int32_t op_ret, int32_t op_errno, fd_t *fd, inode_t *inode,
+               struct iatt *buf, struct iatt *preparent,
+               struct iatt *postparent, dict_t *xdata)
+{
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int32_t
+bm_opendir_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+                int32_t op_ret, int32_t op_errno, fd_t *fd, dict_t *xdata)
+{
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int32_t
+bm_readdirp_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+                 int32_t op_ret, int32_t op_errno, gf_dirent_t *entries,
+                 dict_t *xdata)
+{
+        gf_dirent_t *entry = NULL;
+
+        bm_op_ret = op_ret;
+        bm_op_errno = op_errno;
+
+        list_for_each_entry (entry, &entries->list, list) {
+                if (strncmp (entry->d_name, "file-", 5) == 0 &&
+                    (!entry->inode || !entry->dict)) {
+                        fprintf (stderr, "%s came back unfilled\n",
+                                 entry->d_name);
+                        exit (1);
+                }
+                bm_last_off = entry->d_off;
+        }
+
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int
+bm_remove (const char *path, const struct stat *st, int flag,
+           struct FTW *ftw)
+{
+        return remove (path);
+}
+
+static call_frame_t *
+bm_frame (xlator_t *xl)
+{
+        call_frame_t *frame = NULL;
+
+        frame = create_frame (xl, xl->ctx->pool);
+        if (!frame) {
+                fprintf (stderr, "create_frame failed\n");
+                exit (1);
+        }
+
+        return frame;
+}
+
+static dict_t *
+bm_gfid_req (uuid_t gfid)
+{
+        dict_t *xdata = NULL;
+
+        gf_uuid_generate (gfid);
+        xdata = dict_new ();
+        if (!xdata || dict_set_gfuuid (xdata, "gfid-req", gfid, true)) {
+                fprintf (stderr, "dict_set failed\n");
+                exit (1);
+        }
+
+        return xdata;
+}
+
+static void
+bm_loc (loc_t *loc, inode_table_t *itable, uuid_t pargfid, char *name)
+{
+        memset (loc, 0, sizeof (*loc));
+        loc->inode = inode_new (itable);
+        loc->path = gf_strdup (name);
+        loc->name = loc->path;
+        gf_uuid_copy (loc->pargfid, pargfid);
+}
+
+static void
+bm_drop_caches (void)
+{
+        FILE *fp = NULL;
+
+        sync ();
+        fp = fopen ("/proc/sys/vm/drop_caches", "w");
+        if (!fp || fputs ("3\n", fp) < 0) {
+                perror ("drop_caches");
+                exit (1);
+        }
+        fclose (fp);
+}
+
+static double
+bm_pass (xlator_t *xl, inode_table_t *itable, uuid_t dir, int threads,
+         int cold)
+{
+        dict_t   *options = NULL;
+        dict_t   *xattrs  = NULL;
+        fd_t     *fd      = NULL;
+        loc_t     loc     = {0, };
+        char      count[16];
+        uint64_t  start   = 0;
+        uint64_t  elapsed = 0;
+        uint64_t  entries = 0;
+        int       i       = 0;
+
+        options = dict_copy_with_ref (xl->options, NULL);
+        snprintf (count, sizeof (count), "%d", threads);
+        if (dict_set_str (options, "readdirp-threads", count) ||
+            xl->reconfigure (xl, options)) {
+                fprintf (stderr, "cannot set readdirp-threads to %d\n",
+                         threads);
+                exit (1);
+        }
+        dict_unref (options);
+
+        xattrs = dict_new ();
+        for (i = 0; bm_xattrs[i]; i++) {
+                if (dict_set_int32 (xattrs, bm_xattrs[i], 0)) {
+                        fprintf (stderr, "dict_set failed\n");
+                        exit (1);
+                }
+        }
+
+        if (cold)
+                bm_drop_caches ();
+
+        start = bm_now_ns ();
+
+        memset (&loc, 0, sizeof (loc));
+        loc.inode = inode_new (itable);
+        loc.inode->ia_type = IA_IFDIR;
+        gf_uuid_copy (loc.inode->gfid, dir);
+        gf_uuid_copy (loc.gfid, dir);
+        fd = fd_create (loc.inode, 0);
+        STACK_WIND (bm_frame (xl), bm_opendir_cbk, xl, xl->fops->opendir,
+                    &loc, fd, NULL);
+        bm_check ("opendir");
+
+        bm_last_off = 0;
+        do {
+                STACK_WIND (bm_frame (xl), bm_readdirp_cbk, xl,
+                            xl->fops->readdirp, fd, BM_REPLY_SIZE,
+                            bm_last_off, xattrs);
+                bm_check ("readdirp");
+                entries += bm_op_ret;
+        } while (bm_op_ret > 0);
+
+        elapsed = bm_now_ns () - start;
+
+        fd_unref (fd);
+        loc_wipe (&loc);
+        dict_unref (xattrs);
+
+        return (double)entries * 1e9 / elapsed;
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        xlator_t        *xl = NULL;
+        inode_table_t   *itable = NULL;
+        dict_t          *xdata = NULL;
+        fd_t            *fd = NULL;
+        loc_t            loc = {0, };
+        char             brick[] = "/tmp/posix-readdirp-bm.XXXXXX";
+        char             name[32];
+        uuid_t           root = {0, 0, 0, 0, 0, 0, 0, 0,
+                                 0, 0, 0, 0, 0, 0, 0, 1};
+        uuid_t           dir = {0, };
+        uuid_t           gfid = {0, };
+        int              threads[] = {0, 1, 2, 4, 8};
+        int              cold = 0;
+        int              i = 0;
+
+        cold = (argc > 1 && strcmp (argv[1], "cold") == 0);
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+
+        if (!mkdtemp (brick)) {
+                perror ("mkdtemp");
+                return 1;
+        }
+
+        xl = GF_CALLOC (1, sizeof (*xl), gf_common_mt_xlator_t);
+        xl->name = "posix-bm";
+        xl->ctx = ctx;
+        xl->graph = &bm_graph;
+        xl->options = dict_new ();
+        if (xlator_set_type (xl, "storage/posix")) {
+                fprintf (stderr, "cannot load storage/posix\n");
+                return 1;
+        }
+
+        if (dict_set_str (xl->options, "directory", brick) ||
+            dict_set_str (xl->options, "health-check-interval", "0")) {
+                fprintf (stderr, "dict_set failed\n");
+                return 1;
+        }
+
+        THIS = xl;
+        if (xlator_init (xl)) {
+                fprintf (stderr, "cannot init storage/posix on %s\n", brick);
+                return 1;
+        }
+        itable = inode_table_new (4096, xl);
+
+        bm_loc (&loc, itable, root, "dir");
+        xdata = bm_gfid_req (dir);
+        STACK_WIND (bm_frame (xl), bm_mkdir_cbk, xl, xl->fops->mkdir, &loc,
+                    0755, 0, xdata);
+        bm_check ("mkdir");
+        dict_unref (xdata);
+        loc_wipe (&loc);
+
+        for (i = 0; i < BM_ENTRIES; i++) {
+                snprintf (name, sizeof (name), "file-%d", i);
+                bm_loc (&loc, itable, dir, name);
+                xdata = bm_gfid_req (gfid);
+                fd = fd_create (loc.inode, 0);
+                STACK_WIND (bm_frame (xl), bm_create_cbk, xl,
+                            xl->fops->create, &loc, O_RDWR, 0644, 0, fd,
+                            xdata);
+                bm_check ("create");
+                fd_unref (fd);
+                dict_unref (xdata);
+                loc_wipe (&loc);
+        }
+
+        /* once to get the brick into the page cache */
+        bm_pass (xl, itable, dir, 0, 0);
+
+        printf ("%-8s %-5s %12s\n", "threads", "cache", "entries/s");
+        for (i = 0; i < sizeof (threads) / sizeof (threads[0]); i++)
+                printf ("%-8d %-5s %12.0f\n", threads[i],
+                        cold ? "cold" : "warm",
+                        bm_pass (xl, itable, dir, threads[i], cold));
+
+        if (nftw (brick, bm_remove, 16, FTW_DEPTH | FTW_PHYS))
+                fprintf (stderr, "could not remove %s\n", brick);
+
+        return 0;
+}
@@ -0,0 +1,332 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* qr-admission-bm: hit ratio of the quick-read cache for lookups of small
+ * files with a skewed (zipf) popularity, alone and while a crawler looks up
+ * every file of a large tree once, with and without the admission filter
+ * and cache compression, and the files and bytes the cache ends up holding.
+ *
+ * A lookup is handled the way qr_lookup_cbk() does: a cached file is
+ * refreshed, any other file is read and offered to the cache.
+ *
+ * This is built from a configured source tree together with the sources
+ * of the quick-read xlator, see the README.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+
+#include "quick-read.h"
+#include "quick-read-mem-types.h"
+
+#define BM_CACHE_SIZE   "16MB"
+#define BM_FILE_SIZE    (16 * 1024)
+#define BM_HOT_FILES    20000
+#define BM_ZIPF         0.9
+#define BM_LOOKUPS      400000
+#define BM_SCAN_FILES   8192            /* crawled files still referenced */
+
+extern struct volume_options options[];
+extern int init (xlator_t *this);
+extern qr_inode_t *qr_inode_new (xlator_t *this, inode_t *inode);
+extern void qr_inode_access (xlator_t *this, struct iatt *buf);
+extern void qr_content_update (xlator_t *this, qr_inode_t *qr_inode,
+                               void *data, struct iatt *buf);
+extern void qr_content_refresh (xlator_t *this, qr_inode_t *qr_inode,
+                                struct iatt *buf);
+extern void __qr_inode_prune (qr_inode_t *qr_inode);
+
+static xlator_t      bm_child;
+static xlator_list_t bm_children = {&bm_child, NULL};
+
+static double       *bm_cdf;
+static char         *bm_text;
+static uint64_t      bm_gfid_seq;
+static char         *bm_words[] = {"the ", "quick ", "read ", "cache ",
+                                   "holds ", "small ", "files ", "which ",
+                                   "are ", "looked ", "up ", "often ",
+                                   "<div class=\"", "\">", "</div>\n",
+                                   "0123456789abcdef"};
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bm_zipf_init (void)
+{
+        double sum = 0;
+        int    i   = 0;
+
+        bm_cdf = calloc (BM_HOT_FILES, sizeof (*bm_cdf));
+        for (i = 0; i < BM_HOT_FILES; i++) {
+                sum += 1.0 / pow (i + 1, BM_ZIPF);
+                bm_cdf[i] = sum;
+        }
+        for (i = 0; i < BM_HOT_FILES; i++)
+                bm_cdf[i] /= sum;
+}
+
+static int
+bm_zipf (void)
+{
+        double u    = (double)random () / RAND_MAX;
+        int    low  = 0;
+        int    high = BM_HOT_FILES - 1;
+        int    mid  = 0;
+
+        while (low < high) {
+                mid = (low + high) / 2;
+                if (bm_cdf[mid] < u)
+                        low = mid + 1;
+                else
+                        high = mid;
+        }
+
+        return low;
+}
+
+/* text-like content, compresses about as well as html or source does */
+static void
+bm_text_init (void)
+{
+        char *word = NULL;
+        int   off  = 0;
+        int   len  = 0;
+
+        bm_text = malloc (2 * BM_FILE_SIZE);
+        while (off < 2 * BM_FILE_SIZE) {
+                word = bm_words[random () % 16];
+                len = min (strlen (word), (size_t)(2 * BM_FILE_SIZE - off));
+                memcpy (bm_text + off, word, len);
+                off += len;
+        }
+}
+
+static void *
+bm_content (void)
+{
+        char *data = NULL;
+
+        data = GF_MALLOC (BM_FILE_SIZE, gf_qr_mt_content_t);
+        memcpy (data, bm_text + random () % BM_FILE_SIZE, BM_FILE_SIZE);
+
+        return data;
+}
+
+/* gfids are random, but generating real ones costs more than the cache */
+static void
+bm_gfid (uuid_t gfid)
+{
+        uint64_t h = ++bm_gfid_seq * 0x9e3779b97f4a7c15ULL;
+
+        memcpy (&gfid[0], &h, sizeof (h));
+        h = (h ^ (h >> 31)) * 0xbf58476d1ce4e5b9ULL;
+        memcpy (&gfid[8], &h, sizeof (h));
+}
+
+/* returns 1 on a hit */
+static int
+bm_lookup (xlator_t *this, qr_inode_t *qr_inode, struct iatt *buf)
+{
+        qr_inode_access (this, buf);
+
+        if (qr_inode->data) {
+                qr_content_refresh (this, qr_inode, buf);
+                return 1;
+        }
+
+        qr_content_update (this, qr_inode, bm_content (), buf);
+        return 0;
+}
+
+static void
+bm_forget (qr_inode_t *qr_inode)
+{
+        if (!qr_inode)
+                return;
+
+        if (qr_inode->shard) {
+                LOCK (&qr_inode->shard->lock);
+                {
+                        __qr_inode_prune (qr_inode);
+                }
+                UNLOCK (&qr_inode->shard->lock);
+        }
+        GF_FREE (qr_inode);
+}
+
+static void
+bm_reset (qr_private_t *priv)
+{
+        qr_shard_t *shard = NULL;
+        int         i     = 0;
+
+        for (i = 0; i < QR_SHARD_COUNT; i++) {
+                shard = &priv->table.shards[i];
+                memset (shard->sketch, 0, sizeof (shard->sketch));
+                shard->samples = 0;
+                shard->admitted = 0;
+                shard->rejected = 0;
+        }
+}
+
+static void
+bm_run (xlator_t *this, const char *name, gf_boolean_t filter,
+        gf_boolean_t compression, int scan_per_hot)
+{
+        qr_private_t *priv      = this->private;
+        qr_inode_t  **hot       = NULL;
+        struct iatt  *bufs      = NULL;
+        qr_inode_t  **scan      = NULL;
+        int           next      = 0;
+        struct iatt   scan_buf  = {0, };
+        qr_shard_t   *shard     = NULL;
+        uint64_t      hits      = 0;
+        uint64_t      lookups   = 0;
+        uint64_t      start     = 0;
+        uint64_t      elapsed   = 0;
+        uint64_t      used      = 0;
+        uint64_t      saved     = 0;
+        uint32_t      files     = 0;
+        int           i         = 0;
+        int           j         = 0;
+
+        priv->conf.admission_filter = filter;
+        priv->conf.compression = compression;
+        bm_reset (priv);
+
+        hot = calloc (BM_HOT_FILES, sizeof (*hot));
+        bufs = calloc (BM_HOT_FILES, sizeof (*bufs));
+        scan = calloc (BM_SCAN_FILES, sizeof (*scan));
+        for (i = 0; i < BM_HOT_FILES; i++) {
+                hot[i] = qr_inode_new (this, NULL);
+                bm_gfid (bufs[i].ia_gfid);
+                bufs[i].ia_type = IA_IFREG;
+                bufs[i].ia_size = BM_FILE_SIZE;
+        }
+        scan_buf.ia_type = IA_IFREG;
+        scan_buf.ia_size = BM_FILE_SIZE;
+
+        /* the clients have been running for a while */
+        for (i = 0; i < BM_LOOKUPS / 4; i++) {
+                j = bm_zipf ();
+                bm_lookup (this, hot[j], &bufs[j]);
+        }
+
+        start = bm_now_ns ();
+        for (i = 0; i < BM_LOOKUPS; i++) {
+                j = bm_zipf ();
+                hits += bm_lookup (this, hot[j], &bufs[j]);
+                lookups++;
+
+                for (j = 0; j < scan_per_hot; j++) {
+                        /* every file of the crawl is seen once */
+                        bm_forget (scan[next]);
+                        scan[next] = qr_inode_new (this, NULL);
+                        bm_gfid (scan_buf.ia_gfid);
+                        bm_lookup (this, scan[next], &scan_buf);
+                        next = (next + 1) % BM_SCAN_FILES;
+                        lookups++;
+                }
+        }
+        elapsed = bm_now_ns () - start;
+
+        for (i = 0; i < QR_SHARD_COUNT; i++) {
+                shard = &priv->table.shards[i];
+                files += shard->file_count;
+                used += shard->cache_used;
+                saved += shard->bytes_saved;
+        }
+
+        printf ("%-22s %9.1f%% %12.0f %8u %9.1f %9.1f\n", name,
+                100.0 * hits / BM_LOOKUPS, lookups * 1e9 / elapsed, files,
+                used / 1048576.0, saved / 1048576.0);
+
+        for (i = 0; i < BM_HOT_FILES; i++)
+                bm_forget (hot[i]);
+        for (i = 0; i < BM_SCAN_FILES; i++)
+                bm_forget (scan[i]);
+        free (hot);
+        free (bufs);
+        free (scan);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t    *ctx     = NULL;
+        xlator_t           *qr      = NULL;
+        volume_opt_list_t  *vol_opt = NULL;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+
+        bm_child.name = "brick-bm";
+        bm_child.ctx = ctx;
+
+        qr = GF_CALLOC (1, sizeof (*qr), gf_common_mt_xlator_t);
+        qr->name = "qr-bm";
+        qr->type = "performance/quick-read";
+        qr->ctx = ctx;
+        qr->children = &bm_children;
+        qr->options = dict_new ();
+        INIT_LIST_HEAD (&qr->volume_options);
+        vol_opt = GF_CALLOC (1, sizeof (*vol_opt), gf_common_mt_char);
+        vol_opt->given_opt = options;
+        list_add_tail (&vol_opt->list, &qr->volume_options);
+
+        if (dict_set_str (qr->options, "cache-size", BM_CACHE_SIZE)) {
+                fprintf (stderr, "dict_set failed\n");
+                return 1;
+        }
+
+        THIS = qr;
+        if (init (qr)) {
+                fprintf (stderr, "cannot init quick-read\n");
+                return 1;
+        }
+
+        bm_zipf_init ();
+        bm_text_init ();
+
+        printf ("%-22s %10s %12s %8s %9s %9s\n", "workload", "hot hits",
+                "lookups/s", "files", "used MB", "saved MB");
+        bm_run (qr, "zipf", _gf_false, _gf_false, 0);
+        bm_run (qr, "zipf filter", _gf_true, _gf_false, 0);
+        bm_run (qr, "zipf+scan", _gf_false, _gf_false, 2);
+        bm_run (qr, "zipf+scan filter", _gf_true, _gf_false, 2);
+        bm_run (qr, "zipf filter compress", _gf_true, _gf_true, 0);
+        bm_run (qr, "zipf+scan both", _gf_true, _gf_true, 2);
+
+        return 0;
+}
@@ -0,0 +1,372 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* ra-streams-bm: throughput of one reader through performance/read-ahead
+ * reading a file sequentially, as several interleaved sequential streams,
+ * as small records a fixed distance apart, and at random, with the number
+ * of reads read-ahead sent to its child and what became of the bytes it
+ * read ahead.
+ *
+ * The child is a stand-in for a remote brick: it answers each read
+ * BM_LATENCY_US after the read went through a link of BM_BANDWIDTH bytes
+ * per second, so reads sent together are answered together.
+ *
+ * This is built from a configured source tree together with the sources
+ * of the read-ahead xlator, see the README.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "defaults.h"
+#include "iobuf.h"
+
+#include "read-ahead.h"
+
+#define BM_FILE_SIZE    (1024ULL * 1024 * 1024)
+#define BM_READ_SIZE    (128 * 1024)
+#define BM_LATENCY_US   1000
+#define BM_BANDWIDTH    (1024ULL * 1024 * 1024)
+
+extern struct xlator_fops fops;
+extern struct xlator_cbks cbks;
+extern struct volume_options options[];
+extern int init (xlator_t *this);
+
+struct bm_req {
+        struct list_head  list;
+        call_frame_t     *frame;
+        off_t             offset;
+        size_t            size;
+        uint64_t          deadline;
+};
+
+static glusterfs_graph_t bm_graph = {.xl_count = 1};
+static xlator_t          bm_child;
+static xlator_list_t     bm_children = {&bm_child, NULL};
+static struct list_head  bm_queue;
+static pthread_mutex_t   bm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    bm_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t          bm_link_free;
+static uint64_t          bm_child_reads;
+static uint64_t          bm_child_bytes;
+static struct iobuf     *bm_iobuf;
+static struct iobref    *bm_iobref;
+static int               bm_done;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+bm_child_open (call_frame_t *frame, xlator_t *this, loc_t *loc,
+               int32_t flags, fd_t *fd, dict_t *xdata)
+{
+        STACK_UNWIND_STRICT (open, frame, 0, 0, fd, NULL);
+        return 0;
+}
+
+static int
+bm_child_readv (call_frame_t *frame, xlator_t *this, fd_t *fd, size_t size,
+                off_t offset, uint32_t flags, dict_t *xdata)
+{
+        struct bm_req *req = NULL;
+        uint64_t       now = 0;
+
+        req = GF_CALLOC (1, sizeof (*req), gf_common_mt_char);
+        req->frame = frame;
+        req->offset = offset;
+        req->size = size;
+
+        now = bm_now_ns ();
+        pthread_mutex_lock (&bm_lock);
+        {
+                bm_link_free = max (bm_link_free, now)
+                               + size * 1000000000ULL / BM_BANDWIDTH;
+                req->deadline = bm_link_free + BM_LATENCY_US * 1000ULL;
+                bm_child_reads++;
+                bm_child_bytes += size;
+                list_add_tail (&req->list, &bm_queue);
+                pthread_cond_broadcast (&bm_cond);
+        }
+        pthread_mutex_unlock (&bm_lock);
+
+        return 0;
+}
+
+static struct xlator_fops bm_child_fops = {
+        .open  = bm_child_open,
+        .readv = bm_child_readv,
+};
+
+static struct xlator_cbks bm_child_cbks;
+
+/* answers the reads in the order they were sent, each at its deadline */
+static void *
+bm_child_thread (void *arg)
+{
+        struct bm_req *req   = NULL;
+        struct iovec   iov   = {0, };
+        struct iatt    stbuf = {0, };
+        uint64_t       now   = 0;
+
+        stbuf.ia_size = BM_FILE_SIZE;
+
+        for (;;) {
+                pthread_mutex_lock (&bm_lock);
+                {
+                        while (list_empty (&bm_queue))
+                                pthread_cond_wait (&bm_cond, &bm_lock);
+                        req = list_first_entry (&bm_queue, struct bm_req,
+                                                list);
+                        list_del (&req->list);
+                }
+                pthread_mutex_unlock (&bm_lock);
+
+                now = bm_now_ns ();
+                if (req->deadline > now)
+                        usleep ((req->deadline - now) / 1000);
+
+                iov.iov_base = bm_iobuf->ptr;
+                iov.iov_len = 0;
+                if (req->offset < BM_FILE_SIZE)
+                        iov.iov_len = min (req->size,
+                                           BM_FILE_SIZE - req->offset);
+
+                STACK_UNWIND_STRICT (readv, req->frame, iov.iov_len, 0, &iov,
+                                     1, &stbuf, bm_iobref, NULL);
+                GF_FREE (req);
+        }
+
+        return NULL;
+}
+
+static int
+bm_open_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+             int32_t op_ret, int32_t op_errno, fd_t *fd, dict_t *xdata)
+{
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+static int
+bm_readv_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+              int32_t op_ret, int32_t op_errno, struct iovec *vector,
+              int32_t count, struct iatt *stbuf, struct iobref *iobref,
+              dict_t *xdata)
+{
+        STACK_DESTROY (frame->root);
+
+        if (op_ret < 0) {
+                fprintf (stderr, "readv failed: %s\n", strerror (op_errno));
+                exit (1);
+        }
+
+        pthread_mutex_lock (&bm_lock);
+        {
+                bm_done = 1;
+                pthread_cond_broadcast (&bm_cond);
+        }
+        pthread_mutex_unlock (&bm_lock);
+
+        return 0;
+}
+
+static void
+bm_read (xlator_t *ra, fd_t *fd, off_t offset, size_t size)
+{
+        call_frame_t *frame = NULL;
+
+        frame = create_frame (ra, ra->ctx->pool);
+        if (!frame) {
+                fprintf (stderr, "create_frame failed\n");
+                exit (1);
+        }
+
+        bm_done = 0;
+        STACK_WIND (frame, bm_readv_cbk, ra, ra->fops->readv, fd, size,
+                    offset, 0, NULL);
+
+        pthread_mutex_lock (&bm_lock);
+        {
+                while (!bm_done)
+                        pthread_cond_wait (&bm_cond, &bm_lock);
+        }
+        pthread_mutex_unlock (&bm_lock);
+}
+
+static fd_t *
+bm_open (xlator_t *ra, inode_table_t *itable)
+{
+        call_frame_t *frame = NULL;
+        loc_t         loc   = {0, };
+        fd_t         *fd    = NULL;
+
+        loc.inode = inode_new (itable);
+        fd = fd_create (loc.inode, 0);
+        fd->flags = O_RDONLY;
+
+        frame = create_frame (ra, ra->ctx->pool);
+        STACK_WIND (frame, bm_open_cbk, ra, ra->fops->open, &loc, O_RDONLY,
+                    fd, NULL);
+        loc_wipe (&loc);
+
+        return fd;
+}
+
+/* @streams interleaved readers of @size bytes, @step bytes apart */
+static void
+bm_run (xlator_t *ra, inode_table_t *itable, const char *name, int streams,
+        size_t size, off_t step, int reads)
+{
+        ra_conf_t *conf     = ra->private;
+        fd_t      *fd       = NULL;
+        off_t      offset   = 0;
+        uint64_t   reads0   = 0;
+        uint64_t   bytes0   = 0;
+        int64_t    prefetched = 0;
+        int64_t    consumed = 0;
+        int64_t    wasted   = 0;
+        uint64_t   start    = 0;
+        uint64_t   elapsed  = 0;
+        int        i        = 0;
+
+        fd = bm_open (ra, itable);
+
+        pthread_mutex_lock (&bm_lock);
+        {
+                reads0 = bm_child_reads;
+                bytes0 = bm_child_bytes;
+        }
+        pthread_mutex_unlock (&bm_lock);
+        prefetched = GF_ATOMIC_GET (conf->prefetched);
+        consumed = GF_ATOMIC_GET (conf->consumed);
+        wasted = GF_ATOMIC_GET (conf->wasted);
+
+        start = bm_now_ns ();
+        for (i = 0; i < reads; i++) {
+                if (step)
+                        offset = (i % streams) * (BM_FILE_SIZE / streams)
+                                 + (i / streams) * step;
+                else
+                        offset = (random () % (BM_FILE_SIZE / size)) * size;
+                bm_read (ra, fd, offset, size);
+        }
+        elapsed = bm_now_ns () - start;
+
+        /* the last pages read ahead are dropped with the fd */
+        ra->cbks->release (ra, fd);
+
+        pthread_mutex_lock (&bm_lock);
+        {
+                printf ("%-10s %9.1f %9"PRIu64" %9.1f %9.1f %9.1f %9.1f\n",
+                        name, (double)reads * size * 1e9 / elapsed
+                              / (1024 * 1024),
+                        bm_child_reads - reads0,
+                        (double)(bm_child_bytes - bytes0) / (reads * size),
+                        (GF_ATOMIC_GET (conf->prefetched) - prefetched)
+                        / (1024.0 * 1024),
+                        (GF_ATOMIC_GET (conf->consumed) - consumed)
+                        / (1024.0 * 1024),
+                        (GF_ATOMIC_GET (conf->wasted) - wasted)
+                        / (1024.0 * 1024));
+        }
+        pthread_mutex_unlock (&bm_lock);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t    *ctx    = NULL;
+        xlator_t           *ra     = NULL;
+        inode_table_t      *itable = NULL;
+        volume_opt_list_t  *vol_opt = NULL;
+        pthread_t           thread;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+        ctx->iobuf_pool = iobuf_pool_new ();
+        ctx->page_size = 128 * 1024;
+
+        bm_iobuf = iobuf_get2 (ctx->iobuf_pool, RA_MAX_IO_SIZE);
+        bm_iobref = iobref_new ();
+        iobref_add (bm_iobref, bm_iobuf);
+        memset (bm_iobuf->ptr, 0, RA_MAX_IO_SIZE);
+
+        bm_child.name = "brick-bm";
+        bm_child.ctx = ctx;
+        bm_child.fops = &bm_child_fops;
+        bm_child.cbks = &bm_child_cbks;
+
+        INIT_LIST_HEAD (&bm_queue);
+        pthread_create (&thread, NULL, bm_child_thread, NULL);
+
+        ra = GF_CALLOC (1, sizeof (*ra), gf_common_mt_xlator_t);
+        ra->name = "ra-bm";
+        ra->type = "performance/read-ahead";
+        ra->ctx = ctx;
+        ra->graph = &bm_graph;
+        ra->children = &bm_children;
+        ra->options = dict_new ();
+        ra->fops = &fops;
+        ra->cbks = &cbks;
+        INIT_LIST_HEAD (&ra->volume_options);
+        vol_opt = GF_CALLOC (1, sizeof (*vol_opt), gf_common_mt_char);
+        vol_opt->given_opt = options;
+        list_add_tail (&vol_opt->list, &ra->volume_options);
+
+        if (argc > 1 && dict_set_str (ra->options, "page-count", argv[1])) {
+                fprintf (stderr, "dict_set failed\n");
+                return 1;
+        }
+
+        THIS = ra;
+        if (init (ra)) {
+                fprintf (stderr, "cannot init read-ahead\n");
+                return 1;
+        }
+        itable = inode_table_new (16, ra);
+
+        printf ("%-10s %9s %9s %9s %9s %9s %9s\n", "workload", "MB/s",
+                "reads", "read x", "ahead MB", "used MB", "waste MB");
+        bm_run (ra, itable, "seq", 1, BM_READ_SIZE, BM_READ_SIZE, 2048);
+        bm_run (ra, itable, "seq x4", 4, BM_READ_SIZE, BM_READ_SIZE, 2048);
+        bm_run (ra, itable, "stride", 1, 4096, 64 * 1024, 2048);
+        bm_run (ra, itable, "random", 1, BM_READ_SIZE, 0, 1024);
+
+        return 0;
+}
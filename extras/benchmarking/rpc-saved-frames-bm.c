@@ -0,0 +1,140 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* rpc-saved-frames-bm: measures the cost of matching a reply to its saved
+ * frame (__saved_frame_get) with 64, 1k and 16k requests outstanding on a
+ * single rpc-clnt connection. Replies are consumed both in submission order
+ * and in random order, with a new request submitted for every reply so the
+ * queue depth stays constant.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "mem-pool.h"
+#include "rpc-clnt.h"
+
+#define BM_ITERATIONS   (1 << 20)
+
+/* not exported through rpc-clnt.h */
+struct saved_frames *saved_frames_new (void);
+struct saved_frame *__saved_frames_put (struct saved_frames *frames,
+                                        void *frame, struct rpc_req *rpcreq);
+struct saved_frame *__saved_frame_get (struct saved_frames *frames,
+                                       int64_t callid);
+
+static rpc_clnt_prog_t bm_prog = {
+        .progname = "rpc-saved-frames-bm",
+};
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bm_run (struct rpc_clnt *clnt, int depth, gf_boolean_t random_order)
+{
+        struct saved_frames *frames  = NULL;
+        struct rpc_req      *reqs    = NULL;
+        struct saved_frame  *sframe  = NULL;
+        uint32_t             next    = 0;
+        uint64_t             start   = 0;
+        uint64_t             elapsed = 0;
+        int                  slot    = 0;
+        int                  i       = 0;
+
+        frames = saved_frames_new ();
+        reqs = calloc (depth, sizeof (*reqs));
+        if (!frames || !reqs) {
+                fprintf (stderr, "allocation failed\n");
+                exit (1);
+        }
+
+        for (i = 0; i < depth; i++) {
+                reqs[i].conn = &clnt->conn;
+                reqs[i].prog = &bm_prog;
+                reqs[i].xid = next++;
+                __saved_frames_put (frames, NULL, &reqs[i]);
+        }
+
+        start = bm_now_ns ();
+        for (i = 0; i < BM_ITERATIONS; i++) {
+                if (random_order)
+                        slot = random () % depth;
+                else
+                        slot = i % depth;
+
+                sframe = __saved_frame_get (frames, reqs[slot].xid);
+                if (!sframe) {
+                        fprintf (stderr, "xid %u not found\n",
+                                 reqs[slot].xid);
+                        exit (1);
+                }
+                mem_put (sframe);
+
+                reqs[slot].xid = next++;
+                __saved_frames_put (frames, NULL, &reqs[slot]);
+        }
+        elapsed = bm_now_ns () - start;
+
+        printf ("%-8d %-10s %10.1f ns/reply\n", depth,
+                random_order ? "random" : "in-order",
+                (double)elapsed / BM_ITERATIONS);
+
+        /* nothing to unwind, the fake requests carry no call frame */
+        for (i = 0; i < depth; i++)
+                mem_put (__saved_frame_get (frames, reqs[i].xid));
+        GF_FREE (frames->hash);
+        GF_FREE (frames);
+        free (reqs);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx    = NULL;
+        struct rpc_clnt  clnt   = {0, };
+        int              depths[] = {64, 1024, 16384};
+        int              i      = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        clnt.conn.rpc_clnt = &clnt;
+        clnt.saved_frames_pool = mem_pool_new (struct saved_frame, 32768);
+        if (!clnt.saved_frames_pool) {
+                fprintf (stderr, "failed to create saved frames pool\n");
+                return 1;
+        }
+
+        printf ("%-8s %-10s %s\n", "depth", "order", "reply dispatch");
+        for (i = 0; i < sizeof (depths) / sizeof (depths[0]); i++) {
+                bm_run (&clnt, depths[i], _gf_false);
+                bm_run (&clnt, depths[i], _gf_true);
+        }
+
+        mem_pool_destroy (clnt.saved_frames_pool);
+        return 0;
+}
@@ -0,0 +1,399 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* rpcsvc-fair-bm: round-trip latency of a client sending one call at a
+ * time while another client keeps BM_NOISY_DEPTH calls with a
+ * BM_NOISY_SIZE payload in flight, with the actors run on the event thread
+ * and with rpc.dispatch-threads workers fed in deficit round-robin order.
+ * Each call costs the actor BM_WORK_NS of spinning. Both clients live in
+ * the same process and talk over loopback.
+ *
+ * rpc-transport/socket is loaded from RPC_TRANSPORTDIR.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "event.h"
+#include "iobuf.h"
+#include "rpcsvc.h"
+#include "rpc-clnt.h"
+
+#define BM_PORT                 24991
+#define BM_PROGRAM              1298439
+#define BM_VERSION              1
+#define BM_ECHO                 1
+
+#define BM_NOISY_DEPTH          64
+#define BM_NOISY_SIZE           (16 * 1024)
+#define BM_QUIET_CALLS          2000
+#define BM_WORK_NS              20000
+
+struct bm_client {
+        struct rpc_clnt *rpc;
+        xlator_t        *xl;
+        int              noisy;
+        int              stop;
+        int              inflight;
+        int              failed;
+        int              connected;
+        uint64_t         sent;          /* quiet: time of the last call */
+        uint64_t        *lat;
+        int              done;
+        pthread_mutex_t  lock;
+        pthread_cond_t   cond;
+};
+
+static uint32_t bm_hdr;
+static char     bm_payload[BM_NOISY_SIZE];
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+bm_echo (rpcsvc_request_t *req)
+{
+        struct iovec hdr   = {0, };
+        uint64_t     start = bm_now_ns ();
+
+        while (bm_now_ns () - start < BM_WORK_NS)
+                ;
+
+        hdr.iov_base = &bm_hdr;
+        hdr.iov_len = sizeof (bm_hdr);
+
+        return rpcsvc_submit_generic (req, &hdr, 1, NULL, 0, NULL);
+}
+
+static rpcsvc_actor_t bm_actors[] = {
+        [BM_ECHO] = {"ECHO", BM_ECHO, bm_echo, NULL, 0, DRC_NA},
+};
+
+static rpcsvc_program_t bm_program = {
+        .progname  = "rpcsvc-fair-bm",
+        .prognum   = BM_PROGRAM,
+        .progver   = BM_VERSION,
+        .numactors = BM_ECHO + 1,
+        .actors    = bm_actors,
+};
+
+static char *bm_procnames[] = {"NULL", "ECHO"};
+
+static rpc_clnt_prog_t bm_clnt_program = {
+        .progname  = "rpcsvc-fair-bm",
+        .prognum   = BM_PROGRAM,
+        .progver   = BM_VERSION,
+        .procnames = bm_procnames,
+        .numproc   = BM_ECHO + 1,
+};
+
+static int bm_call (struct bm_client *clnt);
+
+static int
+bm_echo_cbk (struct rpc_req *req, struct iovec *iov, int count, void *myframe)
+{
+        call_frame_t     *frame = myframe;
+        struct bm_client *clnt  = frame->local;
+        uint64_t          now   = bm_now_ns ();
+        int               again = 0;
+
+        frame->local = NULL;
+        STACK_DESTROY (frame->root);
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                if (req->rpc_status == -1)
+                        clnt->failed++;
+                if (!clnt->noisy)
+                        clnt->lat[clnt->done++] = now - clnt->sent;
+                if (!clnt->stop && !clnt->failed &&
+                    (clnt->noisy || clnt->done < BM_QUIET_CALLS)) {
+                        again = 1;
+                } else {
+                        clnt->inflight--;
+                        pthread_cond_signal (&clnt->cond);
+                }
+        }
+        pthread_mutex_unlock (&clnt->lock);
+
+        if (again)
+                bm_call (clnt);
+
+        return 0;
+}
+
+static int
+bm_call (struct bm_client *clnt)
+{
+        call_frame_t    *frame   = NULL;
+        struct iovec     hdr     = {0, };
+        struct iovec     payload = {0, };
+        struct iobref   *iobref  = NULL;
+        int              ret     = -1;
+
+        frame = create_frame (clnt->xl, clnt->xl->ctx->pool);
+        if (!frame)
+                goto out;
+        frame->local = clnt;
+
+        hdr.iov_base = &bm_hdr;
+        hdr.iov_len = sizeof (bm_hdr);
+        payload.iov_base = bm_payload;
+        payload.iov_len = sizeof (bm_payload);
+
+        if (clnt->noisy)
+                iobref = iobref_new ();
+        else
+                clnt->sent = bm_now_ns ();
+
+        ret = rpc_clnt_submit (clnt->rpc, &bm_clnt_program, BM_ECHO,
+                               bm_echo_cbk, &hdr, 1, clnt->noisy ? &payload
+                               : NULL, clnt->noisy ? 1 : 0, iobref, frame,
+                               NULL, 0, NULL, 0, NULL);
+        if (iobref)
+                iobref_unref (iobref);
+out:
+        if (ret) {
+                pthread_mutex_lock (&clnt->lock);
+                {
+                        clnt->failed++;
+                        clnt->inflight--;
+                        pthread_cond_signal (&clnt->cond);
+                }
+                pthread_mutex_unlock (&clnt->lock);
+        }
+        return ret;
+}
+
+static int
+bm_notify (struct rpc_clnt *rpc, void *mydata, rpc_clnt_event_t event,
+           void *data)
+{
+        struct bm_client *clnt = mydata;
+
+        /* no handshake program, so the connection is usable right away */
+        if (event == RPC_CLNT_CONNECT)
+                rpc_clnt_set_connected (&rpc->conn);
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                if (event == RPC_CLNT_CONNECT)
+                        clnt->connected = 1;
+                else if (event == RPC_CLNT_DISCONNECT)
+                        clnt->connected = 0;
+                pthread_cond_signal (&clnt->cond);
+        }
+        pthread_mutex_unlock (&clnt->lock);
+
+        return 0;
+}
+
+static void
+bm_wait (struct bm_client *clnt)
+{
+        pthread_mutex_lock (&clnt->lock);
+        {
+                while (clnt->inflight > 0)
+                        pthread_cond_wait (&clnt->cond, &clnt->lock);
+        }
+        pthread_mutex_unlock (&clnt->lock);
+}
+
+static int
+bm_cmp (const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *)a;
+        uint64_t y = *(const uint64_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+static void
+bm_run (rpcsvc_t *svc, struct bm_client *noisy, struct bm_client *quiet,
+        int threads)
+{
+        dict_t   *options = dict_new ();
+        uint64_t  total = 0;
+        int       i = 0;
+
+        if (dict_set_int32 (options, "rpc.dispatch-threads", threads) ||
+            rpcsvc_set_dispatch_threads (svc, options)) {
+                fprintf (stderr, "cannot start %d dispatch threads\n",
+                         threads);
+                exit (1);
+        }
+        dict_unref (options);
+
+        noisy->stop = 0;
+        noisy->failed = 0;
+        noisy->inflight = BM_NOISY_DEPTH;
+        for (i = 0; i < BM_NOISY_DEPTH; i++)
+                bm_call (noisy);
+
+        quiet->stop = 0;
+        quiet->failed = 0;
+        quiet->done = 0;
+        quiet->inflight = 1;
+        bm_call (quiet);
+        bm_wait (quiet);
+
+        pthread_mutex_lock (&noisy->lock);
+        noisy->stop = 1;
+        pthread_mutex_unlock (&noisy->lock);
+        bm_wait (noisy);
+
+        if (noisy->failed || quiet->failed) {
+                fprintf (stderr, "%d threads: %d calls failed\n", threads,
+                         noisy->failed + quiet->failed);
+                exit (1);
+        }
+
+        qsort (quiet->lat, quiet->done, sizeof (*quiet->lat), bm_cmp);
+        for (i = 0; i < quiet->done; i++)
+                total += quiet->lat[i];
+
+        printf ("%7d %12.1f %12.1f %12.1f\n", threads,
+                total / 1e3 / quiet->done,
+                quiet->lat[quiet->done / 2] / 1e3,
+                quiet->lat[quiet->done * 99 / 100] / 1e3);
+}
+
+static void *
+bm_poller (void *data)
+{
+        event_dispatch (data);
+        return NULL;
+}
+
+static int
+bm_connect (struct bm_client *clnt, xlator_t *xl, int noisy)
+{
+        dict_t *options = NULL;
+
+        clnt->xl = xl;
+        clnt->noisy = noisy;
+        clnt->lat = calloc (BM_QUIET_CALLS, sizeof (*clnt->lat));
+        pthread_mutex_init (&clnt->lock, NULL);
+        pthread_cond_init (&clnt->cond, NULL);
+
+        options = dict_new ();
+        if (dict_set_str (options, "transport-type", "socket") ||
+            dict_set_str (options, "transport.address-family", "inet") ||
+            dict_set_str (options, "remote-host", "127.0.0.1") ||
+            dict_set_int32 (options, "remote-port", BM_PORT) ||
+            dict_set_int32 (options, "ping-timeout", 0))
+                return -1;
+
+        clnt->rpc = rpc_clnt_new (options, xl, noisy ? "noisy" : "quiet", 0);
+        if (!clnt->rpc ||
+            rpc_clnt_register_notify (clnt->rpc, bm_notify, clnt) ||
+            rpc_clnt_start (clnt->rpc))
+                return -1;
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                while (!clnt->connected)
+                        pthread_cond_wait (&clnt->cond, &clnt->lock);
+        }
+        pthread_mutex_unlock (&clnt->lock);
+
+        return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t  *ctx = NULL;
+        xlator_t         *xl = NULL;
+        rpcsvc_t         *svc = NULL;
+        dict_t           *options = NULL;
+        struct bm_client  noisy = {0, };
+        struct bm_client  quiet = {0, };
+        pthread_t         poller;
+        int               threads = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+        ctx->iobuf_pool = iobuf_pool_new ();
+        /* one event thread, so that the server side cannot simply spread
+         * the two connections over two pollers */
+        ctx->event_pool = event_pool_new (16384, 1);
+        if (!ctx->event_pool) {
+                fprintf (stderr, "cannot create event pool\n");
+                return 1;
+        }
+
+        xl = GF_CALLOC (1, sizeof (*xl), gf_common_mt_xlator_t);
+        xl->name = "rpcsvc-fair-bm";
+        xl->ctx = ctx;
+        xl->options = dict_new ();
+        INIT_LIST_HEAD (&xl->volume_options);
+        THIS = xl;
+
+        svc = rpcsvc_init (xl, ctx, dict_new (), 0);
+        if (!svc || rpcsvc_program_register (svc, &bm_program, _gf_false)) {
+                fprintf (stderr, "cannot start rpc service\n");
+                return 1;
+        }
+
+        options = dict_new ();
+        if (dict_set_str (options, "transport-type", "socket") ||
+            dict_set_str (options, "transport.address-family", "inet") ||
+            dict_set_int32 (options, "transport.socket.listen-port",
+                            BM_PORT) ||
+            dict_set_str (options, "transport.socket.bind-address",
+                          "127.0.0.1") ||
+            rpcsvc_create_listeners (svc, options, "fair") <= 0) {
+                fprintf (stderr, "cannot listen on port %d\n", BM_PORT);
+                return 1;
+        }
+
+        pthread_create (&poller, NULL, bm_poller, ctx->event_pool);
+
+        if (bm_connect (&noisy, xl, 1) || bm_connect (&quiet, xl, 0)) {
+                fprintf (stderr, "cannot connect to port %d\n", BM_PORT);
+                return 1;
+        }
+
+        printf ("%7s %12s %12s %12s\n", "threads", "avg-us", "p50-us",
+                "p99-us");
+        for (threads = 0; threads <= 4; threads = threads ? threads * 2 : 1)
+                bm_run (svc, &noisy, &quiet, threads);
+
+        return 0;
+}
@@ -0,0 +1,389 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* socket-ioq-bm: replies per second that 1 to BM_MAX_PRODUCERS threads
+ * get out over one connection, the way io-threads answer a busy client.
+ * The rpcsvc actor hands each call to one of the producers, round-robin,
+ * and the producer submits the reply. An rpc-clnt in the same process
+ * keeps BM_DEPTH calls in flight over loopback.
+ *
+ * rpc-transport/socket is loaded from RPC_TRANSPORTDIR.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "event.h"
+#include "iobuf.h"
+#include "list.h"
+#include "rpcsvc.h"
+#include "rpc-clnt.h"
+
+#define BM_PORT                 24990
+#define BM_PROGRAM              1298438
+#define BM_VERSION              1
+#define BM_ECHO                 1
+
+#define BM_MAX_PRODUCERS        64
+#define BM_DEPTH                256
+#define BM_CALLS                100000
+
+struct bm_producer {
+        pthread_t         thread;
+        pthread_mutex_t   lock;
+        pthread_cond_t    cond;
+        struct list_head  reqs;
+};
+
+struct bm_req {
+        struct list_head  list;
+        rpcsvc_request_t *req;
+};
+
+struct bm_client {
+        struct rpc_clnt *rpc;
+        xlator_t        *xl;
+        int              calls;         /* still to be sent */
+        int              inflight;
+        int              failed;
+        int              connected;
+        pthread_mutex_t  lock;
+        pthread_cond_t   cond;
+};
+
+static struct bm_producer bm_producers[BM_MAX_PRODUCERS];
+static int                bm_active;    /* producers in use */
+static int                bm_next;
+static uint32_t           bm_reply_hdr;
+static uint32_t           bm_call_hdr;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *
+bm_producer (void *data)
+{
+        struct bm_producer *p = data;
+        struct bm_req      *r = NULL;
+        struct iovec        hdr = {0, };
+
+        hdr.iov_base = &bm_reply_hdr;
+        hdr.iov_len = sizeof (bm_reply_hdr);
+
+        for (;;) {
+                pthread_mutex_lock (&p->lock);
+                {
+                        while (list_empty (&p->reqs))
+                                pthread_cond_wait (&p->cond, &p->lock);
+                        r = list_entry (p->reqs.next, struct bm_req, list);
+                        list_del (&r->list);
+                }
+                pthread_mutex_unlock (&p->lock);
+
+                rpcsvc_submit_generic (r->req, &hdr, 1, NULL, 0, NULL);
+                GF_FREE (r);
+        }
+
+        return NULL;
+}
+
+static int
+bm_echo (rpcsvc_request_t *req)
+{
+        struct bm_producer *p = NULL;
+        struct bm_req      *r = NULL;
+
+        r = GF_CALLOC (1, sizeof (*r), gf_common_mt_char);
+        if (!r)
+                return -1;
+        r->req = req;
+
+        /* only the poller thread gets here */
+        p = &bm_producers[bm_next++ % bm_active];
+
+        pthread_mutex_lock (&p->lock);
+        {
+                list_add_tail (&r->list, &p->reqs);
+                pthread_cond_signal (&p->cond);
+        }
+        pthread_mutex_unlock (&p->lock);
+
+        return 0;
+}
+
+static rpcsvc_actor_t bm_actors[] = {
+        [BM_ECHO] = {"ECHO", BM_ECHO, bm_echo, NULL, 0, DRC_NA},
+};
+
+static rpcsvc_program_t bm_program = {
+        .progname  = "socket-ioq-bm",
+        .prognum   = BM_PROGRAM,
+        .progver   = BM_VERSION,
+        .numactors = BM_ECHO + 1,
+        .actors    = bm_actors,
+};
+
+static char *bm_procnames[] = {"NULL", "ECHO"};
+
+static rpc_clnt_prog_t bm_clnt_program = {
+        .progname  = "socket-ioq-bm",
+        .prognum   = BM_PROGRAM,
+        .progver   = BM_VERSION,
+        .procnames = bm_procnames,
+        .numproc   = BM_ECHO + 1,
+};
+
+static int bm_call (struct bm_client *clnt);
+
+static int
+bm_echo_cbk (struct rpc_req *req, struct iovec *iov, int count, void *myframe)
+{
+        call_frame_t     *frame = myframe;
+        struct bm_client *clnt  = frame->local;
+        int               again = 0;
+
+        frame->local = NULL;
+        STACK_DESTROY (frame->root);
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                if (req->rpc_status == -1 ||
+                    iov_length (iov, count) != sizeof (bm_reply_hdr))
+                        clnt->failed++;
+                if (clnt->calls > 0 && !clnt->failed) {
+                        clnt->calls--;
+                        again = 1;
+                } else {
+                        clnt->inflight--;
+                        pthread_cond_signal (&clnt->cond);
+                }
+        }
+        pthread_mutex_unlock (&clnt->lock);
+
+        if (again)
+                bm_call (clnt);
+
+        return 0;
+}
+
+static int
+bm_call (struct bm_client *clnt)
+{
+        call_frame_t    *frame = NULL;
+        struct iovec     hdr   = {0, };
+        int              ret   = -1;
+
+        frame = create_frame (clnt->xl, clnt->xl->ctx->pool);
+        if (!frame)
+                goto out;
+        frame->local = clnt;
+
+        hdr.iov_base = &bm_call_hdr;
+        hdr.iov_len = sizeof (bm_call_hdr);
+
+        ret = rpc_clnt_submit (clnt->rpc, &bm_clnt_program, BM_ECHO,
+                               bm_echo_cbk, &hdr, 1, NULL, 0, NULL, frame,
+                               NULL, 0, NULL, 0, NULL);
+out:
+        if (ret) {
+                pthread_mutex_lock (&clnt->lock);
+                {
+                        clnt->failed++;
+                        clnt->inflight--;
+                        pthread_cond_signal (&clnt->cond);
+                }
+                pthread_mutex_unlock (&clnt->lock);
+        }
+        return ret;
+}
+
+static int
+bm_notify (struct rpc_clnt *rpc, void *mydata, rpc_clnt_event_t event,
+           void *data)
+{
+        struct bm_client *clnt = mydata;
+
+        /* no handshake program, so the connection is usable right away */
+        if (event == RPC_CLNT_CONNECT)
+                rpc_clnt_set_connected (&rpc->conn);
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                if (event == RPC_CLNT_CONNECT)
+                        clnt->connected = 1;
+                else if (event == RPC_CLNT_DISCONNECT)
+                        clnt->connected = 0;
+                pthread_cond_signal (&clnt->cond);
+        }
+        pthread_mutex_unlock (&clnt->lock);
+
+        return 0;
+}
+
+static void
+bm_run (struct bm_client *clnt, int producers)
+{
+        uint64_t start = 0;
+        uint64_t elapsed = 0;
+        int      i = 0;
+
+        bm_active = producers;
+        clnt->calls = BM_CALLS - BM_DEPTH;
+        clnt->inflight = BM_DEPTH;
+        clnt->failed = 0;
+
+        start = bm_now_ns ();
+        for (i = 0; i < BM_DEPTH; i++)
+                bm_call (clnt);
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                while (clnt->inflight > 0)
+                        pthread_cond_wait (&clnt->cond, &clnt->lock);
+        }
+        pthread_mutex_unlock (&clnt->lock);
+        elapsed = bm_now_ns () - start;
+
+        if (clnt->failed) {
+                fprintf (stderr, "%d producers: %d calls failed\n", producers,
+                         clnt->failed);
+                exit (1);
+        }
+
+        printf ("%9d %12.0f\n", producers,
+                (double)BM_CALLS * 1e9 / elapsed);
+}
+
+static void *
+bm_poller (void *data)
+{
+        event_dispatch (data);
+        return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t  *ctx = NULL;
+        xlator_t         *xl = NULL;
+        rpcsvc_t         *svc = NULL;
+        dict_t           *options = NULL;
+        struct bm_client  clnt = {0, };
+        pthread_t         poller;
+        int               producers = 0;
+        int               i = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+        ctx->iobuf_pool = iobuf_pool_new ();
+        ctx->event_pool = event_pool_new (16384, 2);
+        if (!ctx->event_pool) {
+                fprintf (stderr, "cannot create event pool\n");
+                return 1;
+        }
+
+        xl = GF_CALLOC (1, sizeof (*xl), gf_common_mt_xlator_t);
+        xl->name = "socket-ioq-bm";
+        xl->ctx = ctx;
+        xl->options = dict_new ();
+        INIT_LIST_HEAD (&xl->volume_options);
+        THIS = xl;
+
+        for (i = 0; i < BM_MAX_PRODUCERS; i++) {
+                pthread_mutex_init (&bm_producers[i].lock, NULL);
+                pthread_cond_init (&bm_producers[i].cond, NULL);
+                INIT_LIST_HEAD (&bm_producers[i].reqs);
+                pthread_create (&bm_producers[i].thread, NULL, bm_producer,
+                                &bm_producers[i]);
+        }
+
+        svc = rpcsvc_init (xl, ctx, dict_new (), 0);
+        if (!svc || rpcsvc_program_register (svc, &bm_program, _gf_false)) {
+                fprintf (stderr, "cannot start rpc service\n");
+                return 1;
+        }
+
+        options = dict_new ();
+        if (dict_set_str (options, "transport-type", "socket") ||
+            dict_set_str (options, "transport.address-family", "inet") ||
+            dict_set_int32 (options, "transport.socket.listen-port",
+                            BM_PORT) ||
+            dict_set_str (options, "transport.socket.bind-address",
+                          "127.0.0.1") ||
+            rpcsvc_create_listeners (svc, options, "ioq") <= 0) {
+                fprintf (stderr, "cannot listen on port %d\n", BM_PORT);
+                return 1;
+        }
+
+        pthread_create (&poller, NULL, bm_poller, ctx->event_pool);
+
+        clnt.xl = xl;
+        pthread_mutex_init (&clnt.lock, NULL);
+        pthread_cond_init (&clnt.cond, NULL);
+
+        options = dict_new ();
+        if (dict_set_str (options, "transport-type", "socket") ||
+            dict_set_str (options, "transport.address-family", "inet") ||
+            dict_set_str (options, "remote-host", "127.0.0.1") ||
+            dict_set_int32 (options, "remote-port", BM_PORT) ||
+            dict_set_int32 (options, "ping-timeout", 0)) {
+                fprintf (stderr, "dict_set failed\n");
+                return 1;
+        }
+
+        clnt.rpc = rpc_clnt_new (options, xl, "ioq", 0);
+        if (!clnt.rpc ||
+            rpc_clnt_register_notify (clnt.rpc, bm_notify, &clnt) ||
+            rpc_clnt_start (clnt.rpc)) {
+                fprintf (stderr, "cannot connect to port %d\n", BM_PORT);
+                return 1;
+        }
+
+        pthread_mutex_lock (&clnt.lock);
+        {
+                while (!clnt.connected)
+                        pthread_cond_wait (&clnt.cond, &clnt.lock);
+        }
+        pthread_mutex_unlock (&clnt.lock);
+
+        printf ("%9s %12s\n", "producers", "replies/s");
+        for (producers = 1; producers <= BM_MAX_PRODUCERS; producers *= 2)
+                bm_run (&clnt, producers);
+
+        return 0;
+}
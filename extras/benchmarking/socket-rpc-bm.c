@@ -0,0 +1,423 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* socket-rpc-bm: RPCs per second between an rpc-clnt and an rpcsvc in the
+ * same process, over loopback. One job keeps BM_SMALL_DEPTH calls with
+ * empty replies in flight, the way a metadata heavy client does, the other
+ * BM_LARGE_DEPTH calls that each return a BM_LARGE_SIZE payload, the way
+ * reads do. Each job is run once per set of transport.socket options
+ * below, all of which are off by default.
+ *
+ * rpc-transport/socket is loaded from RPC_TRANSPORTDIR.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "event.h"
+#include "iobuf.h"
+#include "rpcsvc.h"
+#include "rpc-clnt.h"
+
+#define BM_PORT         24999
+#define BM_PROGRAM      1298437
+#define BM_VERSION      1
+#define BM_ECHO         1
+
+#define BM_SMALL_DEPTH  64
+#define BM_SMALL_CALLS  100000
+#define BM_LARGE_DEPTH  8
+#define BM_LARGE_CALLS  20000
+#define BM_LARGE_SIZE   (128 * 1024)
+
+struct bm_mode {
+        const char *name;
+        const char *coalesce;
+        const char *zerocopy;
+        const char *ring;
+};
+
+static struct bm_mode bm_modes[] = {
+        {"default",        "off", "0",     "0"},
+        {"coalesce",       "on",  "0",     "0"},
+        {"recv-ring",      "off", "0",     "65536"},
+        {"zerocopy",       "off", "65536", "0"},
+        {"all",            "on",  "65536", "65536"},
+};
+
+struct bm_client {
+        struct rpc_clnt *rpc;
+        xlator_t        *xl;
+        uint32_t         size;          /* reply payload asked for */
+        uint32_t         wire_size;     /* the same, as sent */
+        int              calls;         /* still to be sent */
+        int              inflight;
+        int              failed;
+        int              connected;
+        pthread_mutex_t  lock;
+        pthread_cond_t   cond;
+};
+
+static struct iobuf *bm_payload;
+static uint32_t      bm_reply_hdr;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+bm_echo (rpcsvc_request_t *req)
+{
+        struct iobref *iobref  = NULL;
+        struct iovec   hdr     = {0, };
+        struct iovec   payload = {0, };
+        uint32_t       size    = 0;
+        int            ret     = -1;
+
+        if (req->count < 1 || req->msg[0].iov_len < sizeof (size)) {
+                rpcsvc_request_seterr (req, GARBAGE_ARGS);
+                return -1;
+        }
+        memcpy (&size, req->msg[0].iov_base, sizeof (size));
+        size = ntohl (size);
+        if (size > BM_LARGE_SIZE)
+                size = BM_LARGE_SIZE;
+
+        iobref = iobref_new ();
+        if (!iobref)
+                return -1;
+        iobref_add (iobref, bm_payload);
+
+        hdr.iov_base = &bm_reply_hdr;
+        hdr.iov_len = sizeof (bm_reply_hdr);
+        payload.iov_base = bm_payload->ptr;
+        payload.iov_len = size;
+
+        ret = rpcsvc_submit_generic (req, &hdr, 1, &payload, size ? 1 : 0,
+                                     iobref);
+        iobref_unref (iobref);
+        return ret;
+}
+
+static rpcsvc_actor_t bm_actors[] = {
+        [BM_ECHO] = {"ECHO", BM_ECHO, bm_echo, NULL, 0, DRC_NA},
+};
+
+static rpcsvc_program_t bm_program = {
+        .progname  = "socket-bm",
+        .prognum   = BM_PROGRAM,
+        .progver   = BM_VERSION,
+        .numactors = BM_ECHO + 1,
+        .actors    = bm_actors,
+};
+
+static char *bm_procnames[] = {"NULL", "ECHO"};
+
+static rpc_clnt_prog_t bm_clnt_program = {
+        .progname  = "socket-bm",
+        .prognum   = BM_PROGRAM,
+        .progver   = BM_VERSION,
+        .procnames = bm_procnames,
+        .numproc   = BM_ECHO + 1,
+};
+
+static int bm_call (struct bm_client *clnt);
+
+static int
+bm_echo_cbk (struct rpc_req *req, struct iovec *iov, int count, void *myframe)
+{
+        call_frame_t     *frame = myframe;
+        struct bm_client *clnt  = frame->local;
+        size_t            len   = 0;
+        int               again = 0;
+        int               i     = 0;
+
+        for (i = 0; i < count; i++)
+                len += iov[i].iov_len;
+
+        frame->local = NULL;
+        STACK_DESTROY (frame->root);
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                if (req->rpc_status == -1 ||
+                    len != sizeof (bm_reply_hdr) + clnt->size)
+                        clnt->failed++;
+                if (clnt->calls > 0 && !clnt->failed) {
+                        clnt->calls--;
+                        again = 1;
+                } else {
+                        clnt->inflight--;
+                        pthread_cond_signal (&clnt->cond);
+                }
+        }
+        pthread_mutex_unlock (&clnt->lock);
+
+        if (again)
+                bm_call (clnt);
+
+        return 0;
+}
+
+static int
+bm_call (struct bm_client *clnt)
+{
+        call_frame_t    *frame = NULL;
+        struct iovec     hdr   = {0, };
+        int              ret   = -1;
+
+        frame = create_frame (clnt->xl, clnt->xl->ctx->pool);
+        if (!frame)
+                goto out;
+        frame->local = clnt;
+
+        /* rpc-clnt copies the program header into its own record */
+        hdr.iov_base = &clnt->wire_size;
+        hdr.iov_len = sizeof (clnt->wire_size);
+
+        ret = rpc_clnt_submit (clnt->rpc, &bm_clnt_program, BM_ECHO,
+                               bm_echo_cbk, &hdr, 1, NULL, 0, NULL, frame,
+                               NULL, 0, NULL, 0, NULL);
+out:
+        if (ret) {
+                pthread_mutex_lock (&clnt->lock);
+                {
+                        clnt->failed++;
+                        clnt->inflight--;
+                        pthread_cond_signal (&clnt->cond);
+                }
+                pthread_mutex_unlock (&clnt->lock);
+        }
+        return ret;
+}
+
+static int
+bm_notify (struct rpc_clnt *rpc, void *mydata, rpc_clnt_event_t event,
+           void *data)
+{
+        struct bm_client *clnt = mydata;
+
+        /* no handshake program, so the connection is usable right away */
+        if (event == RPC_CLNT_CONNECT)
+                rpc_clnt_set_connected (&rpc->conn);
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                /* the connection of the previous mode going away */
+                if (rpc != clnt->rpc)
+                        goto unlock;
+                if (event == RPC_CLNT_CONNECT)
+                        clnt->connected = 1;
+                else if (event == RPC_CLNT_DISCONNECT)
+                        clnt->connected = 0;
+                pthread_cond_signal (&clnt->cond);
+        }
+unlock:
+        pthread_mutex_unlock (&clnt->lock);
+
+        return 0;
+}
+
+static void
+bm_set_modes (dict_t *options, struct bm_mode *mode)
+{
+        if (dict_set_str (options, "transport.socket.coalesce-writes",
+                          (char *)mode->coalesce) ||
+            dict_set_str (options, "transport.socket.zerocopy-threshold",
+                          (char *)mode->zerocopy) ||
+            dict_set_str (options, "transport.socket.recv-ring-size",
+                          (char *)mode->ring) ||
+            dict_set_str (options, "transport.address-family", "inet") ||
+            dict_set_str (options, "transport-type", "socket")) {
+                fprintf (stderr, "dict_set failed\n");
+                exit (1);
+        }
+}
+
+static void
+bm_listen (rpcsvc_t *svc, struct bm_mode *mode, int port)
+{
+        dict_t *options = dict_new ();
+
+        bm_set_modes (options, mode);
+        if (dict_set_int32 (options, "transport.socket.listen-port", port) ||
+            dict_set_str (options, "transport.socket.bind-address",
+                          "127.0.0.1") ||
+            rpcsvc_create_listeners (svc, options, (char *)mode->name) <= 0) {
+                fprintf (stderr, "cannot listen on port %d\n", port);
+                exit (1);
+        }
+}
+
+static void
+bm_connect (struct bm_client *clnt, struct bm_mode *mode, int port)
+{
+        dict_t *options = dict_new ();
+
+        bm_set_modes (options, mode);
+        if (dict_set_str (options, "remote-host", "127.0.0.1") ||
+            dict_set_int32 (options, "remote-port", port) ||
+            dict_set_int32 (options, "ping-timeout", 0)) {
+                fprintf (stderr, "dict_set failed\n");
+                exit (1);
+        }
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                clnt->rpc = rpc_clnt_new (options, clnt->xl,
+                                          (char *)mode->name, 0);
+                clnt->connected = 0;
+        }
+        pthread_mutex_unlock (&clnt->lock);
+
+        if (!clnt->rpc ||
+            rpc_clnt_register_notify (clnt->rpc, bm_notify, clnt) ||
+            rpc_clnt_start (clnt->rpc)) {
+                fprintf (stderr, "cannot connect to port %d\n", port);
+                exit (1);
+        }
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                while (!clnt->connected)
+                        pthread_cond_wait (&clnt->cond, &clnt->lock);
+        }
+        pthread_mutex_unlock (&clnt->lock);
+}
+
+static void
+bm_run (struct bm_client *clnt, const char *mode, const char *job,
+        uint32_t size, int depth, int calls)
+{
+        uint64_t start = 0;
+        uint64_t elapsed = 0;
+        int      i = 0;
+
+        clnt->size = size;
+        clnt->wire_size = htonl (size);
+        clnt->calls = calls - depth;
+        clnt->inflight = depth;
+        clnt->failed = 0;
+
+        start = bm_now_ns ();
+        for (i = 0; i < depth; i++)
+                bm_call (clnt);
+
+        pthread_mutex_lock (&clnt->lock);
+        {
+                while (clnt->inflight > 0)
+                        pthread_cond_wait (&clnt->cond, &clnt->lock);
+        }
+        pthread_mutex_unlock (&clnt->lock);
+        elapsed = bm_now_ns () - start;
+
+        if (clnt->failed) {
+                fprintf (stderr, "%s/%s: %d calls failed\n", mode, job,
+                         clnt->failed);
+                exit (1);
+        }
+
+        printf ("%-10s %-6s %12.0f %10.1f\n", mode, job,
+                (double)calls * 1e9 / elapsed,
+                (double)calls * size * 1e3 / elapsed);
+}
+
+static void *
+bm_poller (void *data)
+{
+        event_dispatch (data);
+        return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t  *ctx = NULL;
+        xlator_t         *xl = NULL;
+        rpcsvc_t         *svc = NULL;
+        dict_t           *options = NULL;
+        struct bm_client  clnt = {0, };
+        pthread_t         poller;
+        int               m = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+        ctx->dict_pool = mem_pool_new (dict_t, 32);
+        ctx->dict_pair_pool = mem_pool_new (data_pair_t, 512);
+        ctx->dict_data_pool = mem_pool_new (data_t, 512);
+        ctx->iobuf_pool = iobuf_pool_new ();
+        ctx->event_pool = event_pool_new (16384, 2);
+        if (!ctx->event_pool) {
+                fprintf (stderr, "cannot create event pool\n");
+                return 1;
+        }
+
+        xl = GF_CALLOC (1, sizeof (*xl), gf_common_mt_xlator_t);
+        xl->name = "socket-bm";
+        xl->ctx = ctx;
+        xl->options = dict_new ();
+        INIT_LIST_HEAD (&xl->volume_options);
+        THIS = xl;
+
+        bm_payload = iobuf_get2 (ctx->iobuf_pool, BM_LARGE_SIZE);
+        memset (bm_payload->ptr, 'x', BM_LARGE_SIZE);
+
+        options = dict_new ();
+        svc = rpcsvc_init (xl, ctx, options, 0);
+        if (!svc || rpcsvc_program_register (svc, &bm_program, _gf_false)) {
+                fprintf (stderr, "cannot start rpc service\n");
+                return 1;
+        }
+
+        pthread_create (&poller, NULL, bm_poller, ctx->event_pool);
+
+        clnt.xl = xl;
+        pthread_mutex_init (&clnt.lock, NULL);
+        pthread_cond_init (&clnt.cond, NULL);
+
+        printf ("%-10s %-6s %12s %10s\n", "mode", "job", "rpcs/s", "MB/s");
+        for (m = 0; m < sizeof (bm_modes) / sizeof (bm_modes[0]); m++) {
+                bm_listen (svc, &bm_modes[m], BM_PORT + m);
+                bm_connect (&clnt, &bm_modes[m], BM_PORT + m);
+
+                bm_run (&clnt, bm_modes[m].name, "small", 0,
+                        BM_SMALL_DEPTH, BM_SMALL_CALLS);
+                bm_run (&clnt, bm_modes[m].name, "large", BM_LARGE_SIZE,
+                        BM_LARGE_DEPTH, BM_LARGE_CALLS);
+
+                rpc_clnt_disable (clnt.rpc);
+        }
+
+        return 0;
+}
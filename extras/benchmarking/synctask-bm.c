@@ -0,0 +1,163 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* synctask-bm: context switches per second of synctasks that wake
+ * themselves and yield back to the syncenv, the way a syncop waits for its
+ * callback, and synctasks per second that synctask_new() can start and
+ * join when they return right away.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "xlator.h"
+#include "stack.h"
+#include "syncop.h"
+
+#define BM_YIELDS       200000
+#define BM_SPAWNS       20000
+
+static int             bm_left;
+static pthread_mutex_t bm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  bm_cond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+bm_yield (void *opaque)
+{
+        struct synctask *task = synctask_get ();
+        int              n    = (long)opaque;
+        int              i    = 0;
+
+        for (i = 0; i < n; i++) {
+                synctask_wake (task);
+                synctask_yield (task);
+        }
+
+        return 0;
+}
+
+static int
+bm_noop (void *opaque)
+{
+        return 0;
+}
+
+static int
+bm_done (int ret, call_frame_t *frame, void *opaque)
+{
+        pthread_mutex_lock (&bm_lock);
+        {
+                if (--bm_left == 0)
+                        pthread_cond_signal (&bm_cond);
+        }
+        pthread_mutex_unlock (&bm_lock);
+
+        return 0;
+}
+
+static void
+bm_switch (struct syncenv *env, int tasks)
+{
+        uint64_t start = 0;
+        uint64_t elapsed = 0;
+        int      i = 0;
+
+        bm_left = tasks;
+
+        start = bm_now_ns ();
+        for (i = 0; i < tasks; i++) {
+                if (synctask_new (env, bm_yield, bm_done, NULL,
+                                  (void *)(long)(BM_YIELDS / tasks))) {
+                        fprintf (stderr, "synctask_new failed\n");
+                        exit (1);
+                }
+        }
+
+        pthread_mutex_lock (&bm_lock);
+        {
+                while (bm_left)
+                        pthread_cond_wait (&bm_cond, &bm_lock);
+        }
+        pthread_mutex_unlock (&bm_lock);
+        elapsed = bm_now_ns () - start;
+
+        /* each yield switches out to the scheduler and back in */
+        printf ("%-8s %6d %14.0f\n", "switch", tasks,
+                2.0 * BM_YIELDS * 1e9 / elapsed);
+}
+
+static void
+bm_spawn (struct syncenv *env)
+{
+        uint64_t start = 0;
+        uint64_t elapsed = 0;
+        int      i = 0;
+
+        start = bm_now_ns ();
+        for (i = 0; i < BM_SPAWNS; i++) {
+                if (synctask_new (env, bm_noop, NULL, NULL, NULL)) {
+                        fprintf (stderr, "synctask_new failed\n");
+                        exit (1);
+                }
+        }
+        elapsed = bm_now_ns () - start;
+
+        printf ("%-8s %6d %14.0f\n", "spawn", 1,
+                (double)BM_SPAWNS * 1e9 / elapsed);
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx = NULL;
+        struct syncenv  *env = NULL;
+        int              tasks = 0;
+
+        mem_pools_init_early ();
+        gf_global_mem_acct_enable_set (0);
+
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = ctx;
+
+        ctx->pool = GF_CALLOC (1, sizeof (call_pool_t), gf_common_mt_char);
+        INIT_LIST_HEAD (&ctx->pool->all_frames);
+        LOCK_INIT (&ctx->pool->lock);
+        ctx->pool->frame_mem_pool = mem_pool_new (call_frame_t, 4096);
+        ctx->pool->stack_mem_pool = mem_pool_new (call_stack_t, 1024);
+
+        env = syncenv_new (0, 1, SYNCENV_PROC_MAX);
+        if (!env) {
+                fprintf (stderr, "cannot create syncenv\n");
+                return 1;
+        }
+
+        printf ("%-8s %6s %14s\n", "test", "tasks", "per-second");
+        for (tasks = 1; tasks <= 64; tasks *= 4)
+                bm_switch (env, tasks);
+        bm_spawn (env);
+
+        return 0;
+}
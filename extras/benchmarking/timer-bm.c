@@ -0,0 +1,147 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+
+/* timer-bm: stress test for gf_timer_call_after()/gf_timer_call_cancel().
+ *
+ *  - arms 100k timers spread over the next 10 minutes from several
+ *    threads and cancels them again (ping timers, lease recalls ...)
+ *  - arms 100k short timers and waits for all of them to fire, reporting
+ *    how late the callbacks ran
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "glusterfs.h"
+#include "globals.h"
+#include "timer.h"
+#include "timespec.h"
+
+#define BM_TIMERS       100000
+#define BM_THREADS      8
+
+struct bm_timer {
+        gf_timer_t      *timer;
+        uint64_t         due;
+};
+
+static glusterfs_ctx_t  *bm_ctx;
+static struct bm_timer   bm_timers[BM_TIMERS];
+static gf_atomic_t       bm_fired;
+static gf_atomic_t       bm_late_total;
+static uint64_t          bm_late_max;
+static pthread_mutex_t   bm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t
+bm_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        timespec_now (&ts);
+        return TS (ts);
+}
+
+static void
+bm_timer_cbk (void *data)
+{
+        struct bm_timer *t    = data;
+        uint64_t         late = bm_now_ns () - t->due;
+
+        GF_ATOMIC_ADD (bm_late_total, late);
+        pthread_mutex_lock (&bm_lock);
+        if (late > bm_late_max)
+                bm_late_max = late;
+        pthread_mutex_unlock (&bm_lock);
+        GF_ATOMIC_INC (bm_fired);
+}
+
+static void *
+bm_arm_cancel (void *arg)
+{
+        long            idx   = (long)arg;
+        struct timespec delta = {0, };
+        int             i     = 0;
+        int             n     = BM_TIMERS / BM_THREADS;
+
+        for (i = idx * n; i < (idx + 1) * n; i++) {
+                delta.tv_sec = 1 + (random () % 600);
+                delta.tv_nsec = random () % 1000000000;
+                bm_timers[i].timer = gf_timer_call_after (bm_ctx, delta,
+                                                          bm_timer_cbk,
+                                                          &bm_timers[i]);
+        }
+
+        for (i = idx * n; i < (idx + 1) * n; i++)
+                gf_timer_call_cancel (bm_ctx, bm_timers[i].timer);
+
+        return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+        pthread_t        threads[BM_THREADS];
+        struct timespec  delta  = {0, };
+        uint64_t         start  = 0;
+        uint64_t         now    = 0;
+        long             i      = 0;
+
+        mem_pools_init_early ();
+        mem_pools_init_late ();
+        gf_global_mem_acct_enable_set (0);
+
+        bm_ctx = glusterfs_ctx_new ();
+        if (!bm_ctx || glusterfs_globals_init (bm_ctx)) {
+                fprintf (stderr, "failed to initialise glusterfs context\n");
+                return 1;
+        }
+        THIS->ctx = bm_ctx;
+
+        /* arm + cancel from several threads */
+        start = bm_now_ns ();
+        for (i = 0; i < BM_THREADS; i++)
+                pthread_create (&threads[i], NULL, bm_arm_cancel, (void *)i);
+        for (i = 0; i < BM_THREADS; i++)
+                pthread_join (threads[i], NULL);
+        now = bm_now_ns ();
+
+        printf ("arm+cancel %d timers from %d threads: %.1f ns/timer\n",
+                BM_TIMERS, BM_THREADS, (double)(now - start) / BM_TIMERS);
+
+        /* arm short timers and let them fire */
+        GF_ATOMIC_INIT (bm_fired, 0);
+        GF_ATOMIC_INIT (bm_late_total, 0);
+        start = bm_now_ns ();
+        for (i = 0; i < BM_TIMERS; i++) {
+                delta.tv_sec = 0;
+                delta.tv_nsec = (random () % 500) * 1000000;
+                bm_timers[i].due = bm_now_ns () + TS (delta);
+                bm_timers[i].timer = gf_timer_call_after (bm_ctx, delta,
+                                                          bm_timer_cbk,
+                                                          &bm_timers[i]);
+        }
+        now = bm_now_ns ();
+        printf ("arm %d timers: %.1f ns/timer\n", BM_TIMERS,
+                (double)(now - start) / BM_TIMERS);
+
+        while (GF_ATOMIC_GET (bm_fired) < BM_TIMERS)
+                usleep (10000);
+
+        printf ("fired %d timers: avg late %.3f ms, max late %.3f ms\n",
+                BM_TIMERS,
+                (double)GF_ATOMIC_GET (bm_late_total) / BM_TIMERS / 1e6,
+                (double)bm_late_max / 1e6);
+
+        gf_timer_registry_destroy (bm_ctx);
+        return 0;
+}
@@ -194,6 +194,12 @@ static struct argp_option gf_options[] = {
          OPTION_ARG_OPTIONAL, "Instantiate process global timer-wheel"},
         {"thin-client", ARGP_THIN_CLIENT_KEY, 0, 0,
          "Enables thin mount and connects via gfproxyd daemon"},
+        {"iobuf-hugepages", ARGP_IOBUF_HUGEPAGES_KEY, "MODE", 0,
+         "Back iobuf arenas with huge pages, MODE is \"off\", "
+         "\"transparent\" or \"explicit\" [default: \"off\"]"},
+        {"iobuf-numa", ARGP_IOBUF_NUMA_KEY, "BOOL", OPTION_ARG_OPTIONAL,
+         "Allocate iobufs from arenas local to the NUMA node of the "
+         "calling thread [default: \"off\"]"},
 
         {0, 0, 0, 0, "Fuse options:"},
         {"direct-io-mode", ARGP_DIRECT_IO_MODE_KEY, "BOOL", OPTION_ARG_OPTIONAL,
@@ -1197,6 +1203,35 @@ parse_opts (int key, char *arg, struct argp_state *state)
                 cmd_args->global_timer_wheel = 1;
                 break;
 
+        case ARGP_IOBUF_HUGEPAGES_KEY:
+                if (strcmp (arg, "off") == 0) {
+                        cmd_args->iobuf_hugepages = GF_IOBUF_HUGEPAGES_OFF;
+                } else if (strcmp (arg, "transparent") == 0) {
+                        cmd_args->iobuf_hugepages =
+                                GF_IOBUF_HUGEPAGES_TRANSPARENT;
+                } else if (strcmp (arg, "explicit") == 0) {
+                        cmd_args->iobuf_hugepages =
+                                GF_IOBUF_HUGEPAGES_EXPLICIT;
+                } else {
+                        argp_failure (state, -1, 0,
+                                      "unknown iobuf-hugepages setting "
+                                      "\"%s\"", arg);
+                }
+                break;
+
+        case ARGP_IOBUF_NUMA_KEY:
+                if (!arg)
+                        arg = "yes";
+
+                if (gf_string2boolean (arg, &b) == 0) {
+                        cmd_args->iobuf_numa = b;
+                        break;
+                }
+
+                argp_failure (state, -1, 0,
+                              "unknown iobuf-numa setting \"%s\"", arg);
+                break;
+
 	case ARGP_GID_TIMEOUT_KEY:
 		if (!gf_string2int(arg, &cmd_args->gid_timeout)) {
 			cmd_args->gid_timeout_set = _gf_true;
@@ -2609,6 +2644,14 @@ main (int argc, char *argv[])
         if (ret)
                 goto out;
 
+        /* only arenas added from now on are affected, the pool starts with
+         * one arena per page size */
+        if (cmd->iobuf_hugepages != GF_IOBUF_HUGEPAGES_OFF)
+                iobuf_pool_set_hugepages (ctx->iobuf_pool,
+                                          cmd->iobuf_hugepages);
+        if (cmd->iobuf_numa)
+                iobuf_pool_set_numa (ctx->iobuf_pool, _gf_true);
+
 
         /* log the version of glusterfs running here along with the actual
            command line options. */
@@ -101,6 +101,8 @@ enum argp_option_keys {
         ARGP_PROCESS_NAME_KEY             = 179,
         ARGP_FUSE_EVENT_HISTORY_KEY       = 180,
         ARGP_THIN_CLIENT_KEY              = 181,
+        ARGP_IOBUF_HUGEPAGES_KEY          = 182,
+        ARGP_IOBUF_NUMA_KEY               = 183,
 };
 
 struct _gfd_vol_top_priv {
@@ -25,6 +25,7 @@ typedef struct _call_stub {
         struct mem_pool *stub_mem_pool; /* pointer to stub mempool in ctx_t */
         uint32_t jnl_meta_len;
         uint32_t jnl_data_len;
+        uint64_t enqueued;      /* monotonic ns, for xlators queuing stubs */
         void (*serialize) (struct _call_stub *, char *, char *);
 
 	union {
@@ -67,6 +67,201 @@ get_new_data ()
         return data;
 }
 
+/* Keys that show up in xdata of almost every fop. A pair with one of
+ * these keys points to the string below instead of a copy of its own.
+ */
+static char *dict_well_known_keys[] = {
+        "gfid-req",
+        GFID_XATTR_KEY,
+        GF_CONTENT_KEY,
+        GF_GFIDLESS_LOOKUP,
+        GF_GET_SIZE,
+        GF_REQUEST_LINK_COUNT_XDATA,
+        GF_RESPONSE_LINK_COUNT_XDATA,
+        GF_PREOP_CHECK_FAILED,
+        GF_AFR_DIRTY,
+        GF_XATTROP_INDEX_GFID,
+        GF_XATTROP_DIRTY_GFID,
+        GF_XATTROP_ENTRY_IN_KEY,
+        GF_XATTROP_ENTRY_OUT_KEY,
+        GF_XATTROP_PURGE_INDEX,
+        GLUSTERFS_INTERNAL_FOP_KEY,
+        GLUSTERFS_DURABLE_OP,
+        GLUSTERFS_WRITE_IS_APPEND,
+        GLUSTERFS_WRITE_UPDATE_ATOMIC,
+        GLUSTERFS_OPEN_FD_COUNT,
+        GLUSTERFS_INODELK_COUNT,
+        GLUSTERFS_ENTRYLK_COUNT,
+        GLUSTERFS_POSIXLK_COUNT,
+        GLUSTERFS_PARENT_ENTRYLK,
+        GLUSTERFS_INODELK_DOM_COUNT,
+        GLUSTERFS_BAD_INODE,
+        DHT_IATT_IN_XDATA_KEY,
+        DHT_MODE_IN_XDATA_KEY,
+        TIER_LINKFILE_GFID,
+        GET_ANCESTRY_PATH_KEY,
+        GET_ANCESTRY_DENTRY_KEY,
+        QUOTA_SIZE_KEY,
+        GF_SELINUX_XATTR_KEY,
+        /* cluster/ec, see ec.h */
+        "trusted.ec.version",
+        "trusted.ec.size",
+        "trusted.ec.dirty",
+        "trusted.ec.config",
+        NULL
+};
+
+#define DICT_INTERN_TABLE_SIZE  128     /* power of 2, > 2 * the keys above */
+
+static struct {
+        char     *key;
+        uint32_t  hash;
+} dict_intern_table[DICT_INTERN_TABLE_SIZE];
+
+static pthread_once_t dict_intern_once = PTHREAD_ONCE_INIT;
+
+static void
+dict_intern_init (void)
+{
+        uint32_t hash = 0;
+        int      slot = 0;
+        int      i    = 0;
+
+        for (i = 0; dict_well_known_keys[i]; i++) {
+                hash = SuperFastHash (dict_well_known_keys[i],
+                                      strlen (dict_well_known_keys[i]));
+                slot = hash & (DICT_INTERN_TABLE_SIZE - 1);
+                while (dict_intern_table[slot].key)
+                        slot = (slot + 1) & (DICT_INTERN_TABLE_SIZE - 1);
+
+                dict_intern_table[slot].key = dict_well_known_keys[i];
+                dict_intern_table[slot].hash = hash;
+        }
+}
+
+/* Returns the interned copy of @key if it is a well known one. */
+static char *
+dict_key_intern (char *key, uint32_t hash)
+{
+        int slot = 0;
+
+        (void) pthread_once (&dict_intern_once, dict_intern_init);
+
+        slot = hash & (DICT_INTERN_TABLE_SIZE - 1);
+        while (dict_intern_table[slot].key) {
+                if (dict_intern_table[slot].hash == hash &&
+                    strcmp (dict_intern_table[slot].key, key) == 0)
+                        return dict_intern_table[slot].key;
+                slot = (slot + 1) & (DICT_INTERN_TABLE_SIZE - 1);
+        }
+
+        return NULL;
+}
+
+static data_pair_t *
+dict_pair_alloc (dict_t *this)
+{
+        data_pair_t *pair = NULL;
+        int          i    = 0;
+
+        if (this->pairs_in_use != (1U << GF_DICT_INLINE_PAIRS) - 1) {
+                i = ffs (~this->pairs_in_use) - 1;
+                this->pairs_in_use |= (1U << i);
+                pair = &this->pairs_internal[i];
+                memset (pair, 0, sizeof (*pair));
+                return pair;
+        }
+
+        return mem_get0 (THIS->ctx->dict_pair_pool);
+}
+
+static void
+dict_pair_free (dict_t *this, data_pair_t *pair)
+{
+        if (!pair->key_interned)
+                GF_FREE (pair->key);
+
+        if (pair >= this->pairs_internal &&
+            pair < this->pairs_internal + GF_DICT_INLINE_PAIRS)
+                this->pairs_in_use &= ~(1U << (pair - this->pairs_internal));
+        else
+                mem_put (pair);
+}
+
+/* (Re)builds the open addressing index to hold at least @count pairs at a
+ * load factor of at most 1/2. Without an index lookups walk members_list,
+ * which is what small dicts do anyway.
+ */
+static int
+dict_index_resize (dict_t *this, int count)
+{
+        data_pair_t **index = NULL;
+        data_pair_t  *pair  = NULL;
+        uint32_t      size  = 32;
+        uint32_t      slot  = 0;
+
+        while (size < count * 2)
+                size <<= 1;
+
+        index = GF_CALLOC (size, sizeof (*index), gf_common_mt_dict_index_t);
+        if (!index)
+                return -1;
+
+        for (pair = this->members_list; pair; pair = pair->next) {
+                slot = pair->key_hash & (size - 1);
+                while (index[slot])
+                        slot = (slot + 1) & (size - 1);
+                index[slot] = pair;
+        }
+
+        GF_FREE (this->index);
+        this->index = index;
+        this->index_size = size;
+
+        return 0;
+}
+
+static void
+dict_index_add (dict_t *this, data_pair_t *pair)
+{
+        uint32_t mask = this->index_size - 1;
+        uint32_t slot = 0;
+
+        slot = pair->key_hash & mask;
+        while (this->index[slot])
+                slot = (slot + 1) & mask;
+        this->index[slot] = pair;
+}
+
+static void
+dict_index_del (dict_t *this, data_pair_t *pair)
+{
+        uint32_t mask = this->index_size - 1;
+        uint32_t slot = 0;
+        uint32_t next = 0;
+        uint32_t home = 0;
+
+        slot = pair->key_hash & mask;
+        while (this->index[slot] != pair) {
+                if (!this->index[slot])
+                        return;
+                slot = (slot + 1) & mask;
+        }
+        this->index[slot] = NULL;
+
+        /* shift back the entries of the same cluster that would not be
+         * found anymore across the hole */
+        for (next = (slot + 1) & mask; this->index[next];
+             next = (next + 1) & mask) {
+                home = this->index[next]->key_hash & mask;
+                if (((next - home) & mask) >= ((next - slot) & mask)) {
+                        this->index[slot] = this->index[next];
+                        this->index[next] = NULL;
+                        slot = next;
+                }
+        }
+}
+
 dict_t *
 get_new_dict_full (int size_hint)
 {
@@ -76,34 +271,10 @@ get_new_dict_full (int size_hint)
                 return NULL;
         }
 
-        dict->hash_size = size_hint;
-        if (size_hint == 1) {
-                /*
-                 * This is the only case we ever see currently.  If we ever
-                 * need to support resizing the hash table, the resize function
-                 * will have to take into account the possibility that
-                 * "members" is not separately allocated (i.e. don't just call
-                 * realloc() blindly.
-                 */
-                dict->members = &dict->members_internal;
-        }
-        else {
-                /*
-                 * We actually need to allocate space for size_hint *pointers*
-                 * but we actually allocate space for one *structure*.  Since
-                 * a data_pair_t consists of five pointers, we're wasting four
-                 * pointers' worth for N=1, and will overrun what we allocated
-                 * for N>5.  If anybody ever starts using size_hint, we'll need
-                 * to fix this.
-                 */
-                GF_ASSERT (size_hint <=
-                           (sizeof(data_pair_t) / sizeof(data_pair_t *)));
-                dict->members = mem_get0 (THIS->ctx->dict_pair_pool);
-                if (!dict->members) {
-                        mem_put (dict);
-                        return NULL;
-                }
-        }
+        /* a failure here only means lookups walk the list until the index
+         * can be built */
+        if (size_hint > GF_DICT_INLINE_PAIRS)
+                (void) dict_index_resize (dict, size_hint);
 
         LOCK_INIT (&dict->lock);
 
@@ -243,7 +414,11 @@ data_destroy (data_t *data)
         if (data) {
                 LOCK_DESTROY (&data->lock);
 
-                if (!data->is_static)
+                if (data->backing)
+                        data_unref (data->backing);
+                else if (data->is_stdalloc)
+                        free (data->data);
+                else if (!data->is_static)
                         GF_FREE (data->data);
 
                 data->len = 0xbabababa;
@@ -288,8 +463,9 @@ err_out:
 static data_pair_t *
 dict_lookup_common (dict_t *this, char *key, uint32_t hash)
 {
-        int hashval = 0;
-        data_pair_t *pair;
+        data_pair_t *pair = NULL;
+        uint32_t     mask = 0;
+        uint32_t     slot = 0;
 
         if (!this || !key) {
                 gf_msg_callingfn ("dict", GF_LOG_WARNING, EINVAL,
@@ -298,15 +474,19 @@ dict_lookup_common (dict_t *this, char *key, uint32_t hash)
                 return NULL;
         }
 
-        /* If the divisor is 1, the modulo is always 0,
-         * in such case avoid hash calculation.
-         */
-        if (this->hash_size != 1)
-                hashval = hash % this->hash_size;
+        if (!this->index) {
+                for (pair = this->members_list; pair; pair = pair->next) {
+                        if ((hash == pair->key_hash) &&
+                            !strcmp (pair->key, key))
+                                return pair;
+                }
+                return NULL;
+        }
 
-        for (pair = this->members[hashval]; pair != NULL; pair = pair->hash_next) {
-                if (pair->key && (hash == pair->key_hash) &&
-                    !strcmp (pair->key, key))
+        mask = this->index_size - 1;
+        for (slot = hash & mask; (pair = this->index[slot]) != NULL;
+             slot = (slot + 1) & mask) {
+                if ((hash == pair->key_hash) && !strcmp (pair->key, key))
                         return pair;
         }
 
@@ -344,9 +524,9 @@ dict_lookup (dict_t *this, char *key, data_t **data)
 static int32_t
 dict_set_lk (dict_t *this, char *key, data_t *value, gf_boolean_t replace)
 {
-        int hashval = 0;
         data_pair_t *pair;
         char key_free = 0;
+        char *interned = NULL;
         int ret = 0;
         uint32_t hash = 0;
 
@@ -358,13 +538,7 @@ dict_set_lk (dict_t *this, char *key, data_t *value, gf_boolean_t replace)
                 key_free = 1;
         }
 
-        /* If the divisor is 1, the modulo is always 0,
-         * in such case avoid hash calculation.
-         */
         hash = SuperFastHash (key, strlen (key));
-        if (this->hash_size != 1) {
-                hashval = (hash % this->hash_size);
-        }
 
         /* Search for a existing key if 'replace' is asked for */
         if (replace) {
@@ -381,34 +555,30 @@ dict_set_lk (dict_t *this, char *key, data_t *value, gf_boolean_t replace)
                 }
         }
 
-        if (this->free_pair_in_use) {
-                pair = mem_get0 (THIS->ctx->dict_pair_pool);
-                if (!pair) {
-                        if (key_free)
-                                GF_FREE (key);
-                        return -1;
-                }
-        }
-        else {
-                pair = &this->free_pair;
-                this->free_pair_in_use = _gf_true;
+        pair = dict_pair_alloc (this);
+        if (!pair) {
+                if (key_free)
+                        GF_FREE (key);
+                return -1;
         }
 
+        if (!key_free)
+                interned = dict_key_intern (key, hash);
+
         if (key_free) {
                 /* It's ours.  Use it. */
                 pair->key = key;
                 key_free = 0;
         }
+        else if (interned) {
+                pair->key = interned;
+                pair->key_interned = _gf_true;
+        }
         else {
                 pair->key = (char *) GF_CALLOC (1, strlen (key) + 1,
                                                 gf_common_mt_char);
                 if (!pair->key) {
-                        if (pair == &this->free_pair) {
-                                this->free_pair_in_use = _gf_false;
-                        }
-                        else {
-                                mem_put (pair);
-                        }
+                        dict_pair_free (this, pair);
                         return -1;
                 }
                 strcpy (pair->key, key);
@@ -416,9 +586,6 @@ dict_set_lk (dict_t *this, char *key, data_t *value, gf_boolean_t replace)
         pair->key_hash = hash;
         pair->value = data_ref (value);
 
-        pair->hash_next = this->members[hashval];
-        this->members[hashval] = pair;
-
         pair->next = this->members_list;
         pair->prev = NULL;
         if (this->members_list)
@@ -426,6 +593,16 @@ dict_set_lk (dict_t *this, char *key, data_t *value, gf_boolean_t replace)
         this->members_list = pair;
         this->count++;
 
+        if (this->index && this->count * 2 <= this->index_size) {
+                dict_index_add (this, pair);
+        } else if (this->count > GF_DICT_INLINE_PAIRS &&
+                   dict_index_resize (this, this->count * 2) != 0) {
+                /* lookups fall back to walking the list */
+                GF_FREE (this->index);
+                this->index = NULL;
+                this->index_size = 0;
+        }
+
         if (key_free)
                 GF_FREE (key);
 
@@ -530,7 +707,7 @@ dict_key_count (dict_t *this)
 void
 dict_del (dict_t *this, char *key)
 {
-        int hashval = 0;
+        data_pair_t *pair = NULL;
         uint32_t hash = 0;
 
         if (!this || !key) {
@@ -541,46 +718,25 @@ dict_del (dict_t *this, char *key)
 
         LOCK (&this->lock);
 
-        /* If the divisor is 1, the modulo is always 0,
-         * in such case avoid hash calculation.
-         */
         hash = SuperFastHash (key, strlen (key));
-        if (this->hash_size != 1)
-                hashval = hash % this->hash_size;
-
-        data_pair_t *pair = this->members[hashval];
-        data_pair_t *prev = NULL;
 
-        while (pair) {
-                if ((hash == pair->key_hash) && strcmp (pair->key, key) == 0) {
-                        if (prev)
-                                prev->hash_next = pair->hash_next;
-                        else
-                                this->members[hashval] = pair->hash_next;
+        pair = dict_lookup_common (this, key, hash);
+        if (pair) {
+                if (this->index)
+                        dict_index_del (this, pair);
 
-                        data_unref (pair->value);
+                data_unref (pair->value);
 
-                        if (pair->prev)
-                                pair->prev->next = pair->next;
-                        else
-                                this->members_list = pair->next;
+                if (pair->prev)
+                        pair->prev->next = pair->next;
+                else
+                        this->members_list = pair->next;
 
-                        if (pair->next)
-                                pair->next->prev = pair->prev;
+                if (pair->next)
+                        pair->next->prev = pair->prev;
 
-                        GF_FREE (pair->key);
-                        if (pair == &this->free_pair) {
-                                this->free_pair_in_use = _gf_false;
-                        }
-                        else {
-                                mem_put (pair);
-                        }
-                        this->count--;
-                        break;
-                }
-
-                prev = pair;
-                pair = pair->hash_next;
+                dict_pair_free (this, pair);
+                this->count--;
         }
 
         UNLOCK (&this->lock);
@@ -608,17 +764,12 @@ dict_destroy (dict_t *this)
         while (prev) {
                 pair = pair->next;
                 data_unref (prev->value);
-                GF_FREE (prev->key);
-                if (prev != &this->free_pair) {
-                        mem_put (prev);
-                }
+                dict_pair_free (this, prev);
                 total_pairs++;
                 prev = pair;
         }
 
-        if (this->members != &this->members_internal) {
-                mem_put (this->members);
-        }
+        GF_FREE (this->index);
 
         GF_FREE (this->extra_free);
         free (this->extra_stdfree);
@@ -1368,7 +1519,7 @@ dict_copy (dict_t *dict,
         }
 
         if (!new)
-                new = get_new_dict_full (dict->hash_size);
+                new = get_new_dict_full (dict->count);
 
         dict_foreach (dict, dict_copy_one, new);
 
@@ -2978,6 +3129,130 @@ out:
         return ret;
 }
 
+/**
+ * dict_unserialize_owned - unserialize a buffer into a dict, taking the
+ *                          buffer over
+ *
+ * @buf:  buf containing serialized dict, allocated with malloc()
+ * @size: size of the @buf
+ * @fill: dict to fill in
+ *
+ * Values of GF_DICT_UNSERIALIZE_REF_MIN bytes or more point into @buf
+ * instead of being copied, smaller ones get their own (aligned) copy.
+ * @buf is freed once the last value referring to it is gone. @buf belongs
+ * to the dict whether this succeeds or not.
+ *
+ * @return: success: 0
+ *          failure: -errno
+ */
+
+int32_t
+dict_unserialize_owned (char *orig_buf, int32_t size, dict_t **fill)
+{
+        char    *buf     = NULL;
+        char    *end     = NULL;
+        data_t  *backing = NULL;
+        data_t  *value   = NULL;
+        char    *key     = NULL;
+        int      ret     = -1;
+        int32_t  count   = 0;
+        int32_t  keylen  = 0;
+        int32_t  vallen  = 0;
+        int32_t  hostord = 0;
+        int      i       = 0;
+
+        if (!orig_buf || size <= 0 || !fill || !*fill) {
+                gf_msg_callingfn ("dict", GF_LOG_ERROR, EINVAL,
+                                  LG_MSG_INVALID_ARG, "invalid argument");
+                goto out;
+        }
+
+        buf = orig_buf;
+        end = orig_buf + size;
+
+        if ((buf + DICT_HDR_LEN) > end)
+                goto undersized;
+        memcpy (&hostord, buf, sizeof (hostord));
+        count = ntoh32 (hostord);
+        buf += DICT_HDR_LEN;
+
+        if (count < 0) {
+                gf_msg ("dict", GF_LOG_ERROR, 0, LG_MSG_COUNT_LESS_THAN_ZERO,
+                        "count (%d) <= 0", count);
+                goto out;
+        }
+
+        /* count will be set by the dict_add's below */
+        (*fill)->count = 0;
+
+        for (i = 0; i < count; i++) {
+                if ((buf + DICT_DATA_HDR_KEY_LEN +
+                     DICT_DATA_HDR_VAL_LEN) > end)
+                        goto undersized;
+                memcpy (&hostord, buf, sizeof (hostord));
+                keylen = ntoh32 (hostord);
+                buf += DICT_DATA_HDR_KEY_LEN;
+                memcpy (&hostord, buf, sizeof (hostord));
+                vallen = ntoh32 (hostord);
+                buf += DICT_DATA_HDR_VAL_LEN;
+
+                if (keylen < 0 || vallen < 0 ||
+                    keylen >= (end - buf) || vallen > (end - buf - keylen - 1))
+                        goto undersized;
+                key = buf;
+                buf += keylen + 1;  /* for '\0' */
+
+                value = get_new_data ();
+                if (!value) {
+                        ret = -1;
+                        goto out;
+                }
+                value->len = vallen;
+                if (vallen >= GF_DICT_UNSERIALIZE_REF_MIN && !backing) {
+                        /* first value worth pointing to, @buf gets a
+                         * refcount of its own from here on */
+                        backing = get_new_data ();
+                        if (!backing) {
+                                data_destroy (value);
+                                ret = -1;
+                                goto out;
+                        }
+                        backing->data = orig_buf;
+                        backing->len = size;
+                        backing->is_stdalloc = 1;
+                        data_ref (backing);
+                }
+                if (vallen >= GF_DICT_UNSERIALIZE_REF_MIN) {
+                        value->data = buf;
+                        value->backing = data_ref (backing);
+                } else {
+                        value->data = memdup (buf, vallen);
+                }
+                value->data_type = GF_DATA_TYPE_STR;
+                buf += vallen;
+
+                ret = dict_add (*fill, key, value);
+                if (ret < 0)
+                        goto out;
+        }
+
+        ret = 0;
+        goto out;
+
+undersized:
+        gf_msg_callingfn ("dict", GF_LOG_ERROR, 0, LG_MSG_UNDERSIZED_BUF,
+                          "undersized buffer passed. size (%d), "
+                          "parsed up to (%ld)", size, (long)(buf - orig_buf));
+        ret = -1;
+out:
+        if (backing)
+                data_unref (backing);
+        else
+                free (orig_buf);
+
+        return ret;
+}
+
 /**
  * dict_serialize_value_with_delim_lk: serialize the values in the dictionary
  * into a buffer separated by delimiter (except the last)
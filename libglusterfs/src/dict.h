@@ -60,41 +60,74 @@ typedef struct _data_pair data_pair_t;
                                                                         \
         } while (0)
 
+/* Same as GF_PROTOCOL_DICT_UNSERIALIZE, but the dict takes over buff,
+ * which has to come from malloc() as the xdr decoder hands it out.
+ */
+#define GF_PROTOCOL_DICT_UNSERIALIZE_OWNED(xl,to,buff,len,ret,ope,labl) do { \
+                if (!len)                                               \
+                        break;                                          \
+                to = dict_new();                                        \
+                GF_VALIDATE_OR_GOTO (xl->name, to, labl);               \
+                                                                        \
+                ret = dict_unserialize_owned (buff, len, &to);          \
+                buff = NULL;                                            \
+                if (ret < 0) {                                          \
+                        gf_msg (xl->name, GF_LOG_WARNING, 0,            \
+                                LG_MSG_DICT_UNSERIAL_FAILED,            \
+                                "failed to unserialize dictionary (%s)", \
+                                (#to));                                 \
+                                                                        \
+                        ope = EINVAL;                                   \
+                        goto labl;                                      \
+                }                                                       \
+                                                                        \
+        } while (0)
+
 #define DICT_KEY_VALUE_MAX_SIZE                     1048576
 
+/* values at least this large point into the buffer handed to
+ * dict_unserialize_owned() instead of getting a copy of their own */
+#define GF_DICT_UNSERIALIZE_REF_MIN                 64
+
 struct _data {
         unsigned char  is_static:1;
         unsigned char  is_const:1;
+        unsigned char  is_stdalloc:1; /* data comes from malloc() */
         int32_t        len;
         char          *data;
+        data_t        *backing;     /* data points into backing->data */
         gf_atomic_t    refcount;
         gf_lock_t      lock;
         gf_dict_data_type_t data_type;
 };
 
+/* pairs kept inside dict_t itself, most xdata dicts never need more */
+#define GF_DICT_INLINE_PAIRS                        8
+
 struct _data_pair {
-        struct _data_pair *hash_next;
         struct _data_pair *prev;
         struct _data_pair *next;
         data_t            *value;
         char              *key;
         uint32_t           key_hash;
+        gf_boolean_t       key_interned; /* key is not ours to free */
 };
 
 struct _dict {
         unsigned char   is_static:1;
-        int32_t         hash_size;
         int32_t         count;
         gf_atomic_t     refcount;
-        data_pair_t   **members;
+        data_pair_t   **index;      /* open addressing table, only once
+                                       there are more than
+                                       GF_DICT_INLINE_PAIRS pairs */
+        uint32_t        index_size;
+        uint32_t        pairs_in_use; /* bitmap of pairs_internal */
         data_pair_t    *members_list;
         char           *extra_free;
         char           *extra_stdfree;
         gf_lock_t       lock;
-        data_pair_t    *members_internal;
-        data_pair_t     free_pair;
-        gf_boolean_t    free_pair_in_use;
         uint64_t        max_count;
+        data_pair_t     pairs_internal[GF_DICT_INLINE_PAIRS];
 };
 
 typedef gf_boolean_t (*dict_match_t) (dict_t *d, char *k, data_t *v,
@@ -120,6 +153,7 @@ int32_t dict_serialize (dict_t *dict, char *buf);
 int32_t dict_unserialize (char *buf, int32_t size, dict_t **fill);
 
 int32_t dict_allocate_and_serialize (dict_t *this, char **buf, u_int *length);
+int32_t dict_unserialize_owned (char *buf, int32_t size, dict_t **fill);
 
 void dict_unref (dict_t *dict);
 dict_t *dict_ref (dict_t *dict);
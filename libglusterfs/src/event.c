@@ -302,3 +302,15 @@ event_handled (struct event_pool *event_pool, int fd, int idx, int gen)
 
         return ret;
 }
+
+int
+event_clear_error (struct event_pool *event_pool, int fd, int idx, int gen)
+{
+        int ret = 0;
+
+        if (event_pool->ops->event_clear_error)
+                ret = event_pool->ops->event_clear_error (event_pool, fd, idx,
+                                                          gen);
+
+        return ret;
+}
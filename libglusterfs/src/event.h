@@ -100,6 +100,8 @@ struct event_ops {
         int (*event_pool_destroy) (struct event_pool *event_pool);
         int (*event_handled) (struct event_pool *event_pool, int fd, int idx,
                               int gen);
+        int (*event_clear_error) (struct event_pool *event_pool, int fd,
+                                  int idx, int gen);
 };
 
 struct event_pool *event_pool_new (int count, int eventthreadcount);
@@ -115,5 +117,7 @@ int event_reconfigure_threads (struct event_pool *event_pool, int value);
 int event_pool_destroy (struct event_pool *event_pool);
 int event_dispatch_destroy (struct event_pool *event_pool);
 int event_handled (struct event_pool *event_pool, int fd, int idx, int gen);
+int event_clear_error (struct event_pool *event_pool, int fd, int idx,
+                       int gen);
 
 #endif /* _EVENT_H_ */
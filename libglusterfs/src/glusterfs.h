@@ -167,6 +167,7 @@
 #define GLUSTERFS_WRITE_IS_APPEND "glusterfs.write-is-append"
 #define GLUSTERFS_WRITE_UPDATE_ATOMIC "glusterfs.write-update-atomic"
 #define GLUSTERFS_OPEN_FD_COUNT "glusterfs.open-fd-count"
+#define GLUSTERFS_FSYNC_BATCH_SIZE "glusterfs.fsync-batch-size"
 #define GLUSTERFS_INODELK_COUNT "glusterfs.inodelk-count"
 #define GLUSTERFS_ENTRYLK_COUNT "glusterfs.entrylk-count"
 #define GLUSTERFS_POSIXLK_COUNT "glusterfs.posixlk-count"
@@ -430,6 +431,10 @@ struct _cmd_args {
         char              *process_name;
         char              *event_history;
         int                thin_client;
+
+        /* iobuf arena placement, iobuf_hugepages is a gf_iobuf_hugepages_t */
+        int                iobuf_hugepages;
+        int                iobuf_numa;
 };
 typedef struct _cmd_args cmd_args_t;
 
@@ -73,6 +73,13 @@ hash_gfid (uuid_t uuid, int mod)
 }
 
 
+static pthread_mutex_t *
+__inode_hash_lock (inode_table_t *table, int hash)
+{
+        return &table->hash_lock[hash % GF_INODE_HASH_LOCKS];
+}
+
+
 static void
 __dentry_hash (dentry_t *dentry)
 {
@@ -89,8 +96,12 @@ __dentry_hash (dentry_t *dentry)
         hash = hash_dentry (dentry->parent, dentry->name,
                             table->hashsize);
 
-        list_del_init (&dentry->hash);
-        list_add (&dentry->hash, &table->name_hash[hash]);
+        pthread_mutex_lock (__inode_hash_lock (table, hash));
+        {
+                list_del_init (&dentry->hash);
+                list_add (&dentry->hash, &table->name_hash[hash]);
+        }
+        pthread_mutex_unlock (__inode_hash_lock (table, hash));
 }
 
 
@@ -110,13 +121,27 @@ __is_dentry_hashed (dentry_t *dentry)
 static void
 __dentry_unhash (dentry_t *dentry)
 {
+        inode_table_t   *table = NULL;
+        int              hash = 0;
+
         if (!dentry) {
                 gf_msg_callingfn (THIS->name, GF_LOG_WARNING, 0,
                                   LG_MSG_DENTRY_NOT_FOUND, "dentry not found");
                 return;
         }
 
-        list_del_init (&dentry->hash);
+        if (list_empty (&dentry->hash))
+                return;
+
+        table = dentry->inode->table;
+        hash = hash_dentry (dentry->parent, dentry->name,
+                            table->hashsize);
+
+        pthread_mutex_lock (__inode_hash_lock (table, hash));
+        {
+                list_del_init (&dentry->hash);
+        }
+        pthread_mutex_unlock (__inode_hash_lock (table, hash));
 }
 
 
@@ -229,13 +254,26 @@ __is_dentry_cyclic (dentry_t *dentry)
 static void
 __inode_unhash (inode_t *inode)
 {
+        inode_table_t *table = NULL;
+        int            hash = 0;
+
         if (!inode) {
                 gf_msg_callingfn (THIS->name, GF_LOG_WARNING, 0,
                                   LG_MSG_INODE_NOT_FOUND, "inode not found");
                 return;
         }
 
-        list_del_init (&inode->hash);
+        if (list_empty (&inode->hash))
+                return;
+
+        table = inode->table;
+        hash = hash_gfid (inode->gfid, 65536);
+
+        pthread_mutex_lock (__inode_hash_lock (table, hash));
+        {
+                list_del_init (&inode->hash);
+        }
+        pthread_mutex_unlock (__inode_hash_lock (table, hash));
 }
 
 
@@ -267,8 +305,12 @@ __inode_hash (inode_t *inode)
         table = inode->table;
         hash = hash_gfid (inode->gfid, 65536);
 
-        list_del_init (&inode->hash);
-        list_add (&inode->hash, &table->inode_hash[hash]);
+        pthread_mutex_lock (__inode_hash_lock (table, hash));
+        {
+                list_del_init (&inode->hash);
+                list_add (&inode->hash, &table->inode_hash[hash]);
+        }
+        pthread_mutex_unlock (__inode_hash_lock (table, hash));
 }
 
 
@@ -467,6 +509,7 @@ static inode_t *
 __inode_unref (inode_t *inode)
 {
         int       index = 0;
+        uint32_t  ref   = 0;
         xlator_t *this  = NULL;
 
         if (!inode)
@@ -481,17 +524,17 @@ __inode_unref (inode_t *inode)
         if (__is_root_gfid(inode->gfid))
                 return inode;
 
-        GF_ASSERT (inode->ref);
+        GF_ASSERT (GF_ATOMIC_GET (inode->ref));
 
-        --inode->ref;
+        ref = GF_ATOMIC_DEC (inode->ref);
 
         index = __inode_get_xl_index (inode, this);
         if (index >= 0) {
                 inode->_ctx[index].xl_key = this;
-                inode->_ctx[index].ref--;
+                GF_ATOMIC_DEC (inode->_ctx[index].ref);
         }
 
-        if (!inode->ref) {
+        if (!ref) {
                 inode->table->active_size--;
 
                 if (inode->nlookup)
@@ -515,7 +558,7 @@ __inode_ref (inode_t *inode)
 
         this = THIS;
 
-        if (!inode->ref) {
+        if (!GF_ATOMIC_GET (inode->ref)) {
                 inode->table->lru_size--;
                 __inode_activate (inode);
         }
@@ -528,21 +571,57 @@ __inode_ref (inode_t *inode)
          * in inode table increases which is wrong. So just keep the ref
          * count as 1 always
          */
-        if (__is_root_gfid(inode->gfid) && inode->ref)
+        if (__is_root_gfid(inode->gfid) && GF_ATOMIC_GET (inode->ref))
                 return inode;
 
-        inode->ref++;
+        GF_ATOMIC_INC (inode->ref);
 
         index = __inode_get_xl_index (inode, this);
         if (index >= 0) {
                 inode->_ctx[index].xl_key = this;
-                inode->_ctx[index].ref++;
+                GF_ATOMIC_INC (inode->_ctx[index].ref);
         }
 
         return inode;
 }
 
 
+/* Adds @delta to the refcount of @inode without table->lock, as long as
+ * that neither activates nor passivates it (the count stays above
+ * @floor). Lookups hold only a hash stripe, ref and unref of inodes in use
+ * take no lock at all. Returns _gf_false if the caller has to fall back to
+ * the locked path.
+ */
+static gf_boolean_t
+inode_ref_add_active (inode_t *inode, int delta, uint32_t floor)
+{
+        int       index = 0;
+        uint32_t  ref   = 0;
+        xlator_t *this  = NULL;
+
+        ref = GF_ATOMIC_GET (inode->ref);
+        if (__is_root_gfid (inode->gfid) && ref)
+                return _gf_true;
+
+        for (;;) {
+                if (ref <= floor)
+                        return _gf_false;
+                if (GF_ATOMIC_CMP_SWAP (inode->ref, ref, ref + delta))
+                        break;
+                ref = GF_ATOMIC_GET (inode->ref);
+        }
+
+        this = THIS;
+        index = __inode_get_xl_index (inode, this);
+        if (index >= 0) {
+                inode->_ctx[index].xl_key = this;
+                GF_ATOMIC_ADD (inode->_ctx[index].ref, delta);
+        }
+
+        return _gf_true;
+}
+
+
 inode_t *
 inode_unref (inode_t *inode)
 {
@@ -553,6 +632,9 @@ inode_unref (inode_t *inode)
 
         table = inode->table;
 
+        if (inode_ref_add_active (inode, -1, 1))
+                return inode;
+
         pthread_mutex_lock (&table->lock);
         {
                 inode = __inode_unref (inode);
@@ -575,6 +657,9 @@ inode_ref (inode_t *inode)
 
         table = inode->table;
 
+        if (inode_ref_add_active (inode, 1, 0))
+                return inode;
+
         pthread_mutex_lock (&table->lock);
         {
                 inode = __inode_ref (inode);
@@ -641,6 +726,7 @@ __inode_create (inode_table_t *table)
         }
 
         newi->table = table;
+        GF_ATOMIC_INIT (newi->ref, 0);
 
         LOCK_INIT (&newi->lock);
 
@@ -708,14 +794,14 @@ __inode_ref_reduce_by_n (inode_t *inode, uint64_t nref)
         if (!inode)
                 return NULL;
 
-        GF_ASSERT (inode->ref >= nref);
-
-        inode->ref -= nref;
+        GF_ASSERT (GF_ATOMIC_GET (inode->ref) >= nref);
 
-        if (!nref)
-                inode->ref = 0;
+        if (nref)
+                GF_ATOMIC_SUB (inode->ref, nref);
+        else
+                GF_ATOMIC_SWAP (inode->ref, 0);
 
-        if (!inode->ref) {
+        if (!GF_ATOMIC_GET (inode->ref)) {
                 inode->table->active_size--;
 
                 if (inode->nlookup)
@@ -783,8 +869,10 @@ __dentry_grep (inode_table_t *table, inode_t *parent, const char *name)
 inode_t *
 inode_grep (inode_table_t *table, inode_t *parent, const char *name)
 {
-        inode_t   *inode = NULL;
-        dentry_t  *dentry = NULL;
+        inode_t         *inode = NULL;
+        dentry_t        *dentry = NULL;
+        pthread_mutex_t *hash_lock = NULL;
+        gf_boolean_t     found = _gf_false;
 
         if (!table || !parent || !name) {
                 gf_msg_callingfn (THIS->name, GF_LOG_WARNING, EINVAL,
@@ -793,6 +881,25 @@ inode_grep (inode_table_t *table, inode_t *parent, const char *name)
                 return NULL;
         }
 
+        hash_lock = __inode_hash_lock (table, hash_dentry (parent, name,
+                                                           table->hashsize));
+        pthread_mutex_lock (hash_lock);
+        {
+                dentry = __dentry_grep (table, parent, name);
+
+                if (dentry)
+                        inode = dentry->inode;
+
+                if (inode)
+                        found = inode_ref_add_active (inode, 1, 0);
+        }
+        pthread_mutex_unlock (hash_lock);
+
+        if (!inode || found)
+                return inode;
+
+        /* it is on the lru list, activating it needs the table lock */
+        inode = NULL;
         pthread_mutex_lock (&table->lock);
         {
                 dentry = __dentry_grep (table, parent, name);
@@ -856,9 +963,10 @@ int
 inode_grep_for_gfid (inode_table_t *table, inode_t *parent, const char *name,
                      uuid_t gfid, ia_type_t *type)
 {
-        inode_t   *inode = NULL;
-        dentry_t  *dentry = NULL;
-        int        ret = -1;
+        inode_t         *inode = NULL;
+        dentry_t        *dentry = NULL;
+        pthread_mutex_t *hash_lock = NULL;
+        int              ret = -1;
 
         if (!table || !parent || !name) {
                 gf_msg_callingfn (THIS->name, GF_LOG_WARNING, EINVAL,
@@ -867,7 +975,9 @@ inode_grep_for_gfid (inode_table_t *table, inode_t *parent, const char *name,
                 return ret;
         }
 
-        pthread_mutex_lock (&table->lock);
+        hash_lock = __inode_hash_lock (table, hash_dentry (parent, name,
+                                                           table->hashsize));
+        pthread_mutex_lock (hash_lock);
         {
                 dentry = __dentry_grep (table, parent, name);
 
@@ -880,7 +990,7 @@ inode_grep_for_gfid (inode_table_t *table, inode_t *parent, const char *name,
                         ret = 0;
                 }
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_mutex_unlock (hash_lock);
 
         return ret;
 }
@@ -933,7 +1043,9 @@ out:
 inode_t *
 inode_find (inode_table_t *table, uuid_t gfid)
 {
-        inode_t   *inode = NULL;
+        inode_t         *inode = NULL;
+        pthread_mutex_t *hash_lock = NULL;
+        gf_boolean_t     found = _gf_false;
 
         if (!table) {
                 gf_msg_callingfn (THIS->name, GF_LOG_WARNING, 0,
@@ -942,6 +1054,20 @@ inode_find (inode_table_t *table, uuid_t gfid)
                 return NULL;
         }
 
+        hash_lock = __inode_hash_lock (table, hash_gfid (gfid, 65536));
+        pthread_mutex_lock (hash_lock);
+        {
+                inode = __inode_find (table, gfid);
+                if (inode)
+                        found = inode_ref_add_active (inode, 1, 0);
+        }
+        pthread_mutex_unlock (hash_lock);
+
+        if (!inode || found)
+                return inode;
+
+        /* it is on the lru list, activating it needs the table lock */
+        inode = NULL;
         pthread_mutex_lock (&table->lock);
         {
                 inode = __inode_find (table, gfid);
@@ -1673,6 +1799,9 @@ inode_table_new (size_t lru_limit, xlator_t *xl)
                 ;
         }
 
+        for (i = 0; i < GF_INODE_HASH_LOCKS; i++)
+                pthread_mutex_init (&new->hash_lock[i], NULL);
+
         __inode_table_init_root (new);
 
         pthread_mutex_init (&new->lock, NULL);
@@ -1783,6 +1912,7 @@ void
 inode_table_destroy (inode_table_t *inode_table) {
 
         inode_t  *trav = NULL;
+        int       i    = 0;
 
         if (inode_table == NULL)
                 return;
@@ -1841,7 +1971,8 @@ inode_table_destroy (inode_table_t *inode_table) {
                                                   LG_MSG_REF_COUNT,
                                                   "Active inode(%p) with refcount"
                                                   "(%d) found during cleanup",
-                                                  trav, trav->ref);
+                                                  trav,
+                                                  GF_ATOMIC_GET (trav->ref));
                         __inode_forget (trav, 0);
                         __inode_ref_reduce_by_n (trav, 0);
                 }
@@ -1861,6 +1992,8 @@ inode_table_destroy (inode_table_t *inode_table) {
                 mem_pool_destroy (inode_table->fd_mem_pool);
 
         pthread_mutex_destroy (&inode_table->lock);
+        for (i = 0; i < GF_INODE_HASH_LOCKS; i++)
+                pthread_mutex_destroy (&inode_table->hash_lock[i]);
 
         GF_FREE (inode_table->name);
         GF_FREE (inode_table);
@@ -2343,7 +2476,7 @@ inode_dump (inode_t *inode, char *prefix)
                 gf_proc_dump_write("gfid", "%s", uuid_utoa (inode->gfid));
                 gf_proc_dump_write("nlookup", "%ld", inode->nlookup);
                 gf_proc_dump_write("fd-count", "%u", inode->fd_count);
-                gf_proc_dump_write("ref", "%u", inode->ref);
+                gf_proc_dump_write("ref", "%u", GF_ATOMIC_GET (inode->ref));
                 gf_proc_dump_write("ia_type", "%d", inode->ia_type);
                 if (inode->_ctx) {
                         inode_ctx = GF_CALLOC (inode->table->ctxcount,
@@ -2357,7 +2490,7 @@ inode_dump (inode_t *inode, char *prefix)
                              i++) {
                                 inode_ctx[i] = inode->_ctx[i];
                                 xl = inode_ctx[i].xl_key;
-                                ref = inode_ctx[i].ref;
+                                ref = GF_ATOMIC_GET (inode_ctx[i].ref);
                                 if (ref != 0 && xl) {
                                         gf_proc_dump_build_key (key,
                                                                 "ref_by_xl:",
@@ -2456,7 +2589,7 @@ inode_dump_to_dict (inode_t *inode, char *prefix, dict_t *dict)
 
         memset (key, 0, sizeof (key));
         snprintf (key, sizeof (key), "%s.ref", prefix);
-        ret = dict_set_uint32 (dict, key, inode->ref);
+        ret = dict_set_uint32 (dict, key, GF_ATOMIC_GET (inode->ref));
         if (ret)
                 goto out;
 
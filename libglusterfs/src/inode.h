@@ -18,6 +18,7 @@
 #define LOOKUP_NOT_NEEDED 2
 
 #define DEFAULT_INODE_MEMPOOL_ENTRIES   32 * 1024
+#define GF_INODE_HASH_LOCKS             64 /* stripes over the hash buckets */
 #define INODE_PATH_FMT "<gfid:%s>"
 struct _inode_table;
 typedef struct _inode_table inode_table_t;
@@ -42,6 +43,11 @@ struct _inode_table {
         uint32_t           lru_limit;   /* maximum LRU cache size */
         struct list_head  *inode_hash;  /* buckets for inode hash table */
         struct list_head  *name_hash;   /* buckets for dentry hash table */
+        pthread_mutex_t    hash_lock[GF_INODE_HASH_LOCKS];
+                                        /* striped over the buckets of both
+                                           hash tables, taken inside lock.
+                                           Lookups only need the stripe, any
+                                           change needs both. */
         struct list_head   active;      /* list of inodes currently active (in an fop) */
         uint32_t           active_size; /* count of inodes in active list */
         struct list_head   lru;         /* list of inodes recently used.
@@ -80,7 +86,7 @@ struct _inode_ctx {
                 uint64_t    value2;
                 void       *ptr2;
         };
-        int                 ref; /* This is for debugging inode ref leaks,
+        gf_atomic_int32_t   ref; /* This is for debugging inode ref leaks,
                                     basically helps in identifying the xlator
                                     causing th ref leak, it is printed in
                                     statedump */
@@ -92,7 +98,9 @@ struct _inode {
         gf_lock_t            lock;
         uint64_t             nlookup;
         uint32_t             fd_count;      /* Open fd count */
-        uint32_t             ref;           /* reference count on this inode */
+        gf_atomic_uint32_t   ref;           /* reference count on this inode,
+                                               0 <-> 1 transitions happen only
+                                               under table->lock */
         ia_type_t            ia_type;       /* what kind of file */
         struct list_head     fd_list;       /* list of open files on this inode */
         struct list_head     dentry_list;   /* list of directory entries for this inode */
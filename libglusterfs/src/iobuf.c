@@ -11,9 +11,19 @@
 
 #include "iobuf.h"
 #include "statedump.h"
+#include "syscall.h"
 #include <stdio.h>
 #include "libglusterfs-messages.h"
 
+#ifdef GF_LINUX_HOST_OS
+#include <sched.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#endif /* GF_LINUX_HOST_OS */
+
 /*
   TODO: implement destroy margins and prefetching of arenas
 */
@@ -21,6 +31,14 @@
 #define IOBUF_ARENA_MAX_INDEX  (sizeof (gf_iobuf_init_config) /         \
                                 (sizeof (struct iobuf_init_config)))
 
+/* fwd decl */
+static void
+__iobuf_thread_cache_drain (struct iobuf_pool *iobuf_pool,
+                            struct iobuf_thread_cache *cache);
+
+static void
+iobuf_thread_cache_destroy (void *data);
+
 /* Make sure this array is sorted based on pagesize */
 struct iobuf_init_config gf_iobuf_init_config[] = {
         /* { pagesize, num_pages }, */
@@ -153,8 +171,12 @@ __iobuf_arena_destroy (struct iobuf_pool *iobuf_pool,
         __iobuf_arena_destroy_iobufs (iobuf_arena);
 
         if (iobuf_arena->mem_base
-            && iobuf_arena->mem_base != MAP_FAILED)
+            && iobuf_arena->mem_base != MAP_FAILED) {
                 munmap (iobuf_arena->mem_base, iobuf_arena->arena_size);
+                iobuf_pool->numa_stats[iobuf_arena->numa_node].arenas--;
+                iobuf_pool->numa_stats[iobuf_arena->numa_node].bytes -=
+                        iobuf_arena->arena_size;
+        }
 
         GF_FREE (iobuf_arena);
 out:
@@ -162,9 +184,81 @@ out:
 }
 
 
+/* Maps the memory of @iobuf_arena, backed by huge pages if the pool is
+ * configured for it and the arena is a multiple of a huge page, and
+ * preferably placed on the NUMA node the arena belongs to.
+ */
+static void *
+__iobuf_arena_map (struct iobuf_pool *iobuf_pool,
+                   struct iobuf_arena *iobuf_arena)
+{
+        void          *mem_base  = MAP_FAILED;
+        size_t         size      = 0;
+        int            flags     = MAP_PRIVATE|MAP_ANONYMOUS;
+#if defined(GF_LINUX_HOST_OS) && defined(SYS_mbind)
+        unsigned long  nodemask  = 0;
+        int            ret       = 0;
+#endif
+
+        size = iobuf_arena->arena_size;
+
+        if (iobuf_pool->hugepages != GF_IOBUF_HUGEPAGES_OFF &&
+            size % GF_IOBUF_HUGEPAGE_SIZE == 0) {
+#ifdef MAP_HUGETLB
+                if (iobuf_pool->hugepages == GF_IOBUF_HUGEPAGES_EXPLICIT) {
+                        mem_base = mmap (NULL, size, PROT_READ|PROT_WRITE,
+                                         flags|MAP_HUGETLB, -1, 0);
+                        if (mem_base != MAP_FAILED)
+                                iobuf_arena->hugepages =
+                                        GF_IOBUF_HUGEPAGES_EXPLICIT;
+                }
+#endif
+                if (mem_base == MAP_FAILED) {
+                        mem_base = mmap (NULL, size, PROT_READ|PROT_WRITE,
+                                         flags, -1, 0);
+#ifdef MADV_HUGEPAGE
+                        if (mem_base != MAP_FAILED &&
+                            madvise (mem_base, size, MADV_HUGEPAGE) == 0)
+                                iobuf_arena->hugepages =
+                                        GF_IOBUF_HUGEPAGES_TRANSPARENT;
+#endif
+                }
+
+                if (mem_base != MAP_FAILED &&
+                    iobuf_arena->hugepages != iobuf_pool->hugepages)
+                        iobuf_pool->hugepage_fallbacks++;
+        } else {
+                mem_base = mmap (NULL, size, PROT_READ|PROT_WRITE, flags,
+                                 -1, 0);
+        }
+
+        if (mem_base == MAP_FAILED)
+                return mem_base;
+
+#if defined(GF_LINUX_HOST_OS) && defined(SYS_mbind)
+        if (iobuf_pool->numa_nodes > 1) {
+                /* preferred rather than bound, a full node should not fail
+                 * the allocation */
+                nodemask = 1UL << iobuf_arena->numa_node;
+                ret = syscall (SYS_mbind, mem_base, size, MPOL_PREFERRED,
+                               &nodemask, sizeof (nodemask) * 8, 0);
+                if (ret) {
+                        gf_msg_debug ("iobuf", errno, "failed to place arena "
+                                      "on NUMA node %d",
+                                      iobuf_arena->numa_node);
+                        iobuf_pool->numa_stats[iobuf_arena->numa_node]
+                                .placement_fallbacks++;
+                }
+        }
+#endif
+
+        return mem_base;
+}
+
+
 struct iobuf_arena *
 __iobuf_arena_alloc (struct iobuf_pool *iobuf_pool, size_t page_size,
-                     int32_t num_iobufs)
+                     int32_t num_iobufs, int node)
 {
         struct iobuf_arena *iobuf_arena = NULL;
         size_t              rounded_size = 0;
@@ -181,6 +275,7 @@ __iobuf_arena_alloc (struct iobuf_pool *iobuf_pool, size_t page_size,
         INIT_LIST_HEAD (&iobuf_arena->active.list);
         INIT_LIST_HEAD (&iobuf_arena->passive.list);
         iobuf_arena->iobuf_pool = iobuf_pool;
+        iobuf_arena->numa_node = node;
 
         rounded_size = gf_iobuf_get_pagesize (page_size);
 
@@ -189,14 +284,14 @@ __iobuf_arena_alloc (struct iobuf_pool *iobuf_pool, size_t page_size,
 
         iobuf_arena->arena_size = rounded_size * num_iobufs;
 
-        iobuf_arena->mem_base = mmap (NULL, iobuf_arena->arena_size,
-                                      PROT_READ|PROT_WRITE,
-                                      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        iobuf_arena->mem_base = __iobuf_arena_map (iobuf_pool, iobuf_arena);
         if (iobuf_arena->mem_base == MAP_FAILED) {
                 gf_msg (THIS->name, GF_LOG_WARNING, 0, LG_MSG_MAPPING_FAILED,
                         "mapping failed");
                 goto err;
         }
+        iobuf_pool->numa_stats[node].arenas++;
+        iobuf_pool->numa_stats[node].bytes += iobuf_arena->arena_size;
 
         if (iobuf_pool->rdma_registration) {
                 iobuf_pool->rdma_registration (iobuf_pool->device,
@@ -225,7 +320,8 @@ out:
 
 
 struct iobuf_arena *
-__iobuf_arena_unprune (struct iobuf_pool *iobuf_pool, size_t page_size)
+__iobuf_arena_unprune (struct iobuf_pool *iobuf_pool, size_t page_size,
+                       int node)
 {
         struct iobuf_arena *iobuf_arena  = NULL;
         struct iobuf_arena *tmp          = NULL;
@@ -241,7 +337,7 @@ __iobuf_arena_unprune (struct iobuf_pool *iobuf_pool, size_t page_size)
                 return NULL;
         }
 
-        list_for_each_entry (tmp, &iobuf_pool->purge[index], list) {
+        list_for_each_entry (tmp, &iobuf_pool->purge[node][index], list) {
                 list_del_init (&tmp->list);
                 iobuf_arena = tmp;
                 break;
@@ -253,7 +349,7 @@ out:
 
 struct iobuf_arena *
 __iobuf_pool_add_arena (struct iobuf_pool *iobuf_pool, size_t page_size,
-                        int32_t num_pages)
+                        int32_t num_pages, int node)
 {
         struct iobuf_arena *iobuf_arena  = NULL;
         int                 index        = 0;
@@ -266,18 +362,18 @@ __iobuf_pool_add_arena (struct iobuf_pool *iobuf_pool, size_t page_size,
                 return NULL;
         }
 
-        iobuf_arena = __iobuf_arena_unprune (iobuf_pool, page_size);
+        iobuf_arena = __iobuf_arena_unprune (iobuf_pool, page_size, node);
 
         if (!iobuf_arena)
                 iobuf_arena = __iobuf_arena_alloc (iobuf_pool, page_size,
-                                                   num_pages);
+                                                   num_pages, node);
 
         if (!iobuf_arena) {
                 gf_msg (THIS->name, GF_LOG_WARNING, 0, LG_MSG_ARENA_NOT_FOUND,
                         "arena not found");
                 return NULL;
         }
-        list_add (&iobuf_arena->list, &iobuf_pool->arenas[index]);
+        list_add (&iobuf_arena->list, &iobuf_pool->arenas[node][index]);
 
 
         return iobuf_arena;
@@ -295,7 +391,7 @@ iobuf_pool_add_arena (struct iobuf_pool *iobuf_pool, size_t page_size,
         pthread_mutex_lock (&iobuf_pool->mutex);
         {
                 iobuf_arena = __iobuf_pool_add_arena (iobuf_pool, page_size,
-                                                      num_pages);
+                                                      num_pages, 0);
         }
         pthread_mutex_unlock (&iobuf_pool->mutex);
 
@@ -304,54 +400,78 @@ out:
 }
 
 
-/* This function destroys all the iobufs and the iobuf_pool */
-void
-iobuf_pool_destroy (struct iobuf_pool *iobuf_pool)
+static void
+__iobuf_pool_destroy_node (struct iobuf_pool *iobuf_pool, int node)
 {
         struct iobuf_arena *iobuf_arena = NULL;
         struct iobuf_arena *tmp         = NULL;
         int                 i           = 0;
 
+        for (i = 0; i < IOBUF_ARENA_MAX_INDEX; i++) {
+                list_for_each_entry_safe (iobuf_arena, tmp,
+                                &iobuf_pool->arenas[node][i], list) {
+                        list_del_init (&iobuf_arena->list);
+                        iobuf_pool->arena_cnt--;
+
+                        __iobuf_arena_destroy (iobuf_pool, iobuf_arena);
+                }
+                list_for_each_entry_safe (iobuf_arena, tmp,
+                                &iobuf_pool->purge[node][i], list) {
+                        list_del_init (&iobuf_arena->list);
+                        iobuf_pool->arena_cnt--;
+                        __iobuf_arena_destroy (iobuf_pool, iobuf_arena);
+                }
+                /* If there are no iobuf leaks, there should be no
+                 * arenas in the filled list. If at all there are any
+                 * arenas in the filled list, the below function will
+                 * assert.
+                 */
+                list_for_each_entry_safe (iobuf_arena, tmp,
+                                &iobuf_pool->filled[node][i], list) {
+                        list_del_init (&iobuf_arena->list);
+                        iobuf_pool->arena_cnt--;
+                        __iobuf_arena_destroy (iobuf_pool, iobuf_arena);
+                }
+                /* If there are no iobuf leaks, there shoould be
+                 * no standard alloced arenas, iobuf_put will free such
+                 * arenas.
+                 * TODO: Free the stdalloc arenas forcefully if present?
+                 */
+        }
+}
+
+
+/* This function destroys all the iobufs and the iobuf_pool */
+void
+iobuf_pool_destroy (struct iobuf_pool *iobuf_pool)
+{
+        struct iobuf_thread_cache *cache       = NULL;
+        struct iobuf_thread_cache *tmp_cache   = NULL;
+        int                        node        = 0;
+
         GF_VALIDATE_OR_GOTO ("iobuf", iobuf_pool, out);
 
+        if (iobuf_pool->cache_enabled)
+                pthread_key_delete (iobuf_pool->cache_key);
+
         pthread_mutex_lock (&iobuf_pool->mutex);
         {
-                for (i = 0; i < IOBUF_ARENA_MAX_INDEX; i++) {
-                        list_for_each_entry_safe (iobuf_arena, tmp,
-                                        &iobuf_pool->arenas[i], list) {
-                                list_del_init (&iobuf_arena->list);
-                                iobuf_pool->arena_cnt--;
-
-                                __iobuf_arena_destroy (iobuf_pool, iobuf_arena);
-                        }
-                        list_for_each_entry_safe (iobuf_arena, tmp,
-                                        &iobuf_pool->purge[i], list) {
-                                list_del_init (&iobuf_arena->list);
-                                iobuf_pool->arena_cnt--;
-                                __iobuf_arena_destroy (iobuf_pool, iobuf_arena);
-                        }
-                        /* If there are no iobuf leaks, there should be no
-                         * arenas in the filled list. If at all there are any
-                         * arenas in the filled list, the below function will
-                         * assert.
-                         */
-                        list_for_each_entry_safe (iobuf_arena, tmp,
-                                        &iobuf_pool->filled[i], list) {
-                                list_del_init (&iobuf_arena->list);
-                                iobuf_pool->arena_cnt--;
-                                __iobuf_arena_destroy (iobuf_pool, iobuf_arena);
-                        }
-                        /* If there are no iobuf leaks, there shoould be
-                         * no standard alloced arenas, iobuf_put will free such
-                         * arenas.
-                         * TODO: Free the stdalloc arenas forcefully if present?
-                         */
+                list_for_each_entry_safe (cache, tmp_cache,
+                                          &iobuf_pool->thread_caches, list) {
+                        __iobuf_thread_cache_drain (iobuf_pool, cache);
+                        list_del_init (&cache->list);
+                        pthread_spin_destroy (&cache->lock);
+                        FREE (cache);
                 }
+
+                for (node = 0; node < GF_IOBUF_MAX_NUMA_NODES; node++)
+                        __iobuf_pool_destroy_node (iobuf_pool, node);
         }
         pthread_mutex_unlock (&iobuf_pool->mutex);
 
         pthread_mutex_destroy (&iobuf_pool->mutex);
 
+        GF_FREE (iobuf_pool->cpu_node);
         GF_FREE (iobuf_pool);
 
 out:
@@ -378,7 +498,7 @@ iobuf_create_stdalloc_arena (struct iobuf_pool *iobuf_pool)
         iobuf_arena->page_size = 0x7fffffff;
 
         list_add_tail (&iobuf_arena->list,
-                       &iobuf_pool->arenas[IOBUF_ARENA_MAX_INDEX]);
+                       &iobuf_pool->arenas[0][IOBUF_ARENA_MAX_INDEX]);
 
 err:
         return;
@@ -389,6 +509,7 @@ iobuf_pool_new (void)
 {
         struct iobuf_pool  *iobuf_pool = NULL;
         int                 i          = 0;
+        int                 node       = 0;
         size_t              page_size  = 0;
         size_t              arena_size = 0;
         int32_t             num_pages  = 0;
@@ -398,12 +519,16 @@ iobuf_pool_new (void)
         if (!iobuf_pool)
                 goto out;
         INIT_LIST_HEAD (&iobuf_pool->all_arenas);
+        INIT_LIST_HEAD (&iobuf_pool->thread_caches);
         pthread_mutex_init (&iobuf_pool->mutex, NULL);
-        for (i = 0; i <= IOBUF_ARENA_MAX_INDEX; i++) {
-                INIT_LIST_HEAD (&iobuf_pool->arenas[i]);
-                INIT_LIST_HEAD (&iobuf_pool->filled[i]);
-                INIT_LIST_HEAD (&iobuf_pool->purge[i]);
+        for (node = 0; node < GF_IOBUF_MAX_NUMA_NODES; node++) {
+                for (i = 0; i <= IOBUF_ARENA_MAX_INDEX; i++) {
+                        INIT_LIST_HEAD (&iobuf_pool->arenas[node][i]);
+                        INIT_LIST_HEAD (&iobuf_pool->filled[node][i]);
+                        INIT_LIST_HEAD (&iobuf_pool->purge[node][i]);
+                }
         }
+        iobuf_pool->numa_nodes = 1;
 
         iobuf_pool->default_page_size  = 128 * GF_UNIT_KB;
 
@@ -430,6 +555,15 @@ iobuf_pool_new (void)
         /* Need an arena to handle all the bigger iobuf requests */
         iobuf_create_stdalloc_arena (iobuf_pool);
 
+        /* without the key every get/put simply goes to the arenas */
+        if (pthread_key_create (&iobuf_pool->cache_key,
+                                iobuf_thread_cache_destroy) == 0)
+                iobuf_pool->cache_enabled = _gf_true;
+        else
+                gf_msg ("iobuf", GF_LOG_WARNING, 0, LG_MSG_INIT_IOBUF_FAILED,
+                        "failed to create the key for per-thread iobuf "
+                        "caches, disabling them");
+
         iobuf_pool->arena_size = arena_size;
 out:
 
@@ -437,6 +571,145 @@ out:
 }
 
 
+/* Arenas mapped from now on are backed by huge pages as requested by
+ * @hugepages. Arenas smaller than a huge page are always mapped with
+ * normal pages.
+ */
+int
+iobuf_pool_set_hugepages (struct iobuf_pool *iobuf_pool,
+                          gf_iobuf_hugepages_t hugepages)
+{
+        int ret = -1;
+
+        GF_VALIDATE_OR_GOTO ("iobuf", iobuf_pool, out);
+
+#ifndef MAP_HUGETLB
+        if (hugepages == GF_IOBUF_HUGEPAGES_EXPLICIT) {
+                gf_msg ("iobuf", GF_LOG_WARNING, ENOTSUP,
+                        LG_MSG_INIT_IOBUF_FAILED, "explicit huge pages are "
+                        "not supported, using transparent huge pages");
+                hugepages = GF_IOBUF_HUGEPAGES_TRANSPARENT;
+        }
+#endif
+
+        pthread_mutex_lock (&iobuf_pool->mutex);
+        {
+                iobuf_pool->hugepages = hugepages;
+        }
+        pthread_mutex_unlock (&iobuf_pool->mutex);
+
+        ret = 0;
+out:
+        return ret;
+}
+
+
+#ifdef GF_LINUX_HOST_OS
+/* Reads the cpu -> NUMA node map from sysfs. Returns the number of nodes
+ * found, at most GF_IOBUF_MAX_NUMA_NODES (the rest share lists with the
+ * first ones).
+ */
+static int
+iobuf_numa_init (struct iobuf_pool *iobuf_pool)
+{
+        char     path[PATH_MAX] = {0, };
+        FILE    *fp             = NULL;
+        int     *cpu_node       = NULL;
+        int      cpu_count      = 0;
+        int      nodes          = 0;
+        int      node           = 0;
+        int      first          = 0;
+        int      last           = 0;
+        int      cpu            = 0;
+        int      c              = 0;
+
+        cpu_count = sysconf (_SC_NPROCESSORS_CONF);
+        if (cpu_count <= 0)
+                goto out;
+
+        cpu_node = GF_CALLOC (cpu_count, sizeof (*cpu_node),
+                              gf_common_mt_int);
+        if (!cpu_node)
+                goto out;
+
+        for (node = 0; ; node++) {
+                snprintf (path, sizeof (path),
+                          "/sys/devices/system/node/node%d/cpulist", node);
+                fp = fopen (path, "r");
+                if (!fp)
+                        break;
+
+                /* "0-7,16-23" */
+                while (fscanf (fp, "%d", &first) == 1) {
+                        last = first;
+                        c = fgetc (fp);
+                        if (c == '-') {
+                                if (fscanf (fp, "%d", &last) != 1)
+                                        break;
+                                c = fgetc (fp);
+                        }
+                        for (cpu = first; cpu <= last && cpu < cpu_count;
+                             cpu++)
+                                cpu_node[cpu] = node %
+                                                GF_IOBUF_MAX_NUMA_NODES;
+                        if (c != ',')
+                                break;
+                }
+                fclose (fp);
+        }
+        nodes = min (node, GF_IOBUF_MAX_NUMA_NODES);
+
+        if (nodes > 1) {
+                GF_FREE (iobuf_pool->cpu_node);
+                iobuf_pool->cpu_node = cpu_node;
+                iobuf_pool->cpu_count = cpu_count;
+                cpu_node = NULL;
+        }
+out:
+        GF_FREE (cpu_node);
+
+        return nodes;
+}
+#endif /* GF_LINUX_HOST_OS */
+
+
+/* Keeps separate arena lists per NUMA node once @enable is set, so an
+ * iobuf is carved out of memory local to the cpu that asked for it. On a
+ * single node machine this is a no-op.
+ */
+int
+iobuf_pool_set_numa (struct iobuf_pool *iobuf_pool, gf_boolean_t enable)
+{
+        int ret   = -1;
+        int nodes = 1;
+
+        GF_VALIDATE_OR_GOTO ("iobuf", iobuf_pool, out);
+
+        if (enable) {
+#ifdef GF_LINUX_HOST_OS
+                nodes = iobuf_numa_init (iobuf_pool);
+#endif
+                if (nodes <= 1) {
+                        gf_msg_debug ("iobuf", 0, "single NUMA node, "
+                                      "keeping one set of arenas");
+                        nodes = 1;
+                }
+        }
+
+        pthread_mutex_lock (&iobuf_pool->mutex);
+        {
+                /* arenas of nodes going away stay where they are and are
+                 * still found by iobuf_put(), they just get no new users */
+                iobuf_pool->numa_nodes = nodes;
+        }
+        pthread_mutex_unlock (&iobuf_pool->mutex);
+
+        ret = 0;
+out:
+        return ret;
+}
+
+
 void
 __iobuf_arena_prune (struct iobuf_pool *iobuf_pool,
                      struct iobuf_arena *iobuf_arena, int index)
@@ -448,7 +721,10 @@ __iobuf_arena_prune (struct iobuf_pool *iobuf_pool,
          * (ie, at least few iobufs free in arena), that way, there won't
          * be spurious mmap/unmap of buffers
          */
-        if (list_empty (&iobuf_pool->arenas[index]))
+        if (list_empty (&iobuf_pool->arenas[iobuf_arena->numa_node][index]))
+                goto out;
+
+        if (iobuf_arena->pinned)
                 goto out;
 
         /* All cases matched, destroy */
@@ -466,22 +742,31 @@ out:
 void
 iobuf_pool_prune (struct iobuf_pool *iobuf_pool)
 {
-        struct iobuf_arena *iobuf_arena = NULL;
-        struct iobuf_arena *tmp         = NULL;
-        int                 i           = 0;
+        struct iobuf_arena        *iobuf_arena = NULL;
+        struct iobuf_arena        *tmp         = NULL;
+        struct iobuf_thread_cache *cache       = NULL;
+        int                        node        = 0;
+        int                        i           = 0;
 
         GF_VALIDATE_OR_GOTO ("iobuf", iobuf_pool, out);
 
         pthread_mutex_lock (&iobuf_pool->mutex);
         {
-                for (i = 0; i < IOBUF_ARENA_MAX_INDEX; i++) {
-                        if (list_empty (&iobuf_pool->arenas[i])) {
-                                continue;
-                        }
-
-                        list_for_each_entry_safe (iobuf_arena, tmp,
-                                                  &iobuf_pool->purge[i], list) {
-                                __iobuf_arena_prune (iobuf_pool, iobuf_arena, i);
+                /* cached iobufs keep their arenas from being purged */
+                list_for_each_entry (cache, &iobuf_pool->thread_caches, list)
+                        __iobuf_thread_cache_drain (iobuf_pool, cache);
+
+                for (node = 0; node < iobuf_pool->numa_nodes; node++) {
+                        for (i = 0; i < IOBUF_ARENA_MAX_INDEX; i++) {
+                                if (list_empty (&iobuf_pool->arenas[node][i]))
+                                        continue;
+
+                                list_for_each_entry_safe (iobuf_arena, tmp,
+                                                &iobuf_pool->purge[node][i],
+                                                list) {
+                                        __iobuf_arena_prune (iobuf_pool,
+                                                             iobuf_arena, i);
+                                }
                         }
                 }
         }
@@ -492,8 +777,50 @@ out:
 }
 
 
+/* Keeps the arena @iobuf was carved from mapped for as long as the pool
+ * lives and returns its memory in @region. For consumers that register the
+ * memory with the kernel once and keep referring to it, like the fixed
+ * buffers of an io_uring. Fails for iobufs that are not part of an mmap'd
+ * arena.
+ */
+int
+iobuf_arena_pin (struct iobuf_pool *iobuf_pool, struct iobuf *iobuf,
+                 struct iovec *region)
+{
+        struct iobuf_arena *iobuf_arena = NULL;
+        int                 ret         = -1;
+
+        GF_VALIDATE_OR_GOTO ("iobuf", iobuf_pool, out);
+        GF_VALIDATE_OR_GOTO ("iobuf", iobuf, out);
+
+        pthread_mutex_lock (&iobuf_pool->mutex);
+        {
+                iobuf_arena = iobuf->iobuf_arena;
+                if (!iobuf_arena || !iobuf_arena->mem_base ||
+                    iobuf_arena->mem_base == MAP_FAILED)
+                        goto unlock;
+
+                /* stdalloc'ed iobufs hang off the misc arena */
+                if ((char *)iobuf->ptr < (char *)iobuf_arena->mem_base ||
+                    (char *)iobuf->ptr >= (char *)iobuf_arena->mem_base +
+                                          iobuf_arena->arena_size)
+                        goto unlock;
+
+                iobuf_arena->pinned = _gf_true;
+                region->iov_base = iobuf_arena->mem_base;
+                region->iov_len = iobuf_arena->arena_size;
+                ret = 0;
+        }
+unlock:
+        pthread_mutex_unlock (&iobuf_pool->mutex);
+out:
+        return ret;
+}
+
+
 struct iobuf_arena *
-__iobuf_select_arena (struct iobuf_pool *iobuf_pool, size_t page_size)
+__iobuf_select_arena (struct iobuf_pool *iobuf_pool, size_t page_size,
+                      int node)
 {
         struct iobuf_arena *iobuf_arena  = NULL;
         struct iobuf_arena *trav         = NULL;
@@ -510,7 +837,7 @@ __iobuf_select_arena (struct iobuf_pool *iobuf_pool, size_t page_size)
         }
 
         /* look for unused iobuf from the head-most arena */
-        list_for_each_entry (trav, &iobuf_pool->arenas[index], list) {
+        list_for_each_entry (trav, &iobuf_pool->arenas[node][index], list) {
                 if (trav->passive_cnt) {
                         iobuf_arena = trav;
                         break;
@@ -520,7 +847,8 @@ __iobuf_select_arena (struct iobuf_pool *iobuf_pool, size_t page_size)
         if (!iobuf_arena) {
                 /* all arenas were full, find the right count to add */
                 iobuf_arena = __iobuf_pool_add_arena (iobuf_pool, page_size,
-                                                      gf_iobuf_init_config[index].num_pages);
+                                                      gf_iobuf_init_config[index].num_pages,
+                                                      node);
         }
 
 out:
@@ -565,7 +893,8 @@ __iobuf_get (struct iobuf_arena *iobuf_arena, size_t page_size)
                 }
 
                 list_del (&iobuf_arena->list);
-                list_add (&iobuf_arena->list, &iobuf_pool->filled[index]);
+                list_add (&iobuf_arena->list,
+                          &iobuf_pool->filled[iobuf_arena->numa_node][index]);
         }
 
 out:
@@ -581,7 +910,8 @@ iobuf_get_from_stdalloc (struct iobuf_pool *iobuf_pool, size_t page_size)
         int                 ret         = -1;
 
         /* The first arena in the 'MAX-INDEX' will always be used for misc */
-        list_for_each_entry (trav, &iobuf_pool->arenas[IOBUF_ARENA_MAX_INDEX],
+        list_for_each_entry (trav,
+                             &iobuf_pool->arenas[0][IOBUF_ARENA_MAX_INDEX],
                              list) {
                 iobuf_arena = trav;
                 break;
@@ -616,11 +946,184 @@ out:
 }
 
 
+/* How many iobufs of a size a thread may keep for itself: an eighth of
+ * an arena of that size, which bounds a thread to about 1MB of cached
+ * iobufs and keeps a few threads from making the pool allocate arenas
+ * just to fill their caches (the 1MB iobufs are not cached at all).
+ */
+static int
+iobuf_cache_depth (int index)
+{
+        int depth = 0;
+
+        depth = gf_iobuf_init_config[index].num_pages / 8;
+        if (depth > GF_IOBUF_CACHE_SIZE)
+                depth = GF_IOBUF_CACHE_SIZE;
+
+        return depth;
+}
+
+
+static struct iobuf_thread_cache *
+iobuf_thread_cache_get (struct iobuf_pool *iobuf_pool)
+{
+        struct iobuf_thread_cache *cache = NULL;
+
+        if (!iobuf_pool->cache_enabled)
+                return NULL;
+
+        cache = pthread_getspecific (iobuf_pool->cache_key);
+        if (cache)
+                return cache;
+
+        cache = CALLOC (1, sizeof (*cache));
+        if (!cache)
+                return NULL;
+
+        INIT_LIST_HEAD (&cache->list);
+        (void) pthread_spin_init (&cache->lock, PTHREAD_PROCESS_PRIVATE);
+        cache->iobuf_pool = iobuf_pool;
+
+        pthread_mutex_lock (&iobuf_pool->mutex);
+        {
+                list_add (&cache->list, &iobuf_pool->thread_caches);
+        }
+        pthread_mutex_unlock (&iobuf_pool->mutex);
+
+        (void) pthread_setspecific (iobuf_pool->cache_key, cache);
+
+        return cache;
+}
+
+
+/* NUMA node whose arenas serve the calling thread. */
+static int
+iobuf_numa_node (struct iobuf_pool *iobuf_pool)
+{
+        int cpu = -1;
+
+        if (iobuf_pool->numa_nodes <= 1)
+                return 0;
+
+#ifdef GF_LINUX_HOST_OS
+        cpu = sched_getcpu ();
+#endif
+        if (cpu < 0 || cpu >= iobuf_pool->cpu_count)
+                return 0;
+
+        return iobuf_pool->cpu_node[cpu] % iobuf_pool->numa_nodes;
+}
+
+
+/* Hands out an iobuf of @page_size (already rounded) from the cache of
+ * the calling thread. When that is empty the cache is refilled with half
+ * its depth in the same trip to the arenas, as long as there are free
+ * iobufs in arenas that already exist.
+ */
+static struct iobuf *
+iobuf_get_cached (struct iobuf_pool *iobuf_pool, size_t page_size)
+{
+        struct iobuf_thread_cache *cache       = NULL;
+        struct iobuf_cache_class  *class       = NULL;
+        struct iobuf_arena        *iobuf_arena = NULL;
+        struct iobuf_arena        *trav        = NULL;
+        struct iobuf              *iobuf       = NULL;
+        struct iobuf              *refill[GF_IOBUF_CACHE_SIZE];
+        int                        index       = 0;
+        int                        depth       = 0;
+        int                        count       = 0;
+        int                        node        = 0;
+        int                        i           = 0;
+
+        index = gf_iobuf_get_arena_index (page_size);
+        if (index == -1)
+                return NULL;
+
+        depth = iobuf_cache_depth (index);
+        if (depth)
+                cache = iobuf_thread_cache_get (iobuf_pool);
+
+        node = iobuf_numa_node (iobuf_pool);
+
+        if (cache) {
+                class = &cache->classes[index];
+
+                (void) pthread_spin_lock (&cache->lock);
+                if (class->count) {
+                        iobuf = class->iobufs[--class->count];
+                        class->hits++;
+                        if (iobuf->iobuf_arena->numa_node == node)
+                                cache->numa_local[node]++;
+                        else
+                                cache->numa_remote[node]++;
+                } else {
+                        class->misses++;
+                }
+                (void) pthread_spin_unlock (&cache->lock);
+
+                if (iobuf)
+                        goto out;
+        }
+
+        pthread_mutex_lock (&iobuf_pool->mutex);
+        {
+                /* most eligible arena for picking an iobuf */
+                iobuf_arena = __iobuf_select_arena (iobuf_pool, page_size,
+                                                    node);
+                if (!iobuf_arena)
+                        goto unlock;
+
+                iobuf = __iobuf_get (iobuf_arena, page_size);
+                if (!iobuf)
+                        goto unlock;
+
+                /* the arenas of the node only */
+                iobuf_pool->numa_stats[node].local++;
+                if (!cache)
+                        goto unlock;
+
+                while (count < depth / 2) {
+                        iobuf_arena = NULL;
+                        list_for_each_entry (trav,
+                                             &iobuf_pool->arenas[node][index],
+                                             list) {
+                                if (trav->passive_cnt) {
+                                        iobuf_arena = trav;
+                                        break;
+                                }
+                        }
+                        if (!iobuf_arena)
+                                break;
+
+                        refill[count] = __iobuf_get (iobuf_arena, page_size);
+                        if (!refill[count])
+                                break;
+                        count++;
+                }
+        }
+unlock:
+        pthread_mutex_unlock (&iobuf_pool->mutex);
+
+        if (count) {
+                /* only this thread adds to its cache, it is still empty */
+                (void) pthread_spin_lock (&cache->lock);
+                for (i = 0; i < count; i++)
+                        class->iobufs[class->count++] = refill[i];
+                (void) pthread_spin_unlock (&cache->lock);
+        }
+
+out:
+        if (iobuf)
+                iobuf_ref (iobuf);
+
+        return iobuf;
+}
+
+
 struct iobuf *
 iobuf_get2 (struct iobuf_pool *iobuf_pool, size_t page_size)
 {
         struct iobuf       *iobuf        = NULL;
-        struct iobuf_arena *iobuf_arena  = NULL;
         size_t              rounded_size = 0;
 
         if (page_size == 0) {
@@ -642,23 +1145,7 @@ iobuf_get2 (struct iobuf_pool *iobuf_pool, size_t page_size)
                 return iobuf;
         }
 
-        pthread_mutex_lock (&iobuf_pool->mutex);
-        {
-                /* most eligible arena for picking an iobuf */
-                iobuf_arena = __iobuf_select_arena (iobuf_pool, rounded_size);
-                if (!iobuf_arena)
-                        goto unlock;
-
-                iobuf = __iobuf_get (iobuf_arena, rounded_size);
-                if (!iobuf)
-                        goto unlock;
-
-                iobuf_ref (iobuf);
-         }
-unlock:
-        pthread_mutex_unlock (&iobuf_pool->mutex);
-
-        return iobuf;
+        return iobuf_get_cached (iobuf_pool, rounded_size);
 }
 
 struct iobuf *
@@ -697,33 +1184,14 @@ struct iobuf *
 iobuf_get (struct iobuf_pool *iobuf_pool)
 {
         struct iobuf       *iobuf        = NULL;
-        struct iobuf_arena *iobuf_arena  = NULL;
 
         GF_VALIDATE_OR_GOTO ("iobuf", iobuf_pool, out);
 
-        pthread_mutex_lock (&iobuf_pool->mutex);
-        {
-                /* most eligible arena for picking an iobuf */
-                iobuf_arena = __iobuf_select_arena (iobuf_pool,
-                                                    iobuf_pool->default_page_size);
-                if (!iobuf_arena) {
-                        gf_msg (THIS->name, GF_LOG_WARNING, 0,
-                                LG_MSG_ARENA_NOT_FOUND, "arena not found");
-                        goto unlock;
-                }
-
-                iobuf = __iobuf_get (iobuf_arena,
-                                     iobuf_pool->default_page_size);
-                if (!iobuf) {
-                        gf_msg (THIS->name, GF_LOG_WARNING, 0,
-                                LG_MSG_IOBUF_NOT_FOUND, "iobuf not found");
-                        goto unlock;
-                }
-
-                iobuf_ref (iobuf);
+        iobuf = iobuf_get_cached (iobuf_pool, iobuf_pool->default_page_size);
+        if (!iobuf) {
+                gf_msg (THIS->name, GF_LOG_WARNING, 0,
+                        LG_MSG_IOBUF_NOT_FOUND, "iobuf not found");
         }
-unlock:
-        pthread_mutex_unlock (&iobuf_pool->mutex);
 
 out:
         return iobuf;
@@ -754,7 +1222,8 @@ __iobuf_put (struct iobuf *iobuf, struct iobuf_arena *iobuf_arena)
 
         if (iobuf_arena->passive_cnt == 0) {
                 list_del (&iobuf_arena->list);
-                list_add_tail (&iobuf_arena->list, &iobuf_pool->arenas[index]);
+                list_add_tail (&iobuf_arena->list,
+                               &iobuf_pool->arenas[iobuf_arena->numa_node][index]);
         }
 
         list_del_init (&iobuf->list);
@@ -770,7 +1239,8 @@ __iobuf_put (struct iobuf *iobuf, struct iobuf_arena *iobuf_arena)
 
         if (iobuf_arena->active_cnt == 0) {
                 list_del (&iobuf_arena->list);
-                list_add_tail (&iobuf_arena->list, &iobuf_pool->purge[index]);
+                list_add_tail (&iobuf_arena->list,
+                               &iobuf_pool->purge[iobuf_arena->numa_node][index]);
                 __iobuf_arena_prune (iobuf_pool, iobuf_arena, index);
         }
 out:
@@ -778,11 +1248,126 @@ out:
 }
 
 
+/* Returns everything @cache holds to the arenas. Must be called with
+ * iobuf_pool->mutex held.
+ */
+static void
+__iobuf_thread_cache_drain (struct iobuf_pool *iobuf_pool,
+                            struct iobuf_thread_cache *cache)
+{
+        struct iobuf_cache_class *class = NULL;
+        struct iobuf             *iobuf = NULL;
+        int                       i     = 0;
+
+        (void) pthread_spin_lock (&cache->lock);
+        for (i = 0; i < IOBUF_ARENA_MAX_INDEX; i++) {
+                class = &cache->classes[i];
+                while (class->count) {
+                        iobuf = class->iobufs[--class->count];
+                        __iobuf_put (iobuf, iobuf->iobuf_arena);
+                }
+        }
+        (void) pthread_spin_unlock (&cache->lock);
+}
+
+
+/* pthread key destructor, runs when a thread that used the pool exits */
+static void
+iobuf_thread_cache_destroy (void *data)
+{
+        struct iobuf_thread_cache *cache      = data;
+        struct iobuf_pool         *iobuf_pool = NULL;
+        int                        i          = 0;
+
+        iobuf_pool = cache->iobuf_pool;
+
+        pthread_mutex_lock (&iobuf_pool->mutex);
+        {
+                __iobuf_thread_cache_drain (iobuf_pool, cache);
+                for (i = 0; i < IOBUF_ARENA_MAX_INDEX; i++) {
+                        iobuf_pool->cache_hits[i] += cache->classes[i].hits;
+                        iobuf_pool->cache_misses[i] +=
+                                cache->classes[i].misses;
+                }
+                for (i = 0; i < GF_IOBUF_MAX_NUMA_NODES; i++) {
+                        iobuf_pool->numa_stats[i].local +=
+                                cache->numa_local[i];
+                        iobuf_pool->numa_stats[i].remote +=
+                                cache->numa_remote[i];
+                }
+                list_del_init (&cache->list);
+        }
+        pthread_mutex_unlock (&iobuf_pool->mutex);
+
+        pthread_spin_destroy (&cache->lock);
+        FREE (cache);
+}
+
+
+/* Keeps @iobuf in the cache of the calling thread. A full cache first
+ * hands its older half back to the arenas in one go. Returns -1 if the
+ * iobuf has to be put back to its arena by the caller.
+ */
+static int
+iobuf_put_cached (struct iobuf_pool *iobuf_pool, struct iobuf *iobuf,
+                  int index)
+{
+        struct iobuf_thread_cache *cache = NULL;
+        struct iobuf_cache_class  *class = NULL;
+        struct iobuf              *flush[GF_IOBUF_CACHE_SIZE];
+        int                        depth = 0;
+        int                        count = 0;
+        int                        i     = 0;
+
+        depth = iobuf_cache_depth (index);
+        if (!depth)
+                return -1;
+
+        cache = iobuf_thread_cache_get (iobuf_pool);
+        if (!cache)
+                return -1;
+
+        class = &cache->classes[index];
+
+        /* undo iobuf_get_page_aligned(), __iobuf_put() does the same */
+        if (iobuf->free_ptr) {
+                iobuf->ptr = iobuf->free_ptr;
+                iobuf->free_ptr = NULL;
+        }
+
+        (void) pthread_spin_lock (&cache->lock);
+        {
+                if (class->count == depth) {
+                        count = (depth + 1) / 2;
+                        memcpy (flush, class->iobufs,
+                                count * sizeof (*flush));
+                        memmove (class->iobufs, class->iobufs + count,
+                                 (depth - count) * sizeof (*flush));
+                        class->count -= count;
+                }
+                class->iobufs[class->count++] = iobuf;
+        }
+        (void) pthread_spin_unlock (&cache->lock);
+
+        if (count) {
+                pthread_mutex_lock (&iobuf_pool->mutex);
+                {
+                        for (i = 0; i < count; i++)
+                                __iobuf_put (flush[i], flush[i]->iobuf_arena);
+                }
+                pthread_mutex_unlock (&iobuf_pool->mutex);
+        }
+
+        return 0;
+}
+
+
 void
 iobuf_put (struct iobuf *iobuf)
 {
         struct iobuf_arena *iobuf_arena = NULL;
         struct iobuf_pool  *iobuf_pool = NULL;
+        int                 index = 0;
 
         GF_VALIDATE_OR_GOTO ("iobuf", iobuf, out);
 
@@ -800,6 +1385,10 @@ iobuf_put (struct iobuf *iobuf)
                 return;
         }
 
+        index = gf_iobuf_get_arena_index (iobuf_arena->page_size);
+        if (index != -1 && iobuf_put_cached (iobuf_pool, iobuf, index) == 0)
+                return;
+
         pthread_mutex_lock (&iobuf_pool->mutex);
         {
                 __iobuf_put (iobuf, iobuf_arena);
@@ -1134,6 +1723,10 @@ iobuf_arena_info_dump (struct iobuf_arena *iobuf_arena, const char *key_prefix)
         gf_proc_dump_write(key, "%"PRIu64, iobuf_arena->max_active);
         gf_proc_dump_build_key(key, key_prefix, "page_size");
         gf_proc_dump_write(key, "%"PRIu64, iobuf_arena->page_size);
+        gf_proc_dump_build_key(key, key_prefix, "numa_node");
+        gf_proc_dump_write(key, "%d", iobuf_arena->numa_node);
+        gf_proc_dump_build_key(key, key_prefix, "hugepages");
+        gf_proc_dump_write(key, "%d", iobuf_arena->hugepages);
         list_for_each_entry (trav, &iobuf_arena->active.list, list) {
                 gf_proc_dump_build_key(key, key_prefix,"active_iobuf.%d", i++);
                 gf_proc_dump_add_section(key);
@@ -1148,7 +1741,16 @@ void
 iobuf_stats_dump (struct iobuf_pool *iobuf_pool)
 {
         char               msg[1024];
+        char               key[GF_DUMP_MAX_BUF_LEN];
         struct iobuf_arena *trav = NULL;
+        struct iobuf_thread_cache *cache = NULL;
+        struct iobuf_numa_stats *stats = NULL;
+        uint64_t           hits = 0;
+        uint64_t           misses = 0;
+        uint64_t           local = 0;
+        uint64_t           remote = 0;
+        int                cached = 0;
+        int                node = 0;
         int                i = 1;
         int                j = 0;
         int                ret = -1;
@@ -1172,30 +1774,94 @@ iobuf_stats_dump (struct iobuf_pool *iobuf_pool)
                            iobuf_pool->arena_cnt);
         gf_proc_dump_write("iobuf_pool.request_misses", "%"PRId64,
                            iobuf_pool->request_misses);
+        gf_proc_dump_write("iobuf_pool.hugepages", "%d",
+                           iobuf_pool->hugepages);
+        gf_proc_dump_write("iobuf_pool.hugepage_fallbacks", "%"PRIu64,
+                           iobuf_pool->hugepage_fallbacks);
+        gf_proc_dump_write("iobuf_pool.numa_nodes", "%d",
+                           iobuf_pool->numa_nodes);
+
+        for (node = 0; node < GF_IOBUF_MAX_NUMA_NODES; node++) {
+                stats = &iobuf_pool->numa_stats[node];
+                /* nodes no longer in use are shown while arenas are left */
+                if (node >= iobuf_pool->numa_nodes && !stats->arenas)
+                        continue;
+
+                local = stats->local;
+                remote = stats->remote;
+                list_for_each_entry (cache, &iobuf_pool->thread_caches, list) {
+                        (void) pthread_spin_lock (&cache->lock);
+                        local += cache->numa_local[node];
+                        remote += cache->numa_remote[node];
+                        (void) pthread_spin_unlock (&cache->lock);
+                }
+
+                snprintf (msg, sizeof (msg), "iobuf_pool.numa.%d", node);
+                gf_proc_dump_build_key (key, msg, "arenas");
+                gf_proc_dump_write (key, "%d", stats->arenas);
+                gf_proc_dump_build_key (key, msg, "bytes");
+                gf_proc_dump_write (key, "%"PRIu64, stats->bytes);
+                gf_proc_dump_build_key (key, msg, "local_allocs");
+                gf_proc_dump_write (key, "%"PRIu64, local);
+                gf_proc_dump_build_key (key, msg, "remote_allocs");
+                gf_proc_dump_write (key, "%"PRIu64, remote);
+                gf_proc_dump_build_key (key, msg, "placement_fallbacks");
+                gf_proc_dump_write (key, "%"PRIu64,
+                                    stats->placement_fallbacks);
+        }
 
         for (j = 0; j < IOBUF_ARENA_MAX_INDEX; j++) {
-                list_for_each_entry (trav, &iobuf_pool->arenas[j], list) {
-                        snprintf(msg, sizeof(msg),
-                                 "arena.%d", i);
-                        gf_proc_dump_add_section(msg);
-                        iobuf_arena_info_dump(trav,msg);
-                        i++;
-                }
-                list_for_each_entry (trav, &iobuf_pool->purge[j], list) {
-                        snprintf(msg, sizeof(msg),
-                                 "purge.%d", i);
-                        gf_proc_dump_add_section(msg);
-                        iobuf_arena_info_dump(trav,msg);
-                        i++;
-                }
-                list_for_each_entry (trav, &iobuf_pool->filled[j], list) {
-                        snprintf(msg, sizeof(msg),
-                                 "filled.%d", i);
-                        gf_proc_dump_add_section(msg);
-                        iobuf_arena_info_dump(trav,msg);
-                        i++;
+                hits = iobuf_pool->cache_hits[j];
+                misses = iobuf_pool->cache_misses[j];
+                cached = 0;
+                list_for_each_entry (cache, &iobuf_pool->thread_caches, list) {
+                        (void) pthread_spin_lock (&cache->lock);
+                        hits += cache->classes[j].hits;
+                        misses += cache->classes[j].misses;
+                        cached += cache->classes[j].count;
+                        (void) pthread_spin_unlock (&cache->lock);
                 }
 
+                snprintf (msg, sizeof (msg), "iobuf_pool.cache.%zu",
+                          gf_iobuf_init_config[j].pagesize);
+                gf_proc_dump_build_key (key, msg, "hits");
+                gf_proc_dump_write (key, "%"PRIu64, hits);
+                gf_proc_dump_build_key (key, msg, "misses");
+                gf_proc_dump_write (key, "%"PRIu64, misses);
+                gf_proc_dump_build_key (key, msg, "cached");
+                gf_proc_dump_write (key, "%d", cached);
+        }
+
+        for (node = 0; node < GF_IOBUF_MAX_NUMA_NODES; node++) {
+                for (j = 0; j < IOBUF_ARENA_MAX_INDEX; j++) {
+                        list_for_each_entry (trav,
+                                             &iobuf_pool->arenas[node][j],
+                                             list) {
+                                snprintf(msg, sizeof(msg),
+                                         "arena.%d", i);
+                                gf_proc_dump_add_section(msg);
+                                iobuf_arena_info_dump(trav,msg);
+                                i++;
+                        }
+                        list_for_each_entry (trav,
+                                             &iobuf_pool->purge[node][j],
+                                             list) {
+                                snprintf(msg, sizeof(msg),
+                                         "purge.%d", i);
+                                gf_proc_dump_add_section(msg);
+                                iobuf_arena_info_dump(trav,msg);
+                                i++;
+                        }
+                        list_for_each_entry (trav,
+                                             &iobuf_pool->filled[node][j],
+                                             list) {
+                                snprintf(msg, sizeof(msg),
+                                         "filled.%d", i);
+                                gf_proc_dump_add_section(msg);
+                                iobuf_arena_info_dump(trav,msg);
+                                i++;
+                        }
+                }
         }
 
         pthread_mutex_unlock(&iobuf_pool->mutex);
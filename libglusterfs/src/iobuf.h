@@ -21,6 +21,24 @@
 
 #define GF_RDMA_DEVICE_COUNT 8
 
+/* upper bound of iobufs a thread keeps per page size, see
+ * iobuf_cache_depth() for the actual depth of each size */
+#define GF_IOBUF_CACHE_SIZE 16
+
+/* NUMA nodes that get their own arena lists, threads on higher nodes use
+ * the lists of node (node % GF_IOBUF_MAX_NUMA_NODES) */
+#define GF_IOBUF_MAX_NUMA_NODES 8
+
+/* arenas of at least this size are backed by huge pages when asked to */
+#define GF_IOBUF_HUGEPAGE_SIZE  (2 * GF_UNIT_MB)
+
+typedef enum {
+        GF_IOBUF_HUGEPAGES_OFF = 0,
+        GF_IOBUF_HUGEPAGES_TRANSPARENT, /* madvise(MADV_HUGEPAGE) */
+        GF_IOBUF_HUGEPAGES_EXPLICIT,    /* MAP_HUGETLB, from the reserved
+                                           hugetlbfs pool */
+} gf_iobuf_hugepages_t;
+
 /* Lets try to define the new anonymous mapping
  * flag, in case the system is still using the
  * now deprecated MAP_ANON flag.
@@ -49,6 +67,9 @@ struct iobuf_arena;
 /* expandable and contractable pool of memory, internally broken into arenas */
 struct iobuf_pool;
 
+/* iobufs a thread took from the arenas but is not using, per page size */
+struct iobuf_thread_cache;
+
 struct iobuf_init_config {
         size_t   pagesize;
         int32_t  num_pages;
@@ -103,6 +124,47 @@ struct iobuf_arena {
                                            (unused by itself) */
         uint64_t            alloc_cnt;  /* total allocs in this pool */
         int                 max_active; /* max active buffers at a given time */
+
+        int                 numa_node;  /* arena lists this arena is on */
+        gf_iobuf_hugepages_t hugepages; /* how mem_base is backed */
+        gf_boolean_t        pinned;     /* mem_base was handed to the kernel,
+                                           never purge */
+};
+
+
+struct iobuf_cache_class {
+        int                 count;
+        struct iobuf       *iobufs[GF_IOBUF_CACHE_SIZE];
+        uint64_t            hits;
+        uint64_t            misses;
+};
+
+
+struct iobuf_thread_cache {
+        struct list_head          list; /* iobuf_pool->thread_caches */
+        struct iobuf_pool        *iobuf_pool;
+        /* taken by the owning thread on every get/put, by others only for
+           statedump and when the pool drains all caches */
+        pthread_spinlock_t        lock;
+        struct iobuf_cache_class  classes[GF_VARIABLE_IOBUF_COUNT];
+        /* cache hits by the node of the thread, see iobuf_numa_stats */
+        uint64_t                  numa_local[GF_IOBUF_MAX_NUMA_NODES];
+        uint64_t                  numa_remote[GF_IOBUF_MAX_NUMA_NODES];
+};
+
+
+/* Per NUMA node counters, under iobuf_pool->mutex. Allocations are counted
+ * by the node of the thread that asked, as local when the iobuf comes from
+ * an arena of that node and remote otherwise (it was cached by a thread
+ * that has moved since, or freed into the cache by a thread on another
+ * node). */
+struct iobuf_numa_stats {
+        int                 arenas;     /* mapped for the node */
+        uint64_t            bytes;      /* in those arenas */
+        uint64_t            local;
+        uint64_t            remote;
+        uint64_t            placement_fallbacks; /* arenas mbind() could
+                                                    not place on it */
 };
 
 
@@ -114,16 +176,25 @@ struct iobuf_pool {
 
         int                 arena_cnt;
         struct list_head    all_arenas;
-        struct list_head    arenas[GF_VARIABLE_IOBUF_COUNT];
-        /* array of arenas. Each element of the array is a list of arenas
-           holding iobufs of particular page_size */
+        struct list_head    arenas[GF_IOBUF_MAX_NUMA_NODES][GF_VARIABLE_IOBUF_COUNT];
+        /* array of arenas per NUMA node. Each element of the array is a
+           list of arenas holding iobufs of particular page_size. Without
+           NUMA awareness only node 0 is used. */
 
-        struct list_head    filled[GF_VARIABLE_IOBUF_COUNT];
+        struct list_head    filled[GF_IOBUF_MAX_NUMA_NODES][GF_VARIABLE_IOBUF_COUNT];
         /* array of arenas without free iobufs */
 
-        struct list_head    purge[GF_VARIABLE_IOBUF_COUNT];
+        struct list_head    purge[GF_IOBUF_MAX_NUMA_NODES][GF_VARIABLE_IOBUF_COUNT];
         /* array of of arenas which can be purged */
 
+        gf_iobuf_hugepages_t hugepages;
+        uint64_t            hugepage_fallbacks; /* arenas that could not get
+                                                   huge pages */
+        int                 numa_nodes; /* > 1 if arenas are per node */
+        int                 cpu_count;
+        int                *cpu_node;   /* NUMA node of each cpu */
+        struct iobuf_numa_stats numa_stats[GF_IOBUF_MAX_NUMA_NODES];
+
         uint64_t            request_misses; /* mostly the requests for higher
                                               value of iobufs */
         int                 rdma_device_count;
@@ -132,10 +203,22 @@ struct iobuf_pool {
         int (*rdma_registration)(void **, void*);
         int (*rdma_deregistration)(struct list_head**, struct iobuf_arena *);
 
+        /* per-thread caches in front of the arenas */
+        gf_boolean_t        cache_enabled;
+        pthread_key_t       cache_key;
+        struct list_head    thread_caches;
+        /* hits and misses of threads that have exited */
+        uint64_t            cache_hits[GF_VARIABLE_IOBUF_COUNT];
+        uint64_t            cache_misses[GF_VARIABLE_IOBUF_COUNT];
 };
 
 
 struct iobuf_pool *iobuf_pool_new (void);
+int iobuf_pool_set_hugepages (struct iobuf_pool *iobuf_pool,
+                              gf_iobuf_hugepages_t hugepages);
+int iobuf_pool_set_numa (struct iobuf_pool *iobuf_pool, gf_boolean_t enable);
+int iobuf_arena_pin (struct iobuf_pool *iobuf_pool, struct iobuf *iobuf,
+                     struct iovec *region);
 void iobuf_pool_destroy (struct iobuf_pool *iobuf_pool);
 struct iobuf *iobuf_get (struct iobuf_pool *iobuf_pool);
 void iobuf_unref (struct iobuf *iobuf);
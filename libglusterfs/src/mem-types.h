@@ -176,6 +176,9 @@ enum gf_common_mem_types_ {
         gf_common_ping_local_t,
         gf_common_volfile_t,
         gf_common_mt_mgmt_v3_lock_timer_t,
+        gf_common_mt_rpcclnt_savedframe_hash_t,
+        gf_common_mt_dict_index_t,
+        gf_common_mt_rpcsvc_queue_t,
         gf_common_mt_end
 };
 #endif
@@ -16,6 +16,7 @@
 #include "stack.h"
 #include "common-utils.h"
 #include "syscall.h"
+#include "syncop.h"
 
 
 #ifdef HAVE_MALLOC_H
@@ -859,8 +860,10 @@ gf_proc_dump_info (int signum, glusterfs_ctx_t *ctx)
 
         if (GF_PROC_DUMP_IS_OPTION_ENABLED (iobuf))
                 iobuf_stats_dump (ctx->iobuf_pool);
-        if (GF_PROC_DUMP_IS_OPTION_ENABLED (callpool))
+        if (GF_PROC_DUMP_IS_OPTION_ENABLED (callpool)) {
                 gf_proc_dump_pending_frames (ctx->pool);
+                syncenv_dump (ctx->env);
+        }
 
         /* dictionary stats */
         gf_proc_dump_add_section ("dict");
@@ -11,6 +11,237 @@
 #include "syncop.h"
 #include "libglusterfs-messages.h"
 
+#include "timespec.h"
+#include "statedump.h"
+
+#include <sys/mman.h>
+
+#ifdef SYNCTASK_FAST_SWITCH
+/*
+ * synctask_ctx_swap (&from_sp, to_sp) pushes the callee-saved registers on
+ * the current stack, stores the stack pointer in from_sp, loads to_sp and
+ * pops the registers saved there. A new task's stack is prepared by
+ * synctask_ctx_make() to "return" into synctask_ctx_entry, which calls the
+ * function left in a callee-saved register and never returns.
+ */
+void synctask_ctx_swap (void **from, void *to);
+void synctask_ctx_entry (void);
+
+#if defined(__x86_64__)
+__asm__ (
+"        .pushsection .text\n"
+"        .globl  synctask_ctx_swap\n"
+"        .hidden synctask_ctx_swap\n"
+"        .type   synctask_ctx_swap, @function\n"
+"        .p2align 4\n"
+"synctask_ctx_swap:\n"
+"        pushq   %rbp\n"
+"        pushq   %rbx\n"
+"        pushq   %r12\n"
+"        pushq   %r13\n"
+"        pushq   %r14\n"
+"        pushq   %r15\n"
+"        subq    $8, %rsp\n"
+"        stmxcsr (%rsp)\n"
+"        fnstcw  4(%rsp)\n"
+"        movq    %rsp, (%rdi)\n"
+"        movq    %rsi, %rsp\n"
+"        ldmxcsr (%rsp)\n"
+"        fldcw   4(%rsp)\n"
+"        addq    $8, %rsp\n"
+"        popq    %r15\n"
+"        popq    %r14\n"
+"        popq    %r13\n"
+"        popq    %r12\n"
+"        popq    %rbx\n"
+"        popq    %rbp\n"
+"        ret\n"
+"        .size   synctask_ctx_swap, .-synctask_ctx_swap\n"
+"        .globl  synctask_ctx_entry\n"
+"        .hidden synctask_ctx_entry\n"
+"        .type   synctask_ctx_entry, @function\n"
+"        .p2align 4\n"
+"synctask_ctx_entry:\n"
+"        callq   *%r13\n"
+"        ud2\n"
+"        .size   synctask_ctx_entry, .-synctask_ctx_entry\n"
+"        .popsection\n"
+);
+
+/* mxcsr + x87 control word, r15, r14, r13, r12, rbx, rbp, return address */
+#define SYNCTASK_CTX_WORDS 8
+
+static void *
+synctask_ctx_make (void *stack, size_t size, void (*fn) (void))
+{
+        uintptr_t *sp = NULL;
+
+        /* the entry code is reached by ret, so the stack has to be 16-byte
+         * aligned right after the return address is popped */
+        sp = (uintptr_t *)(((uintptr_t)stack + size) & ~(uintptr_t)15);
+        sp -= 2 + SYNCTASK_CTX_WORDS;
+
+        memset (sp, 0, SYNCTASK_CTX_WORDS * sizeof (*sp));
+        sp[0] = 0x1F80 | ((uintptr_t)0x037F << 32); /* default mxcsr, fpcw */
+        sp[3] = (uintptr_t)fn;                      /* r13 */
+        sp[7] = (uintptr_t)synctask_ctx_entry;
+
+        return sp;
+}
+
+#elif defined(__aarch64__)
+__asm__ (
+"        .pushsection .text\n"
+"        .globl  synctask_ctx_swap\n"
+"        .hidden synctask_ctx_swap\n"
+"        .type   synctask_ctx_swap, %function\n"
+"        .p2align 4\n"
+"synctask_ctx_swap:\n"
+"        sub     sp, sp, #160\n"
+"        stp     x19, x20, [sp, #0]\n"
+"        stp     x21, x22, [sp, #16]\n"
+"        stp     x23, x24, [sp, #32]\n"
+"        stp     x25, x26, [sp, #48]\n"
+"        stp     x27, x28, [sp, #64]\n"
+"        stp     x29, x30, [sp, #80]\n"
+"        stp     d8, d9, [sp, #96]\n"
+"        stp     d10, d11, [sp, #112]\n"
+"        stp     d12, d13, [sp, #128]\n"
+"        stp     d14, d15, [sp, #144]\n"
+"        mov     x2, sp\n"
+"        str     x2, [x0]\n"
+"        mov     sp, x1\n"
+"        ldp     x19, x20, [sp, #0]\n"
+"        ldp     x21, x22, [sp, #16]\n"
+"        ldp     x23, x24, [sp, #32]\n"
+"        ldp     x25, x26, [sp, #48]\n"
+"        ldp     x27, x28, [sp, #64]\n"
+"        ldp     x29, x30, [sp, #80]\n"
+"        ldp     d8, d9, [sp, #96]\n"
+"        ldp     d10, d11, [sp, #112]\n"
+"        ldp     d12, d13, [sp, #128]\n"
+"        ldp     d14, d15, [sp, #144]\n"
+"        add     sp, sp, #160\n"
+"        ret\n"
+"        .size   synctask_ctx_swap, .-synctask_ctx_swap\n"
+"        .globl  synctask_ctx_entry\n"
+"        .hidden synctask_ctx_entry\n"
+"        .type   synctask_ctx_entry, %function\n"
+"        .p2align 4\n"
+"synctask_ctx_entry:\n"
+"        blr     x19\n"
+"        brk     #1000\n"
+"        .size   synctask_ctx_entry, .-synctask_ctx_entry\n"
+"        .popsection\n"
+);
+
+/* x19-x28, x29, x30, d8-d15 */
+#define SYNCTASK_CTX_WORDS 20
+
+static void *
+synctask_ctx_make (void *stack, size_t size, void (*fn) (void))
+{
+        uintptr_t *sp = NULL;
+
+        sp = (uintptr_t *)(((uintptr_t)stack + size) & ~(uintptr_t)15);
+        sp -= SYNCTASK_CTX_WORDS;
+
+        memset (sp, 0, SYNCTASK_CTX_WORDS * sizeof (*sp));
+        sp[0] = (uintptr_t)fn;                      /* x19 */
+        sp[11] = (uintptr_t)synctask_ctx_entry;     /* x30 */
+
+        return sp;
+}
+#endif
+#endif /* SYNCTASK_FAST_SWITCH */
+
+
+/*
+ * Task stacks are mapped with a PROT_NONE guard page below them, so that an
+ * overflow faults right away instead of corrupting whatever the allocator
+ * put next to it. Mapping and unmapping 2MB for each task is the bulk of
+ * the cost of a short synctask, so released stacks are kept on a free list
+ * for the next task of the same stack size.
+ */
+struct synctask_stack {
+        struct list_head  list;
+        size_t            size;
+};
+
+static struct {
+        pthread_mutex_t   lock;
+        struct list_head  free;
+        int               count;
+} synctask_stacks = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .free = {&synctask_stacks.free, &synctask_stacks.free},
+};
+
+static void *
+synctask_stack_get (size_t size)
+{
+        struct synctask_stack *stack = NULL;
+        struct synctask_stack *tmp   = NULL;
+        size_t                 page  = sysconf (_SC_PAGESIZE);
+        char                  *base  = NULL;
+
+        pthread_mutex_lock (&synctask_stacks.lock);
+        {
+                list_for_each_entry (tmp, &synctask_stacks.free, list) {
+                        if (tmp->size == size) {
+                                list_del (&tmp->list);
+                                synctask_stacks.count--;
+                                stack = tmp;
+                                break;
+                        }
+                }
+        }
+        pthread_mutex_unlock (&synctask_stacks.lock);
+
+        if (stack)
+                return stack;
+
+        base = mmap (NULL, size + page, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+                gf_msg ("syncop", GF_LOG_ERROR, errno, LG_MSG_NO_MEMORY,
+                        "failed to map a stack of %zu bytes", size);
+                return NULL;
+        }
+
+        if (mprotect (base, page, PROT_NONE) != 0) {
+                gf_msg ("syncop", GF_LOG_WARNING, errno, LG_MSG_NO_MEMORY,
+                        "failed to set up stack guard page");
+        }
+
+        return base + page;
+}
+
+static void
+synctask_stack_put (void *ptr, size_t size)
+{
+        struct synctask_stack *stack = ptr;
+        size_t                 page  = sysconf (_SC_PAGESIZE);
+
+        if (!ptr)
+                return;
+
+        pthread_mutex_lock (&synctask_stacks.lock);
+        {
+                if (synctask_stacks.count < SYNCENV_STACK_POOL_MAX) {
+                        stack->size = size;
+                        list_add (&stack->list, &synctask_stacks.free);
+                        synctask_stacks.count++;
+                        stack = NULL;
+                }
+        }
+        pthread_mutex_unlock (&synctask_stacks.lock);
+
+        if (stack)
+                munmap ((char *)ptr - page, size + page);
+}
+
+
 int
 syncopctx_setfsuid (void *uid)
 {
@@ -245,14 +476,16 @@ out:
         return ret;
 }
 
-static void
+/* Task state changes happen under task->lock. Returns true if the task has
+ * to be put on a run queue.
+ */
+static gf_boolean_t
 __run (struct synctask *task)
 {
         struct syncenv *env = NULL;
 
         env = task->env;
 
-        list_del_init (&task->all_tasks);
         switch (task->state) {
         case SYNCTASK_INIT:
         case SYNCTASK_SUSPEND:
@@ -260,25 +493,23 @@ __run (struct synctask *task)
         case SYNCTASK_RUN:
                 gf_msg_debug (task->xl->name, 0, "re-running already running"
                               " task");
-                env->runcount--;
-                break;
+                return _gf_false;
         case SYNCTASK_WAIT:
-                env->waitcount--;
+                GF_ATOMIC_DEC (env->waitcount);
                 break;
         case SYNCTASK_DONE:
                 gf_msg (task->xl->name, GF_LOG_WARNING, 0,
                         LG_MSG_COMPLETED_TASK, "running completed task");
-		return;
+		return _gf_false;
 	case SYNCTASK_ZOMBIE:
 		gf_msg (task->xl->name, GF_LOG_WARNING, 0,
                         LG_MSG_WAKE_UP_ZOMBIE, "attempted to wake up "
                         "zombie!!");
-		return;
+		return _gf_false;
         }
 
-        list_add_tail (&task->all_tasks, &env->runq);
-        env->runcount++;
         task->state = SYNCTASK_RUN;
+        return _gf_true;
 }
 
 
@@ -289,20 +520,16 @@ __wait (struct synctask *task)
 
         env = task->env;
 
-        list_del_init (&task->all_tasks);
         switch (task->state) {
         case SYNCTASK_INIT:
         case SYNCTASK_SUSPEND:
-                break;
         case SYNCTASK_RUN:
-                env->runcount--;
                 break;
         case SYNCTASK_WAIT:
                 gf_msg (task->xl->name, GF_LOG_WARNING, 0,
                         LG_MSG_REWAITING_TASK, "re-waiting already waiting "
                         "task");
-                env->waitcount--;
-                break;
+                return;
         case SYNCTASK_DONE:
                 gf_msg (task->xl->name, GF_LOG_WARNING, 0,
                         LG_MSG_COMPLETED_TASK,
@@ -315,12 +542,93 @@ __wait (struct synctask *task)
 		return;
         }
 
-        list_add_tail (&task->all_tasks, &env->waitq);
-        env->waitcount++;
+        GF_ATOMIC_INC (env->waitcount);
         task->state = SYNCTASK_WAIT;
 }
 
 
+static uint64_t
+syncenv_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        timespec_now (&ts);
+        return (uint64_t)ts.tv_sec * GIGA + ts.tv_nsec;
+}
+
+
+/* Hand an idle processor something to do: @proc itself if it is asleep,
+ * otherwise any idle processor, which will steal the task from @proc.
+ */
+static void
+syncenv_kick (struct syncenv *env, struct syncproc *proc)
+{
+        struct syncproc *idle = NULL;
+
+        /* A processor going idle bumps idlecount before its last look at
+         * the run queues, so either it sees the task that was just queued
+         * or the queuer sees it idle here. */
+        if (GF_ATOMIC_GET (env->idlecount) == 0)
+                return;
+
+        pthread_mutex_lock (&env->mutex);
+        {
+                if (proc && proc->idle)
+                        idle = proc;
+                else if (!list_empty (&env->idle))
+                        idle = list_entry (env->idle.next, struct syncproc,
+                                           idle_list);
+
+                if (idle) {
+                        list_del_init (&idle->idle_list);
+                        idle->idle = 0;
+                        GF_ATOMIC_DEC (env->idlecount);
+                        pthread_cond_signal (&idle->cond);
+                }
+        }
+        pthread_mutex_unlock (&env->mutex);
+}
+
+
+/* Queue a runnable task. It goes back to the processor it last ran on, or
+ * for a new task to the processor of the synctask that created or woke it,
+ * so that it finds its data in that CPU's cache; other processors steal it
+ * if that one is busy.
+ */
+static void
+syncenv_enqueue (struct syncenv *env, struct synctask *task)
+{
+        struct syncproc *proc   = task->proc;
+        struct synctask *curr   = NULL;
+        int              queued = 0;
+
+        if (!proc) {
+                curr = synctask_get ();
+                if (curr && curr->env == env)
+                        proc = curr->proc;
+        }
+
+        if (!proc || !proc->alive)
+                proc = &env->proc[GF_ATOMIC_INC (env->next) % env->procmax];
+
+        task->queued = syncenv_now_ns ();
+
+        pthread_mutex_lock (&proc->lock);
+        {
+                list_add_tail (&task->all_tasks, &proc->runq);
+                queued = ++proc->runcount;
+        }
+        pthread_mutex_unlock (&proc->lock);
+
+        GF_ATOMIC_INC (env->runcount);
+
+        /* a task requeued by its own processor is picked up next anyway,
+         * unless others are already waiting there */
+        if (queued > 1 || !pthread_equal (proc->processor, pthread_self ()))
+                syncenv_kick (env, proc);
+}
+
+
 void
 synctask_yield (struct synctask *task)
 {
@@ -335,10 +643,14 @@ synctask_yield (struct synctask *task)
                 task->state = SYNCTASK_SUSPEND;
                 (void) gf_backtrace_save (task->btbuf);
         }
+#ifdef SYNCTASK_FAST_SWITCH
+        synctask_ctx_swap (&task->sp, task->proc->sched_sp);
+#else
         if (swapcontext (&task->ctx, &task->proc->sched) < 0) {
                 gf_msg ("syncop", GF_LOG_ERROR, errno,
                         LG_MSG_SWAPCONTEXT_FAILED, "swapcontext failed");
         }
+#endif
 
         THIS = oldTHIS;
 }
@@ -347,20 +659,19 @@ synctask_yield (struct synctask *task)
 void
 synctask_wake (struct synctask *task)
 {
-        struct syncenv *env = NULL;
-
-        env = task->env;
+        gf_boolean_t run = _gf_false;
 
-        pthread_mutex_lock (&env->mutex);
+        LOCK (&task->lock);
         {
                 task->woken = 1;
 
                 if (task->slept)
-                        __run (task);
-
-		pthread_cond_broadcast (&env->cond);
+                        run = __run (task);
         }
-        pthread_mutex_unlock (&env->mutex);
+        UNLOCK (&task->lock);
+
+        if (run)
+                syncenv_enqueue (task->env, task);
 }
 
 void
@@ -388,7 +699,7 @@ synctask_destroy (struct synctask *task)
         if (!task)
                 return;
 
-        GF_FREE (task->stack);
+        synctask_stack_put (task->stack, task->stacksize);
 
         if (task->opframe)
                 STACK_DESTROY (task->opframe->root);
@@ -398,6 +709,8 @@ synctask_destroy (struct synctask *task)
                pthread_cond_destroy (&task->cond);
         }
 
+        LOCK_DESTROY (&task->lock);
+
         GF_FREE (task);
 }
 
@@ -486,30 +799,32 @@ synctask_create (struct syncenv *env, size_t stacksize, synctask_fn_t fn,
 
         INIT_LIST_HEAD (&newtask->all_tasks);
         INIT_LIST_HEAD (&newtask->waitq);
+        LOCK_INIT (&newtask->lock);
 
-        if (getcontext (&newtask->ctx) < 0) {
-                gf_msg ("syncop", GF_LOG_ERROR, errno,
-                        LG_MSG_GETCONTEXT_FAILED, "getcontext failed");
-                goto err;
-        }
+        if (stacksize <= 0)
+                stacksize = env->stacksize;
 
-        if (stacksize <= 0) {
-                newtask->stack = GF_CALLOC (1, env->stacksize,
-                                            gf_common_mt_syncstack);
-                newtask->ctx.uc_stack.ss_size = env->stacksize;
-        } else {
-                newtask->stack = GF_CALLOC (1, stacksize,
-                                            gf_common_mt_syncstack);
-                newtask->ctx.uc_stack.ss_size = stacksize;
+        newtask->stacksize = stacksize;
+        newtask->stack = synctask_stack_get (stacksize);
+        if (!newtask->stack) {
+                goto err;
         }
 
-        if (!newtask->stack) {
+#ifdef SYNCTASK_FAST_SWITCH
+        newtask->sp = synctask_ctx_make (newtask->stack, stacksize,
+                                         synctask_wrap);
+#else
+        if (getcontext (&newtask->ctx) < 0) {
+                gf_msg ("syncop", GF_LOG_ERROR, errno,
+                        LG_MSG_GETCONTEXT_FAILED, "getcontext failed");
                 goto err;
         }
 
         newtask->ctx.uc_stack.ss_sp   = newtask->stack;
+        newtask->ctx.uc_stack.ss_size = stacksize;
 
         makecontext (&newtask->ctx, (void (*)(void)) synctask_wrap, 0);
+#endif
 
         newtask->state = SYNCTASK_INIT;
 
@@ -531,9 +846,10 @@ synctask_create (struct syncenv *env, size_t stacksize, synctask_fn_t fn,
 	return newtask;
 err:
         if (newtask) {
-                GF_FREE (newtask->stack);
+                synctask_stack_put (newtask->stack, newtask->stacksize);
                 if (newtask->opframe)
                         STACK_DESTROY (newtask->opframe->root);
+                LOCK_DESTROY (&newtask->lock);
                 GF_FREE (newtask);
         }
 
@@ -586,6 +902,87 @@ synctask_new (struct syncenv *env, synctask_fn_t fn, synctask_cbk_t cbk,
         return synctask_new1 (env, 0, fn, cbk, frame, opaque);
 }
 
+static struct synctask *
+syncproc_pop (struct syncproc *proc)
+{
+        struct synctask *task = NULL;
+
+        pthread_mutex_lock (&proc->lock);
+        {
+                if (!list_empty (&proc->runq)) {
+                        task = list_entry (proc->runq.next, struct synctask,
+                                           all_tasks);
+                        list_del_init (&task->all_tasks);
+                        proc->runcount--;
+                }
+        }
+        pthread_mutex_unlock (&proc->lock);
+
+        return task;
+}
+
+
+/* Take the oldest task from the first other processor that has one,
+ * starting with the one after @proc so that thieves spread out.
+ */
+static struct synctask *
+syncenv_steal (struct syncenv *env, struct syncproc *proc)
+{
+        struct synctask *task = NULL;
+        int              self = proc - env->proc;
+        int              i    = 0;
+
+        for (i = 1; i < env->procmax && !task; i++)
+                task = syncproc_pop (&env->proc[(self + i) % env->procmax]);
+
+        if (task)
+                proc->stolen++;
+
+        return task;
+}
+
+
+/* Called with env->mutex held. A processor only goes away with an empty
+ * run queue; anything queued on it later is stolen by the others.
+ */
+static gf_boolean_t
+__syncproc_exit (struct syncproc *proc)
+{
+        struct syncenv *env  = proc->env;
+        gf_boolean_t    gone = _gf_false;
+
+        pthread_mutex_lock (&proc->lock);
+        {
+                if (list_empty (&proc->runq)) {
+                        proc->alive = 0;
+                        proc->processor = 0;
+                        gone = _gf_true;
+                }
+        }
+        pthread_mutex_unlock (&proc->lock);
+
+        if (!gone)
+                return _gf_false;
+
+        env->procs--;
+        pthread_cond_broadcast (&env->cond);
+
+        /* let the others re-check whether they should go too */
+        if (env->destroy) {
+                while (!list_empty (&env->idle)) {
+                        proc = list_entry (env->idle.next, struct syncproc,
+                                           idle_list);
+                        list_del_init (&proc->idle_list);
+                        proc->idle = 0;
+                        GF_ATOMIC_DEC (env->idlecount);
+                        pthread_cond_signal (&proc->cond);
+                }
+        }
+
+        return _gf_true;
+}
+
+
 struct synctask *
 syncenv_task (struct syncproc *proc)
 {
@@ -593,52 +990,94 @@ syncenv_task (struct syncproc *proc)
         struct synctask  *task = NULL;
         struct timespec   sleep_till = {0, };
         int               ret = 0;
+        uint64_t          wait = 0;
 
         env = proc->env;
 
-        pthread_mutex_lock (&env->mutex);
-        {
-                while (list_empty (&env->runq)) {
+        for (;;) {
+                task = syncproc_pop (proc);
+                if (!task)
+                        task = syncenv_steal (env, proc);
+                if (task)
+                        break;
+
+                /* If either of the conditions are met then exit
+                 * the current thread:
+                 * 1. syncenv has to scale down(procs > procmin)
+                 * 2. syncenv is in destroy mode and no tasks in
+                 *    either waitq or runq.
+                 *
+                 * At any point in time, a task can be either in runq,
+                 * or in executing state or in the waitq. Once the
+                 * destroy mode is set, no new synctask creates will
+                 * be allowed, but whatever in waitq or runq should be
+                 * allowed to finish before exiting any of the syncenv
+                 * processor threads.
+                 */
+                pthread_mutex_lock (&env->mutex);
+                {
+                        if (env->destroy &&
+                            GF_ATOMIC_GET (env->waitcount) == 0 &&
+                            GF_ATOMIC_GET (env->runcount) == 0 &&
+                            __syncproc_exit (proc)) {
+                                pthread_mutex_unlock (&env->mutex);
+                                return NULL;
+                        }
+
+                        list_add (&proc->idle_list, &env->idle);
+                        proc->idle = 1;
+                        GF_ATOMIC_INC (env->idlecount);
+                }
+                pthread_mutex_unlock (&env->mutex);
+
+                /* one more look, now that queuers will kick us */
+                task = syncproc_pop (proc);
+                if (!task)
+                        task = syncenv_steal (env, proc);
+
+                pthread_mutex_lock (&env->mutex);
+                {
+                        ret = 0;
                         sleep_till.tv_sec = time (NULL) + SYNCPROC_IDLE_TIME;
-                        ret = pthread_cond_timedwait (&env->cond, &env->mutex,
-                                                      &sleep_till);
-                        if (!list_empty (&env->runq))
-                                break;
-                        /* If either of the conditions are met then exit
-                         * the current thread:
-                         * 1. syncenv has to scale down(procs > procmin)
-                         * 2. syncenv is in destroy mode and no tasks in
-                         *    either waitq or runq.
-                         *
-                         * At any point in time, a task can be either in runq,
-                         * or in executing state or in the waitq. Once the
-                         * destroy mode is set, no new synctask creates will
-                         * be allowed, but whatever in waitq or runq should be
-                         * allowed to finish before exiting any of the syncenv
-                         * processor threads.
-                         */
-                        if (((ret == ETIMEDOUT) && (env->procs > env->procmin))
-                            || (env->destroy && list_empty (&env->waitq))) {
-                                task = NULL;
-                                env->procs--;
-                                memset (proc, 0, sizeof (*proc));
-                                pthread_cond_broadcast (&env->cond);
-                                goto unlock;
+                        while (!task && proc->idle && ret != ETIMEDOUT)
+                                ret = pthread_cond_timedwait (&proc->cond,
+                                                              &env->mutex,
+                                                              &sleep_till);
+
+                        if (proc->idle) {
+                                list_del_init (&proc->idle_list);
+                                proc->idle = 0;
+                                GF_ATOMIC_DEC (env->idlecount);
+                        }
+
+                        if (!task && (ret == ETIMEDOUT) &&
+                            (env->procs > env->procmin) &&
+                            __syncproc_exit (proc)) {
+                                pthread_mutex_unlock (&env->mutex);
+                                return NULL;
                         }
                 }
+                pthread_mutex_unlock (&env->mutex);
 
-                task = list_entry (env->runq.next, struct synctask, all_tasks);
+                if (task)
+                        break;
+        }
+
+        GF_ATOMIC_DEC (env->runcount);
 
-                list_del_init (&task->all_tasks);
-                env->runcount--;
+        wait = syncenv_now_ns () - task->queued;
+        proc->dispatched++;
+        proc->wait_ns += wait;
+        if (wait > proc->max_wait_ns)
+                proc->max_wait_ns = wait;
 
+        LOCK (&task->lock);
+        {
                 task->woken = 0;
                 task->slept = 0;
-
                 task->proc = proc;
         }
-unlock:
-        pthread_mutex_unlock (&env->mutex);
+        UNLOCK (&task->lock);
 
         return task;
 }
@@ -648,12 +1087,16 @@ void
 synctask_switchto (struct synctask *task)
 {
         struct syncenv *env = NULL;
+        gf_boolean_t    run = _gf_false;
 
         env = task->env;
 
         synctask_set (task);
         THIS = task->xl;
 
+#ifdef SYNCTASK_FAST_SWITCH
+        synctask_ctx_swap (&task->proc->sched_sp, task->sp);
+#else
 #if defined(__NetBSD__) && defined(_UC_TLSBASE)
         /* Preserve pthread private pointer through swapcontex() */
         task->ctx.uc_flags &= ~_UC_TLSBASE;
@@ -663,22 +1106,26 @@ synctask_switchto (struct synctask *task)
                 gf_msg ("syncop", GF_LOG_ERROR, errno,
                         LG_MSG_SWAPCONTEXT_FAILED, "swapcontext failed");
         }
+#endif
 
         if (task->state == SYNCTASK_DONE) {
                 synctask_done (task);
                 return;
         }
 
-        pthread_mutex_lock (&env->mutex);
+        LOCK (&task->lock);
         {
                 if (task->woken) {
-                        __run (task);
+                        run = __run (task);
                 } else {
                         task->slept = 1;
                         __wait (task);
                 }
         }
-        pthread_mutex_unlock (&env->mutex);
+        UNLOCK (&task->lock);
+
+        if (run)
+                syncenv_enqueue (env, task);
 }
 
 void *
@@ -712,14 +1159,20 @@ syncenv_scale (struct syncenv *env)
         int  scale = 0;
         int  i = 0;
         int  ret = 0;
+        int  runcount = 0;
         char thread_name[GF_THREAD_NAMEMAX] = {0,};
 
+        /* cheap check first, this runs after every task */
+        runcount = GF_ATOMIC_GET (env->runcount);
+        if (env->procs >= runcount || env->procs >= env->procmax)
+                return;
+
         pthread_mutex_lock (&env->mutex);
         {
-                if (env->procs > env->runcount)
+                if (env->destroy || env->procs > runcount)
                         goto unlock;
 
-                scale = env->runcount;
+                scale = runcount;
                 if (scale > env->procmax)
                         scale = env->procmax;
                 if (scale > env->procs)
@@ -727,18 +1180,22 @@ syncenv_scale (struct syncenv *env)
                 while (diff) {
                         diff--;
                         for (; (i < env->procmax); i++) {
-                                if (env->proc[i].processor == 0)
+                                if (!env->proc[i].alive)
                                         break;
                         }
+                        if (i == env->procmax)
+                                break;
 
-                        env->proc[i].env = env;
                         snprintf (thread_name, sizeof(thread_name),
                                   "%s%d", "sproc", env->procs);
+                        env->proc[i].alive = 1;
                         ret = gf_thread_create (&env->proc[i].processor, NULL,
                                                 syncenv_processor,
                                                 &env->proc[i], thread_name);
-                        if (ret)
+                        if (ret) {
+                                env->proc[i].alive = 0;
                                 break;
+                        }
                         env->procs++;
                         i++;
                 }
@@ -747,11 +1204,61 @@ unlock:
         pthread_mutex_unlock (&env->mutex);
 }
 
+
+void
+syncenv_dump (struct syncenv *env)
+{
+        struct syncproc *proc                     = NULL;
+        char             key[GF_DUMP_MAX_BUF_LEN] = {0, };
+        int              i                        = 0;
+
+        if (!env)
+                return;
+
+        gf_proc_dump_add_section ("syncenv");
+
+        gf_proc_dump_write ("procs", "%d", env->procs);
+        gf_proc_dump_write ("procmin", "%d", env->procmin);
+        gf_proc_dump_write ("procmax", "%d", env->procmax);
+        gf_proc_dump_write ("runcount", "%"PRId64,
+                            (int64_t)GF_ATOMIC_GET (env->runcount));
+        gf_proc_dump_write ("waitcount", "%"PRId64,
+                            (int64_t)GF_ATOMIC_GET (env->waitcount));
+        gf_proc_dump_write ("idle", "%"PRId64,
+                            (int64_t)GF_ATOMIC_GET (env->idlecount));
+
+        /* statistics are read without the locks, good enough for a dump */
+        for (i = 0; i < env->procmax; i++) {
+                proc = &env->proc[i];
+                if (!proc->alive && !proc->dispatched)
+                        continue;
+
+                gf_proc_dump_build_key (key, "proc", "%d.alive", i);
+                gf_proc_dump_write (key, "%d", proc->alive);
+                gf_proc_dump_build_key (key, "proc", "%d.runq_depth", i);
+                gf_proc_dump_write (key, "%d", proc->runcount);
+                gf_proc_dump_build_key (key, "proc", "%d.dispatched", i);
+                gf_proc_dump_write (key, "%"PRIu64, proc->dispatched);
+                gf_proc_dump_build_key (key, "proc", "%d.stolen", i);
+                gf_proc_dump_write (key, "%"PRIu64, proc->stolen);
+                gf_proc_dump_build_key (key, "proc", "%d.avg_runq_wait_usec",
+                                        i);
+                gf_proc_dump_write (key, "%"PRIu64, proc->dispatched ?
+                                    proc->wait_ns / proc->dispatched / 1000
+                                    : 0);
+                gf_proc_dump_build_key (key, "proc", "%d.max_runq_wait_usec",
+                                        i);
+                gf_proc_dump_write (key, "%"PRIu64, proc->max_wait_ns / 1000);
+        }
+}
+
 /* The syncenv threads are cleaned up in this routine.
  */
 void
 syncenv_destroy (struct syncenv *env)
 {
+        struct syncproc *proc = NULL;
+        int              i    = 0;
 
         if (env == NULL)
                 return;
@@ -761,9 +1268,8 @@ syncenv_destroy (struct syncenv *env)
          *
          * If syncenv threads are in pthread cond wait with no tasks in
          * their run or wait queue, then the threads are woken up by
-         * broadcasting the cond variable and if destroy field is set,
-         * the infinite loop in syncenv_processor is broken and the
-         * threads return.
+         * signalling them and if destroy field is set, the loop in
+         * syncenv_task is broken and the threads return.
          *
          * If syncenv threads have tasks in runq or waitq, the tasks are
          * completed and only then the thread returns.
@@ -771,10 +1277,15 @@ syncenv_destroy (struct syncenv *env)
         pthread_mutex_lock (&env->mutex);
         {
                 env->destroy = 1;
-                /* This broadcast will wake threads in pthread_cond_wait
-                 * in syncenv_task
-                 */
-                pthread_cond_broadcast (&env->cond);
+                /* wake the idle processors in syncenv_task */
+                while (!list_empty (&env->idle)) {
+                        proc = list_entry (env->idle.next, struct syncproc,
+                                           idle_list);
+                        list_del_init (&proc->idle_list);
+                        proc->idle = 0;
+                        GF_ATOMIC_DEC (env->idlecount);
+                        pthread_cond_signal (&proc->cond);
+                }
 
                 /* when the syncenv_task() thread is exiting, it broadcasts to
                  * wake the below wait.
@@ -785,9 +1296,15 @@ syncenv_destroy (struct syncenv *env)
         }
         pthread_mutex_unlock (&env->mutex);
 
+        for (i = 0; i < env->procmax; i++) {
+                pthread_mutex_destroy (&env->proc[i].lock);
+                pthread_cond_destroy (&env->proc[i].cond);
+        }
+
         pthread_mutex_destroy (&env->mutex);
         pthread_cond_destroy (&env->cond);
 
+        GF_FREE (env->proc);
         GF_FREE (env);
 
         return;
@@ -800,12 +1317,19 @@ syncenv_new (size_t stacksize, int procmin, int procmax)
         struct syncenv *newenv = NULL;
         int             ret = 0;
         int             i = 0;
+        long            cpus = 0;
         char            thread_name[GF_THREAD_NAMEMAX] = {0,};
 
+        /* by default, grow up to one processor per CPU, but no fewer than
+         * SYNCENV_PROC_MAX as synctasks mostly sleep on network replies */
+        if (!procmax) {
+                cpus = sysconf (_SC_NPROCESSORS_ONLN);
+                procmax = max (cpus, SYNCENV_PROC_MAX);
+        }
 	if (!procmin || procmin < 0)
 		procmin = SYNCENV_PROC_MIN;
-	if (!procmax || procmax > SYNCENV_PROC_MAX)
-		procmax = SYNCENV_PROC_MAX;
+	if (procmax > SYNCENV_PROC_LIMIT)
+		procmax = SYNCENV_PROC_LIMIT;
 
 	if (procmin > procmax)
 		return NULL;
@@ -815,11 +1339,21 @@ syncenv_new (size_t stacksize, int procmin, int procmax)
         if (!newenv)
                 return NULL;
 
+        newenv->proc = GF_CALLOC (procmax, sizeof (*newenv->proc),
+                                  gf_common_mt_syncenv);
+        if (!newenv->proc) {
+                GF_FREE (newenv);
+                return NULL;
+        }
+
         pthread_mutex_init (&newenv->mutex, NULL);
         pthread_cond_init (&newenv->cond, NULL);
 
-        INIT_LIST_HEAD (&newenv->runq);
-        INIT_LIST_HEAD (&newenv->waitq);
+        INIT_LIST_HEAD (&newenv->idle);
+        GF_ATOMIC_INIT (newenv->runcount, 0);
+        GF_ATOMIC_INIT (newenv->waitcount, 0);
+        GF_ATOMIC_INIT (newenv->idlecount, 0);
+        GF_ATOMIC_INIT (newenv->next, 0);
 
         newenv->stacksize    = SYNCENV_DEFAULT_STACKSIZE;
         if (stacksize)
@@ -827,17 +1361,32 @@ syncenv_new (size_t stacksize, int procmin, int procmax)
 	newenv->procmin = procmin;
 	newenv->procmax = procmax;
 
-        for (i = 0; i < newenv->procmin; i++) {
+        for (i = 0; i < newenv->procmax; i++) {
                 newenv->proc[i].env = newenv;
-                snprintf (thread_name, sizeof(thread_name),
-                          "%s%d", "sproc", (newenv->procs));
-                ret = gf_thread_create (&newenv->proc[i].processor, NULL,
-                                        syncenv_processor, &newenv->proc[i],
-                                        thread_name);
-                if (ret)
-                        break;
-                newenv->procs++;
+                pthread_mutex_init (&newenv->proc[i].lock, NULL);
+                pthread_cond_init (&newenv->proc[i].cond, NULL);
+                INIT_LIST_HEAD (&newenv->proc[i].runq);
+                INIT_LIST_HEAD (&newenv->proc[i].idle_list);
+        }
+
+        pthread_mutex_lock (&newenv->mutex);
+        {
+                for (i = 0; i < newenv->procmin; i++) {
+                        snprintf (thread_name, sizeof(thread_name),
+                                  "%s%d", "sproc", (newenv->procs));
+                        newenv->proc[i].alive = 1;
+                        ret = gf_thread_create (&newenv->proc[i].processor,
+                                                NULL, syncenv_processor,
+                                                &newenv->proc[i],
+                                                thread_name);
+                        if (ret) {
+                                newenv->proc[i].alive = 0;
+                                break;
+                        }
+                        newenv->procs++;
+                }
         }
+        pthread_mutex_unlock (&newenv->mutex);
 
         if (ret != 0) {
                 syncenv_destroy (newenv);
@@ -847,7 +1396,6 @@ syncenv_new (size_t stacksize, int procmin, int procmax)
         return newenv;
 }
 
-
 int
 synclock_init (synclock_t *lock, lock_attr_t attr)
 {
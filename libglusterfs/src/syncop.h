@@ -16,10 +16,23 @@
 #include <pthread.h>
 #include <ucontext.h>
 
+/* default processor limit, raised to the number of CPUs on bigger boxes */
 #define SYNCENV_PROC_MAX 16
 #define SYNCENV_PROC_MIN 2
+#define SYNCENV_PROC_LIMIT 1024
 #define SYNCPROC_IDLE_TIME 600
 
+/* Switch synctasks with a few instructions of assembly where we know the
+ * calling convention, instead of swapcontext() which also saves and restores
+ * the signal mask with a system call. Valgrind and the sanitizers only
+ * follow stack switches done through ucontext.
+ */
+#if (defined(__x86_64__) || defined(__aarch64__)) && defined(__ELF__) && \
+    !defined(RUN_WITH_VALGRIND) && !defined(__SANITIZE_ADDRESS__) && \
+    !defined(__SANITIZE_THREAD__)
+#define SYNCTASK_FAST_SWITCH 1
+#endif
+
 /*
  * Flags for syncopctx valid elements
  */
@@ -68,7 +81,11 @@ struct synctask {
         gid_t               gid;
 
         ucontext_t          ctx;
-        struct syncproc    *proc;
+        void               *sp;   /* saved stack pointer, fast switch */
+        size_t              stacksize;
+        struct syncproc    *proc; /* last ran on, preferred next time */
+        gf_lock_t           lock; /* guards state, woken and slept */
+        uint64_t            queued; /* when last put on a run queue, ns */
 
         pthread_mutex_t     mutex; /* for synchronous spawning of synctask */
         pthread_cond_t      cond;
@@ -82,24 +99,43 @@ struct synctask {
 struct syncproc {
         pthread_t           processor;
         ucontext_t          sched;
+        void               *sched_sp;
         struct syncenv     *env;
         struct synctask    *current;
+
+        pthread_mutex_t     lock;      /* guards runq and runcount */
+        struct list_head    runq;
+        int                 runcount;
+        int                 alive;
+
+        pthread_cond_t      cond;      /* idle processor sleeps here */
+        struct list_head    idle_list; /* on env->idle, under env->mutex */
+        int                 idle;
+
+        /* kept by the processor itself, for statedump */
+        uint64_t            dispatched;
+        uint64_t            stolen;
+        uint64_t            wait_ns;
+        uint64_t            max_wait_ns;
 };
 
-/* hosts the scheduler thread and framework for executing synctasks */
+/* hosts the scheduler thread and framework for executing synctasks.
+ * Every processor has its own run queue; idle ones steal from busy ones.
+ */
 struct syncenv {
-        struct syncproc     proc[SYNCENV_PROC_MAX];
+        struct syncproc    *proc;      /* procmax slots */
         int                 procs;
 
-        struct list_head    runq;
-        int                 runcount;
-        struct list_head    waitq;
-        int                 waitcount;
+        gf_atomic_t         runcount;
+        gf_atomic_t         waitcount;
+        gf_atomic_t         idlecount;
+        gf_atomic_t         next;      /* round-robin for new tasks */
+        struct list_head    idle;
 
 	int                 procmin;
 	int                 procmax;
 
-        pthread_mutex_t     mutex;
+        pthread_mutex_t     mutex;     /* guards procs, idle and destroy */
         pthread_cond_t      cond;
 
         size_t              stacksize;
@@ -285,10 +321,13 @@ struct syncopctx {
 
 
 #define SYNCENV_DEFAULT_STACKSIZE (2 * 1024 * 1024)
+/* unused task stacks kept mapped for the next synctask */
+#define SYNCENV_STACK_POOL_MAX 64
 
 struct syncenv * syncenv_new (size_t stacksize, int procmin, int procmax);
 void syncenv_destroy (struct syncenv *);
 void syncenv_scale (struct syncenv *env);
+void syncenv_dump (struct syncenv *env);
 
 int synctask_new1 (struct syncenv *, size_t stacksize, synctask_fn_t,
                     synctask_cbk_t, call_frame_t *frame, void *);
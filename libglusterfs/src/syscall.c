@@ -224,6 +224,35 @@ sys_unlink (const char *pathname)
 }
 
 
+int
+sys_unlinkat (int dirfd, const char *pathname, int flags)
+{
+#ifdef GF_DARWIN_HOST_OS
+        char path[PATH_MAX];
+        int  len = 0;
+
+        /* join @pathname to the path of @dirfd rather than moving the
+           working directory of the whole process */
+        if (dirfd != AT_FDCWD && pathname[0] != '/') {
+                if (fcntl (dirfd, F_GETPATH, path) == -1)
+                        return -1;
+                len = strlen (path);
+                if (snprintf (path + len, sizeof (path) - len, "/%s",
+                              pathname) >= sizeof (path) - len) {
+                        errno = ENAMETOOLONG;
+                        return -1;
+                }
+                pathname = path;
+        }
+        if (flags & AT_REMOVEDIR)
+                return FS_RET_CHECK0(rmdir (pathname), errno);
+        return FS_RET_CHECK0(unlink (pathname), errno);
+#else
+        return FS_RET_CHECK0(unlinkat (dirfd, pathname, flags), errno);
+#endif
+}
+
+
 int
 sys_rmdir (const char *pathname)
 {
@@ -94,6 +94,9 @@ sys_mkdirat (int dirfd, const char *pathname, mode_t mode);
 int
 sys_unlink (const char *pathname);
 
+int
+sys_unlinkat (int dirfd, const char *pathname, int flags);
+
 int
 sys_rmdir (const char *pathname);
 
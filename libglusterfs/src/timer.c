@@ -15,10 +15,154 @@
 #include "timespec.h"
 #include "libglusterfs-messages.h"
 
+/* upper bound for a single sleep of the timer thread, in ticks */
+#define GF_TIMER_IDLE_TICKS     (GIGA / GF_TIMER_TICK_NSEC)
+
 /* fwd decl */
 static gf_timer_registry_t *
 gf_timer_registry_init (glusterfs_ctx_t *);
 
+static uint64_t
+gf_timer_now_ns (void)
+{
+        struct timespec now = {0, };
+
+        timespec_now (&now);
+        return TS (now);
+}
+
+
+/* Places @event in the wheel slot matching its expiry relative to the
+ * next tick to be expired. Must be called with reg->lock held.
+ */
+static void
+__gf_timer_wheel_add (gf_timer_registry_t *reg, gf_timer_t *event)
+{
+        struct list_head *vec     = NULL;
+        uint64_t          expires = 0;
+        uint64_t          idx     = 0;
+        int               shift   = 0;
+        int               level   = 0;
+
+        expires = event->expires;
+        if (expires < reg->now)
+                expires = reg->now;
+
+        idx = expires - reg->now;
+        if (idx >= GF_TIMER_MAX_TICKS) {
+                /* park it in the furthest slot, it is placed again with
+                 * its real expiry when that slot is cascaded */
+                idx = GF_TIMER_MAX_TICKS - 1;
+                expires = reg->now + idx;
+        }
+
+        if (idx < GF_TIMER_ROOT_SIZE) {
+                vec = &reg->root[expires & GF_TIMER_ROOT_MASK];
+        } else {
+                for (level = 0; level < GF_TIMER_LEVELS; level++) {
+                        shift = GF_TIMER_ROOT_BITS +
+                                (level + 1) * GF_TIMER_LEVEL_BITS;
+                        if (idx < (1ULL << shift))
+                                break;
+                }
+                shift -= GF_TIMER_LEVEL_BITS;
+                vec = &reg->levels[level][(expires >> shift) &
+                                          GF_TIMER_LEVEL_MASK];
+        }
+
+        list_add_tail (&event->list, vec);
+}
+
+
+/* Moves the timers of the coarser wheels that fall into the root wheel
+ * round starting at reg->now down to finer slots.
+ */
+static void
+__gf_timer_wheel_cascade (gf_timer_registry_t *reg)
+{
+        struct list_head  pending;
+        gf_timer_t       *event = NULL;
+        gf_timer_t       *tmp   = NULL;
+        int               level = 0;
+        int               index = 0;
+
+        for (level = 0; level < GF_TIMER_LEVELS; level++) {
+                index = (reg->now >> (GF_TIMER_ROOT_BITS +
+                                      level * GF_TIMER_LEVEL_BITS)) &
+                        GF_TIMER_LEVEL_MASK;
+
+                INIT_LIST_HEAD (&pending);
+                list_splice_init (&reg->levels[level][index], &pending);
+                list_for_each_entry_safe (event, tmp, &pending, list) {
+                        list_del (&event->list);
+                        __gf_timer_wheel_add (reg, event);
+                }
+
+                if (index)
+                        break;
+        }
+}
+
+
+/* Advances the wheel up to (and including) @target, moving every timer
+ * that became due onto @expired. Must be called with reg->lock held.
+ */
+static void
+__gf_timer_wheel_expire (gf_timer_registry_t *reg, uint64_t target,
+                         struct list_head *expired)
+{
+        struct list_head *slot  = NULL;
+        gf_timer_t       *event = NULL;
+
+        while (reg->now <= target) {
+                if (!reg->count) {
+                        /* nothing armed, no need to walk the slots */
+                        reg->now = target + 1;
+                        break;
+                }
+
+                if (!(reg->now & GF_TIMER_ROOT_MASK))
+                        __gf_timer_wheel_cascade (reg);
+
+                slot = &reg->root[reg->now & GF_TIMER_ROOT_MASK];
+                list_for_each_entry (event, slot, list) {
+                        event->fired = _gf_true;
+                        reg->count--;
+                }
+                list_append_init (slot, expired);
+
+                reg->now++;
+        }
+}
+
+
+/* Tick at which the timer thread has to look at the wheel again. */
+static uint64_t
+__gf_timer_wheel_next (gf_timer_registry_t *reg)
+{
+        uint64_t tick     = 0;
+        uint64_t boundary = 0;
+
+        if (!reg->count)
+                return reg->now + GF_TIMER_IDLE_TICKS;
+
+        /* the coarser wheels have not been cascaded for this round yet */
+        if (!(reg->now & GF_TIMER_ROOT_MASK))
+                return reg->now;
+
+        boundary = (reg->now | GF_TIMER_ROOT_MASK) + 1;
+        for (tick = reg->now; tick < boundary; tick++) {
+                if (!list_empty (&reg->root[tick & GF_TIMER_ROOT_MASK]))
+                        return tick;
+        }
+
+        /* only timers in the coarser wheels, or in root slots of the next
+         * round: either way the next cascade is the earliest they can be
+         * due */
+        return boundary;
+}
+
+
 gf_timer_t *
 gf_timer_call_after (glusterfs_ctx_t *ctx,
                      struct timespec delta,
@@ -27,7 +171,6 @@ gf_timer_call_after (glusterfs_ctx_t *ctx,
 {
         gf_timer_registry_t *reg = NULL;
         gf_timer_t *event = NULL;
-        gf_timer_t *trav = NULL;
         uint64_t at = 0;
 
         if (ctx == NULL)
@@ -45,25 +188,32 @@ gf_timer_call_after (glusterfs_ctx_t *ctx,
                 return NULL;
         }
 
-        event = GF_CALLOC (1, sizeof (*event), gf_common_mt_gf_timer_t);
+        event = mem_get0 (reg->timer_pool);
         if (!event) {
                 return NULL;
         }
-        timespec_now (&event->at);
-        timespec_adjust_delta (&event->at, delta);
-        at = TS (event->at);
+        at = gf_timer_now_ns () + TS (delta);
+        event->at.tv_sec = at / GIGA;
+        event->at.tv_nsec = at % GIGA;
         event->callbk = callbk;
         event->data = data;
         event->xl = THIS;
-        LOCK (&reg->lock);
+        INIT_LIST_HEAD (&event->list);
+
+        pthread_mutex_lock (&reg->lock);
         {
-                list_for_each_entry_reverse (trav, &reg->active, list) {
-                        if (TS (trav->at) < at)
-                                break;
-                }
-                list_add (&event->list, &trav->list);
+                /* round up, a timer must never fire early */
+                if (at > reg->base)
+                        event->expires = (at - reg->base +
+                                          GF_TIMER_TICK_NSEC - 1) /
+                                         GF_TIMER_TICK_NSEC;
+                __gf_timer_wheel_add (reg, event);
+                reg->count++;
+
+                if (event->expires < reg->wakeup)
+                        pthread_cond_signal (&reg->cond);
         }
-        UNLOCK (&reg->lock);
+        pthread_mutex_unlock (&reg->lock);
         return event;
 }
 
@@ -104,18 +254,19 @@ gf_timer_call_cancel (glusterfs_ctx_t *ctx,
                 return 0;
         }
 
-        LOCK (&reg->lock);
+        pthread_mutex_lock (&reg->lock);
         {
                 fired = event->fired;
                 if (fired)
                         goto unlock;
                 list_del (&event->list);
+                reg->count--;
         }
 unlock:
-        UNLOCK (&reg->lock);
+        pthread_mutex_unlock (&reg->lock);
 
         if (!fired) {
-                GF_FREE (event);
+                mem_put (event);
                 return 0;
         }
         return -1;
@@ -126,103 +277,139 @@ static void *
 gf_timer_proc (void *data)
 {
         gf_timer_registry_t *reg = data;
+        struct list_head expired;
         struct timespec sleepts;
         gf_timer_t *event = NULL;
         gf_timer_t *tmp = NULL;
         xlator_t   *old_THIS = NULL;
+        uint64_t    wakeup = 0;
+#if defined(GF_DARWIN_HOST_OS)
+        uint64_t    now = 0;
+#endif
+        int         i = 0;
+        int         j = 0;
+
+        INIT_LIST_HEAD (&expired);
 
+        pthread_mutex_lock (&reg->lock);
         while (!reg->fin) {
-                uint64_t now;
-                struct timespec now_ts;
-
-                timespec_now (&now_ts);
-                now = TS (now_ts);
-                while (1) {
-                        uint64_t at;
-                        char need_cbk = 0;
-
-                        /*
-                         * This will be overridden with a shorter interval if
-                         * there's an event scheduled sooner. That makes the
-                         * system more responsive in most cases, but doesn't
-                         * include the case where a timer is added while we're
-                         * asleep. It's tempting to use pthread_cond_timedwait,
-                         * with the caveat that we'd be relying on system time
-                         * instead of monotonic time. That's a mess when the
-                         * system time is adjusted.  Another alternative might
-                         * be to use pthread_kill, but that will remain TBD for
-                         * now.
-                         */
-                        sleepts.tv_sec = 1;
-                        sleepts.tv_nsec = 0;
-
-                        LOCK (&reg->lock);
-                        {
-                                /*
-                                 * Using list_for_each and then always breaking
-                                 * after the first iteration might seem strange,
-                                 * but (unlike alternatives) is independent of
-                                 * the underlying list implementation.
-                                 */
-                                list_for_each_entry_safe (event,
-                                             tmp, &reg->active, list) {
-                                        at = TS (event->at);
-                                        if (now >= at) {
-                                                need_cbk = 1;
-                                                event->fired = _gf_true;
-                                                list_del (&event->list);
-                                        } else {
-                                                uint64_t diff = now - at;
-
-                                                if (diff < 1000000000) {
-                                                        sleepts.tv_sec = 0;
-                                                        sleepts.tv_nsec = diff;
-                                                }
-                                        }
-                                        break;
-                                }
-                        }
-                        UNLOCK (&reg->lock);
-                        if (need_cbk) {
+                __gf_timer_wheel_expire (reg, (gf_timer_now_ns () -
+                                               reg->base) /
+                                              GF_TIMER_TICK_NSEC,
+                                         &expired);
+
+                if (!list_empty (&expired)) {
+                        /* callbacks may arm or cancel timers */
+                        pthread_mutex_unlock (&reg->lock);
+
+                        list_for_each_entry_safe (event, tmp, &expired,
+                                                  list) {
+                                list_del (&event->list);
                                 old_THIS = NULL;
                                 if (event->xl) {
                                         old_THIS = THIS;
                                         THIS = event->xl;
                                 }
                                 event->callbk (event->data);
-                                GF_FREE (event);
+                                mem_put (event);
                                 if (old_THIS) {
                                         THIS = old_THIS;
                                 }
-                        } else {
-                                break;
                         }
+
+                        pthread_mutex_lock (&reg->lock);
+                        continue;
                 }
-                nanosleep (&sleepts, NULL);
+
+                /* gf_timer_call_after() signals us if it arms a timer
+                 * that is due before this */
+                reg->wakeup = __gf_timer_wheel_next (reg);
+                wakeup = reg->base + reg->wakeup * GF_TIMER_TICK_NSEC;
+#if defined(GF_DARWIN_HOST_OS)
+                now = gf_timer_now_ns ();
+                wakeup = (wakeup > now) ? wakeup - now : 0;
+                sleepts.tv_sec = wakeup / GIGA;
+                sleepts.tv_nsec = wakeup % GIGA;
+                pthread_cond_timedwait_relative_np (&reg->cond, &reg->lock,
+                                                    &sleepts);
+#else
+                sleepts.tv_sec = wakeup / GIGA;
+                sleepts.tv_nsec = wakeup % GIGA;
+                pthread_cond_timedwait (&reg->cond, &reg->lock, &sleepts);
+#endif
         }
 
-        LOCK (&reg->lock);
-        {
-                /* Do not call gf_timer_call_cancel(),
-                 * it will lead to deadlock
-                 */
-                list_for_each_entry_safe (event, tmp, &reg->active, list) {
+        /* Do not call gf_timer_call_cancel(),
+         * it will lead to deadlock
+         */
+        for (i = 0; i < GF_TIMER_ROOT_SIZE; i++) {
+                list_for_each_entry_safe (event, tmp, &reg->root[i], list) {
                         list_del (&event->list);
-                        GF_FREE (event);
+                        mem_put (event);
+                }
+        }
+        for (i = 0; i < GF_TIMER_LEVELS; i++) {
+                for (j = 0; j < GF_TIMER_LEVEL_SIZE; j++) {
+                        list_for_each_entry_safe (event, tmp,
+                                                  &reg->levels[i][j], list) {
+                                list_del (&event->list);
+                                mem_put (event);
+                        }
                 }
         }
-        UNLOCK (&reg->lock);
-        LOCK_DESTROY (&reg->lock);
+        reg->count = 0;
+        pthread_mutex_unlock (&reg->lock);
 
         return NULL;
 }
 
 
+static int
+gf_timer_registry_lock_init (gf_timer_registry_t *reg)
+{
+        pthread_condattr_t attr;
+        int ret = -1;
+
+        ret = pthread_mutex_init (&reg->lock, NULL);
+        if (ret)
+                goto out;
+
+        ret = pthread_condattr_init (&attr);
+        if (ret)
+                goto destroy_lock;
+
+#if !defined(GF_DARWIN_HOST_OS)
+        /* sleep on the same clock timespec_now() reads, Darwin waits with
+         * a relative timeout instead */
+        ret = pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+        if (ret) {
+                pthread_condattr_destroy (&attr);
+                goto destroy_lock;
+        }
+#endif
+
+        ret = pthread_cond_init (&reg->cond, &attr);
+        pthread_condattr_destroy (&attr);
+        if (ret)
+                goto destroy_lock;
+
+        return 0;
+
+destroy_lock:
+        pthread_mutex_destroy (&reg->lock);
+out:
+        return ret;
+}
+
+
 static gf_timer_registry_t *
 gf_timer_registry_init (glusterfs_ctx_t *ctx)
 {
         gf_timer_registry_t *reg = NULL;
+        gf_timer_registry_t *new = NULL;
         int ret = -1;
+        int i = 0;
+        int j = 0;
 
         if (ctx == NULL) {
                 gf_msg_callingfn ("timer", GF_LOG_ERROR, EINVAL,
@@ -240,21 +427,54 @@ gf_timer_registry_init (glusterfs_ctx_t *ctx)
         LOCK (&ctx->lock);
         {
                 reg = ctx->timer;
-                if (reg) {
-                        UNLOCK (&ctx->lock);
-                        goto out;
-                }
-                reg = GF_CALLOC (1, sizeof (*reg),
-                              gf_common_mt_gf_timer_registry_t);
-                if (!reg) {
-                        UNLOCK (&ctx->lock);
-                        goto out;
-                }
-                ctx->timer = reg;
-                LOCK_INIT (&reg->lock);
-                INIT_LIST_HEAD (&reg->active);
         }
         UNLOCK (&ctx->lock);
+        if (reg)
+                goto out;
+
+        /* mem_pool_new_ctx() takes ctx->lock, set up the registry
+         * outside of it */
+        new = GF_CALLOC (1, sizeof (*new), gf_common_mt_gf_timer_registry_t);
+        if (!new)
+                goto out;
+
+        new->timer_pool = mem_pool_new_ctx (ctx, gf_timer_t, 4096);
+        if (!new->timer_pool) {
+                GF_FREE (new);
+                goto out;
+        }
+
+        if (gf_timer_registry_lock_init (new)) {
+                mem_pool_destroy (new->timer_pool);
+                GF_FREE (new);
+                goto out;
+        }
+
+        for (i = 0; i < GF_TIMER_ROOT_SIZE; i++)
+                INIT_LIST_HEAD (&new->root[i]);
+        for (i = 0; i < GF_TIMER_LEVELS; i++) {
+                for (j = 0; j < GF_TIMER_LEVEL_SIZE; j++)
+                        INIT_LIST_HEAD (&new->levels[i][j]);
+        }
+        new->base = gf_timer_now_ns ();
+
+        LOCK (&ctx->lock);
+        {
+                reg = ctx->timer;
+                if (!reg)
+                        reg = ctx->timer = new;
+        }
+        UNLOCK (&ctx->lock);
+
+        if (reg != new) {
+                /* lost the race against another thread */
+                pthread_cond_destroy (&new->cond);
+                pthread_mutex_destroy (&new->lock);
+                mem_pool_destroy (new->timer_pool);
+                GF_FREE (new);
+                goto out;
+        }
+
         ret = gf_thread_create (&reg->th, NULL, gf_timer_proc, reg, "timer");
         if (ret) {
                 gf_msg (THIS->name, GF_LOG_ERROR, ret,
@@ -287,7 +507,16 @@ gf_timer_registry_destroy (glusterfs_ctx_t *ctx)
                 return;
 
         thr_id = reg->th;
-        reg->fin = 1;
+        pthread_mutex_lock (&reg->lock);
+        {
+                reg->fin = 1;
+                pthread_cond_signal (&reg->cond);
+        }
+        pthread_mutex_unlock (&reg->lock);
         pthread_join (thr_id, NULL);
+
+        pthread_cond_destroy (&reg->cond);
+        pthread_mutex_destroy (&reg->lock);
+        mem_pool_destroy (reg->timer_pool);
         GF_FREE (reg);
 }
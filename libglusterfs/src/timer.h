@@ -18,6 +18,24 @@
 
 typedef void (*gf_timer_cbk_t) (void *);
 
+/* Timers are kept in a hierarchical timing wheel: a root wheel with one
+ * slot per tick, and GF_TIMER_LEVELS coarser wheels whose slots are
+ * cascaded down into finer ones as time advances. Arming and cancelling
+ * are O(1) and expiry only touches the slots that are due.
+ */
+#define GF_TIMER_TICK_NSEC      1000000ULL      /* 1ms */
+#define GF_TIMER_ROOT_BITS      8
+#define GF_TIMER_LEVEL_BITS     6
+#define GF_TIMER_LEVELS         4
+#define GF_TIMER_ROOT_SIZE      (1 << GF_TIMER_ROOT_BITS)
+#define GF_TIMER_LEVEL_SIZE     (1 << GF_TIMER_LEVEL_BITS)
+#define GF_TIMER_ROOT_MASK      (GF_TIMER_ROOT_SIZE - 1)
+#define GF_TIMER_LEVEL_MASK     (GF_TIMER_LEVEL_SIZE - 1)
+/* ticks covered by the wheel, timers further out get re-cascaded */
+#define GF_TIMER_MAX_TICKS      (1ULL << (GF_TIMER_ROOT_BITS +          \
+                                          GF_TIMER_LEVELS *             \
+                                          GF_TIMER_LEVEL_BITS))
+
 struct _gf_timer {
         union {
                 struct list_head list;
@@ -31,13 +49,21 @@ struct _gf_timer {
         void             *data;
         xlator_t         *xl;
 	gf_boolean_t      fired;
+        uint64_t          expires;      /* tick at which the timer is due */
 };
 
 struct _gf_timer_registry {
         pthread_t        th;
         char             fin;
-        struct list_head active;
-        gf_lock_t        lock;
+        pthread_mutex_t  lock;
+        pthread_cond_t   cond;
+        struct mem_pool *timer_pool;
+        uint64_t         base;          /* monotonic time of tick 0, in ns */
+        uint64_t         now;           /* next tick to be expired */
+        uint64_t         wakeup;        /* tick gf_timer_proc sleeps until */
+        uint64_t         count;         /* armed timers */
+        struct list_head root[GF_TIMER_ROOT_SIZE];
+        struct list_head levels[GF_TIMER_LEVELS][GF_TIMER_LEVEL_SIZE];
 };
 
 typedef struct _gf_timer gf_timer_t;
@@ -35,6 +35,7 @@ __saved_frames_get_timedout (struct saved_frames *frames, uint32_t timeout,
 		if ((tmp->saved_at.tv_sec + timeout) <= current->tv_sec) {
 			bailout_frame = tmp;
 			list_del_init (&bailout_frame->list);
+                        list_del_init (&bailout_frame->hash);
 			frames->count--;
 		}
 	}
@@ -58,6 +59,59 @@ _is_lock_fop (struct saved_frame *sframe)
                 (fop == GFS3_OP_FENTRYLK));
 }
 
+static inline struct list_head *
+__saved_frames_bucket (struct saved_frames *frames, uint32_t xid)
+{
+        return &frames->hash[xid & (frames->hash_size - 1)];
+}
+
+
+/* Doubles the xid hash once the table is more than twice as full as it
+ * has buckets. Failing to grow is not fatal, lookups just get longer
+ * chains.
+ */
+static void
+__saved_frames_hash_grow (struct saved_frames *frames)
+{
+        struct list_head   *old_hash = NULL;
+        struct list_head   *new_hash = NULL;
+        struct saved_frame *trav     = NULL;
+        struct saved_frame *tmp      = NULL;
+        uint32_t            old_size = 0;
+        uint32_t            new_size = 0;
+        uint32_t            i        = 0;
+
+        if (frames->count < (frames->hash_size * 2) ||
+            frames->hash_size >= SAVED_FRAMES_HASH_MAX)
+                return;
+
+        old_size = frames->hash_size;
+        new_size = old_size * 2;
+
+        new_hash = GF_CALLOC (new_size, sizeof (*new_hash),
+                              gf_common_mt_rpcclnt_savedframe_hash_t);
+        if (!new_hash)
+                return;
+
+        for (i = 0; i < new_size; i++)
+                INIT_LIST_HEAD (&new_hash[i]);
+
+        old_hash = frames->hash;
+        frames->hash = new_hash;
+        frames->hash_size = new_size;
+
+        for (i = 0; i < old_size; i++) {
+                list_for_each_entry_safe (trav, tmp, &old_hash[i], hash) {
+                        list_move_tail (&trav->hash,
+                                        __saved_frames_bucket (frames,
+                                                           trav->rpcreq->xid));
+                }
+        }
+
+        GF_FREE (old_hash);
+}
+
+
 struct saved_frame *
 __saved_frames_put (struct saved_frames *frames, void *frame,
                     struct rpc_req *rpcreq)
@@ -72,6 +126,7 @@ __saved_frames_put (struct saved_frames *frames, void *frame,
 
         memset (saved_frame, 0, sizeof (*saved_frame));
 	INIT_LIST_HEAD (&saved_frame->list);
+        INIT_LIST_HEAD (&saved_frame->hash);
 
 	saved_frame->capital_this = THIS;
 	saved_frame->frame        = frame;
@@ -83,8 +138,13 @@ __saved_frames_put (struct saved_frames *frames, void *frame,
         else
                 list_add_tail (&saved_frame->list, &frames->sf.list);
 
+        list_add_tail (&saved_frame->hash,
+                       __saved_frames_bucket (frames, rpcreq->xid));
+
 	frames->count++;
 
+        __saved_frames_hash_grow (frames);
+
 out:
 	return saved_frame;
 }
@@ -238,6 +298,7 @@ struct saved_frames *
 saved_frames_new (void)
 {
 	struct saved_frames *saved_frames = NULL;
+        uint32_t             i            = 0;
 
 	saved_frames = GF_CALLOC (1, sizeof (*saved_frames),
                                   gf_common_mt_rpcclnt_savedframe_t);
@@ -245,6 +306,18 @@ saved_frames_new (void)
 		return NULL;
 	}
 
+        saved_frames->hash = GF_CALLOC (SAVED_FRAMES_HASH_MIN,
+                                        sizeof (*saved_frames->hash),
+                                        gf_common_mt_rpcclnt_savedframe_hash_t);
+        if (!saved_frames->hash) {
+                GF_FREE (saved_frames);
+                return NULL;
+        }
+
+        saved_frames->hash_size = SAVED_FRAMES_HASH_MIN;
+        for (i = 0; i < saved_frames->hash_size; i++)
+                INIT_LIST_HEAD (&saved_frames->hash[i]);
+
 	INIT_LIST_HEAD (&saved_frames->sf.list);
 	INIT_LIST_HEAD (&saved_frames->lk_sf.list);
 
@@ -252,6 +325,21 @@ saved_frames_new (void)
 }
 
 
+static struct saved_frame *
+__saved_frame_lookup (struct saved_frames *frames, int64_t callid)
+{
+	struct saved_frame *tmp = NULL;
+
+	list_for_each_entry (tmp, __saved_frames_bucket (frames, callid),
+                             hash) {
+		if (tmp->rpcreq->xid == callid)
+			return tmp;
+	}
+
+	return NULL;
+}
+
+
 int
 __saved_frame_copy (struct saved_frames *frames, int64_t callid,
                     struct saved_frame *saved_frame)
@@ -264,21 +352,11 @@ __saved_frame_copy (struct saved_frames *frames, int64_t callid,
                 goto out;
         }
 
-	list_for_each_entry (tmp, &frames->sf.list, list) {
-		if (tmp->rpcreq->xid == callid) {
-			*saved_frame = *tmp;
-                        ret = 0;
-			goto out;
-		}
-	}
-
-	list_for_each_entry (tmp, &frames->lk_sf.list, list) {
-		if (tmp->rpcreq->xid == callid) {
-			*saved_frame = *tmp;
-                        ret = 0;
-			goto out;
-		}
-	}
+        tmp = __saved_frame_lookup (frames, callid);
+        if (tmp) {
+                *saved_frame = *tmp;
+                ret = 0;
+        }
 
 out:
 	return ret;
@@ -289,28 +367,12 @@ struct saved_frame *
 __saved_frame_get (struct saved_frames *frames, int64_t callid)
 {
 	struct saved_frame *saved_frame = NULL;
-	struct saved_frame *tmp = NULL;
 
-	list_for_each_entry (tmp, &frames->sf.list, list) {
-		if (tmp->rpcreq->xid == callid) {
-			list_del_init (&tmp->list);
-			frames->count--;
-			saved_frame = tmp;
-			goto out;
-		}
-	}
-
-	list_for_each_entry (tmp, &frames->lk_sf.list, list) {
-		if (tmp->rpcreq->xid == callid) {
-			list_del_init (&tmp->list);
-			frames->count--;
-			saved_frame = tmp;
-			goto out;
-		}
-	}
-
-out:
+        saved_frame = __saved_frame_lookup (frames, callid);
 	if (saved_frame) {
+                list_del_init (&saved_frame->list);
+                list_del_init (&saved_frame->hash);
+                frames->count--;
                 THIS  = saved_frame->capital_this;
         }
 
@@ -357,6 +419,7 @@ saved_frames_unwind (struct saved_frames *saved_frames)
                                        trav->rpcreq->conn->rpc_clnt->reqpool);
 
 		list_del_init (&trav->list);
+                list_del_init (&trav->hash);
                 mem_put (trav);
 	}
 }
@@ -370,6 +433,7 @@ saved_frames_destroy (struct saved_frames *frames)
 
 	saved_frames_unwind (frames);
 
+        GF_FREE (frames->hash);
 	GF_FREE (frames);
 }
 
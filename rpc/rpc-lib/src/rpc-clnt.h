@@ -50,6 +50,7 @@ struct saved_frame {
 			struct saved_frame *frame_prev;
 		};
 	};
+        struct list_head         hash;     /* chain in saved_frames->hash */
         void                    *capital_this;
 	void                    *frame;
 	struct timeval           saved_at;
@@ -57,10 +58,20 @@ struct saved_frame {
         rpc_transport_rsp_t      rsp;
 };
 
+/* Replies are matched to saved frames through a hash indexed by xid.
+ * xids are handed out sequentially per rpc_clnt, so masking off the low
+ * bits spreads outstanding frames evenly across buckets. The table grows
+ * (power of two) with the number of outstanding frames.
+ */
+#define SAVED_FRAMES_HASH_MIN   64
+#define SAVED_FRAMES_HASH_MAX   65536
+
 struct saved_frames {
 	int64_t            count;
 	struct saved_frame sf;
 	struct saved_frame lk_sf;
+        struct list_head  *hash;
+        uint32_t           hash_size;
 };
 
 
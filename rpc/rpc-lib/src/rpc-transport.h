@@ -193,6 +193,7 @@ struct rpc_transport {
         char                      *name;
         void                      *dnscache;
         void                      *drc_client;
+        void                      *dispatch_queue;
         data_t                    *buf;
         int32_t                  (*init)   (rpc_transport_t *this);
         void                     (*fini)   (rpc_transport_t *this);
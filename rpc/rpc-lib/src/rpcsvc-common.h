@@ -81,6 +81,20 @@ typedef struct rpcsvc_state {
         gf_boolean_t            addr_namelookup;
         /* determine whether throttling is needed, by default OFF */
         gf_boolean_t            throttle;
+
+        /* Requests are handed to a pool of dispatch workers through one
+         * queue per connection, served in deficit round-robin order, when
+         * rpc.dispatch-threads is non-zero. Otherwise actors run on the
+         * event thread that read the request. */
+        struct {
+                pthread_mutex_t         lock;
+                pthread_cond_t          cond;
+                struct list_head        active; /* queues with requests */
+                struct list_head        queues; /* all queues, for dumps */
+                int                     threads;
+                int                     running;
+                uint32_t                quantum;
+        } dispatch;
 } rpcsvc_t;
 
 /* DRC START */
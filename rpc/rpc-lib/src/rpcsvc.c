@@ -25,6 +25,8 @@
 #include "syncop.h"
 #include "rpc-drc.h"
 #include "protocol-common.h"
+#include "statedump.h"
+#include "timespec.h"
 
 #include <errno.h>
 #include <pthread.h>
@@ -577,6 +579,177 @@ rpcsvc_check_and_reply_error (int ret, call_frame_t *frame, void *opaque)
         return 0;
 }
 
+/* Pick the next request to run in deficit round-robin order: the queue at
+ * the head of the active list is served as long as its deficit covers the
+ * cost of its oldest request, and is credited one quantum per round before
+ * it has to give way to the next connection.
+ */
+static rpcsvc_request_t *
+__rpcsvc_dispatch_next (rpcsvc_t *svc)
+{
+        rpcsvc_queue_t   *queue   = NULL;
+        rpcsvc_request_t *req     = NULL;
+        struct timespec   now     = {0, };
+        struct timespec   elapsed = {0, };
+        uint64_t          wait    = 0;
+
+        while (!list_empty (&svc->dispatch.active)) {
+                queue = list_entry (svc->dispatch.active.next,
+                                    rpcsvc_queue_t, active);
+                req = list_entry (queue->requests.next, rpcsvc_request_t,
+                                  request_list);
+
+                if (queue->deficit < req->drr_cost) {
+                        if (!queue->credited) {
+                                queue->deficit += svc->dispatch.quantum;
+                                queue->credited = _gf_true;
+                        } else {
+                                queue->credited = _gf_false;
+                                list_move_tail (&queue->active,
+                                                &svc->dispatch.active);
+                        }
+                        continue;
+                }
+
+                queue->deficit -= req->drr_cost;
+                list_del_init (&req->request_list);
+                queue->depth--;
+                queue->dispatched++;
+
+                if (list_empty (&queue->requests)) {
+                        /* an idle connection does not bank credit */
+                        queue->deficit = 0;
+                        queue->credited = _gf_false;
+                        list_del_init (&queue->active);
+                }
+
+                timespec_now (&now);
+                timespec_sub (&req->drr_queued, &now, &elapsed);
+                wait = elapsed.tv_sec * 1000000ULL + elapsed.tv_nsec / 1000;
+                queue->wait_usec += wait;
+                if (wait > queue->max_wait_usec)
+                        queue->max_wait_usec = wait;
+
+                return req;
+        }
+
+        return NULL;
+}
+
+
+static void *
+rpcsvc_dispatch_worker (void *arg)
+{
+        rpcsvc_t         *svc   = arg;
+        rpcsvc_request_t *req   = NULL;
+        rpcsvc_actor_t   *actor = NULL;
+        int               ret   = 0;
+
+        while (1) {
+                pthread_mutex_lock (&svc->dispatch.lock);
+                {
+                        while (!(req = __rpcsvc_dispatch_next (svc))) {
+                                /* queued requests are drained before an
+                                 * excess worker goes away */
+                                if (svc->dispatch.running >
+                                    svc->dispatch.threads) {
+                                        svc->dispatch.running--;
+                                        break;
+                                }
+                                pthread_cond_wait (&svc->dispatch.cond,
+                                                   &svc->dispatch.lock);
+                        }
+                }
+                pthread_mutex_unlock (&svc->dispatch.lock);
+
+                if (!req)
+                        break;
+
+                THIS = svc->xl;
+
+                actor = rpcsvc_program_actor (req);
+                ret = actor->actor (req);
+
+                rpcsvc_check_and_reply_error (ret, NULL, req);
+        }
+
+        return NULL;
+}
+
+
+/* Queue @req on its connection's dispatch queue. Returns -1 if there are no
+ * dispatch workers, in which case the caller runs the actor itself.
+ */
+static int
+rpcsvc_dispatch_enqueue (rpcsvc_t *svc, rpcsvc_request_t *req)
+{
+        rpc_transport_t *trans = req->trans;
+        rpcsvc_queue_t  *queue = NULL;
+        int              ret   = -1;
+
+        req->drr_cost = iov_length (req->msg, req->count) +
+                        RPCSVC_DISPATCH_REQUEST_COST;
+        timespec_now (&req->drr_queued);
+
+        pthread_mutex_lock (&svc->dispatch.lock);
+        {
+                if (!svc->dispatch.threads || !svc->dispatch.running)
+                        goto unlock;
+
+                queue = trans->dispatch_queue;
+                if (!queue) {
+                        queue = GF_CALLOC (1, sizeof (*queue),
+                                           gf_common_mt_rpcsvc_queue_t);
+                        if (!queue)
+                                goto unlock;
+
+                        INIT_LIST_HEAD (&queue->active);
+                        INIT_LIST_HEAD (&queue->requests);
+                        queue->trans = trans;
+                        list_add_tail (&queue->list, &svc->dispatch.queues);
+                        trans->dispatch_queue = queue;
+                }
+
+                if (list_empty (&queue->requests))
+                        list_add_tail (&queue->active, &svc->dispatch.active);
+
+                list_add_tail (&req->request_list, &queue->requests);
+                if (++queue->depth > queue->max_depth)
+                        queue->max_depth = queue->depth;
+
+                pthread_cond_signal (&svc->dispatch.cond);
+                ret = 0;
+        }
+unlock:
+        pthread_mutex_unlock (&svc->dispatch.lock);
+
+        return ret;
+}
+
+
+/* Every queued request holds a ref on its transport, so the queue is empty
+ * by the time the transport is cleaned up.
+ */
+static void
+rpcsvc_dispatch_release (rpcsvc_t *svc, rpc_transport_t *trans)
+{
+        rpcsvc_queue_t *queue = NULL;
+
+        pthread_mutex_lock (&svc->dispatch.lock);
+        {
+                queue = trans->dispatch_queue;
+                trans->dispatch_queue = NULL;
+                if (queue) {
+                        list_del_init (&queue->active);
+                        list_del_init (&queue->list);
+                }
+        }
+        pthread_mutex_unlock (&svc->dispatch.lock);
+
+        GF_FREE (queue);
+}
+
+
 int
 rpcsvc_handle_rpc_call (rpcsvc_t *svc, rpc_transport_t *trans,
                         rpc_transport_pollin_t *msg)
@@ -716,6 +889,11 @@ rpcsvc_handle_rpc_call (rpcsvc_t *svc, rpc_transport_t *trans,
                         pthread_mutex_unlock (&req->prog->queue_lock);
 
                         ret = 0;
+                } else if (rpcsvc_dispatch_enqueue (svc, req) == 0) {
+                        /* the dispatch worker runs the actor and sends
+                         * the reply, or the error reply */
+                        ret = 0;
+                        goto out;
                 } else {
                         ret = actor_fn (req);
                 }
@@ -829,6 +1007,8 @@ rpcsvc_notify (rpc_transport_t *trans, void *mydata,
                 break;
 
         case RPC_TRANSPORT_CLEANUP:
+                rpcsvc_dispatch_release (svc, trans);
+
                 listener = rpcsvc_get_listener (svc, -1, trans->listener);
                 if (listener == NULL) {
                         goto out;
@@ -2425,6 +2605,128 @@ rpcsvc_set_outstanding_rpc_limit (rpcsvc_t *svc, dict_t *options, int defvalue)
         return (0);
 }
 
+/*
+ * Configure() rpc.dispatch-threads and rpc.dispatch-quantum. With a
+ * non-zero thread count, requests are queued per connection and handed to
+ * that many workers in deficit round-robin order, so that one busy client
+ * cannot hold an event thread against everybody else. Workers are started
+ * as needed; surplus ones exit once the queues are drained.
+ */
+int
+rpcsvc_set_dispatch_threads (rpcsvc_t *svc, dict_t *options)
+{
+        int              ret      = 0;
+        int32_t          threads  = RPCSVC_DEFAULT_DISPATCH_THREADS;
+        uint64_t         quantum  = RPCSVC_DEFAULT_DISPATCH_QUANTUM;
+        char            *qstr     = NULL;
+        pthread_t        thread;
+        static char     *thrkey   = "rpc.dispatch-threads";
+        static char     *qkey     = "rpc.dispatch-quantum";
+
+        if ((!svc) || (!options))
+                return (-1);
+
+        if (dict_get_int32 (options, thrkey, &threads) < 0)
+                threads = RPCSVC_DEFAULT_DISPATCH_THREADS;
+        if (threads < 0)
+                threads = 0;
+        if (threads > RPCSVC_MAX_DISPATCH_THREADS)
+                threads = RPCSVC_MAX_DISPATCH_THREADS;
+
+        if ((dict_get_str (options, qkey, &qstr) == 0) &&
+            (gf_string2bytesize_uint64 (qstr, &quantum) != 0))
+                quantum = RPCSVC_DEFAULT_DISPATCH_QUANTUM;
+        if (quantum < RPCSVC_MIN_DISPATCH_QUANTUM)
+                quantum = RPCSVC_MIN_DISPATCH_QUANTUM;
+        if (quantum > RPCSVC_MAX_DISPATCH_QUANTUM)
+                quantum = RPCSVC_MAX_DISPATCH_QUANTUM;
+
+        ret = 0;
+
+        pthread_mutex_lock (&svc->dispatch.lock);
+        {
+                svc->dispatch.quantum = quantum;
+
+                if (svc->dispatch.threads != threads)
+                        gf_log (GF_RPCSVC, GF_LOG_INFO,
+                                "Configured %s with value %d", thrkey,
+                                threads);
+                svc->dispatch.threads = threads;
+
+                while (svc->dispatch.running < svc->dispatch.threads) {
+                        ret = gf_thread_create_detached (&thread,
+                                                   rpcsvc_dispatch_worker,
+                                                   svc, "rpcdisp");
+                        if (ret) {
+                                gf_log (GF_RPCSVC, GF_LOG_ERROR,
+                                        "failed to start dispatch worker, "
+                                        "running %d of %d",
+                                        svc->dispatch.running,
+                                        svc->dispatch.threads);
+                                svc->dispatch.threads = svc->dispatch.running;
+                                ret = -1;
+                                break;
+                        }
+                        svc->dispatch.running++;
+                }
+
+                /* let surplus workers notice */
+                pthread_cond_broadcast (&svc->dispatch.cond);
+        }
+        pthread_mutex_unlock (&svc->dispatch.lock);
+
+        return ret;
+}
+
+/*
+ * Dump the dispatch queue of each connection: its depth, the deepest it
+ * got, and how long requests waited in it for a worker.
+ */
+int
+rpcsvc_dispatch_dump (rpcsvc_t *svc)
+{
+        rpcsvc_queue_t  *queue                    = NULL;
+        char             key[GF_DUMP_MAX_BUF_LEN] = {0};
+        int              i                        = 0;
+
+        if (!svc)
+                return -1;
+
+        gf_proc_dump_add_section ("rpc.dispatch");
+
+        if (pthread_mutex_trylock (&svc->dispatch.lock))
+                return -1;
+
+        gf_proc_dump_write ("threads", "%d", svc->dispatch.threads);
+        gf_proc_dump_write ("running", "%d", svc->dispatch.running);
+        gf_proc_dump_write ("quantum", "%u", svc->dispatch.quantum);
+
+        list_for_each_entry (queue, &svc->dispatch.queues, list) {
+                gf_proc_dump_build_key (key, "client", "%d.identifier", i);
+                gf_proc_dump_write (key, "%s",
+                                    queue->trans->peerinfo.identifier);
+                gf_proc_dump_build_key (key, "client", "%d.queue_depth", i);
+                gf_proc_dump_write (key, "%u", queue->depth);
+                gf_proc_dump_build_key (key, "client", "%d.max_queue_depth",
+                                        i);
+                gf_proc_dump_write (key, "%u", queue->max_depth);
+                gf_proc_dump_build_key (key, "client", "%d.dispatched", i);
+                gf_proc_dump_write (key, "%"PRIu64, queue->dispatched);
+                gf_proc_dump_build_key (key, "client", "%d.avg_wait_usec",
+                                        i);
+                gf_proc_dump_write (key, "%"PRIu64, queue->dispatched ?
+                                    queue->wait_usec / queue->dispatched : 0);
+                gf_proc_dump_build_key (key, "client", "%d.max_wait_usec",
+                                        i);
+                gf_proc_dump_write (key, "%"PRIu64, queue->max_wait_usec);
+                i++;
+        }
+
+        pthread_mutex_unlock (&svc->dispatch.lock);
+
+        return 0;
+}
+
 /*
  * Enable throttling for rpcsvc_t svc.
  * Returns 0 on success, -1 otherwise.
@@ -2493,6 +2795,12 @@ rpcsvc_init (xlator_t *xl, glusterfs_ctx_t *ctx, dict_t *options,
         INIT_LIST_HEAD (&svc->listeners);
         INIT_LIST_HEAD (&svc->programs);
 
+        pthread_mutex_init (&svc->dispatch.lock, NULL);
+        pthread_cond_init (&svc->dispatch.cond, NULL);
+        INIT_LIST_HEAD (&svc->dispatch.active);
+        INIT_LIST_HEAD (&svc->dispatch.queues);
+        svc->dispatch.quantum = RPCSVC_DEFAULT_DISPATCH_QUANTUM;
+
         ret = rpcsvc_init_options (svc, options);
         if (ret == -1) {
                 gf_log (GF_RPCSVC, GF_LOG_ERROR, "Failed to init options");
@@ -38,6 +38,15 @@
 #define RPCSVC_MAX_OUTSTANDING_RPC_LIMIT 65536
 #define RPCSVC_MIN_OUTSTANDING_RPC_LIMIT 0 /* No limit i.e. Unlimited */
 
+#define RPCSVC_DEFAULT_DISPATCH_THREADS 0 /* Run actors on the event thread */
+#define RPCSVC_MAX_DISPATCH_THREADS 64
+#define RPCSVC_DEFAULT_DISPATCH_QUANTUM (128 * GF_UNIT_KB)
+#define RPCSVC_MIN_DISPATCH_QUANTUM (4 * GF_UNIT_KB)
+#define RPCSVC_MAX_DISPATCH_QUANTUM (16 * GF_UNIT_MB)
+/* Fixed charge per request on top of its payload, so that a flood of
+ * small requests is accounted for and not just the bulk writes. */
+#define RPCSVC_DISPATCH_REQUEST_COST (1 * GF_UNIT_KB)
+
 #define GF_RPCSVC       "rpc-service"
 #define RPCSVC_THREAD_STACK_SIZE ((size_t)(1024 * GF_UNIT_KB))
 
@@ -250,8 +259,28 @@ struct rpcsvc_request {
 
         /* request queue in rpcsvc */
         struct list_head         request_list;
+
+        /* deficit round-robin charge and time of queueing, when the
+         * request waits in its connection's dispatch queue */
+        uint32_t                 drr_cost;
+        struct timespec          drr_queued;
 };
 
+/* Per-connection queue of requests waiting for a dispatch worker. */
+typedef struct rpcsvc_queue {
+        struct list_head         active;   /* in svc->dispatch.active */
+        struct list_head         list;     /* in svc->dispatch.queues */
+        struct list_head         requests;
+        rpc_transport_t         *trans;
+        int64_t                  deficit;
+        gf_boolean_t             credited; /* got its quantum this round */
+        uint32_t                 depth;
+        uint32_t                 max_depth;
+        uint64_t                 dispatched;
+        uint64_t                 wait_usec;
+        uint64_t                 max_wait_usec;
+} rpcsvc_queue_t;
+
 #define rpcsvc_request_program(req) ((rpcsvc_program_t *)((req)->prog))
 #define rpcsvc_request_procnum(req) (((req)->procnum))
 #define rpcsvc_request_program_private(req) (((rpcsvc_program_t *)((req)->prog))->private)
@@ -615,6 +644,12 @@ rpcsvc_set_root_squash (rpcsvc_t *svc, dict_t *options);
 int
 rpcsvc_set_outstanding_rpc_limit (rpcsvc_t *svc, dict_t *options, int defvalue);
 
+int
+rpcsvc_set_dispatch_threads (rpcsvc_t *svc, dict_t *options);
+
+int
+rpcsvc_dispatch_dump (rpcsvc_t *svc);
+
 int
 rpcsvc_set_throttle_on (rpcsvc_t *svc);
 
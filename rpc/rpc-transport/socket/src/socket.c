@@ -38,6 +38,14 @@
 #include <errno.h>
 #include <rpc/xdr.h>
 #include <sys/ioctl.h>
+#ifdef GF_LINUX_HOST_OS
+#include <linux/errqueue.h>
+#endif
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && \
+    defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_SOCKET_ZEROCOPY 1
+#endif
 #define GF_LOG_ERRNO(errno) ((errno == ENOTCONN) ? GF_LOG_DEBUG : GF_LOG_ERROR)
 #define SA(ptr) ((struct sockaddr *)ptr)
 
@@ -51,6 +59,9 @@
 #define SSL_EC_CURVE_OPT    "transport.socket.ssl-ec-curve"
 #define SSL_CRL_PATH_OPT    "transport.socket.ssl-crl-path"
 #define OWN_THREAD_OPT      "transport.socket.own-thread"
+#define COALESCE_WRITES_OPT "transport.socket.coalesce-writes"
+#define ZEROCOPY_OPT        "transport.socket.zerocopy-threshold"
+#define RECV_RING_OPT       "transport.socket.recv-ring-size"
 
 /* TBD: do automake substitutions etc. (ick) to set these. */
 #if !defined(DEFAULT_ETC_SSL)
@@ -478,6 +489,222 @@ out:
         return ret;
 }
 
+
+/* Read into the caller's vector and, with the same readv(), as much of
+   what follows as fits into the ring. Later reads are served from the
+   ring until it runs dry, so a burst of small RPCs costs one syscall
+   instead of a few per record. */
+static int
+__socket_ring_read (rpc_transport_t *this, struct iovec *opvector, int opcount)
+{
+        socket_private_t *priv = NULL;
+        struct iovec      iov[MAX_IOVEC + 1];
+        size_t            req_len = 0;
+        ssize_t           ret = -1;
+
+        priv = this->private;
+        req_len = iov_length (opvector, opcount);
+
+        if (priv->ring.head < priv->ring.tail) {
+                ret = iov_load (opvector, opcount,
+                                &priv->ring.buf[priv->ring.head],
+                                min (req_len,
+                                     priv->ring.tail - priv->ring.head));
+                priv->ring.head += ret;
+                return ret;
+        }
+
+        if (!priv->ring.buf) {
+                priv->ring.buf = GF_MALLOC (priv->ring.size, gf_sock_mt_ring);
+                if (!priv->ring.buf) {
+                        priv->ring.size = 0;
+                        return __socket_cached_read (this, opvector, opcount);
+                }
+        }
+
+        if (opcount > MAX_IOVEC)
+                return sys_readv (priv->sock, opvector, IOV_MIN (opcount));
+
+        memcpy (iov, opvector, opcount * sizeof (*iov));
+        iov[opcount].iov_base = priv->ring.buf;
+        iov[opcount].iov_len = priv->ring.size;
+
+        ret = sys_readv (priv->sock, iov, opcount + 1);
+        if (ret > (ssize_t)req_len) {
+                priv->ring.head = 0;
+                priv->ring.tail = ret - req_len;
+                ret = req_len;
+        }
+
+        return ret;
+}
+
+
+static gf_boolean_t
+socket_ring_pending (rpc_transport_t *this)
+{
+        socket_private_t *priv = NULL;
+        gf_boolean_t      pending = _gf_false;
+
+        priv = this->private;
+
+        pthread_mutex_lock (&priv->in_lock);
+        {
+                pending = (priv->ring.head < priv->ring.tail);
+        }
+        pthread_mutex_unlock (&priv->in_lock);
+
+        return pending;
+}
+
+
+#ifdef HAVE_SOCKET_ZEROCOPY
+static ssize_t
+__socket_zc_sendv (rpc_transport_t *this, struct iovec *vector, int count,
+                   struct iobref *iobref)
+{
+        socket_private_t *priv = NULL;
+        struct socket_zc *zc = NULL;
+        struct msghdr     msg = {0, };
+        ssize_t           ret = -1;
+        int               on = 1;
+
+        priv = this->private;
+
+        if (!priv->zc_on) {
+                if (setsockopt (priv->sock, SOL_SOCKET, SO_ZEROCOPY, &on,
+                                sizeof (on)) != 0) {
+                        gf_log (this->name, GF_LOG_INFO, "SO_ZEROCOPY failed "
+                                "(%s), sending copies", strerror (errno));
+                        priv->zc_threshold = 0;
+                        goto copy;
+                }
+                priv->zc_on = _gf_true;
+        }
+
+        zc = GF_CALLOC (1, sizeof (*zc), gf_sock_mt_zc);
+        if (!zc)
+                goto copy;
+
+        msg.msg_iov = vector;
+        msg.msg_iovlen = count;
+
+        ret = sendmsg (priv->sock, &msg, MSG_ZEROCOPY);
+        if (ret < 0) {
+                GF_FREE (zc);
+                /* out of optmem, this one gets copied */
+                if (errno == ENOBUFS)
+                        goto copy;
+                return ret;
+        }
+
+        zc->seq = priv->zc_next++;
+        zc->iobref = iobref_ref (iobref);
+        list_add_tail (&zc->list, &priv->zc_pending);
+
+        return ret;
+copy:
+        return sys_writev (priv->sock, vector, count);
+}
+
+
+/* Let go of the payloads of the MSG_ZEROCOPY sends the kernel is done
+   with, returns how many completions there were. */
+static int
+__socket_zc_reap (rpc_transport_t *this)
+{
+        socket_private_t         *priv = NULL;
+        struct sock_extended_err *serr = NULL;
+        struct socket_zc         *zc = NULL;
+        struct socket_zc         *tmp = NULL;
+        struct cmsghdr           *cm = NULL;
+        struct msghdr             msg = {0, };
+        char                      control[128];
+        int                       found = 0;
+
+        priv = this->private;
+
+        for (;;) {
+                memset (&msg, 0, sizeof (msg));
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof (control);
+
+                if (recvmsg (priv->sock, &msg, MSG_ERRQUEUE) < 0)
+                        break;
+
+                for (cm = CMSG_FIRSTHDR (&msg); cm;
+                     cm = CMSG_NXTHDR (&msg, cm)) {
+                        if (!(cm->cmsg_level == SOL_IP &&
+                              cm->cmsg_type == IP_RECVERR) &&
+                            !(cm->cmsg_level == SOL_IPV6 &&
+                              cm->cmsg_type == IPV6_RECVERR))
+                                continue;
+
+                        serr = (void *)CMSG_DATA (cm);
+                        if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+                            serr->ee_errno != 0)
+                                continue;
+
+                        found++;
+
+                        /* the kernel had to copy after all (loopback, a
+                           NIC without scatter-gather), the bookkeeping
+                           only costs from here on */
+                        if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                                priv->zc_threshold = 0;
+
+                        /* [ee_info, ee_data] are done */
+                        list_for_each_entry_safe (zc, tmp, &priv->zc_pending,
+                                                  list) {
+                                if ((int32_t)(zc->seq - serr->ee_info) < 0 ||
+                                    (int32_t)(zc->seq - serr->ee_data) > 0)
+                                        continue;
+                                list_del (&zc->list);
+                                iobref_unref (zc->iobref);
+                                GF_FREE (zc);
+                        }
+                }
+        }
+
+        return found;
+}
+#else
+static ssize_t
+__socket_zc_sendv (rpc_transport_t *this, struct iovec *vector, int count,
+                   struct iobref *iobref)
+{
+        socket_private_t *priv = this->private;
+
+        return sys_writev (priv->sock, vector, count);
+}
+
+
+static int
+__socket_zc_reap (rpc_transport_t *this)
+{
+        return 0;
+}
+#endif
+
+
+static void
+__socket_zc_flush (rpc_transport_t *this)
+{
+        socket_private_t *priv = NULL;
+        struct socket_zc *zc = NULL;
+        struct socket_zc *tmp = NULL;
+
+        priv = this->private;
+
+        list_for_each_entry_safe (zc, tmp, &priv->zc_pending, list) {
+                list_del (&zc->list);
+                iobref_unref (zc->iobref);
+                GF_FREE (zc);
+        }
+        priv->zc_on = _gf_false;
+        priv->zc_next = 0;
+}
+
 static gf_boolean_t
 __does_socket_rwv_error_need_logging (socket_private_t *priv, int write)
 {
@@ -502,7 +729,7 @@ __does_socket_rwv_error_need_logging (socket_private_t *priv, int write)
 static int
 __socket_rwv (rpc_transport_t *this, struct iovec *vector, int count,
               struct iovec **pending_vector, int *pending_count, size_t *bytes,
-              int write)
+              int write, struct iobref *zc_iobref)
 {
         socket_private_t *priv = NULL;
         int               sock = -1;
@@ -544,6 +771,10 @@ __socket_rwv (rpc_transport_t *this, struct iovec *vector, int count,
                         if (priv->use_ssl) {
                                 ret = ssl_write_one (this, opvector->iov_base,
                                                      opvector->iov_len);
+                        } else if (zc_iobref) {
+                                ret = __socket_zc_sendv (this, opvector,
+                                                         IOV_MIN(opcount),
+                                                         zc_iobref);
                         } else {
                                 ret = sys_writev (sock, opvector, IOV_MIN(opcount));
                         }
@@ -554,7 +785,12 @@ __socket_rwv (rpc_transport_t *this, struct iovec *vector, int count,
                         }
                         this->total_bytes_write += ret;
                 } else {
-                        ret = __socket_cached_read (this, opvector, opcount);
+                        if (priv->ring.size && !priv->use_ssl)
+                                ret = __socket_ring_read (this, opvector,
+                                                          opcount);
+                        else
+                                ret = __socket_cached_read (this, opvector,
+                                                            opcount);
 
                         if (ret == 0) {
                                 gf_log(this->name, GF_LOG_DEBUG, "EOF on socket");
@@ -649,7 +885,7 @@ __socket_readv (rpc_transport_t *this, struct iovec *vector, int count,
         int ret = -1;
 
         ret = __socket_rwv (this, vector, count,
-                            pending_vector, pending_count, bytes, 0);
+                            pending_vector, pending_count, bytes, 0, NULL);
 
         return ret;
 }
@@ -657,12 +893,13 @@ __socket_readv (rpc_transport_t *this, struct iovec *vector, int count,
 
 static int
 __socket_writev (rpc_transport_t *this, struct iovec *vector, int count,
-                 struct iovec **pending_vector, int *pending_count)
+                 struct iovec **pending_vector, int *pending_count,
+                 struct iobref *zc_iobref)
 {
         int ret = -1;
 
         ret = __socket_rwv (this, vector, count,
-                            pending_vector, pending_count, NULL, 1);
+                            pending_vector, pending_count, NULL, 1, zc_iobref);
 
         return ret;
 }
@@ -967,6 +1204,8 @@ __socket_reset (rpc_transport_t *this)
         GF_FREE (priv->incoming.request_info);
 
         memset (&priv->incoming, 0, sizeof (priv->incoming));
+        priv->ring.head = priv->ring.tail = 0;
+        __socket_zc_flush (this);
 
         event_unregister_close (this->ctx->event_pool, priv->sock, priv->idx);
 
@@ -1003,12 +1242,15 @@ socket_set_last_frag_header_size (uint32_t size, char *haddr)
 static struct ioq *
 __socket_ioq_new (rpc_transport_t *this, rpc_transport_msg_t *msg)
 {
+        socket_private_t *priv  = NULL;
         struct ioq       *entry = NULL;
         int               count = 0;
         uint32_t          size  = 0;
 
         GF_VALIDATE_OR_GOTO ("socket", this, out);
 
+        priv = this->private;
+
         /* TODO: use mem-pool */
         entry = GF_CALLOC (1, sizeof (*entry), gf_common_mt_ioq);
         if (!entry)
@@ -1048,12 +1290,22 @@ __socket_ioq_new (rpc_transport_t *this, rpc_transport_msg_t *msg)
                 entry->count += msg->proghdrcount;
         }
 
+        entry->payload = entry->count;
         if (msg->progpayload != NULL) {
                 memcpy (&entry->vector[entry->count], msg->progpayload,
                         sizeof (struct iovec) * msg->progpayloadcount);
                 entry->count += msg->progpayloadcount;
         }
 
+        /* Only the payload is sent without a copy, it lives in the iobref.
+           The headers (the fragment header sits in this entry) are gone
+           before the kernel would be done with them. */
+        if (priv->zc_threshold && msg->iobref && !priv->use_ssl &&
+            !priv->own_thread && iov_length (msg->progpayload,
+                                             msg->progpayloadcount) >=
+                                 priv->zc_threshold)
+                entry->zerocopy = _gf_true;
+
         entry->pending_vector = entry->vector;
         entry->pending_count  = entry->count;
 
@@ -1084,6 +1336,33 @@ out:
 }
 
 
+/* Move whatever was pushed on outq to the tail of ioq, oldest first. */
+static void
+__socket_outq_splice (rpc_transport_t *this)
+{
+        socket_private_t *priv = NULL;
+        struct ioq       *entry = NULL;
+        struct ioq       *next = NULL;
+        struct ioq       *oldest = NULL;
+
+        priv = this->private;
+
+        entry = __atomic_exchange_n (&priv->outq, NULL, __ATOMIC_ACQUIRE);
+        while (entry) {
+                next = entry->outq_next;
+                entry->outq_next = oldest;
+                oldest = entry;
+                entry = next;
+        }
+
+        for (entry = oldest; entry; entry = next) {
+                next = entry->outq_next;
+                entry->outq_next = NULL;
+                list_add_tail (&entry->list, &priv->ioq);
+        }
+}
+
+
 static void
 __socket_ioq_flush (rpc_transport_t *this)
 {
@@ -1095,6 +1374,7 @@ __socket_ioq_flush (rpc_transport_t *this)
 
         priv = this->private;
 
+        __socket_outq_splice (this);
         while (!list_empty (&priv->ioq)) {
                 entry = priv->ioq_next;
                 __socket_ioq_entry_free (entry);
@@ -1105,62 +1385,174 @@ out:
 }
 
 
+static void
+__socket_ioq_entry_done (rpc_transport_t *this, struct ioq *entry, int direct)
+{
+        socket_private_t *priv = NULL;
+        char              a_byte = 0;
+
+        __socket_ioq_entry_free (entry);
+        priv = this->private;
+        if (priv->own_thread) {
+                /*
+                 * The pipe should only remain readable if there are
+                 * more entries after this, so drain the byte
+                 * representing this entry.
+                 */
+                if (!direct && sys_read (priv->pipe[0], &a_byte, 1) < 1) {
+                        gf_log(this->name, GF_LOG_WARNING,
+                               "read error on pipe");
+                }
+        }
+}
+
+
 static int
 __socket_ioq_churn_entry (rpc_transport_t *this, struct ioq *entry, int direct)
 {
         int               ret = -1;
-        socket_private_t *priv = NULL;
-        char              a_byte = 0;
+        struct iovec     *payload = NULL;
+        int               left = 0;
+
+        payload = &entry->vector[entry->payload];
+        if (entry->zerocopy && entry->pending_vector < payload) {
+                /* headers first, copied as usual */
+                ret = __socket_writev (this, entry->pending_vector,
+                                       payload - entry->pending_vector,
+                                       &entry->pending_vector, &left, NULL);
+                if (ret == -1)
+                        return ret;
+                entry->pending_count = left + entry->count - entry->payload;
+                if (ret > 0)
+                        return ret;
+        }
 
         ret = __socket_writev (this, entry->pending_vector,
                                entry->pending_count,
                                &entry->pending_vector,
-                               &entry->pending_count);
+                               &entry->pending_count,
+                               entry->zerocopy ? entry->iobref : NULL);
 
         if (ret == 0) {
                 /* current entry was completely written */
                 GF_ASSERT (entry->pending_count == 0);
-                __socket_ioq_entry_free (entry);
-                priv = this->private;
-                if (priv->own_thread) {
-                        /*
-                         * The pipe should only remain readable if there are
-                         * more entries after this, so drain the byte
-                         * representing this entry.
-                         */
-                        if (!direct && sys_read (priv->pipe[0], &a_byte, 1) < 1) {
-                                gf_log(this->name, GF_LOG_WARNING,
-                                       "read error on pipe");
-                        }
+                __socket_ioq_entry_done (this, entry, direct);
+        }
+
+        return ret;
+}
+
+
+static void
+__socket_iov_advance (struct iovec **vector, int *count, size_t bytes)
+{
+        while (bytes && *count) {
+                if (bytes >= (*vector)->iov_len) {
+                        bytes -= (*vector)->iov_len;
+                        (*vector)++;
+                        (*count)--;
+                } else {
+                        (*vector)->iov_base += bytes;
+                        (*vector)->iov_len -= bytes;
+                        bytes = 0;
                 }
         }
+}
+
+
+/* Write as many queued entries as fit into one writev(), then settle who
+   got how far. Entries that go out MSG_ZEROCOPY are left to
+   __socket_ioq_churn_entry(). */
+static int
+__socket_ioq_churn_coalesced (rpc_transport_t *this)
+{
+        socket_private_t *priv = NULL;
+        struct ioq       *entry = NULL;
+        struct ioq       *tmp = NULL;
+        struct iovec      vector[GF_SOCKET_COALESCE_IOV];
+        struct iovec     *pending = NULL;
+        int               count = 0;
+        int               left = 0;
+        size_t            total = 0;
+        size_t            written = 0;
+        size_t            len = 0;
+        int               ret = -1;
+
+        priv = this->private;
+
+        list_for_each_entry (entry, &priv->ioq, list) {
+                if (entry->zerocopy ||
+                    count + entry->pending_count > GF_SOCKET_COALESCE_IOV)
+                        break;
+                memcpy (&vector[count], entry->pending_vector,
+                        entry->pending_count * sizeof (struct iovec));
+                count += entry->pending_count;
+        }
+
+        total = iov_length (vector, count);
+        ret = __socket_writev (this, vector, count, &pending, &left, NULL);
+        if (ret == -1)
+                return ret;
+
+        written = total - iov_length (pending, left);
+
+        list_for_each_entry_safe (entry, tmp, &priv->ioq, list) {
+                len = iov_length (entry->pending_vector,
+                                  entry->pending_count);
+                if (written < len) {
+                        __socket_iov_advance (&entry->pending_vector,
+                                              &entry->pending_count, written);
+                        break;
+                }
+                written -= len;
+                __socket_ioq_entry_done (this, entry, 0);
+        }
 
         return ret;
 }
 
 
 static int
-__socket_ioq_churn (rpc_transport_t *this)
+__socket_ioq_write (rpc_transport_t *this)
 {
         socket_private_t *priv = NULL;
         int               ret = 0;
         struct ioq       *entry = NULL;
 
-        GF_VALIDATE_OR_GOTO ("socket", this, out);
-        GF_VALIDATE_OR_GOTO ("socket", this->private, out);
-
         priv = this->private;
 
         while (!list_empty (&priv->ioq)) {
                 /* pick next entry */
                 entry = priv->ioq_next;
 
-                ret = __socket_ioq_churn_entry (this, entry, 0);
+                if (priv->coalesce_writes && !priv->use_ssl &&
+                    !entry->zerocopy && entry->list.next != &priv->ioq)
+                        ret = __socket_ioq_churn_coalesced (this);
+                else
+                        ret = __socket_ioq_churn_entry (this, entry, 0);
 
                 if (ret != 0)
                         break;
         }
 
+        return ret;
+}
+
+
+static int
+__socket_ioq_churn (rpc_transport_t *this)
+{
+        socket_private_t *priv = NULL;
+        int               ret = 0;
+
+        GF_VALIDATE_OR_GOTO ("socket", this, out);
+        GF_VALIDATE_OR_GOTO ("socket", this->private, out);
+
+        priv = this->private;
+
+        __socket_outq_splice (this);
+        ret = __socket_ioq_write (this);
+
         if (!priv->own_thread && list_empty (&priv->ioq)) {
                 /* all pending writes done, not interested in POLLOUT */
                 priv->idx = event_select_on (this->ctx->event_pool,
@@ -2297,9 +2689,12 @@ socket_event_poll_in (rpc_transport_t *this, gf_boolean_t notify_handled)
         rpc_transport_pollin_t *pollin = NULL;
         socket_private_t       *priv = this->private;
         glusterfs_ctx_t        *ctx  = NULL;
+        gf_boolean_t            more = _gf_false;
 
         ctx = this->ctx;
 
+again:
+        pollin = NULL;
         ret = socket_proto_state_machine (this, &pollin);
 
         if (pollin) {
@@ -2310,10 +2705,17 @@ socket_event_poll_in (rpc_transport_t *this, gf_boolean_t notify_handled)
                 pthread_mutex_unlock (&priv->notify.lock);
         }
 
+        /* Records already in the ring don't make the socket readable,
+           nobody else is going to pick them up. They are ours until the
+           ring is empty, so the fd is only handed back after that. */
+        more = (ret != -1 && pollin && priv->ring.size &&
+                socket_ring_pending (this));
 
-        if (notify_handled && (ret != -1))
+        if (notify_handled && (ret != -1) && !more) {
                 event_handled (ctx->event_pool, priv->sock, priv->idx,
                                priv->gen);
+                notify_handled = _gf_false;
+        }
 
         if (pollin) {
                 priv->ot_state = OT_CALLBACK;
@@ -2335,6 +2737,9 @@ socket_event_poll_in (rpc_transport_t *this, gf_boolean_t notify_handled)
                                 pthread_cond_signal (&priv->notify.cond);
                 }
                 pthread_mutex_unlock (&priv->notify.lock);
+
+                if (more)
+                        goto again;
         }
 
         return ret;
@@ -2417,6 +2822,34 @@ out:
 
 static int socket_disconnect (rpc_transport_t *this, gf_boolean_t wait);
 
+/* returns true when the error queue only had MSG_ZEROCOPY completions */
+static gf_boolean_t
+socket_zc_reap (rpc_transport_t *this)
+{
+        socket_private_t *priv  = NULL;
+        int               found = 0;
+        int               error = 0;
+        socklen_t         len   = sizeof (error);
+
+        priv = this->private;
+
+        pthread_mutex_lock (&priv->out_lock);
+        {
+                if (!list_empty (&priv->zc_pending))
+                        found = __socket_zc_reap (this);
+        }
+        pthread_mutex_unlock (&priv->out_lock);
+
+        if (!found)
+                return _gf_false;
+
+        if (getsockopt (priv->sock, SOL_SOCKET, SO_ERROR, &error, &len) ||
+            error)
+                return _gf_false;
+
+        return _gf_true;
+}
+
 /* reads rpc_requests during pollin */
 static int
 socket_event_handler (int fd, int idx, int gen, void *data,
@@ -2469,6 +2902,13 @@ socket_event_handler (int fd, int idx, int gen, void *data,
                 ret = 0;
         }
 
+        /* MSG_ZEROCOPY completions come in on the error queue, that's not
+           the socket failing */
+        if (!ret && poll_err && socket_zc_reap (this)) {
+                event_clear_error (ctx->event_pool, fd, idx, gen);
+                poll_err = 0;
+        }
+
         if (!ret && poll_out) {
                 ret = socket_event_poll_out (this);
         }
@@ -2857,6 +3297,9 @@ socket_server_event_handler (int fd, int idx, int gen, void *data,
 
                 new_priv->sock = new_sock;
                 new_priv->own_thread = priv->own_thread;
+                new_priv->coalesce_writes = priv->coalesce_writes;
+                new_priv->zc_threshold = priv->zc_threshold;
+                new_priv->ring.size = priv->ring.size;
 
                 new_priv->ssl_ctx = priv->ssl_ctx;
                 if (new_priv->use_ssl && !new_priv->own_thread) {
@@ -3596,6 +4039,102 @@ out:
 }
 
 
+/*
+ * Submitting threads don't take out_lock: they push the entry on outq
+ * and the one that wins out_flushing moves outq to ioq and writes it.
+ * Others return right away, their entries go out with the flusher's
+ * batch, which has another look at outq after letting go of the flag.
+ * When ioq was already waiting for POLLOUT the entries are only queued,
+ * socket_event_poll_out() writes them. A write error disconnects the
+ * transport, as it does there, and the queued entries are failed with
+ * it. The own-thread poller keeps the locked path, it counts entries
+ * through its pipe.
+ */
+static void
+socket_outq_flush (rpc_transport_t *this)
+{
+        socket_private_t *priv = NULL;
+        gf_boolean_t      was_empty = _gf_false;
+        int               ret = 0;
+
+        priv = this->private;
+
+        do {
+                if (__atomic_exchange_n (&priv->out_flushing, 1,
+                                         __ATOMIC_SEQ_CST))
+                        break;
+
+                pthread_mutex_lock (&priv->out_lock);
+                {
+                        was_empty = list_empty (&priv->ioq);
+                        __socket_outq_splice (this);
+
+                        if (priv->connected != 1) {
+                                /* lost the race with a disconnect */
+                                __socket_ioq_flush (this);
+                        } else if (was_empty) {
+                                ret = __socket_ioq_write (this);
+                                if (ret > 0) {
+                                        /* continue writing on POLLOUT */
+                                        priv->idx = event_select_on (
+                                                this->ctx->event_pool,
+                                                priv->sock, priv->idx, -1, 1);
+                                } else if (ret == -1) {
+                                        /* the poller sees the shutdown and
+                                         * flushes what is still queued */
+                                        gf_log (this->name, GF_LOG_TRACE,
+                                                "__socket_ioq_write returned "
+                                                "-1; disconnecting socket");
+                                        __socket_disconnect (this);
+                                }
+                        }
+                }
+                pthread_mutex_unlock (&priv->out_lock);
+
+                __atomic_store_n (&priv->out_flushing, 0, __ATOMIC_SEQ_CST);
+        } while (__atomic_load_n (&priv->outq, __ATOMIC_SEQ_CST));
+}
+
+
+static int32_t
+socket_outq_submit (rpc_transport_t *this, rpc_transport_msg_t *msg)
+{
+        socket_private_t *priv = NULL;
+        struct ioq       *entry = NULL;
+        struct ioq       *head = NULL;
+
+        priv = this->private;
+
+        if (priv->connected != 1) {
+                if (!priv->submit_log && !priv->connect_finish_log) {
+                        gf_log (this->name, GF_LOG_INFO,
+                                "not connected (priv->connected = %d)",
+                                priv->connected);
+                        priv->submit_log = 1;
+                }
+                return -1;
+        }
+        if (priv->submit_log)
+                priv->submit_log = 0;
+
+        /* only reads settings that are fixed while connected */
+        entry = __socket_ioq_new (this, msg);
+        if (!entry)
+                return -1;
+
+        head = __atomic_load_n (&priv->outq, __ATOMIC_RELAXED);
+        do {
+                entry->outq_next = head;
+        } while (!__atomic_compare_exchange_n (&priv->outq, &head, entry, 1,
+                                               __ATOMIC_SEQ_CST,
+                                               __ATOMIC_RELAXED));
+
+        socket_outq_flush (this);
+
+        return 0;
+}
+
+
 static int32_t
 socket_submit_request (rpc_transport_t *this, rpc_transport_req_t *req)
 {
@@ -3613,6 +4152,11 @@ socket_submit_request (rpc_transport_t *this, rpc_transport_req_t *req)
         priv = this->private;
         ctx  = this->ctx;
 
+        if (!priv->own_thread) {
+                ret = socket_outq_submit (this, &req->msg);
+                goto out;
+        }
+
         pthread_mutex_lock (&priv->out_lock);
         {
                 if (priv->connected != 1) {
@@ -3687,6 +4231,11 @@ socket_submit_reply (rpc_transport_t *this, rpc_transport_reply_t *reply)
         priv = this->private;
         ctx  = this->ctx;
 
+        if (!priv->own_thread) {
+                ret = socket_outq_submit (this, &reply->msg);
+                goto out;
+        }
+
         pthread_mutex_lock (&priv->out_lock);
         {
                 if (priv->connected != 1) {
@@ -3869,6 +4418,50 @@ struct rpc_transport_ops tops = {
         .throttle           = socket_throttle,
 };
 
+/* coalesce-writes, zerocopy-threshold and recv-ring-size; a new ring size
+   only applies to connections made after the change */
+static int
+socket_io_options (rpc_transport_t *this, socket_private_t *priv,
+                   dict_t *options)
+{
+        char             *optstr = NULL;
+        uint64_t          size   = 0;
+
+        priv->coalesce_writes = _gf_false;
+        if (dict_get_str (options, COALESCE_WRITES_OPT, &optstr) == 0 &&
+            gf_string2boolean (optstr, &priv->coalesce_writes) != 0) {
+                gf_log (this->name, GF_LOG_ERROR, "'%s' takes only boolean "
+                        "options", COALESCE_WRITES_OPT);
+                return -1;
+        }
+
+        priv->zc_threshold = 0;
+        if (dict_get_str (options, ZEROCOPY_OPT, &optstr) == 0 &&
+            gf_string2bytesize_uint64 (optstr, &priv->zc_threshold) != 0) {
+                gf_log (this->name, GF_LOG_ERROR, "invalid number format: %s",
+                        optstr);
+                return -1;
+        }
+#ifndef HAVE_SOCKET_ZEROCOPY
+        if (priv->zc_threshold) {
+                gf_log (this->name, GF_LOG_WARNING, "%s: MSG_ZEROCOPY is not "
+                        "supported on this platform", ZEROCOPY_OPT);
+                priv->zc_threshold = 0;
+        }
+#endif
+
+        if (dict_get_str (options, RECV_RING_OPT, &optstr) == 0 &&
+            gf_string2bytesize_uint64 (optstr, &size) != 0) {
+                gf_log (this->name, GF_LOG_ERROR, "invalid number format: %s",
+                        optstr);
+                return -1;
+        }
+        if (!priv->ring.buf)
+                priv->ring.size = size;
+
+        return 0;
+}
+
 int
 reconfigure (rpc_transport_t *this, dict_t *options)
 {
@@ -3953,6 +4546,11 @@ reconfigure (rpc_transport_t *this, dict_t *options)
 
         priv->windowsize = (int)windowsize;
 
+        if (socket_io_options (this, priv, options) != 0) {
+                ret = -1;
+                goto out;
+        }
+
         if (dict_get (options, "non-blocking-io")) {
                 optstr = data_to_str (dict_get (options,
                                                 "non-blocking-io"));
@@ -4144,6 +4742,7 @@ socket_init (rpc_transport_t *this)
         priv->bio = 0;
         priv->windowsize = GF_DEFAULT_SOCKET_WINDOW_SIZE;
         INIT_LIST_HEAD (&priv->ioq);
+        INIT_LIST_HEAD (&priv->zc_pending);
         pthread_mutex_init (&priv->notify.lock, NULL);
         pthread_cond_init (&priv->notify.cond, NULL);
 
@@ -4267,6 +4866,9 @@ socket_init (rpc_transport_t *this)
                 }
         }
 
+        if (socket_io_options (this, priv, this->options) != 0)
+                return -1;
+
         priv->windowsize = (int)windowsize;
 
         priv->ssl_enabled = _gf_false;
@@ -4570,6 +5172,7 @@ fini (rpc_transport_t *this)
                 pthread_mutex_destroy (&priv->out_lock);
                 pthread_mutex_destroy (&priv->cond_lock);
                 pthread_cond_destroy (&priv->cond);
+                GF_FREE (priv->ring.buf);
                 if (priv->ssl_private_key) {
                         GF_FREE(priv->ssl_private_key);
                 }
@@ -4696,6 +5299,33 @@ struct volume_options options[] = {
         { .key   = {OWN_THREAD_OPT},
           .type  = GF_OPTION_TYPE_BOOL
         },
+        { .key   = {COALESCE_WRITES_OPT},
+          .type  = GF_OPTION_TYPE_BOOL,
+          .default_value = "off",
+          .description = "Once replies or requests queue up behind a full "
+                         "socket, send as many of them as possible with "
+                         "one writev()."
+        },
+        { .key   = {ZEROCOPY_OPT},
+          .type  = GF_OPTION_TYPE_SIZET,
+          .min   = 0,
+          .max   = 1 * GF_UNIT_GB,
+          .default_value = "0",
+          .description = "Send payloads of at least this size with "
+                         "MSG_ZEROCOPY, holding on to their buffers until "
+                         "the kernel is done with them. 0 turns it off. "
+                         "Linux only, not used with SSL or own-thread."
+        },
+        { .key   = {RECV_RING_OPT},
+          .type  = GF_OPTION_TYPE_SIZET,
+          .min   = 0,
+          .max   = 4 * GF_UNIT_MB,
+          .default_value = "0",
+          .description = "Read whatever the socket has, up to this much "
+                         "beyond what the current RPC needs, and serve the "
+                         "next RPCs from it. 0 turns it off. Not used with "
+                         "SSL."
+        },
         { .key   = {"ssl-own-cert"},
           .type  = GF_OPTION_TYPE_STR,
           .description = "SSL certificate. Ignored if SSL is not enabled."
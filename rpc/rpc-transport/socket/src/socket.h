@@ -54,6 +54,9 @@
 #define GF_KEEPALIVE_INTERVAL           (2)
 #define GF_KEEPALIVE_COUNT              (9)
 
+/* most iovecs handed to one writev() when queued entries are coalesced */
+#define GF_SOCKET_COALESCE_IOV          (256)
+
 typedef enum {
         SP_STATE_NADA = 0,
         SP_STATE_COMPLETE,
@@ -114,6 +117,18 @@ struct ioq {
         struct iovec      *pending_vector;
         int                pending_count;
         struct iobref     *iobref;
+        int                payload;     /* first payload vector */
+        gf_boolean_t       zerocopy;    /* payload goes out MSG_ZEROCOPY */
+        struct ioq        *outq_next;   /* while on priv->outq */
+};
+
+/* A MSG_ZEROCOPY send the kernel can still be reading from. The iobref
+   keeps the payload in place until the completion for seq comes back on
+   the error queue. */
+struct socket_zc {
+        struct list_head   list;
+        uint32_t           seq;
+        struct iobref     *iobref;
 };
 
 typedef struct {
@@ -222,6 +237,10 @@ typedef struct {
         struct gf_sock_incoming incoming;
         pthread_mutex_t        in_lock;
         pthread_mutex_t        out_lock;
+        /* Submitted but not yet on ioq, newest first. Pushed without
+           out_lock, the thread holding out_flushing moves it over. */
+        struct ioq            *outq;
+        int                    out_flushing;
         pthread_mutex_t        cond_lock;
         pthread_cond_t         cond;
         int                    windowsize;
@@ -261,6 +280,19 @@ typedef struct {
                 pthread_cond_t   cond;
                 uint64_t         in_progress;
         } notify;
+        gf_boolean_t           coalesce_writes;
+        uint64_t               zc_threshold;   /* 0: no MSG_ZEROCOPY */
+        gf_boolean_t           zc_on;          /* SO_ZEROCOPY is set */
+        uint32_t               zc_next;        /* seq of the next send */
+        struct list_head       zc_pending;     /* struct socket_zc */
+        /* whatever the socket had beyond what the reader asked for, it is
+           handed out before the socket is read again (under in_lock) */
+        struct {
+                char          *buf;
+                size_t         size;
+                size_t         head;
+                size_t         tail;
+        } ring;
 } socket_private_t;
 
 
@@ -0,0 +1,74 @@
+#!/bin/bash
+#Test that md-cache-size bounds the memory of the cached xattrs, and that
+#xattrs dropped to stay under it are fetched again correctly.
+
+. $(dirname $0)/../../include.rc
+. $(dirname $0)/../../volume.rc
+
+cleanup;
+
+function mdc_counter {
+        local statedump=$(generate_mount_statedump $V0)
+
+        grep "^$1=" $statedump | cut -d= -f2
+        cleanup_mount_statedump $V0
+}
+
+#Reads the xattr of every file, prints how many differ from what was set
+function mdc_check_xattrs {
+        local bad=0
+        local i
+
+        for i in {1..200}; do
+                [ "$(getfattr --only-values -n user.DOSATTRIB \
+                     $M0/file$i 2>/dev/null)" = "$(dosattrib $i)" ] ||
+                        bad=$((bad + 1))
+        done
+        echo $bad
+}
+
+function dosattrib {
+        printf "file-%04d-%0100d" $1 0
+}
+
+TEST glusterd
+TEST pidof glusterd
+
+TEST $CLI volume create $V0 $H0:$B0/${V0}{0,1}
+TEST $CLI volume set $V0 group metadata-cache
+TEST $CLI volume set $V0 performance.cache-samba-metadata on
+TEST $CLI volume set $V0 performance.md-cache-size 4KB
+EXPECT '4KB' volinfo_field $V0 'performance.md-cache-size'
+TEST $CLI volume start $V0
+
+TEST $GFS --volfile-server=$H0 --volfile-id=$V0 $M0
+
+#Distinct values, so that none of them are shared, 200 of them take more
+#than 4KB
+for i in {1..200}; do
+        touch $M0/file$i
+        setfattr -n user.DOSATTRIB -v "$(dosattrib $i)" $M0/file$i
+done
+
+EXPECT "0" mdc_check_xattrs
+EXPECT "0" mdc_check_xattrs
+
+evictions=$(mdc_counter xattr_evictions)
+TEST [ $evictions -gt 0 ]
+TEST [ $(mdc_counter cache_used) -le 4096 ]
+
+#Without a limit nothing is dropped any more
+TEST $CLI volume set $V0 performance.md-cache-size 0
+EXPECT_WITHIN $CONFIG_UPDATE_TIMEOUT "0" mdc_counter cache_size
+
+EXPECT "0" mdc_check_xattrs
+EXPECT "0" mdc_check_xattrs
+EXPECT "$evictions" mdc_counter xattr_evictions
+
+TEST rm -f $M0/file*
+
+EXPECT_WITHIN $UMOUNT_TIMEOUT "Y" force_umount $M0
+TEST $CLI volume stop $V0
+TEST $CLI volume delete $V0
+
+cleanup;
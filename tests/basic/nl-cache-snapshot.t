@@ -0,0 +1,70 @@
+#!/bin/bash
+#Test that nl-cache saves its cache in nl-cache-snapshot-dir on unmount and
+#loads it back on the next mount, dropping the entries of a directory that
+#another client changed in between.
+
+. $(dirname $0)/../include.rc
+. $(dirname $0)/../volume.rc
+
+cleanup;
+
+function nlc_counter {
+        mount_get_option_value $M0 $V0-nl-cache $1
+}
+
+TEST glusterd
+
+TEST $CLI volume create $V0 $H0:$B0/${V0}{0..4}
+EXPECT 'Created' volinfo_field $V0 'Status'
+
+TEST $CLI volume set $V0 group nl-cache
+TEST mkdir -p $B0/snapshots
+TEST $CLI volume set $V0 performance.nl-cache-snapshot-dir $B0/snapshots
+EXPECT "$B0/snapshots" volinfo_field $V0 'performance.nl-cache-snapshot-dir'
+#Lookups of the directories have to reach nl-cache, not stop in md-cache
+TEST $CLI volume set $V0 performance.stat-prefetch off
+
+TEST $CLI volume start $V0;
+EXPECT 'Started' volinfo_field $V0 'Status';
+
+TEST glusterfs --volfile-id=/$V0 --volfile-server=$H0 $M0 \
+               --attribute-timeout=0 --entry-timeout=0
+TEST glusterfs --volfile-id=/$V0 --volfile-server=$H0 $M1 \
+               --attribute-timeout=0 --entry-timeout=0
+
+TEST mkdir $M0/changed $M0/unchanged
+TEST ! ls -l $M0/changed/file
+TEST ! ls -l $M0/unchanged/file
+
+snapshot=$B0/snapshots/$V0-nl-cache$(echo $M0 | tr / -).snapshot
+EXPECT_WITHIN $UMOUNT_TIMEOUT "Y" force_umount $M0
+EXPECT_WITHIN $UMOUNT_TIMEOUT "Y" path_exists $snapshot
+
+#The other client creates the missing file while the first is unmounted
+TEST touch $M1/changed/file
+
+TEST glusterfs --volfile-id=/$V0 --volfile-server=$H0 $M0 \
+               --attribute-timeout=0 --entry-timeout=0
+TEST [ $(nlc_counter snapshot_dirs_loaded) -ge 2 ]
+
+#The lookup of the changed directory drops what was saved for it...
+TEST ls -l $M0/changed/file
+TEST [ $(nlc_counter snapshot_dirs_discarded) -ge 1 ]
+
+#...while the other one answers from the snapshot
+TEST ! ls -l $M0/unchanged/file
+TEST [ $(nlc_counter snapshot_dirs_reused) -ge 1 ]
+TEST [ $(nlc_counter negative_lookup_hit_count) -ge 1 ]
+
+#Entries loaded from the snapshot are invalidated like any other
+TEST touch $M1/unchanged/file
+TEST ls -l $M0/unchanged/file
+
+TEST rm -rf $M0/changed $M0/unchanged
+
+EXPECT_WITHIN $UMOUNT_TIMEOUT "Y" force_umount $M0
+EXPECT_WITHIN $UMOUNT_TIMEOUT "Y" force_umount $M1
+TEST $CLI volume stop $V0
+TEST $CLI volume delete $V0
+
+cleanup;
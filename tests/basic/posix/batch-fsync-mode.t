@@ -0,0 +1,70 @@
+#!/bin/bash
+#Test that with batch-fsync-mode group-commit concurrent fsyncs from clients
+#are batched by the brick, and that the data they cover reaches the files.
+
+. $(dirname $0)/../../include.rc
+. $(dirname $0)/../../volume.rc
+
+cleanup;
+
+function fsync_writer {
+        local file=$1
+        local i
+
+        for i in {0..31}; do
+                dd if=$B0/data of=$file bs=4k skip=$i seek=$i count=1 \
+                   conv=fsync,notrunc 2>/dev/null || return 1
+        done
+}
+
+#fsyncs the fsyncer of a brick was handed
+function brick_fsync_requests {
+        local statedump=$(generate_brick_statedump $V0 $H0 $1)
+
+        grep "^fsync_requests=" $statedump | cut -d= -f2
+        cleanup_statedump $(get_brick_pid $V0 $H0 $1)
+}
+
+TEST glusterd
+TEST pidof glusterd
+
+TEST $CLI volume create $V0 $H0:$B0/${V0}{0,1}
+TEST $CLI volume set $V0 storage.batch-fsync-mode group-commit
+EXPECT 'group-commit' volinfo_field $V0 'storage.batch-fsync-mode'
+TEST $CLI volume start $V0
+
+TEST $GFS --volfile-server=$H0 --volfile-id=$V0 $M0
+
+TEST dd if=/dev/urandom of=$B0/data bs=4k count=32
+
+#Writers on files of their own and on a shared one
+for i in {0..7}; do
+        fsync_writer $M0/file$i &
+        fsync_writer $M0/shared &
+done
+wait
+
+drop_cache $M0
+for i in {0..7}; do
+        TEST cmp $B0/data $M0/file$i
+done
+TEST cmp $B0/data $M0/shared
+
+#Every one of the 16 x 32 fsyncs went through the batches
+requests=$(( $(brick_fsync_requests $B0/${V0}0) +
+             $(brick_fsync_requests $B0/${V0}1) ))
+TEST [ $requests -eq 512 ]
+
+#Back to the default mode on the same files
+TEST $CLI volume set $V0 storage.batch-fsync-mode reverse-fsync
+TEST fsync_writer $M0/shared
+drop_cache $M0
+TEST cmp $B0/data $M0/shared
+
+TEST rm -f $M0/file* $M0/shared
+
+EXPECT_WITHIN $UMOUNT_TIMEOUT "Y" force_umount $M0
+TEST $CLI volume stop $V0
+TEST $CLI volume delete $V0
+
+cleanup;
@@ -0,0 +1,64 @@
+#!/bin/bash
+#Test reads, writes, fsync and fallocate through the io_uring engine of posix,
+#for buffered and O_DIRECT fds, and with the engine switched off again.
+
+. $(dirname $0)/../../include.rc
+. $(dirname $0)/../../volume.rc
+
+cleanup;
+TEST glusterd
+TEST pidof glusterd
+
+TEST $CLI volume create $V0 $H0:$B0/${V0}{0,1}
+TEST $CLI volume set $V0 storage.io-uring on
+TEST $CLI volume set $V0 performance.strict-o-direct on
+EXPECT 'on' volinfo_field $V0 'storage.io-uring'
+TEST $CLI volume start $V0
+
+TEST $GFS --volfile-server=$H0 --volfile-id=$V0 $M0
+
+TEST dd if=/dev/urandom of=$B0/data bs=128k count=64
+
+#Buffered fds
+TEST dd if=$B0/data of=$M0/buffered bs=128k conv=fsync
+drop_cache $M0
+TEST cmp $B0/data $M0/buffered
+
+#O_DIRECT fds
+TEST dd if=$B0/data of=$M0/direct bs=128k oflag=direct conv=fsync
+TEST dd if=$M0/direct of=$B0/direct bs=128k iflag=direct
+TEST cmp $B0/data $B0/direct
+
+#Many writes in flight at once on one file
+for i in {0..15}; do
+        dd if=$B0/data of=$M0/parallel bs=128k skip=$((i * 4)) \
+           seek=$((i * 4)) count=4 conv=notrunc 2>/dev/null &
+done
+wait
+drop_cache $M0
+TEST cmp $B0/data $M0/parallel
+
+TEST fallocate -l 1M $M0/falloc
+EXPECT "1048576" stat -c %s $M0/falloc
+
+#The ring, if the kernel has one, is still alive after all of it
+statedump=$(generate_brick_statedump $V0 $H0 $B0/${V0}0)
+TEST ! grep -q "^io_uring.dead=1" $statedump
+cleanup_statedump $(get_brick_pid $V0 $H0 $B0/${V0}0)
+
+#And the same without it, on the files it wrote
+TEST $CLI volume set $V0 storage.io-uring off
+EXPECT 'off' volinfo_field $V0 'storage.io-uring'
+TEST dd if=$M0/buffered of=$B0/buffered bs=128k
+TEST cmp $B0/data $B0/buffered
+TEST dd if=$B0/data of=$M0/buffered bs=128k conv=fsync,notrunc
+drop_cache $M0
+TEST cmp $B0/data $M0/buffered
+
+TEST rm -f $M0/buffered $M0/direct $M0/parallel $M0/falloc
+
+EXPECT_WITHIN $UMOUNT_TIMEOUT "Y" force_umount $M0
+TEST $CLI volume stop $V0
+TEST $CLI volume delete $V0
+
+cleanup;
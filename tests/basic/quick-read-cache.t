@@ -0,0 +1,88 @@
+#!/bin/bash
+#Test reads served from the quick-read cache with qr-cache-compression on,
+#and that qr-admission-filter keeps a scan of many files out of a full cache.
+
+. $(dirname $0)/../include.rc
+. $(dirname $0)/../volume.rc
+
+cleanup;
+
+function qr_counter {
+        local statedump=$(generate_mount_statedump $V0)
+
+        grep "^$1=" $statedump | cut -d= -f2
+        cleanup_mount_statedump $V0
+}
+
+#Reads every file of the scan, prints how many differ from the source
+function qr_scan {
+        local bad=0
+        local i
+
+        for i in {1..1000}; do
+                cmp -s $B0/small $M0/scan/$i || bad=$((bad + 1))
+        done
+        echo $bad
+}
+
+TEST glusterd
+TEST pidof glusterd
+
+TEST $CLI volume create $V0 $H0:$B0/${V0}{0,1}
+TEST $CLI volume set $V0 performance.qr-cache-compression on
+EXPECT 'on' volinfo_field $V0 'performance.qr-cache-compression'
+TEST $CLI volume set $V0 performance.cache-size 4MB
+#Lookups have to reach quick-read for it to cache the files
+TEST $CLI volume set $V0 performance.stat-prefetch off
+TEST $CLI volume start $V0
+
+TEST $GFS --volfile-server=$H0 --volfile-id=$V0 $M0 --attribute-timeout=0 \
+          --entry-timeout=0
+
+#A file that compresses well and one that does not
+seq 1 8000 > $B0/text
+TEST dd if=/dev/urandom of=$B0/random bs=32k count=1
+TEST cp $B0/text $B0/random $M0/
+
+drop_cache $M0
+TEST cmp $B0/text $M0/text
+TEST cmp $B0/random $M0/random
+EXPECT "1" qr_counter files_compressed
+
+#Reads from the compressed copy, whole and at an offset
+TEST cmp $B0/text $M0/text
+TEST cmp <(dd if=$B0/text bs=1000 skip=5 count=3 2>/dev/null) \
+         <(dd if=$M0/text bs=1000 skip=5 count=3 2>/dev/null)
+TEST [ $(qr_counter cache-hit) -gt 0 ]
+
+#A write to the file drops the compressed copy
+TEST cp $B0/random $M0/text
+TEST cmp $B0/random $M0/text
+
+#A scan of 16MB of files looked up once fills the 4MB cache, after which
+#the filter turns the rest away
+TEST dd if=/dev/urandom of=$B0/small bs=16k count=1
+TEST mkdir $M0/scan
+for i in {1..1000}; do
+        cp $B0/small $M0/scan/$i
+done
+
+drop_cache $M0
+EXPECT "0" qr_scan
+rejected=$(qr_counter files_rejected)
+TEST [ $rejected -gt 0 ]
+
+TEST $CLI volume set $V0 performance.qr-admission-filter off
+EXPECT_WITHIN $CONFIG_UPDATE_TIMEOUT "off" qr_counter admission_filter
+
+drop_cache $M0
+EXPECT "0" qr_scan
+EXPECT "$rejected" qr_counter files_rejected
+
+TEST rm -rf $M0/scan $M0/text $M0/random
+
+EXPECT_WITHIN $UMOUNT_TIMEOUT "Y" force_umount $M0
+TEST $CLI volume stop $V0
+TEST $CLI volume delete $V0
+
+cleanup;
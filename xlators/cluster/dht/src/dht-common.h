@@ -89,6 +89,10 @@ struct dht_layout {
         int                type;
         gf_atomic_t        ref; /* use with dht_conf_t->layout_lock */
         gf_boolean_t       search_unhashed;
+        gf_boolean_t       sorted; /* list[] is in dht_layout_sort() order
+                                      with no overlapping ranges, so
+                                      dht_layout_search() can bisect it.
+                                      Cleared whenever a range changes. */
         struct {
                 int        err;   /* 0 = normal
                                      -1 = dir exists and no xattr
@@ -850,6 +854,7 @@ dht_layout_t                            *dht_layout_get (xlator_t *this, inode_t
 dht_layout_t                            *dht_layout_for_subvol (xlator_t *this, xlator_t *subvol);
 xlator_t *dht_layout_search (xlator_t   *this, dht_layout_t *layout,
                              const char *name);
+int dht_layout_bisect (dht_layout_t *layout, uint32_t hash);
 int32_t
 dht_migration_get_dst_subvol(xlator_t *this, dht_local_t  *local);
 int32_t
@@ -132,6 +132,42 @@ dht_layout_ref (xlator_t *this, dht_layout_t *layout)
 }
 
 
+/* Returns the index of the entry whose range holds @hash in a layout that
+ * has been through dht_layout_sort(), or -1. Gives the same answer as a
+ * linear scan for the first matching entry: zeroed-out entries sort to the
+ * front and can only match hash 0, and the remaining ranges are disjoint.
+ */
+int
+dht_layout_bisect (dht_layout_t *layout, uint32_t hash)
+{
+        int base = 0;
+        int half = 0;
+        int n    = 0;
+
+        if (layout->cnt <= 0)
+                return -1;
+
+        /* last entry starting at or below hash; written so the compiler
+         * can use a conditional move instead of a hard to predict branch */
+        n = layout->cnt;
+        while (n > 1) {
+                half = n / 2;
+                base = (layout->list[base + half].start <= hash) ?
+                        base + half : base;
+                n -= half;
+        }
+
+        if (hash == 0)
+                base = 0;
+
+        if (layout->list[base].start <= hash &&
+            layout->list[base].stop >= hash)
+                return base;
+
+        return -1;
+}
+
+
 xlator_t *
 dht_layout_search (xlator_t *this, dht_layout_t *layout, const char *name)
 {
@@ -149,11 +185,17 @@ dht_layout_search (xlator_t *this, dht_layout_t *layout, const char *name)
                 goto out;
         }
 
-        for (i = 0; i < layout->cnt; i++) {
-                if (layout->list[i].start <= hash
-                    && layout->list[i].stop >= hash) {
+        if (layout->sorted) {
+                i = dht_layout_bisect (layout, hash);
+                if (i >= 0)
                         subvol = layout->list[i].xlator;
-                        break;
+        } else {
+                for (i = 0; i < layout->cnt; i++) {
+                        if (layout->list[i].start <= hash
+                            && layout->list[i].stop >= hash) {
+                                subvol = layout->list[i].xlator;
+                                break;
+                        }
                 }
         }
 
@@ -319,6 +361,7 @@ dht_disk_layout_merge (xlator_t *this, dht_layout_t *layout,
         layout->list[pos].commit_hash = commit_hash;
         layout->list[pos].start = start_off;
         layout->list[pos].stop  = stop_off;
+        layout->sorted = _gf_false;
 
         gf_msg_trace (this->name, 0,
                       "merged to layout: %u - %u (type %d, hash %d) from %s",
@@ -423,6 +466,8 @@ dht_layout_entry_swap (dht_layout_t *layout, int i, int j)
         layout->list[j].xlator = xlator_swap;
         layout->list[j].err    = err_swap;
         layout->list[j].commit_hash = commit_hash_swap;
+
+        layout->sorted = _gf_false;
 }
 
 void
@@ -439,6 +484,8 @@ dht_layout_range_swap (dht_layout_t *layout, int i, int j)
 
         layout->list[j].start  = start_swap;
         layout->list[j].stop   = stop_swap;
+
+        layout->sorted = _gf_false;
 }
 
 int64_t
@@ -484,6 +531,27 @@ out:
 }
 
 
+/* A sorted layout can be bisected only if, past the leading zeroed-out
+ * entries, every range starts after the previous one stops.
+ */
+static gf_boolean_t
+dht_layout_is_bisectable (dht_layout_t *layout)
+{
+        int i = 0;
+
+        while (i < layout->cnt && !layout->list[i].start &&
+               !layout->list[i].stop)
+                i++;
+
+        for (i = i + 1; i < layout->cnt; i++) {
+                if (layout->list[i].start <= layout->list[i - 1].stop)
+                        return _gf_false;
+        }
+
+        return _gf_true;
+}
+
+
 int
 dht_layout_sort (dht_layout_t *layout)
 {
@@ -491,6 +559,9 @@ dht_layout_sort (dht_layout_t *layout)
         int       j = 0;
         int64_t   ret = 0;
 
+        if (layout->sorted)
+                return 0;
+
         /* TODO: O(n^2) -- bad bad */
 
         for (i = 0; i < layout->cnt - 1; i++) {
@@ -501,6 +572,8 @@ dht_layout_sort (dht_layout_t *layout)
                 }
         }
 
+        layout->sorted = dht_layout_is_bisectable (layout);
+
         return 0;
 }
 
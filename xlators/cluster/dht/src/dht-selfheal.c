@@ -20,6 +20,7 @@
                 layout->list[i].start = srt;                            \
                 layout->list[i].stop  = srt + chunk - 1;                \
                 layout->list[i].commit_hash = layout->commit_hash;      \
+                layout->sorted = _gf_false;                             \
                                                                         \
                 gf_msg_trace (this->name, 0,                            \
                               "gave fix: %u - %u, with commit-hash %u"  \
@@ -36,6 +37,7 @@
                         layout->list[cnt].start = 0;                    \
                         layout->list[cnt].stop  = 0;                    \
                 }                                                       \
+                layout->sorted = _gf_false;                             \
         } while (0)
 
 int
@@ -0,0 +1,184 @@
+/*
+  Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of GlusterFS.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+/*
+ * Compares dht_layout_search() on a sorted layout (bisection) against the
+ * linear scan used for unsorted layouts, for 8, 64 and 512 subvolumes.
+ *
+ * Build from the top of a configured tree with something like:
+ *
+ *   gcc -O2 -DGF_LINUX_HOST_OS -D_GNU_SOURCE -include config.h \
+ *       -Ilibglusterfs/src -Irpc/xdr/src -Irpc/rpc-lib/src \
+ *       -Ixlators/lib/src -Ixlators/cluster/dht/src \
+ *       xlators/cluster/dht/src/unittest/dht_layout_bench.c \
+ *       xlators/cluster/dht/src/dht-layout.c \
+ *       -Llibglusterfs/src/.libs -lglusterfs -o dht_layout_bench
+ */
+
+#include "dht-common.h"
+#include "hashfn.h"
+#include "xlator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_NAMES     4096
+#define BENCH_LOOKUPS   (1 << 22)
+
+/*
+ * The rest of dht is not linked in, keep only what dht-layout.c needs.
+ */
+int
+dht_hash_compute (xlator_t *this, int type, const char *name, uint32_t *hash_p)
+{
+        *hash_p = gf_dm_hashfn (name, strlen (name));
+        return 0;
+}
+
+int
+dht_inode_ctx_layout_get (inode_t *inode, xlator_t *this,
+                          dht_layout_t **layout)
+{
+        return -1;
+}
+
+int
+dht_inode_ctx_layout_set (inode_t *inode, xlator_t *this,
+                          dht_layout_t *layout_int)
+{
+        return -1;
+}
+
+void dht_layout_entry_swap (dht_layout_t *layout, int i, int j);
+
+static char        bench_names[BENCH_NAMES][32];
+static xlator_t   *bench_subvols;
+
+static uint64_t
+bench_now_ns (void)
+{
+        struct timespec ts = {0, };
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* even split of the hash space, handed to the subvolumes in random order
+ * the way bricks report their ranges on lookup */
+static dht_layout_t *
+bench_layout_new (xlator_t *this, int cnt)
+{
+        dht_layout_t *layout = NULL;
+        uint32_t      chunk  = 0;
+        int           i      = 0;
+        int           j      = 0;
+
+        layout = dht_layout_new (this, cnt);
+        if (!layout)
+                return NULL;
+
+        chunk = 0xffffffff / cnt;
+        for (i = 0; i < cnt; i++) {
+                layout->list[i].xlator = &bench_subvols[i];
+                layout->list[i].start = i * chunk;
+                layout->list[i].stop = (i == cnt - 1) ? 0xffffffff
+                                                      : (i + 1) * chunk - 1;
+        }
+
+        for (i = cnt - 1; i > 0; i--) {
+                j = random () % (i + 1);
+                dht_layout_entry_swap (layout, i, j);
+        }
+
+        return layout;
+}
+
+static uint64_t
+bench_search (xlator_t *this, dht_layout_t *layout, xlator_t **found)
+{
+        uint64_t start = 0;
+        int      i     = 0;
+
+        start = bench_now_ns ();
+        for (i = 0; i < BENCH_LOOKUPS; i++) {
+                found[i % BENCH_NAMES] =
+                        dht_layout_search (this, layout,
+                                           bench_names[i % BENCH_NAMES]);
+        }
+        return bench_now_ns () - start;
+}
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t *ctx         = NULL;
+        xlator_t        *this        = NULL;
+        dht_layout_t    *layout      = NULL;
+        xlator_t        *linear[BENCH_NAMES];
+        xlator_t        *bisect[BENCH_NAMES];
+        uint64_t         linear_ns   = 0;
+        uint64_t         bisect_ns   = 0;
+        int              counts[]    = {8, 64, 512};
+        int              i           = 0;
+
+        gf_global_mem_acct_enable_set (0);
+        ctx = glusterfs_ctx_new ();
+        if (!ctx || glusterfs_globals_init (ctx))
+                return 1;
+        this = THIS;
+        this->ctx = ctx;
+        this->name = "dht-layout-bench";
+
+        bench_subvols = calloc (512, sizeof (*bench_subvols));
+        if (!bench_subvols)
+                return 1;
+
+        for (i = 0; i < BENCH_NAMES; i++)
+                snprintf (bench_names[i], sizeof (bench_names[i]),
+                          "file-%08d.dat", i);
+
+        printf ("%-8s %14s %14s\n", "subvols", "linear ns/op",
+                "bisect ns/op");
+
+        for (i = 0; i < sizeof (counts) / sizeof (counts[0]); i++) {
+                layout = bench_layout_new (this, counts[i]);
+                if (!layout)
+                        return 1;
+
+                /* sorted, but force the linear scan */
+                dht_layout_sort (layout);
+                if (!layout->sorted) {
+                        fprintf (stderr, "layout of %d not bisectable\n",
+                                 counts[i]);
+                        return 1;
+                }
+                layout->sorted = _gf_false;
+                linear_ns = bench_search (this, layout, linear);
+
+                layout->sorted = _gf_true;
+                bisect_ns = bench_search (this, layout, bisect);
+
+                if (memcmp (linear, bisect, sizeof (linear))) {
+                        fprintf (stderr, "results differ for %d subvols\n",
+                                 counts[i]);
+                        return 1;
+                }
+
+                printf ("%-8d %14.1f %14.1f\n", counts[i],
+                        (double)linear_ns / BENCH_LOOKUPS,
+                        (double)bisect_ns / BENCH_LOOKUPS);
+
+                GF_FREE (layout);
+        }
+
+        free (bench_subvols);
+        return 0;
+}
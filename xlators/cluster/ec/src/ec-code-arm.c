@@ -0,0 +1,163 @@
+/*
+  Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of GlusterFS.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include "ec-code-arm.h"
+
+/* All AArch64 instructions are 32 bits wide and always stored in little
+ * endian order, whatever the endianness of the data is. */
+static void
+ec_code_arm_emit(ec_code_builder_t *builder, uint32_t insn)
+{
+    uint8_t bytes[4];
+
+    bytes[0] = insn & 0xFF;
+    bytes[1] = (insn >> 8) & 0xFF;
+    bytes[2] = (insn >> 16) & 0xFF;
+    bytes[3] = (insn >> 24) & 0xFF;
+
+    ec_code_emit(builder, bytes, 4);
+}
+
+static gf_boolean_t
+ec_code_arm_offset(ec_code_builder_t *builder, uint32_t offset, uint32_t size,
+                   uint32_t *imm)
+{
+    /* Loads and stores only use the scaled unsigned 12 bits offset form. */
+    if (((offset % size) != 0) || (offset / size > 4095)) {
+        ec_code_error(builder, EINVAL);
+        return _gf_false;
+    }
+    *imm = offset / size;
+
+    return _gf_true;
+}
+
+void
+ec_code_arm_op_ret(ec_code_builder_t *builder)
+{
+    ec_code_arm_emit(builder, 0xD65F0000 | (REG_X30 << 5));
+}
+
+void
+ec_code_arm_op_add_r2r(ec_code_builder_t *builder, ec_code_arm_reg_t src1,
+                       ec_code_arm_reg_t src2, ec_code_arm_reg_t dst)
+{
+    ec_code_arm_emit(builder, 0x8B000000 | (src2 << 16) | (src1 << 5) | dst);
+}
+
+void
+ec_code_arm_op_add_i2r(ec_code_builder_t *builder, uint32_t value,
+                       ec_code_arm_reg_t reg)
+{
+    if (value > 4095) {
+        ec_code_error(builder, EINVAL);
+        return;
+    }
+
+    ec_code_arm_emit(builder, 0x91000000 | (value << 10) | (reg << 5) | reg);
+}
+
+void
+ec_code_arm_op_mov_m2r(ec_code_builder_t *builder, ec_code_arm_reg_t base,
+                       uint32_t offset, ec_code_arm_reg_t dst)
+{
+    uint32_t imm;
+
+    if (ec_code_arm_offset(builder, offset, 8, &imm)) {
+        ec_code_arm_emit(builder, 0xF9400000 | (imm << 10) | (base << 5) |
+                                  dst);
+    }
+}
+
+void
+ec_code_arm_op_test_i2r(ec_code_builder_t *builder, uint32_t value,
+                        ec_code_arm_reg_t reg)
+{
+    uint32_t ones;
+
+    /* A logical immediate can encode many other patterns, but the generated
+     * code only needs to test the low bits of an offset. */
+    if ((value == 0) || ((value & (value + 1)) != 0)) {
+        ec_code_error(builder, EINVAL);
+        return;
+    }
+    ones = __builtin_popcount(value);
+
+    /* ANDS XZR, Xn, #value with N = 1 and immr = 0. */
+    ec_code_arm_emit(builder, 0xF240001F | ((ones - 1) << 10) | (reg << 5));
+}
+
+void
+ec_code_arm_op_jne(ec_code_builder_t *builder, uint32_t address)
+{
+    int32_t rel;
+
+    rel = (int32_t)(address - builder->address) / 4;
+    if ((rel < -(1 << 18)) || (rel >= (1 << 18))) {
+        ec_code_error(builder, EINVAL);
+        return;
+    }
+
+    /* B.NE */
+    ec_code_arm_emit(builder, 0x54000001 | ((rel & 0x7FFFF) << 5));
+}
+
+void
+ec_code_arm_op_mov_neon2neon(ec_code_builder_t *builder, uint32_t src,
+                             uint32_t dst)
+{
+    /* ORR Vd.16B, Vn.16B, Vn.16B */
+    ec_code_arm_emit(builder, 0x4EA01C00 | (src << 16) | (src << 5) | dst);
+}
+
+void
+ec_code_arm_op_mov_neon2m(ec_code_builder_t *builder, uint32_t src,
+                          ec_code_arm_reg_t base, uint32_t offset)
+{
+    uint32_t imm;
+
+    /* STR Qt, [Xn, #offset] */
+    if (ec_code_arm_offset(builder, offset, 16, &imm)) {
+        ec_code_arm_emit(builder, 0x3D800000 | (imm << 10) | (base << 5) |
+                                  src);
+    }
+}
+
+void
+ec_code_arm_op_mov_m2neon(ec_code_builder_t *builder, ec_code_arm_reg_t base,
+                          uint32_t offset, uint32_t dst)
+{
+    uint32_t imm;
+
+    /* LDR Qt, [Xn, #offset] */
+    if (ec_code_arm_offset(builder, offset, 16, &imm)) {
+        ec_code_arm_emit(builder, 0x3DC00000 | (imm << 10) | (base << 5) |
+                                  dst);
+    }
+}
+
+void
+ec_code_arm_op_xor_neon2neon(ec_code_builder_t *builder, uint32_t src,
+                             uint32_t dst)
+{
+    ec_code_arm_op_xor3_neon2neon(builder, dst, src, dst);
+}
+
+void
+ec_code_arm_op_xor3_neon2neon(ec_code_builder_t *builder, uint32_t src1,
+                              uint32_t src2, uint32_t dst)
+{
+    /* EOR Vd.16B, Vn.16B, Vm.16B */
+    ec_code_arm_emit(builder, 0x6E201C00 | (src2 << 16) | (src1 << 5) | dst);
+}
@@ -0,0 +1,56 @@
+/*
+  Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of GlusterFS.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+#ifndef __EC_CODE_ARM_H__
+#define __EC_CODE_ARM_H__
+
+#include "ec-code.h"
+
+/* AArch64 general purpose registers. Only the ones used by the generated
+ * code are named. REG_X0 to REG_X4 hold the arguments of the generated
+ * functions, REG_X9 and REG_X10 are scratch registers. */
+enum _ec_code_arm_reg {
+    REG_X0 = 0,
+    REG_X1,
+    REG_X2,
+    REG_X3,
+    REG_X4,
+    REG_X9 = 9,
+    REG_X10,
+    REG_X30 = 30
+};
+
+typedef enum _ec_code_arm_reg ec_code_arm_reg_t;
+
+void ec_code_arm_op_ret(ec_code_builder_t *builder);
+
+void ec_code_arm_op_add_r2r(ec_code_builder_t *builder, ec_code_arm_reg_t src1,
+                            ec_code_arm_reg_t src2, ec_code_arm_reg_t dst);
+void ec_code_arm_op_add_i2r(ec_code_builder_t *builder, uint32_t value,
+                            ec_code_arm_reg_t reg);
+void ec_code_arm_op_mov_m2r(ec_code_builder_t *builder, ec_code_arm_reg_t base,
+                            uint32_t offset, ec_code_arm_reg_t dst);
+void ec_code_arm_op_test_i2r(ec_code_builder_t *builder, uint32_t value,
+                             ec_code_arm_reg_t reg);
+void ec_code_arm_op_jne(ec_code_builder_t *builder, uint32_t address);
+
+void ec_code_arm_op_mov_neon2neon(ec_code_builder_t *builder, uint32_t src,
+                                  uint32_t dst);
+void ec_code_arm_op_mov_neon2m(ec_code_builder_t *builder, uint32_t src,
+                               ec_code_arm_reg_t base, uint32_t offset);
+void ec_code_arm_op_mov_m2neon(ec_code_builder_t *builder,
+                               ec_code_arm_reg_t base, uint32_t offset,
+                               uint32_t dst);
+void ec_code_arm_op_xor_neon2neon(ec_code_builder_t *builder, uint32_t src,
+                                  uint32_t dst);
+void ec_code_arm_op_xor3_neon2neon(ec_code_builder_t *builder, uint32_t src1,
+                                   uint32_t src2, uint32_t dst);
+
+#endif /* __EC_CODE_ARM_H__ */
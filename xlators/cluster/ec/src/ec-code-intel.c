@@ -91,6 +91,48 @@ ec_code_intel_vex(ec_code_intel_t *intel, gf_boolean_t w, gf_boolean_t l,
     }
 }
 
+static void
+ec_code_intel_evex(ec_code_intel_t *intel, gf_boolean_t w,
+                   ec_code_vex_opcode_t opcode, ec_code_vex_prefix_t prefix,
+                   uint32_t reg)
+{
+    /* Only the 512 bits form of the first 16 vector registers is used, so
+     * R', V' and the high bit of the rm register are always 0. There is no
+     * masking nor broadcasting. */
+    ec_code_intel_rex(intel, w);
+    intel->rex.present = _gf_false;
+
+    intel->vex.bytes = 4;
+    intel->vex.data[0] = 0x62;
+    intel->vex.data[1] = ((intel->rex.r << 7) | (intel->rex.x << 6) |
+                          (intel->rex.b << 5) | opcode) ^ 0xF0;
+    intel->vex.data[2] = (intel->rex.w << 7) | ((~reg & 0x0F) << 3) | 0x04 |
+                         prefix;
+    intel->vex.data[3] = 0x48;
+}
+
+static void
+ec_code_intel_evex_disp8(ec_code_intel_t *intel, int32_t size)
+{
+    int32_t offset;
+
+    /* EVEX 8 bits displacements are scaled by the size of the memory
+     * operand. */
+    if ((intel->modrm.mod != 1) && (intel->modrm.mod != 2)) {
+        return;
+    }
+    offset = (int32_t)intel->offset.value;
+    if (((offset % size) == 0) && (offset / size >= -128) &&
+        (offset / size <= 127)) {
+        intel->modrm.mod = 1;
+        intel->offset.bytes = 1;
+        intel->offset.value = offset / size;
+    } else {
+        intel->modrm.mod = 2;
+        intel->offset.bytes = 4;
+    }
+}
+
 static void
 ec_code_intel_modrm_reg(ec_code_intel_t *intel, uint32_t rm, uint32_t reg)
 {
@@ -598,3 +640,120 @@ ec_code_intel_op_xor_m2avx(ec_code_builder_t *builder,
 
     ec_code_intel_emit(builder, &intel);
 }
+
+void
+ec_code_intel_op_vzeroupper(ec_code_builder_t *builder)
+{
+    ec_code_intel_t intel;
+
+    ec_code_intel_init(&intel);
+
+    ec_code_intel_op_1(&intel, 0x77, 0);
+    ec_code_intel_vex(&intel, _gf_false, _gf_false, VEX_OPCODE_0F,
+                      VEX_PREFIX_NONE, VEX_REG_NONE);
+
+    ec_code_intel_emit(builder, &intel);
+}
+
+void
+ec_code_intel_op_mov_avx5122avx512(ec_code_builder_t *builder, uint32_t src,
+                                   uint32_t dst)
+{
+    ec_code_intel_t intel;
+
+    ec_code_intel_init(&intel);
+
+    ec_code_intel_modrm_reg(&intel, src, dst);
+    ec_code_intel_op_1(&intel, 0x6F, 0);
+    ec_code_intel_evex(&intel, _gf_true, VEX_OPCODE_0F, VEX_PREFIX_66,
+                       VEX_REG_NONE);
+
+    ec_code_intel_emit(builder, &intel);
+}
+
+void
+ec_code_intel_op_mov_avx5122m(ec_code_builder_t *builder, uint32_t src,
+                              ec_code_intel_reg_t base,
+                              ec_code_intel_reg_t index, uint32_t scale,
+                              int32_t offset)
+{
+    ec_code_intel_t intel;
+
+    ec_code_intel_init(&intel);
+
+    ec_code_intel_modrm_mem(&intel, src, base, index, scale, offset);
+    ec_code_intel_evex_disp8(&intel, 64);
+    ec_code_intel_op_1(&intel, 0x7F, 0);
+    ec_code_intel_evex(&intel, _gf_true, VEX_OPCODE_0F, VEX_PREFIX_F3,
+                       VEX_REG_NONE);
+
+    ec_code_intel_emit(builder, &intel);
+}
+
+void
+ec_code_intel_op_mov_m2avx512(ec_code_builder_t *builder,
+                              ec_code_intel_reg_t base,
+                              ec_code_intel_reg_t index, uint32_t scale,
+                              int32_t offset, uint32_t dst)
+{
+    ec_code_intel_t intel;
+
+    ec_code_intel_init(&intel);
+
+    ec_code_intel_modrm_mem(&intel, dst, base, index, scale, offset);
+    ec_code_intel_evex_disp8(&intel, 64);
+    ec_code_intel_op_1(&intel, 0x6F, 0);
+    ec_code_intel_evex(&intel, _gf_true, VEX_OPCODE_0F, VEX_PREFIX_F3,
+                       VEX_REG_NONE);
+
+    ec_code_intel_emit(builder, &intel);
+}
+
+void
+ec_code_intel_op_xor_avx5122avx512(ec_code_builder_t *builder, uint32_t src,
+                                   uint32_t dst)
+{
+    ec_code_intel_t intel;
+
+    ec_code_intel_init(&intel);
+
+    ec_code_intel_modrm_reg(&intel, src, dst);
+    ec_code_intel_op_1(&intel, 0xEF, 0);
+    ec_code_intel_evex(&intel, _gf_true, VEX_OPCODE_0F, VEX_PREFIX_66, dst);
+
+    ec_code_intel_emit(builder, &intel);
+}
+
+void
+ec_code_intel_op_xor3_avx5122avx512(ec_code_builder_t *builder,
+                                    uint32_t src1, uint32_t src2,
+                                    uint32_t dst)
+{
+    ec_code_intel_t intel;
+
+    ec_code_intel_init(&intel);
+
+    ec_code_intel_modrm_reg(&intel, src2, dst);
+    ec_code_intel_op_1(&intel, 0xEF, 0);
+    ec_code_intel_evex(&intel, _gf_true, VEX_OPCODE_0F, VEX_PREFIX_66, src1);
+
+    ec_code_intel_emit(builder, &intel);
+}
+
+void
+ec_code_intel_op_xor_m2avx512(ec_code_builder_t *builder,
+                              ec_code_intel_reg_t base,
+                              ec_code_intel_reg_t index, uint32_t scale,
+                              int32_t offset, uint32_t dst)
+{
+    ec_code_intel_t intel;
+
+    ec_code_intel_init(&intel);
+
+    ec_code_intel_modrm_mem(&intel, dst, base, index, scale, offset);
+    ec_code_intel_evex_disp8(&intel, 64);
+    ec_code_intel_op_1(&intel, 0xEF, 0);
+    ec_code_intel_evex(&intel, _gf_true, VEX_OPCODE_0F, VEX_PREFIX_66, dst);
+
+    ec_code_intel_emit(builder, &intel);
+}
@@ -181,4 +181,26 @@ void ec_code_intel_op_xor_m2avx(ec_code_builder_t *builder,
                                 ec_code_intel_reg_t index, uint32_t scale,
                                 int32_t offset, uint32_t dst);
 
+void ec_code_intel_op_vzeroupper(ec_code_builder_t *builder);
+
+void ec_code_intel_op_mov_avx5122avx512(ec_code_builder_t *builder,
+                                        uint32_t src, uint32_t dst);
+void ec_code_intel_op_mov_avx5122m(ec_code_builder_t *builder, uint32_t src,
+                                   ec_code_intel_reg_t base,
+                                   ec_code_intel_reg_t index, uint32_t scale,
+                                   int32_t offset);
+void ec_code_intel_op_mov_m2avx512(ec_code_builder_t *builder,
+                                   ec_code_intel_reg_t base,
+                                   ec_code_intel_reg_t index, uint32_t scale,
+                                   int32_t offset, uint32_t dst);
+void ec_code_intel_op_xor_avx5122avx512(ec_code_builder_t *builder,
+                                        uint32_t src, uint32_t dst);
+void ec_code_intel_op_xor3_avx5122avx512(ec_code_builder_t *builder,
+                                         uint32_t src1, uint32_t src2,
+                                         uint32_t dst);
+void ec_code_intel_op_xor_m2avx512(ec_code_builder_t *builder,
+                                   ec_code_intel_reg_t base,
+                                   ec_code_intel_reg_t index, uint32_t scale,
+                                   int32_t offset, uint32_t dst);
+
 #endif /* __EC_CODE_INTEL_H__ */
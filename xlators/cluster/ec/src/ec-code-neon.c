@@ -0,0 +1,131 @@
+/*
+  Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of GlusterFS.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+#include <errno.h>
+
+#include "ec-code-arm.h"
+
+/* The low halves of v8 to v15 must be preserved across calls, so the
+ * galois field registers are mapped to v16 to v31, which are not. v0 is
+ * used as a temporary for loads that are xored into a register. */
+#define NEON_REG(_reg) ((_reg) + 16)
+#define NEON_TMP 0
+
+static void
+ec_code_neon_prolog(ec_code_builder_t *builder)
+{
+    builder->loop = builder->address;
+
+    /* Load and store instructions only accept an immediate offset, so the
+     * current position in the source is computed once per iteration. */
+    if (builder->linear) {
+        ec_code_arm_op_add_r2r(builder, REG_X1, REG_X2, REG_X9);
+    }
+}
+
+static void
+ec_code_neon_epilog(ec_code_builder_t *builder)
+{
+    ec_code_arm_op_add_i2r(builder, 16, REG_X2);
+    ec_code_arm_op_add_i2r(builder, 16, REG_X0);
+    ec_code_arm_op_test_i2r(builder, builder->width - 1, REG_X2);
+    ec_code_arm_op_jne(builder, builder->loop);
+
+    ec_code_arm_op_ret(builder);
+}
+
+static ec_code_arm_reg_t
+ec_code_neon_base(ec_code_builder_t *builder, uint32_t idx, uint32_t bit,
+                  uint32_t *offset)
+{
+    if (builder->linear) {
+        *offset = idx * builder->width * builder->bits + bit * builder->width;
+
+        return REG_X9;
+    }
+
+    if (builder->base != idx) {
+        ec_code_arm_op_mov_m2r(builder, REG_X1, idx * 8, REG_X10);
+        ec_code_arm_op_add_r2r(builder, REG_X10, REG_X2, REG_X10);
+        builder->base = idx;
+    }
+    *offset = bit * builder->width;
+
+    return REG_X10;
+}
+
+static void
+ec_code_neon_load(ec_code_builder_t *builder, uint32_t dst, uint32_t idx,
+                  uint32_t bit)
+{
+    ec_code_arm_reg_t base;
+    uint32_t offset;
+
+    base = ec_code_neon_base(builder, idx, bit, &offset);
+    ec_code_arm_op_mov_m2neon(builder, base, offset, NEON_REG(dst));
+}
+
+static void
+ec_code_neon_store(ec_code_builder_t *builder, uint32_t src, uint32_t bit)
+{
+    ec_code_arm_op_mov_neon2m(builder, NEON_REG(src), REG_X0,
+                              bit * builder->width);
+}
+
+static void
+ec_code_neon_copy(ec_code_builder_t *builder, uint32_t dst, uint32_t src)
+{
+    ec_code_arm_op_mov_neon2neon(builder, NEON_REG(src), NEON_REG(dst));
+}
+
+static void
+ec_code_neon_xor2(ec_code_builder_t *builder, uint32_t dst, uint32_t src)
+{
+    ec_code_arm_op_xor_neon2neon(builder, NEON_REG(src), NEON_REG(dst));
+}
+
+static void
+ec_code_neon_xor3(ec_code_builder_t *builder, uint32_t dst, uint32_t src1,
+                  uint32_t src2)
+{
+    ec_code_arm_op_xor3_neon2neon(builder, NEON_REG(src1), NEON_REG(src2),
+                                  NEON_REG(dst));
+}
+
+static void
+ec_code_neon_xorm(ec_code_builder_t *builder, uint32_t dst, uint32_t idx,
+                  uint32_t bit)
+{
+    ec_code_arm_reg_t base;
+    uint32_t offset;
+
+    base = ec_code_neon_base(builder, idx, bit, &offset);
+    ec_code_arm_op_mov_m2neon(builder, base, offset, NEON_TMP);
+    ec_code_arm_op_xor_neon2neon(builder, NEON_TMP, NEON_REG(dst));
+}
+
+static char *ec_code_neon_needed_flags[] = {
+    "asimd",
+    NULL
+};
+
+ec_code_gen_t ec_code_gen_neon = {
+    .name   = "neon",
+    .flags  = ec_code_neon_needed_flags,
+    .width  = 16,
+    .prolog = ec_code_neon_prolog,
+    .epilog = ec_code_neon_epilog,
+    .load   = ec_code_neon_load,
+    .store  = ec_code_neon_store,
+    .copy   = ec_code_neon_copy,
+    .xor2   = ec_code_neon_xor2,
+    .xor3   = ec_code_neon_xor3,
+    .xorm   = ec_code_neon_xorm
+};
@@ -0,0 +1,18 @@
+/*
+  Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of GlusterFS.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+#ifndef __EC_CODE_NEON_H__
+#define __EC_CODE_NEON_H__
+
+#include "ec-code.h"
+
+extern ec_code_gen_t ec_code_gen_neon;
+
+#endif /* __EC_CODE_NEON_H__ */
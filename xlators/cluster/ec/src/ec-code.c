@@ -34,6 +34,14 @@
 #include "ec-code-avx.h"
 #endif
 
+#ifdef USE_EC_DYNAMIC_AVX512
+#include "ec-code-avx512.h"
+#endif
+
+#ifdef USE_EC_DYNAMIC_NEON
+#include "ec-code-neon.h"
+#endif
+
 #define EC_CODE_SIZE (1024 * 64)
 #define EC_CODE_ALIGN 4096
 
@@ -57,6 +65,9 @@ struct _ec_code_proc {
 };
 
 static ec_code_gen_t *ec_code_gen_table[] = {
+#ifdef USE_EC_DYNAMIC_AVX512
+    &ec_code_gen_avx512,
+#endif
 #ifdef USE_EC_DYNAMIC_AVX
     &ec_code_gen_avx,
 #endif
@@ -65,6 +76,9 @@ static ec_code_gen_t *ec_code_gen_table[] = {
 #endif
 #ifdef USE_EC_DYNAMIC_X64
     &ec_code_gen_x64,
+#endif
+#ifdef USE_EC_DYNAMIC_NEON
+    &ec_code_gen_neon,
 #endif
     NULL
 };
@@ -659,6 +673,11 @@ ec_code_compile(ec_code_builder_t *builder)
         return EC_ERR(err);
     }
 
+    /* The code has been written through a different mapping than the one
+     * that will execute it. Architectures without a coherent instruction
+     * cache need it to be synchronized. This is a no-op on intel. */
+    __builtin___clear_cache(func, (char *)func + builder->size);
+
     GF_FREE(builder);
 
     return func;
@@ -1012,7 +1031,9 @@ ec_code_detect(xlator_t *xl, const char *def)
 
     while ((line = ec_code_proc_line(&file, &length)) != NULL) {
         data = ec_code_proc_split(line, &length, ':');
-        if ((data != NULL) && (strcmp(line, "flags") == 0)) {
+        /* Intel lists the cpu extensions in "flags", ARM in "Features". */
+        if ((data != NULL) && ((strcmp(line, "flags") == 0) ||
+                               (strcmp(line, "Features") == 0))) {
             list = data;
             count = 0;
             while ((data != NULL) && (*data != 0)) {
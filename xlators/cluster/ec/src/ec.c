@@ -1510,7 +1510,7 @@ struct volume_options options[] =
     {
         .key = { "cpu-extensions" },
         .type = GF_OPTION_TYPE_STR,
-        .value = { "none", "auto", "x64", "sse", "avx" },
+        .value = { "none", "auto", "x64", "sse", "avx", "avx512", "neon" },
         .default_value = "auto",
         .description = "force the cpu extensions to be used to accelerate the "
                        "galois field computations."
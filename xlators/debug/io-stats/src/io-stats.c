@@ -44,6 +44,7 @@
 #define DEFAULT_PWD_BUF_SZ 16384
 #define DEFAULT_GRP_BUF_SZ 16384
 #define IOS_BLOCK_COUNT_SIZE 32
+#define IOS_FSYNC_BATCH_SIZE 16
 
 typedef enum {
         IOS_STATS_TYPE_NONE,
@@ -121,6 +122,8 @@ struct ios_global_stats {
         gf_atomic_t     data_read;
         gf_atomic_t     block_count_write[IOS_BLOCK_COUNT_SIZE];
         gf_atomic_t     block_count_read[IOS_BLOCK_COUNT_SIZE];
+        /* fsyncs answered by a batch of 2^i or more, see posix group-commit */
+        gf_atomic_t     fsync_batch[IOS_FSYNC_BATCH_SIZE];
         gf_atomic_t     fop_hits[GF_FOP_MAXVALUE];
         gf_atomic_t     upcall_hits[GF_UPCALL_FLAGS_MAXVALUE];
         struct timeval  started_at;
@@ -511,6 +514,22 @@ ios_bump_write (xlator_t *this, fd_t *fd, size_t len)
 }
 
 
+static void
+ios_bump_fsync_batch (xlator_t *this, uint32_t batch)
+{
+        struct ios_conf  *conf = NULL;
+        int               lb2 = 0;
+
+        conf = this->private;
+        if (!conf)
+                return;
+
+        lb2 = min (log_base2 (batch), IOS_FSYNC_BATCH_SIZE - 1);
+        GF_ATOMIC_INC (conf->cumulative.fsync_batch[lb2]);
+        GF_ATOMIC_INC (conf->incremental.fsync_batch[lb2]);
+}
+
+
 static void
 ios_bump_upcall (xlator_t *this, gf_upcall_flags_t event)
 {
@@ -774,6 +793,72 @@ err:
         return ret;
 }
 
+struct ios_subvol_dump {
+        xlator_t        *this;
+        FILE            *logfp;
+        char            *key_prefix;    /* NULL unless logging json */
+        char            *str_prefix;
+        xlator_t        *subvol;
+};
+
+static int
+_ios_dump_subvol_pair (dict_t *dict, char *key, data_t *value, void *data)
+{
+        struct ios_subvol_dump *dump = data;
+        xlator_t               *this = dump->this;
+
+        if (dump->key_prefix)
+                ios_log (this, dump->logfp, "\"%s.%s.%s.%s\": \"%s\",",
+                         dump->key_prefix, dump->str_prefix,
+                         dump->subvol->name, key, data_to_str (value));
+        else
+                ios_log (this, dump->logfp, "%-28s : %s", key,
+                         data_to_str (value));
+
+        return 0;
+}
+
+static void
+_ios_dump_subvol (xlator_t *each, void *data)
+{
+        struct ios_subvol_dump *dump = data;
+        dict_t                 *dict = NULL;
+
+        if (each == dump->this || !each->dumpops ||
+            !each->dumpops->priv_to_dict)
+                return;
+
+        dict = dict_new ();
+        if (!dict)
+                return;
+
+        if (each->dumpops->priv_to_dict (each, dict) == 0 && dict->count) {
+                if (!dump->key_prefix)
+                        ios_log (dump->this, dump->logfp, "\n=== %s ===",
+                                 each->name);
+                dump->subvol = each;
+                dict_foreach (dict, _ios_dump_subvol_pair, dump);
+        }
+
+        dict_unref (dict);
+}
+
+/* Logs the state the xlators below us expose through priv_to_dict, such as
+ * how io-threads is sizing itself, next to our own numbers. */
+static void
+ios_dump_subvols (xlator_t *this, FILE *logfp, char *key_prefix,
+                  char *str_prefix)
+{
+        struct ios_subvol_dump dump = {
+                .this           = this,
+                .logfp          = logfp,
+                .key_prefix     = key_prefix,
+                .str_prefix     = str_prefix,
+        };
+
+        xlator_foreach_depth_first (this, _ios_dump_subvol, &dump);
+}
+
 int
 io_stats_dump_global_to_json_logfp (xlator_t *this,
     struct ios_global_stats *stats, struct timeval *now, int interval,
@@ -855,6 +940,22 @@ io_stats_dump_global_to_json_logfp (xlator_t *this,
                 }
         }
 
+        for (i = 0; i < IOS_FSYNC_BATCH_SIZE; i++) {
+                if (interval == -1) {
+                        ios_log (this, logfp,
+                                "\"%s.%s.fsync_batch_%d\": \"%"GF_PRI_ATOMIC"\",",
+                                key_prefix, str_prefix, (1 << i),
+                                GF_ATOMIC_GET (stats->fsync_batch[i]));
+                } else {
+                        ios_log (this, logfp,
+                                "\"%s.%s.fsync_batch_%d_per_sec\": \"%0.2lf\",",
+                                key_prefix, str_prefix, (1 << i),
+                                (double)
+                                (GF_ATOMIC_GET (stats->fsync_batch[i]) /
+                                 interval_sec));
+                }
+        }
+
         if (interval == -1) {
                 ios_log (this, logfp, "\"%s.%s.fds.open_count\": \"%"PRId64
                         "\",", key_prefix, str_prefix,
@@ -951,6 +1052,7 @@ io_stats_dump_global_to_json_logfp (xlator_t *this,
         }
 
         if (interval == -1) {
+                ios_dump_subvols (this, logfp, key_prefix, str_prefix);
                 ios_log (this, logfp, "\"%s.%s.uptime\": \"%"PRId64"\",",
                          key_prefix, str_prefix,
                          (uint64_t) (now->tv_sec - stats->started_at.tv_sec));
@@ -1296,6 +1398,24 @@ io_stats_dump_global_to_logfp (xlator_t *this, struct ios_global_stats *stats,
                 ios_log (this, logfp, "%s\n", str_write);
         }
 
+        for (i = 0; i < IOS_FSYNC_BATCH_SIZE; i++) {
+                if (GF_ATOMIC_GET (stats->fsync_batch[i]))
+                        break;
+        }
+        if (i < IOS_FSYNC_BATCH_SIZE) {
+                ios_log (this, logfp, "%-13s %12s", "Fsync Batch",
+                         "Fsync Count");
+                ios_log (this, logfp, "%-13s %12s", "-----------",
+                         "-----------");
+                for (; i < IOS_FSYNC_BATCH_SIZE; i++) {
+                        fop_hits = GF_ATOMIC_GET (stats->fsync_batch[i]);
+                        if (fop_hits)
+                                ios_log (this, logfp, "%12d+ %12"PRIu64,
+                                         (1 << i), fop_hits);
+                }
+                ios_log (this, logfp, "%s", "");
+        }
+
         ios_log (this, logfp, "%-13s %10s %14s %14s %14s", "Fop",
                  "Call Count", "Avg-Latency", "Min-Latency",
                  "Max-Latency");
@@ -1342,6 +1462,9 @@ io_stats_dump_global_to_logfp (xlator_t *this, struct ios_global_stats *stats,
                                  conf->cumulative.max_nr_opens, timestr);
                 }
                 UNLOCK (&conf->lock);
+
+                ios_dump_subvols (this, logfp, NULL, NULL);
+
                 ios_log (this, logfp, "\n==========Open File Stats========");
                 ios_log (this, logfp, "\nCOUNT:  \t  FILE NAME");
                 list_head = &conf->list[IOS_STATS_TYPE_OPEN];
@@ -2183,6 +2306,12 @@ io_stats_fsync_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
                     int32_t op_ret, int32_t op_errno,
                     struct iatt *prebuf, struct iatt *postbuf, dict_t *xdata)
 {
+        uint32_t batch = 0;
+
+        if (op_ret == 0 && xdata &&
+            dict_get_uint32 (xdata, GLUSTERFS_FSYNC_BATCH_SIZE, &batch) == 0)
+                ios_bump_fsync_batch (this, batch);
+
         UPDATE_PROFILE_STATS (frame, FSYNC);
         STACK_UNWIND_STRICT (fsync, frame, op_ret, op_errno, prebuf, postbuf, xdata);
         return 0;
@@ -3806,6 +3935,15 @@ io_priv (xlator_t *this)
 
         }
 
+        for (i = 0; i < IOS_FSYNC_BATCH_SIZE; i++) {
+                count = GF_ATOMIC_GET (conf->cumulative.fsync_batch[i]);
+                if (!count)
+                        continue;
+                gf_proc_dump_build_key (key, key_prefix_cumulative,
+                                        "fsync_batch_%d", (1 << i));
+                gf_proc_dump_write (key, "%"PRIu64, count);
+        }
+
         return 0;
 }
 
@@ -3959,6 +4097,9 @@ ios_init_stats (struct ios_global_stats *stats)
                 GF_ATOMIC_INIT (stats->block_count_read[i], 0);
         }
 
+        for (i = 0; i < IOS_FSYNC_BATCH_SIZE; i++)
+                GF_ATOMIC_INIT (stats->fsync_batch[i], 0);
+
         for (i = 0; i < GF_FOP_MAXVALUE; i++)
                 GF_ATOMIC_INIT (stats->fop_hits[i], 0);
 
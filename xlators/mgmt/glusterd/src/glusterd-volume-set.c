@@ -1728,6 +1728,21 @@ struct volopt_map_entry glusterd_volopt_map[] = {
           .voltype     = "performance/io-threads",
           .op_version  = 1
         },
+        { .key         = "performance.io-thread-adaptive",
+          .voltype     = "performance/io-threads",
+          .option      = "adaptive-threads",
+          .op_version  = GD_OP_VERSION_4_0_0
+        },
+        { .key         = "performance.io-thread-min-count",
+          .voltype     = "performance/io-threads",
+          .option      = "min-thread-count",
+          .op_version  = GD_OP_VERSION_4_0_0
+        },
+        { .key         = "performance.io-thread-latency-target",
+          .voltype     = "performance/io-threads",
+          .option      = "latency-target",
+          .op_version  = GD_OP_VERSION_4_0_0
+        },
 
         /* Other perf xlators' options */
         { .key        = "performance.cache-size",
@@ -1748,6 +1763,18 @@ struct volopt_map_entry glusterd_volopt_map[] = {
            .op_version = GD_OP_VERSION_4_0_0,
            .flags      = VOLOPT_FLAG_CLIENT_OPT
         },
+        { .key        = "performance.qr-cache-compression",
+          .voltype    = "performance/quick-read",
+          .option     = "cache-compression",
+          .op_version = GD_OP_VERSION_4_0_0,
+          .flags      = VOLOPT_FLAG_CLIENT_OPT
+        },
+        { .key        = "performance.qr-admission-filter",
+          .voltype    = "performance/quick-read",
+          .option     = "admission-filter",
+          .op_version = GD_OP_VERSION_4_0_0,
+          .flags      = VOLOPT_FLAG_CLIENT_OPT
+        },
         { .key        = "performance.flush-behind",
           .voltype    = "performance/write-behind",
           .option     = "flush-behind",
@@ -1882,6 +1909,12 @@ struct volopt_map_entry glusterd_volopt_map[] = {
           .op_version = GD_OP_VERSION_4_0_0,
           .flags      = VOLOPT_FLAG_CLIENT_OPT
         },
+        { .key        = "performance.md-cache-size",
+          .voltype    = "performance/md-cache",
+          .option     = "md-cache-size",
+          .op_version = GD_OP_VERSION_4_0_0,
+          .flags      = VOLOPT_FLAG_CLIENT_OPT
+        },
 
          /* Crypt xlator options */
 
@@ -1992,6 +2025,27 @@ struct volopt_map_entry glusterd_volopt_map[] = {
           .value       = "9",
           .flags       = VOLOPT_FLAG_CLIENT_OPT
         },
+        { .key         = "client.coalesce-writes",
+          .voltype     = "protocol/client",
+          .option      = "transport.socket.coalesce-writes",
+          .op_version  = GD_OP_VERSION_4_0_0,
+          .value       = "off",
+          .flags       = VOLOPT_FLAG_CLIENT_OPT
+        },
+        { .key         = "client.zerocopy-threshold",
+          .voltype     = "protocol/client",
+          .option      = "transport.socket.zerocopy-threshold",
+          .op_version  = GD_OP_VERSION_4_0_0,
+          .value       = "0",
+          .flags       = VOLOPT_FLAG_CLIENT_OPT
+        },
+        { .key         = "client.recv-ring-size",
+          .voltype     = "protocol/client",
+          .option      = "transport.socket.recv-ring-size",
+          .op_version  = GD_OP_VERSION_4_0_0,
+          .value       = "0",
+          .flags       = VOLOPT_FLAG_CLIENT_OPT
+        },
 
         /* Server xlator options */
         { .key         = "network.tcp-window-size",
@@ -2053,6 +2107,16 @@ struct volopt_map_entry glusterd_volopt_map[] = {
           .type        = GLOBAL_DOC,
           .op_version  = 3
         },
+        { .key         = "server.dispatch-threads",
+          .voltype     = "protocol/server",
+          .option      = "rpc.dispatch-threads",
+          .op_version  = GD_OP_VERSION_4_0_0
+        },
+        { .key         = "server.dispatch-quantum",
+          .voltype     = "protocol/server",
+          .option      = "rpc.dispatch-quantum",
+          .op_version  = GD_OP_VERSION_4_0_0
+        },
         { .key         = "features.lock-heal",
           .voltype     = "protocol/server",
           .option      = "lk-heal",
@@ -2130,6 +2194,24 @@ struct volopt_map_entry glusterd_volopt_map[] = {
           .op_version  = GD_OP_VERSION_3_10_2,
           .value       = "9",
         },
+        { .key         = "server.coalesce-writes",
+          .voltype     = "protocol/server",
+          .option      = "transport.socket.coalesce-writes",
+          .op_version  = GD_OP_VERSION_4_0_0,
+          .value       = "off",
+        },
+        { .key         = "server.zerocopy-threshold",
+          .voltype     = "protocol/server",
+          .option      = "transport.socket.zerocopy-threshold",
+          .op_version  = GD_OP_VERSION_4_0_0,
+          .value       = "0",
+        },
+        { .key         = "server.recv-ring-size",
+          .voltype     = "protocol/server",
+          .option      = "transport.socket.recv-ring-size",
+          .op_version  = GD_OP_VERSION_4_0_0,
+          .value       = "0",
+        },
         { .key         = "transport.listen-backlog",
           .voltype     = "protocol/server",
           .option      = "transport.listen-backlog",
@@ -2919,6 +3001,31 @@ struct volopt_map_entry glusterd_volopt_map[] = {
           .voltype     = "storage/posix",
           .op_version  = GD_OP_VERSION_4_0_0,
         },
+        { .option      = "dirfd-cache-size",
+          .key         = "storage.dirfd-cache-size",
+          .voltype     = "storage/posix",
+          .op_version  = GD_OP_VERSION_4_0_0,
+        },
+        { .option      = "readdirp-threads",
+          .key         = "storage.readdirp-threads",
+          .voltype     = "storage/posix",
+          .op_version  = GD_OP_VERSION_4_0_0,
+        },
+        { .option      = "io-uring",
+          .key         = "storage.io-uring",
+          .voltype     = "storage/posix",
+          .op_version  = GD_OP_VERSION_4_0_0,
+        },
+        { .option      = "io-uring-queue-depth",
+          .key         = "storage.io-uring-queue-depth",
+          .voltype     = "storage/posix",
+          .op_version  = GD_OP_VERSION_4_0_0,
+        },
+        { .option      = "io-uring-sqpoll",
+          .key         = "storage.io-uring-sqpoll",
+          .voltype     = "storage/posix",
+          .op_version  = GD_OP_VERSION_4_0_0,
+        },
         { .key         = "storage.bd-aio",
           .voltype     = "storage/bd",
           .op_version  = 3
@@ -3579,6 +3686,13 @@ struct volopt_map_entry glusterd_volopt_map[] = {
           .flags       = VOLOPT_FLAG_CLIENT_OPT,
           .op_version  = GD_OP_VERSION_3_11_0,
         },
+        { .key         = "performance.nl-cache-snapshot-dir",
+          .voltype     = "performance/nl-cache",
+          .option      = "nl-cache-snapshot-dir",
+          .type        = NO_DOC,
+          .flags       = VOLOPT_FLAG_CLIENT_OPT,
+          .op_version  = GD_OP_VERSION_4_0_0,
+        },
 
         /* Brick multiplexing options */
         { .key         = GLUSTERD_BRICK_MULTIPLEX_KEY,
@@ -4887,6 +4887,8 @@ fuse_thread_proc (void *data)
         fuse_handler_t          **fuse_ops = NULL;
         struct pollfd             pfd[2] = {{0,}};
         gf_boolean_t              mount_finished = _gf_false;
+        gf_boolean_t              unmounted = _gf_false;
+        xlator_t                 *subvol = NULL;
 
         this = data;
         priv = this->private;
@@ -4973,6 +4975,7 @@ fuse_thread_proc (void *data)
 
                 if (res == -1) {
                         if (errno == ENODEV || errno == EBADF) {
+                                unmounted = (errno == ENODEV);
                                 gf_log ("glusterfs-fuse", GF_LOG_DEBUG,
                                         "terminating upon getting %s when "
                                         "reading /dev/fuse",
@@ -5093,6 +5096,21 @@ fuse_thread_proc (void *data)
                         "initating unmount of %s", mount_point);
         }
 
+        /* On a clean unmount tell the graph it is going away, as gfapi
+         * does in glfs_fini(), so that xlators can save what they want to
+         * keep for the next mount before the process is killed. */
+        if (unmounted) {
+                pthread_mutex_lock (&priv->sync_mutex);
+                {
+                        subvol = priv->active_subvol;
+                }
+                pthread_mutex_unlock (&priv->sync_mutex);
+
+                if (subvol)
+                        xlator_notify (subvol, GF_EVENT_PARENT_DOWN, subvol,
+                                       NULL);
+        }
+
         /* Kill the whole process, not just this thread. */
         kill (getpid(), SIGTERM);
         return NULL;
@@ -27,58 +27,6 @@ ioc_get_priority (ioc_table_t *table, const char *path);
 struct volume_options options[];
 
 
-static uint32_t
-ioc_hashfn (void *data, int len)
-{
-        off_t offset;
-
-        offset = *(off_t *) data;
-
-        return (offset >> ioc_log2_page_size);
-}
-
-/* TODO: This function is not used, uncomment when we find a
-         usage for this function.
-
-static ioc_inode_t *
-ioc_inode_reupdate (ioc_inode_t *ioc_inode)
-{
-        ioc_table_t *table = NULL;
-
-        table = ioc_inode->table;
-
-        list_add_tail (&ioc_inode->inode_lru,
-                       &table->inode_lru[ioc_inode->weight]);
-
-        return ioc_inode;
-}
-
-
-static ioc_inode_t *
-ioc_get_inode (dict_t *dict, char *name)
-{
-        ioc_inode_t *ioc_inode      = NULL;
-        data_t      *ioc_inode_data = NULL;
-        ioc_table_t *table          = NULL;
-
-        ioc_inode_data = dict_get (dict, name);
-        if (ioc_inode_data) {
-                ioc_inode = data_to_ptr (ioc_inode_data);
-                table = ioc_inode->table;
-
-                ioc_table_lock (table);
-                {
-                        if (list_empty (&ioc_inode->inode_lru)) {
-                                ioc_inode = ioc_inode_reupdate (ioc_inode);
-                        }
-                }
-                ioc_table_unlock (table);
-        }
-
-        return ioc_inode;
-}
-*/
-
 int32_t
 ioc_inode_need_revalidate (ioc_inode_t *ioc_inode)
 {
@@ -110,8 +58,8 @@ __ioc_inode_flush (ioc_inode_t *ioc_inode)
         int64_t     destroy_size = 0;
         int64_t     ret          = 0;
 
-        list_for_each_entry_safe (curr, next, &ioc_inode->cache.page_lru,
-                                  page_lru) {
+        list_for_each_entry_safe (curr, next, &ioc_inode->cache.page_list,
+                                  page_list) {
                 ret = __ioc_page_destroy (curr);
 
                 if (ret != -1)
@@ -132,13 +80,8 @@ ioc_inode_flush (ioc_inode_t *ioc_inode)
         }
         ioc_inode_unlock (ioc_inode);
 
-        if (destroy_size) {
-                ioc_table_lock (ioc_inode->table);
-                {
-                        ioc_inode->table->cache_used -= destroy_size;
-                }
-                ioc_table_unlock (ioc_inode->table);
-        }
+        if (destroy_size)
+                GF_ATOMIC_SUB (ioc_inode->table->cache_used, destroy_size);
 
         return;
 }
@@ -221,13 +164,6 @@ ioc_inode_update (xlator_t *this, inode_t *inode, char *path,
                 ioc_inode_flush (ioc_inode);
         }
 
-        ioc_table_lock (ioc_inode->table);
-        {
-                list_move_tail (&ioc_inode->inode_lru,
-                                &table->inode_lru[ioc_inode->weight]);
-        }
-        ioc_table_unlock (ioc_inode->table);
-
 out:
         return 0;
 }
@@ -389,13 +325,8 @@ ioc_cache_validate_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
                 local_stbuf = NULL;
         }
 
-        if (destroy_size) {
-                ioc_table_lock (ioc_inode->table);
-                {
-                        ioc_inode->table->cache_used -= destroy_size;
-                }
-                ioc_table_unlock (ioc_inode->table);
-        }
+        if (destroy_size)
+                GF_ATOMIC_SUB (ioc_inode->table->cache_used, destroy_size);
 
         if (op_ret < 0)
                 local_stbuf = NULL;
@@ -576,13 +507,6 @@ ioc_open_cbk (call_frame_t *frame, void *cookie, xlator_t *this, int32_t op_ret,
                         goto out;
                 }
 
-                ioc_table_lock (ioc_inode->table);
-                {
-                        list_move_tail (&ioc_inode->inode_lru,
-                                        &table->inode_lru[ioc_inode->weight]);
-                }
-                ioc_table_unlock (ioc_inode->table);
-
                 ioc_inode_lock (ioc_inode);
                 {
                         if ((table->min_file_size > ioc_inode->ia_size)
@@ -902,11 +826,8 @@ ioc_need_prune (ioc_table_t *table)
 {
         int64_t cache_difference = 0;
 
-        ioc_table_lock (table);
-        {
-                cache_difference = table->cache_used - table->cache_size;
-        }
-        ioc_table_unlock (table);
+        cache_difference = GF_ATOMIC_GET (table->cache_used)
+                           - table->cache_size;
 
         if (cache_difference > 0)
                 return 1;
@@ -1041,8 +962,11 @@ ioc_dispatch_requests (call_frame_t *frame, ioc_inode_t *ioc_inode, fd_t *fd,
 
                 if (fault) {
                         fault = 0;
+                        GF_ATOMIC_INC (table->misses);
                         /* new page created, increase the table->cache_used */
                         ioc_page_fault (ioc_inode, frame, fd, trav_offset);
+                } else {
+                        GF_ATOMIC_INC (table->hits);
                 }
 
                 if (need_validate) {
@@ -1097,7 +1021,6 @@ ioc_readv (call_frame_t *frame, xlator_t *this, fd_t *fd,
         uint64_t     tmp_ioc_inode = 0;
         ioc_inode_t *ioc_inode     = NULL;
         ioc_local_t *local         = NULL;
-        uint32_t     weight        = 0;
         ioc_table_t *table         = NULL;
         int32_t      op_errno      = -1;
 
@@ -1133,24 +1056,6 @@ ioc_readv (call_frame_t *frame, xlator_t *this, fd_t *fd,
                 goto out;
         }
 
-        ioc_inode_lock (ioc_inode);
-        {
-                if (!ioc_inode->cache.page_table) {
-                        ioc_inode->cache.page_table
-                                = rbthash_table_init
-                                (this->ctx, IOC_PAGE_TABLE_BUCKET_COUNT,
-                                 ioc_hashfn, NULL, 0,
-                                 table->mem_pool);
-
-                        if (ioc_inode->cache.page_table == NULL) {
-                                op_errno = ENOMEM;
-                                ioc_inode_unlock (ioc_inode);
-                                goto out;
-                        }
-                }
-        }
-        ioc_inode_unlock (ioc_inode);
-
         if (!fd_ctx_get (fd, this, NULL)) {
                 /* disable caching for this fd, go ahead with normal readv */
                 STACK_WIND_TAIL (frame, FIRST_CHILD (this),
@@ -1181,15 +1086,6 @@ ioc_readv (call_frame_t *frame, xlator_t *this, fd_t *fd,
                       "= %"PRId64" && size = %"GF_PRI_SIZET"",
                       frame, offset, size);
 
-        weight = ioc_inode->weight;
-
-        ioc_table_lock (ioc_inode->table);
-        {
-                list_move_tail (&ioc_inode->inode_lru,
-                                &ioc_inode->table->inode_lru[weight]);
-        }
-        ioc_table_unlock (ioc_inode->table);
-
         ioc_dispatch_requests (frame, ioc_inode, fd, offset, size);
         return 0;
 
@@ -1520,9 +1416,6 @@ ioc_get_priority_list (const char *opt_str, struct list_head *first)
         /* Get the pattern for cache priority.
          * "option priority *.jpg:1,abc*:2" etc
          */
-        /* TODO: inode_lru in table is statically hard-coded to 5,
-         * should be changed to run-time configuration
-         */
         stripe_str = strtok_r (string, ",", &tmp_str);
         while (stripe_str) {
                 curr = GF_CALLOC (1, sizeof (struct ioc_priority),
@@ -1732,11 +1625,9 @@ init (xlator_t *this)
 {
         ioc_table_t     *table             = NULL;
         dict_t          *xl_options        = NULL;
-        uint32_t         index             = 0;
         int32_t          ret               = -1;
         glusterfs_ctx_t *ctx               = NULL;
         data_t          *data              = 0;
-        uint32_t         num_pages         = 0;
 
         xl_options = this->options;
 
@@ -1806,16 +1697,6 @@ init (xlator_t *this)
                 goto out;
         }
 
-        table->inode_lru = GF_CALLOC (table->max_pri,
-                                      sizeof (struct list_head),
-                                      gf_ioc_mt_list_head);
-        if (table->inode_lru == NULL) {
-                goto out;
-        }
-
-        for (index = 0; index < (table->max_pri); index++)
-                INIT_LIST_HEAD (&table->inode_lru[index]);
-
         this->local_pool = mem_pool_new (ioc_local_t, 64);
         if (!this->local_pool) {
                 ret = -1;
@@ -1828,14 +1709,16 @@ init (xlator_t *this)
         pthread_mutex_init (&table->table_lock, NULL);
         this->private = table;
 
-        num_pages = (table->cache_size / table->page_size)
-                + ((table->cache_size % table->page_size)
-                   ? 1 : 0);
+        GF_ATOMIC_INIT (table->cache_used, 0);
+        GF_ATOMIC_INIT (table->hits, 0);
+        GF_ATOMIC_INIT (table->misses, 0);
+        GF_ATOMIC_INIT (table->ghost_hits, 0);
+        GF_ATOMIC_INIT (table->evictions, 0);
 
-        table->mem_pool = mem_pool_new (rbthash_entry_t, num_pages);
-        if (!table->mem_pool) {
+        if (ioc_shards_init (table) != 0) {
                 gf_msg (this->name, GF_LOG_ERROR, ENOMEM,
-                        IO_CACHE_MSG_NO_MEMORY, "Unable to allocate mem_pool");
+                        IO_CACHE_MSG_NO_MEMORY,
+                        "Unable to allocate the page cache shards");
                 goto out;
         }
 
@@ -1847,7 +1730,6 @@ init (xlator_t *this)
 out:
         if (ret == -1) {
                 if (table != NULL) {
-                        GF_FREE (table->inode_lru);
                         GF_FREE (table);
                 }
         }
@@ -1928,8 +1810,6 @@ out:
 void
 __ioc_cache_dump (ioc_inode_t *ioc_inode, char *prefix)
 {
-        off_t        offset                   = 0;
-        ioc_table_t *table                    = NULL;
         ioc_page_t  *page                     = NULL;
         int          i                        = 0;
         char         key[GF_DUMP_MAX_BUF_LEN] = {0, };
@@ -1939,8 +1819,6 @@ __ioc_cache_dump (ioc_inode_t *ioc_inode, char *prefix)
                 goto out;
         }
 
-        table = ioc_inode->table;
-
         if (ioc_inode->cache.tv.tv_sec) {
                 gf_time_fmt (timestr, sizeof timestr,
                              ioc_inode->cache.tv.tv_sec, gf_timefmt_FT);
@@ -1951,13 +1829,9 @@ __ioc_cache_dump (ioc_inode_t *ioc_inode, char *prefix)
                                     timestr);
         }
 
-        for (offset = 0; offset < ioc_inode->ia_size;
-             offset += table->page_size) {
-                page = __ioc_page_get (ioc_inode, offset);
-                if (page == NULL) {
-                        continue;
-                }
-
+        /* walk the pages of the inode rather than look them up, so that
+         * dumping them doesn't count as reading them */
+        list_for_each_entry (page, &ioc_inode->cache.page_list, page_list) {
                 sprintf (key, "inode.cache.page[%d]", i++);
                 __ioc_page_dump (page, key);
         }
@@ -2031,6 +1905,42 @@ out:
         return ret;
 }
 
+/* the queue sizes are read without the shard locks, they are only a hint */
+static void
+ioc_shards_dump (ioc_table_t *table)
+{
+        ioc_shard_t *shard     = NULL;
+        uint64_t     probation = 0;
+        uint64_t     protected = 0;
+        uint64_t     ghosts    = 0;
+        uint64_t     hits      = 0;
+        uint64_t     misses    = 0;
+        uint32_t     i         = 0;
+
+        for (i = 0; i < IOC_SHARD_COUNT; i++) {
+                shard = &table->shards[i];
+                probation += shard->probation_count;
+                protected += shard->protected_count;
+                ghosts += shard->ghost_count;
+        }
+
+        hits = GF_ATOMIC_GET (table->hits);
+        misses = GF_ATOMIC_GET (table->misses);
+
+        gf_proc_dump_write ("shards", "%d", IOC_SHARD_COUNT);
+        gf_proc_dump_write ("probation_pages", "%"PRIu64, probation);
+        gf_proc_dump_write ("protected_pages", "%"PRIu64, protected);
+        gf_proc_dump_write ("ghost_pages", "%"PRIu64, ghosts);
+        gf_proc_dump_write ("hits", "%"PRIu64, hits);
+        gf_proc_dump_write ("misses", "%"PRIu64, misses);
+        gf_proc_dump_write ("hit_ratio", "%.2f%%", (hits + misses)
+                            ? 100.0 * hits / (hits + misses) : 0.0);
+        gf_proc_dump_write ("ghost_hits", "%"PRId64,
+                            GF_ATOMIC_GET (table->ghost_hits));
+        gf_proc_dump_write ("evictions", "%"PRId64,
+                            GF_ATOMIC_GET (table->evictions));
+}
+
 int
 ioc_priv_dump (xlator_t *this)
 {
@@ -2054,13 +1964,16 @@ ioc_priv_dump (xlator_t *this)
         {
                 gf_proc_dump_write ("page_size", "%ld", priv->page_size);
                 gf_proc_dump_write ("cache_size", "%ld", priv->cache_size);
-                gf_proc_dump_write ("cache_used", "%ld", priv->cache_used);
+                gf_proc_dump_write ("cache_used", "%"PRId64,
+                                    GF_ATOMIC_GET (priv->cache_used));
                 gf_proc_dump_write ("inode_count", "%u", priv->inode_count);
                 gf_proc_dump_write ("cache_timeout", "%u", priv->cache_timeout);
                 gf_proc_dump_write ("min-file-size", "%u", priv->min_file_size);
                 gf_proc_dump_write ("max-file-size", "%u", priv->max_file_size);
         }
         pthread_mutex_unlock (&priv->table_lock);
+
+        ioc_shards_dump (priv);
 out:
         if (ret && priv) {
                 if (!add_section) {
@@ -2076,6 +1989,46 @@ out:
         return 0;
 }
 
+/* The cache efficiency counters, for io-stats to log along with its own. */
+int
+ioc_priv_to_dict (xlator_t *this, dict_t *dict)
+{
+        ioc_table_t *table  = NULL;
+        uint64_t     hits   = 0;
+        uint64_t     misses = 0;
+        int          ret    = -1;
+
+        table = this->private;
+        if (!table)
+                return 0;
+
+        hits = GF_ATOMIC_GET (table->hits);
+        misses = GF_ATOMIC_GET (table->misses);
+
+        ret = dict_set_uint64 (dict, "hits", hits);
+        if (ret)
+                goto out;
+
+        ret = dict_set_uint64 (dict, "misses", misses);
+        if (ret)
+                goto out;
+
+        ret = dict_set_double (dict, "hit_ratio", (hits + misses)
+                               ? 100.0 * hits / (hits + misses) : 0.0);
+        if (ret)
+                goto out;
+
+        ret = dict_set_uint64 (dict, "ghost_hits",
+                               GF_ATOMIC_GET (table->ghost_hits));
+        if (ret)
+                goto out;
+
+        ret = dict_set_uint64 (dict, "evictions",
+                               GF_ATOMIC_GET (table->evictions));
+out:
+        return ret;
+}
+
 /*
  * fini -
  *
@@ -2095,10 +2048,7 @@ fini (xlator_t *this)
 
         this->private = NULL;
 
-        if (table->mem_pool != NULL) {
-                mem_pool_destroy (table->mem_pool);
-                table->mem_pool = NULL;
-        }
+        ioc_shards_fini (table);
 
         list_for_each_entry_safe (curr, tmp, &table->priority_list, list) {
                 list_del_init (&curr->list);
@@ -2106,15 +2056,10 @@ fini (xlator_t *this)
                 GF_FREE (curr);
         }
 
-        /* inode_lru and inodes list can be empty in case fini() is
-         * called soon after init()? Hence commenting the below asserts.
+        /* inodes list can be empty in case fini() is called soon after
+         * init()? Hence commenting the below assert.
          */
-        /*for (i = 0; i < table->max_pri; i++) {
-                GF_ASSERT (list_empty (&table->inode_lru[i]));
-        }
-
-        GF_ASSERT (list_empty (&table->inodes));
-        */
+        /* GF_ASSERT (list_empty (&table->inodes)); */
         pthread_mutex_destroy (&table->table_lock);
         GF_FREE (table);
 
@@ -2143,6 +2088,7 @@ struct xlator_fops fops = {
 struct xlator_dumpops dumpops = {
         .priv        = ioc_priv_dump,
         .inodectx    = ioc_inode_dump,
+        .priv_to_dict = ioc_priv_to_dict,
 };
 
 struct xlator_cbks cbks = {
@@ -20,7 +20,6 @@
 #include "xlator.h"
 #include "common-utils.h"
 #include "call-stub.h"
-#include "rbthash.h"
 #include "hashfn.h"
 #include <sys/time.h>
 #include <fnmatch.h>
@@ -28,7 +27,9 @@
 
 #define IOC_PAGE_SIZE    (1024 * 128)   /* 128KB */
 #define IOC_CACHE_SIZE   (32 * 1024 * 1024)
-#define IOC_PAGE_TABLE_BUCKET_COUNT 1
+#define IOC_SHARD_COUNT  16
+#define IOC_PRUNE_SCAN   8              /* cold pages compared on eviction */
+#define IOC_GHOST_RATIO  4              /* ghosts remembered per cached page */
 
 struct ioc_table;
 struct ioc_local;
@@ -100,7 +101,11 @@ struct ioc_local {
  *
  */
 struct ioc_page {
-        struct list_head    page_lru;
+        struct list_head    page_list; /* pages of the inode */
+        struct list_head    page_hash; /* hash chain of the shard */
+        struct list_head    page_lru;  /* probation or protected queue */
+        struct ioc_shard    *shard;    /* NULL once the page is unhashed */
+        char                hot;       /* page is in the protected queue */
         struct ioc_inode    *inode;   /* inode this page belongs to */
         struct ioc_priority *priority;
         char                dirty;
@@ -116,9 +121,41 @@ struct ioc_page {
         char                stale;
 };
 
+/*
+ * ioc_ghost - a page recently evicted from the probation queue, kept by
+ *             (gfid, offset) only, so that it goes straight to the
+ *             protected queue when it is read again.
+ */
+struct ioc_ghost {
+        struct list_head  hash;
+        struct list_head  list;
+        uuid_t            gfid;
+        off_t             offset;
+};
+
+/*
+ * ioc_shard - one slice of the page cache shared by all the inodes.
+ *
+ * Pages are placed by a hash of (gfid, offset) and replaced with 2Q: new
+ * pages enter the probation queue and only those read again after they
+ * were evicted from it, as told by the ghost queue, enter the protected
+ * queue. A sequential scan thus only cycles through probation and leaves
+ * the protected working set alone.
+ */
+struct ioc_shard {
+        pthread_mutex_t   lock;
+        struct list_head *buckets;
+        struct list_head *ghost_buckets;
+        struct list_head  probation;
+        struct list_head  protected;
+        struct list_head  ghosts;
+        uint32_t          probation_count;
+        uint32_t          protected_count;
+        uint32_t          ghost_count;
+};
+
 struct ioc_cache {
-        rbthash_table_t  *page_table;
-        struct list_head  page_lru;
+        struct list_head  page_list;
         time_t            mtime;       /*
                                         * seconds component of file mtime
                                         */
@@ -138,7 +175,6 @@ struct ioc_inode {
                                             * list of inodes, maintained by
                                             * io-cache translator
                                             */
-        struct list_head       inode_lru;
         struct ioc_waitq      *waitq;
         pthread_mutex_t        inode_lock;
         uint32_t               weight;      /*
@@ -151,12 +187,11 @@ struct ioc_inode {
 struct ioc_table {
         uint64_t         page_size;
         uint64_t         cache_size;
-        uint64_t         cache_used;
+        gf_atomic_t      cache_used;
         uint64_t         min_file_size;
         uint64_t         max_file_size;
         struct list_head inodes; /* list of inodes cached */
         struct list_head active;
-        struct list_head *inode_lru;
         struct list_head priority_list;
         int32_t          readv_count;
         pthread_mutex_t  table_lock;
@@ -164,7 +199,13 @@ struct ioc_table {
         uint32_t         inode_count;
         int32_t          cache_timeout;
         int32_t          max_pri;
-        struct mem_pool  *mem_pool;
+        struct ioc_shard *shards;
+        uint32_t         bucket_count;  /* per shard, a power of two */
+        struct mem_pool  *ghost_pool;
+        gf_atomic_t      hits;
+        gf_atomic_t      misses;
+        gf_atomic_t      ghost_hits;
+        gf_atomic_t      evictions;
 };
 
 typedef struct ioc_table ioc_table_t;
@@ -173,6 +214,11 @@ typedef struct ioc_page ioc_page_t;
 typedef struct ioc_inode ioc_inode_t;
 typedef struct ioc_waitq ioc_waitq_t;
 typedef struct ioc_fill ioc_fill_t;
+typedef struct ioc_ghost ioc_ghost_t;
+typedef struct ioc_shard ioc_shard_t;
+
+/* log2 of the page size of the table, set up by init() */
+extern int ioc_log2_page_size;
 
 void *
 str_to_ptr (char *string);
@@ -326,6 +372,12 @@ ioc_cache_still_valid (ioc_inode_t *ioc_inode, struct iatt *stbuf);
 int32_t
 ioc_prune (ioc_table_t *table);
 
+int32_t
+ioc_shards_init (ioc_table_t *table);
+
+void
+ioc_shards_fini (ioc_table_t *table);
+
 int32_t
 ioc_need_prune (ioc_table_t *table);
 
@@ -11,8 +11,6 @@
 #include "io-cache.h"
 #include "ioc-mem-types.h"
 
-extern int ioc_log2_page_size;
-
 /*
  * str_to_ptr - convert a string to pointer
  * @string: string
@@ -188,7 +186,7 @@ ioc_inode_create (ioc_table_t *table, inode_t *inode, uint32_t weight)
 
         ioc_inode->inode = inode;
         ioc_inode->table = table;
-        INIT_LIST_HEAD (&ioc_inode->cache.page_lru);
+        INIT_LIST_HEAD (&ioc_inode->cache.page_list);
         pthread_mutex_init (&ioc_inode->inode_lock, NULL);
         ioc_inode->weight = weight;
 
@@ -196,13 +194,11 @@ ioc_inode_create (ioc_table_t *table, inode_t *inode, uint32_t weight)
         {
                 table->inode_count++;
                 list_add (&ioc_inode->inode_list, &table->inodes);
-                list_add_tail (&ioc_inode->inode_lru,
-                               &table->inode_lru[weight]);
         }
         ioc_table_unlock (table);
 
         gf_msg_trace (table->xl->name, 0,
-                      "adding to inode_lru[%d]", weight);
+                      "adding inode(%p) with weight %d", ioc_inode, weight);
 
 out:
         return ioc_inode;
@@ -229,12 +225,10 @@ ioc_inode_destroy (ioc_inode_t *ioc_inode)
         {
                 table->inode_count--;
                 list_del (&ioc_inode->inode_list);
-                list_del (&ioc_inode->inode_lru);
         }
         ioc_table_unlock (table);
 
         ioc_inode_flush (ioc_inode);
-        rbthash_table_destroy (ioc_inode->cache.page_table);
 
         pthread_mutex_destroy (&ioc_inode->inode_lock);
         GF_FREE (ioc_inode);
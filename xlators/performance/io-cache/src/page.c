@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <sys/time.h>
 #include "io-cache-messages.h"
+
 char
 ioc_empty (struct ioc_cache *cache)
 {
@@ -24,34 +25,184 @@ ioc_empty (struct ioc_cache *cache)
 
         GF_VALIDATE_OR_GOTO ("io-cache", cache, out);
 
-        is_empty = list_empty (&cache->page_lru);
+        is_empty = list_empty (&cache->page_list);
 
 out:
         return is_empty;
 }
 
 
+/*
+ * ioc_page_hash - hash of a page of a file. the low bits select the shard
+ *                 and the rest the bucket in it, so that the pages of one
+ *                 large file are spread over all the shards.
+ */
+static uint64_t
+ioc_page_hash (uuid_t gfid, off_t offset)
+{
+        uint64_t hash = 0;
+
+        memcpy (&hash, gfid + 8, sizeof (hash));
+        hash ^= (uint64_t)(offset >> ioc_log2_page_size)
+                * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 32;
+
+        return hash;
+}
+
+
+static ioc_shard_t *
+ioc_page_shard (ioc_table_t *table, uint64_t hash)
+{
+        return &table->shards[hash % IOC_SHARD_COUNT];
+}
+
+
+static struct list_head *
+ioc_page_bucket (ioc_table_t *table, struct list_head *buckets, uint64_t hash)
+{
+        return &buckets[(hash / IOC_SHARD_COUNT) & (table->bucket_count - 1)];
+}
+
+
+/* number of pages each shard is expected to hold */
+static uint64_t
+ioc_shard_pages (ioc_table_t *table)
+{
+        uint64_t pages = 0;
+
+        pages = table->cache_size / table->page_size / IOC_SHARD_COUNT;
+
+        return (pages > 0) ? pages : 1;
+}
+
+
+static void
+__ioc_ghost_del (ioc_shard_t *shard, ioc_ghost_t *ghost)
+{
+        list_del (&ghost->hash);
+        list_del (&ghost->list);
+        shard->ghost_count--;
+
+        mem_put (ghost);
+}
+
+
+static ioc_ghost_t *
+__ioc_ghost_get (ioc_table_t *table, ioc_shard_t *shard, uuid_t gfid,
+                 off_t offset, uint64_t hash)
+{
+        ioc_ghost_t      *ghost  = NULL;
+        struct list_head *bucket = NULL;
+
+        bucket = ioc_page_bucket (table, shard->ghost_buckets, hash);
+        list_for_each_entry (ghost, bucket, hash) {
+                if ((ghost->offset == offset)
+                    && (gf_uuid_compare (ghost->gfid, gfid) == 0))
+                        return ghost;
+        }
+
+        return NULL;
+}
+
+
+/*
+ * __ioc_ghost_add - remember a page evicted from the probation queue. a
+ *                   ghost is much smaller than a page, so the shard keeps
+ *                   IOC_GHOST_RATIO of them per page it holds and the reuse
+ *                   of a page is still seen behind a long scan. the oldest
+ *                   ones are forgotten first.
+ */
+static void
+__ioc_ghost_add (ioc_table_t *table, ioc_shard_t *shard, ioc_page_t *page)
+{
+        ioc_ghost_t *ghost     = NULL;
+        uuid_t      *gfid      = NULL;
+        uint64_t     ghost_max = 0;
+
+        gfid = &page->inode->inode->gfid;
+
+        ghost = mem_get (table->ghost_pool);
+        if (ghost == NULL)
+                return;
+
+        gf_uuid_copy (ghost->gfid, *gfid);
+        ghost->offset = page->offset;
+
+        list_add (&ghost->hash,
+                  ioc_page_bucket (table, shard->ghost_buckets,
+                                   ioc_page_hash (*gfid, page->offset)));
+        list_add_tail (&ghost->list, &shard->ghosts);
+        shard->ghost_count++;
+
+        ghost_max = ioc_shard_pages (table) * IOC_GHOST_RATIO;
+        while (shard->ghost_count > ghost_max) {
+                ghost = list_first_entry (&shard->ghosts, ioc_ghost_t, list);
+                __ioc_ghost_del (shard, ghost);
+        }
+}
+
+
+/* takes the page out of the hash and the queues of its shard */
+static void
+__ioc_page_unhash (ioc_page_t *page)
+{
+        ioc_shard_t *shard = NULL;
+
+        shard = page->shard;
+
+        list_del_init (&page->page_hash);
+        list_del_init (&page->page_lru);
+
+        if (page->hot)
+                shard->protected_count--;
+        else
+                shard->probation_count--;
+
+        page->shard = NULL;
+}
+
+
 ioc_page_t *
 __ioc_page_get (ioc_inode_t *ioc_inode, off_t offset)
 {
         ioc_page_t   *page           = NULL;
+        ioc_page_t   *trav           = NULL;
         ioc_table_t  *table          = NULL;
+        ioc_shard_t  *shard          = NULL;
+        uint64_t      hash           = 0;
         off_t         rounded_offset = 0;
 
         GF_VALIDATE_OR_GOTO ("io-cache", ioc_inode, out);
 
         table = ioc_inode->table;
-        GF_VALIDATE_OR_GOTO ("io-cache", ioc_inode, out);
+        GF_VALIDATE_OR_GOTO ("io-cache", table, out);
 
         rounded_offset = floor (offset, table->page_size);
 
-        page = rbthash_get (ioc_inode->cache.page_table, &rounded_offset,
-                            sizeof (rounded_offset));
+        hash = ioc_page_hash (ioc_inode->inode->gfid, rounded_offset);
+        shard = ioc_page_shard (table, hash);
 
-        if (page != NULL) {
-                /* push the page to the end of the lru list */
-                list_move_tail (&page->page_lru, &ioc_inode->cache.page_lru);
+        pthread_mutex_lock (&shard->lock);
+        {
+                list_for_each_entry (trav, ioc_page_bucket (table,
+                                                            shard->buckets,
+                                                            hash),
+                                     page_hash) {
+                        if ((trav->inode == ioc_inode)
+                            && (trav->offset == rounded_offset)) {
+                                page = trav;
+                                break;
+                        }
+                }
+
+                /* pages on probation keep their place however often they
+                 * are read, or a scan reading each page in several pieces
+                 * would look like reuse. */
+                if ((page != NULL) && page->hot)
+                        list_move_tail (&page->page_lru, &shard->protected);
         }
+        pthread_mutex_unlock (&shard->lock);
 
 out:
         return page;
@@ -87,7 +238,8 @@ out:
 int64_t
 __ioc_page_destroy (ioc_page_t *page)
 {
-        int64_t  page_size = 0;
+        int64_t      page_size = 0;
+        ioc_shard_t *shard     = NULL;
 
         GF_VALIDATE_OR_GOTO ("io-cache", page, out);
 
@@ -99,9 +251,16 @@ __ioc_page_destroy (ioc_page_t *page)
                 page_size = -1;
                 page->stale = 1;
         } else {
-                rbthash_remove (page->inode->cache.page_table, &page->offset,
-                                sizeof (page->offset));
-                list_del (&page->page_lru);
+                /* pages evicted by ioc_prune() are already unhashed */
+                shard = page->shard;
+                if (shard != NULL) {
+                        pthread_mutex_lock (&shard->lock);
+                        {
+                                __ioc_page_unhash (page);
+                        }
+                        pthread_mutex_unlock (&shard->lock);
+                }
+                list_del (&page->page_list);
 
                 gf_msg_trace (page->inode->table->xl->name, 0,
                               "destroying page = %p, offset = %"PRId64" "
@@ -148,44 +307,149 @@ out:
         return ret;
 }
 
-int32_t
-__ioc_inode_prune (ioc_inode_t *curr, uint64_t *size_pruned,
-                   uint64_t size_to_prune, uint32_t index)
-{
-        ioc_page_t  *page  = NULL, *next = NULL;
-        int32_t      ret   = 0;
-        ioc_table_t *table = NULL;
 
-        if (curr == NULL) {
-                goto out;
+/*
+ * __ioc_shard_victim - choose the page to evict from a shard and lock its
+ *                      inode.
+ *
+ * among the IOC_PRUNE_SCAN oldest pages of the queue, the one whose inode
+ * has the lowest priority is taken. the other queue is tried if none of
+ * them can go.
+ *
+ * inode locks are taken before shard locks everywhere else, so they can
+ * only be tried here: pages whose inode is busy are passed over, as are
+ * pages being read from the child or waited on.
+ */
+static ioc_page_t *
+__ioc_shard_victim (ioc_shard_t *shard, gf_boolean_t probation)
+{
+        struct list_head *queues[2] = {NULL, };
+        ioc_page_t       *page      = NULL;
+        ioc_page_t       *victim    = NULL;
+        uint32_t          scanned   = 0;
+        int               i         = 0;
+
+        if (probation) {
+                queues[0] = &shard->probation;
+                queues[1] = &shard->protected;
+        } else {
+                queues[0] = &shard->protected;
+                queues[1] = &shard->probation;
         }
 
-        table = curr->table;
+        for (i = 0; (i < 2) && (victim == NULL); i++) {
+                scanned = 0;
+                list_for_each_entry (page, queues[i], page_lru) {
+                        if (scanned++ == IOC_PRUNE_SCAN)
+                                break;
 
-        list_for_each_entry_safe (page, next, &curr->cache.page_lru, page_lru) {
-                *size_pruned += page->size;
-                ret = __ioc_page_destroy (page);
+                        if ((victim != NULL)
+                            && (victim->inode->weight <= page->inode->weight))
+                                continue;
 
-                if (ret != -1)
-                        table->cache_used -= ret;
+                        if (pthread_mutex_trylock (&page->inode->inode_lock))
+                                continue;
 
-                gf_msg_trace (table->xl->name, 0,
-                              "index = %d && "
-                              "table->cache_used = %"PRIu64" && table->"
-                              "cache_size = %"PRIu64, index, table->cache_used,
-                              table->cache_size);
+                        if (!page->ready || page->waitq) {
+                                pthread_mutex_unlock (&page->inode->inode_lock);
+                                continue;
+                        }
 
-                if ((*size_pruned) >= size_to_prune)
-                        break;
+                        if (victim != NULL)
+                                pthread_mutex_unlock (&victim->inode->inode_lock);
+                        victim = page;
+                }
         }
 
-        if (ioc_empty (&curr->cache)) {
-                list_del_init (&curr->inode_lru);
+        return victim;
+}
+
+
+/*
+ * ioc_shard_evict - evict one page from a shard.
+ *
+ * returns the size freed, or -1 if the shard had nothing to evict.
+ */
+static int64_t
+ioc_shard_evict (ioc_table_t *table, ioc_shard_t *shard,
+                 gf_boolean_t probation)
+{
+        ioc_page_t  *page      = NULL;
+        ioc_inode_t *ioc_inode = NULL;
+        int64_t      ret       = -1;
+
+        pthread_mutex_lock (&shard->lock);
+        {
+                page = __ioc_shard_victim (shard, probation);
+                if (page != NULL) {
+                        if (!page->hot)
+                                __ioc_ghost_add (table, shard, page);
+                        __ioc_page_unhash (page);
+                }
         }
+        pthread_mutex_unlock (&shard->lock);
+
+        if (page == NULL)
+                goto out;
+
+        /* the inode lock taken by __ioc_shard_victim () keeps everyone
+         * else off the page, now that it can't be found in the shard */
+        ioc_inode = page->inode;
+        ret = __ioc_page_destroy (page);
+        pthread_mutex_unlock (&ioc_inode->inode_lock);
+
+        GF_ATOMIC_INC (table->evictions);
 
 out:
-        return 0;
+        return ret;
 }
+
+
+/*
+ * ioc_prune_shard - choose the shard to evict a page from.
+ *
+ * while probation holds more than a quarter of the pages of the cache, it
+ * is the shard with the most pages on probation, otherwise the one with the
+ * most protected pages. the counts are read without the shard locks, they
+ * only need to be about right. shards in @skip had nothing to evict.
+ */
+static ioc_shard_t *
+ioc_prune_shard (ioc_table_t *table, uint32_t skip, gf_boolean_t *probation)
+{
+        ioc_shard_t *shard          = NULL;
+        ioc_shard_t *most_probation = NULL;
+        ioc_shard_t *most_protected = NULL;
+        uint64_t     total          = 0;
+        uint32_t     i              = 0;
+
+        for (i = 0; i < IOC_SHARD_COUNT; i++) {
+                if (skip & (1U << i))
+                        continue;
+
+                shard = &table->shards[i];
+                total += shard->probation_count;
+
+                if ((most_probation == NULL)
+                    || (shard->probation_count
+                        > most_probation->probation_count))
+                        most_probation = shard;
+
+                if ((most_protected == NULL)
+                    || (shard->protected_count
+                        > most_protected->protected_count))
+                        most_protected = shard;
+        }
+
+        if (most_probation == NULL)
+                return NULL;
+
+        *probation = ((total > ioc_shard_pages (table) * IOC_SHARD_COUNT / 4)
+                      || (most_protected->protected_count == 0));
+
+        return *probation ? most_probation : most_protected;
+}
+
+
 /*
  * ioc_prune - prune the cache. we have a limit to the number of pages we
  *             can have in-memory.
@@ -196,41 +460,35 @@ out:
 int32_t
 ioc_prune (ioc_table_t *table)
 {
-        ioc_inode_t *curr          = NULL, *next_ioc_inode = NULL;
-        int32_t      index         = 0;
-        uint64_t     size_to_prune = 0;
-        uint64_t     size_pruned   = 0;
+        ioc_shard_t  *shard         = NULL;
+        int64_t       size_to_prune = 0;
+        int64_t       size_pruned   = 0;
+        int64_t       ret           = 0;
+        uint32_t      skip          = 0;
+        gf_boolean_t  probation     = _gf_false;
 
         GF_VALIDATE_OR_GOTO ("io-cache", table, out);
 
-        ioc_table_lock (table);
-        {
-                size_to_prune = table->cache_used - table->cache_size;
-                /* take out the least recently used inode */
-                for (index=0; index < table->max_pri; index++) {
-                        list_for_each_entry_safe (curr, next_ioc_inode,
-                                                  &table->inode_lru[index],
-                                                  inode_lru) {
-                                /* prune page-by-page for this inode, till
-                                 * we reach the equilibrium */
-                                ioc_inode_lock (curr);
-                                {
-                                        __ioc_inode_prune (curr, &size_pruned,
-                                                           size_to_prune,
-                                                           index);
-                                }
-                                ioc_inode_unlock (curr);
+        size_to_prune = GF_ATOMIC_GET (table->cache_used) - table->cache_size;
 
-                                if (size_pruned >= size_to_prune)
-                                        break;
-                        } /* list_for_each_entry_safe (curr...) */
+        while (size_pruned < size_to_prune) {
+                shard = ioc_prune_shard (table, skip, &probation);
+                if (shard == NULL)
+                        break;
 
-                        if (size_pruned >= size_to_prune)
-                                break;
-                } /* for(index=0;...) */
+                ret = ioc_shard_evict (table, shard, probation);
+                if (ret < 0) {
+                        skip |= 1U << (shard - table->shards);
+                        continue;
+                }
+
+                size_pruned += ret;
+                GF_ATOMIC_SUB (table->cache_used, ret);
+        }
 
-        } /* ioc_inode_table locked region end */
-        ioc_table_unlock (table);
+        gf_msg_trace (table->xl->name, 0,
+                      "pruned %"PRId64" of %"PRId64" bytes", size_pruned,
+                      size_to_prune);
 
 out:
         return 0;
@@ -250,6 +508,9 @@ __ioc_page_create (ioc_inode_t *ioc_inode, off_t offset)
         ioc_page_t  *page           = NULL;
         off_t        rounded_offset = 0;
         ioc_page_t  *newpage        = NULL;
+        ioc_shard_t *shard          = NULL;
+        ioc_ghost_t *ghost          = NULL;
+        uint64_t     hash           = 0;
 
         GF_VALIDATE_OR_GOTO ("io-cache", ioc_inode, out);
 
@@ -263,20 +524,39 @@ __ioc_page_create (ioc_inode_t *ioc_inode, off_t offset)
                 goto out;
         }
 
-        if (!ioc_inode) {
-                GF_FREE (newpage);
-                newpage = NULL;
-                goto out;
-        }
-
         newpage->offset = rounded_offset;
         newpage->inode = ioc_inode;
         pthread_mutex_init (&newpage->page_lock, NULL);
 
-        rbthash_insert (ioc_inode->cache.page_table, newpage, &rounded_offset,
-                        sizeof (rounded_offset));
+        hash = ioc_page_hash (ioc_inode->inode->gfid, rounded_offset);
+        shard = ioc_page_shard (table, hash);
+
+        pthread_mutex_lock (&shard->lock);
+        {
+                /* read again soon after it was evicted from probation */
+                ghost = __ioc_ghost_get (table, shard, ioc_inode->inode->gfid,
+                                         rounded_offset, hash);
+                if (ghost != NULL) {
+                        __ioc_ghost_del (shard, ghost);
+
+                        newpage->hot = 1;
+                        list_add_tail (&newpage->page_lru, &shard->protected);
+                        shard->protected_count++;
+                } else {
+                        list_add_tail (&newpage->page_lru, &shard->probation);
+                        shard->probation_count++;
+                }
+
+                list_add (&newpage->page_hash,
+                          ioc_page_bucket (table, shard->buckets, hash));
+                newpage->shard = shard;
+        }
+        pthread_mutex_unlock (&shard->lock);
+
+        if (ghost != NULL)
+                GF_ATOMIC_INC (table->ghost_hits);
 
-        list_add_tail (&newpage->page_lru, &ioc_inode->cache.page_lru);
+        list_add_tail (&newpage->page_list, &ioc_inode->cache.page_list);
 
         page = newpage;
 
@@ -287,6 +567,96 @@ out:
         return page;
 }
 
+
+int32_t
+ioc_shards_init (ioc_table_t *table)
+{
+        ioc_shard_t *shard    = NULL;
+        uint64_t     pages    = 0;
+        uint32_t     buckets  = 16;
+        uint32_t     i        = 0;
+        uint32_t     j        = 0;
+        int32_t      ret      = -1;
+
+        /* sized for the ghosts, which outnumber the pages */
+        pages = ioc_shard_pages (table);
+        while (buckets < pages * IOC_GHOST_RATIO)
+                buckets <<= 1;
+        table->bucket_count = buckets;
+
+        table->shards = GF_CALLOC (IOC_SHARD_COUNT, sizeof (ioc_shard_t),
+                                   gf_ioc_mt_ioc_shard_t);
+        if (table->shards == NULL)
+                goto out;
+
+        for (i = 0; i < IOC_SHARD_COUNT; i++) {
+                shard = &table->shards[i];
+
+                /* pages and ghosts have a bucket array each */
+                shard->buckets = GF_CALLOC (2 * buckets,
+                                            sizeof (struct list_head),
+                                            gf_ioc_mt_list_head);
+                if (shard->buckets == NULL)
+                        goto out;
+                shard->ghost_buckets = shard->buckets + buckets;
+
+                for (j = 0; j < 2 * buckets; j++)
+                        INIT_LIST_HEAD (&shard->buckets[j]);
+
+                INIT_LIST_HEAD (&shard->probation);
+                INIT_LIST_HEAD (&shard->protected);
+                INIT_LIST_HEAD (&shard->ghosts);
+                pthread_mutex_init (&shard->lock, NULL);
+        }
+
+        table->ghost_pool = mem_pool_new (ioc_ghost_t,
+                                          pages * IOC_SHARD_COUNT
+                                          * IOC_GHOST_RATIO);
+        if (table->ghost_pool == NULL)
+                goto out;
+
+        ret = 0;
+out:
+        if (ret != 0)
+                ioc_shards_fini (table);
+
+        return ret;
+}
+
+
+void
+ioc_shards_fini (ioc_table_t *table)
+{
+        ioc_shard_t *shard = NULL;
+        ioc_ghost_t *ghost = NULL, *tmp = NULL;
+        uint32_t     i     = 0;
+
+        if (table->shards == NULL)
+                goto out;
+
+        for (i = 0; i < IOC_SHARD_COUNT; i++) {
+                shard = &table->shards[i];
+                if (shard->buckets == NULL)
+                        break;
+
+                list_for_each_entry_safe (ghost, tmp, &shard->ghosts, list) {
+                        __ioc_ghost_del (shard, ghost);
+                }
+
+                pthread_mutex_destroy (&shard->lock);
+                GF_FREE (shard->buckets);
+        }
+
+        GF_FREE (table->shards);
+        table->shards = NULL;
+
+out:
+        if (table->ghost_pool != NULL) {
+                mem_pool_destroy (table->ghost_pool);
+                table->ghost_pool = NULL;
+        }
+}
+
 /*
  * ioc_wait_on_page - pause a frame to wait till the arrival of a page.
  * here we need to handle the case when the frame who calls wait_on_page
@@ -532,21 +902,11 @@ unlock:
 
         ioc_waitq_return (waitq);
 
-        if (iobref_page_size) {
-                ioc_table_lock (table);
-                {
-                        table->cache_used += iobref_page_size;
-                }
-                ioc_table_unlock (table);
-        }
+        if (iobref_page_size)
+                GF_ATOMIC_ADD (table->cache_used, iobref_page_size);
 
-        if (destroy_size) {
-                ioc_table_lock (table);
-                {
-                        table->cache_used -= destroy_size;
-                }
-                ioc_table_unlock (table);
-        }
+        if (destroy_size)
+                GF_ATOMIC_SUB (table->cache_used, destroy_size);
 
         if (ioc_need_prune (ioc_inode->table)) {
                 ioc_prune (ioc_inode->table);
@@ -656,7 +1016,6 @@ __ioc_frame_fill (ioc_page_t *page, call_frame_t *frame, off_t offset,
         off_t        src_offset = 0;
         off_t        dst_offset = 0;
         ssize_t      copy_size  = 0;
-        ioc_inode_t *ioc_inode  = NULL;
         ioc_fill_t  *new        = NULL;
         int8_t       found      = 0;
         int32_t      ret        = -1;
@@ -675,15 +1034,11 @@ __ioc_frame_fill (ioc_page_t *page, call_frame_t *frame, off_t offset,
                 goto out;
         }
 
-        ioc_inode = page->inode;
-
         gf_msg_trace (frame->this->name, 0,
                       "frame (%p) offset = %"PRId64" && size = %"GF_PRI_SIZET" "
                       "&& page->size = %"GF_PRI_SIZET" && wait_count = %d",
                       frame, offset, size, page->size, local->wait_count);
 
-        /* immediately move this page to the end of the page_lru list */
-        list_move_tail (&page->page_lru, &ioc_inode->cache.page_lru);
         /* fill local->pending_size bytes from local->pending_offset */
         if (local->op_ret != -1) {
                 local->op_errno = op_errno;
@@ -1017,7 +1372,7 @@ __ioc_page_error (ioc_page_t *page, int32_t op_ret, int32_t op_errno)
         ret = __ioc_page_destroy (page);
 
         if (ret != -1) {
-                table->cache_used -= ret;
+                GF_ATOMIC_SUB (table->cache_used, ret);
         }
 
 out:
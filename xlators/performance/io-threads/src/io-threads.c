@@ -19,6 +19,7 @@
 #include <sys/time.h>
 #include <time.h>
 #include "locking.h"
+#include "timespec.h"
 #include "io-threads-messages.h"
 
 void *iot_worker (void *arg);
@@ -48,20 +49,31 @@ struct volume_options options[];
                 }                                                              \
         } while (0)
 
+static iot_queue_t *
+iot_next_queue (iot_conf_t *conf)
+{
+        uint64_t next = GF_ATOMIC_INC (conf->next_queue);
+
+        return &conf->queues[next % conf->queue_count];
+}
+
 iot_client_ctx_t *
 iot_get_ctx (xlator_t *this, client_t *client)
 {
         iot_client_ctx_t        *ctx    = NULL;
         iot_client_ctx_t        *setted_ctx    = NULL;
+        iot_queue_t             *queue  = NULL;
         int                      i;
 
         if (client_ctx_get (client, this, (void **)&ctx) != 0) {
                 ctx = GF_CALLOC (IOT_PRI_MAX, sizeof(*ctx),
                                  gf_iot_mt_client_ctx_t);
                 if (ctx) {
+                        queue = iot_next_queue (this->private);
                         for (i = 0; i < IOT_PRI_MAX; ++i) {
                                 INIT_LIST_HEAD (&ctx[i].clients);
                                 INIT_LIST_HEAD (&ctx[i].reqs);
+                                ctx[i].queue = queue;
                         }
                         setted_ctx = client_ctx_set (client, this, ctx);
                         if (ctx != setted_ctx) {
@@ -75,114 +87,381 @@ iot_get_ctx (xlator_t *this, client_t *client)
 }
 
 call_stub_t *
-__iot_dequeue (iot_conf_t *conf, int *pri)
+__iot_dequeue (iot_queue_t *queue, int pri)
 {
         call_stub_t             *stub = NULL;
-        int                     i = 0;
         iot_client_ctx_t        *ctx;
 
+        if (list_empty (&queue->clients[pri]))
+                return NULL;
+
+        /* Get the first per-client queue for this priority. */
+        ctx = list_first_entry (&queue->clients[pri], iot_client_ctx_t,
+                                clients);
+        if (list_empty (&ctx->reqs))
+                return NULL;
+
+        /* Get the first request on that queue. */
+        stub = list_first_entry (&ctx->reqs, call_stub_t, list);
+        list_del_init (&stub->list);
+        if (list_empty (&ctx->reqs)) {
+                list_del_init (&ctx->clients);
+        } else {
+                list_rotate_left (&queue->clients[pri]);
+        }
+
+        queue->sizes[pri]--;
+
+        return stub;
+}
+
+
+/* Takes the next request a worker living on @home should run, honouring
+ * the priorities and their thread limits across all queues. */
+call_stub_t *
+iot_dequeue (iot_conf_t *conf, iot_queue_t *home, int *pri)
+{
+        call_stub_t             *stub  = NULL;
+        iot_queue_t             *queue = NULL;
+        int                      i     = 0;
+        int                      j     = 0;
+
         *pri = -1;
         for (i = 0; i < IOT_PRI_MAX; i++) {
-
-                if (conf->ac_iot_count[i] >= conf->ac_iot_limit[i]) {
+                if (GF_ATOMIC_GET (conf->queue_sizes[i]) <= 0)
                         continue;
-                }
 
-                if (list_empty (&conf->clients[i])) {
+                if (GF_ATOMIC_INC (conf->ac_iot_count[i]) >
+                    conf->ac_iot_limit[i]) {
+                        GF_ATOMIC_DEC (conf->ac_iot_count[i]);
                         continue;
                 }
 
-                /* Get the first per-client queue for this priority. */
-                ctx = list_first_entry (&conf->clients[i],
-                                        iot_client_ctx_t, clients);
-                if (!ctx) {
-                        continue;
-                }
+                queue = home;
+                for (j = 0; j < conf->queue_count; j++) {
+                        /* unlocked peek, the lock is only worth taking
+                         * when there might be something to take */
+                        if (queue->sizes[i] > 0) {
+                                pthread_mutex_lock (&queue->lock);
+                                {
+                                        stub = __iot_dequeue (queue, i);
+                                        if (stub) {
+                                                queue->dequeued++;
+                                                if (queue != home)
+                                                        queue->stolen++;
+                                                GF_ATOMIC_DEC (conf->queue_sizes[i]);
+                                                GF_ATOMIC_DEC (conf->queue_size);
+                                        }
+                                }
+                                pthread_mutex_unlock (&queue->lock);
 
-                if (list_empty (&ctx->reqs)) {
-                        continue;
+                                if (stub) {
+                                        *pri = i;
+                                        return stub;
+                                }
+                        }
+
+                        if (++queue == conf->queues + conf->queue_count)
+                                queue = conf->queues;
                 }
 
-                /* Get the first request on that queue. */
-                stub = list_first_entry (&ctx->reqs, call_stub_t, list);
-                list_del_init (&stub->list);
-                if (list_empty (&ctx->reqs)) {
-                        list_del_init (&ctx->clients);
-                } else {
-                        list_rotate_left (&conf->clients[i]);
+                GF_ATOMIC_DEC (conf->ac_iot_count[i]);
+        }
+
+        return NULL;
+}
+
+
+void
+__iot_enqueue (iot_conf_t *conf, iot_queue_t *queue, iot_client_ctx_t *ctx,
+               call_stub_t *stub, int pri)
+{
+        if (list_empty (&ctx->reqs)) {
+                list_add_tail (&ctx->clients, &queue->clients[pri]);
+        }
+        list_add_tail (&stub->list, &ctx->reqs);
+
+        queue->sizes[pri]++;
+        GF_ATOMIC_INC (conf->queue_sizes[pri]);
+        GF_ATOMIC_INC (conf->queue_size);
+}
+
+
+/* Wakes an idle worker, preferably one living on @queue. Returns whether
+ * there was one. */
+gf_boolean_t
+iot_wake_worker (iot_conf_t *conf, iot_queue_t *queue)
+{
+        iot_worker_t    *worker = NULL;
+        iot_worker_t    *tmp    = NULL;
+
+        if (GF_ATOMIC_GET (conf->sleep_count) == 0)
+                return _gf_false;
+
+        pthread_mutex_lock (&conf->mutex);
+        {
+                list_for_each_entry (tmp, &conf->idle_workers, idle) {
+                        if (tmp->home == queue) {
+                                worker = tmp;
+                                break;
+                        }
                 }
 
-                conf->ac_iot_count[i]++;
-                *pri = i;
-                break;
+                if (!worker && !list_empty (&conf->idle_workers))
+                        worker = list_first_entry (&conf->idle_workers,
+                                                   iot_worker_t, idle);
+
+                if (worker) {
+                        list_del_init (&worker->idle);
+                        worker->woken = _gf_true;
+                        pthread_cond_signal (&worker->cond);
+                }
         }
+        pthread_mutex_unlock (&conf->mutex);
 
-        if (!stub)
-                return NULL;
+        return (worker != NULL);
+}
 
-        conf->queue_size--;
-        conf->queue_sizes[*pri]--;
 
-        return stub;
+/* How many threads we may run right now. */
+static int32_t
+iot_thread_cap (iot_conf_t *conf)
+{
+        if (conf->adaptive)
+                return min (conf->target_count, conf->max_count);
+
+        return conf->max_count;
 }
 
 
-void
-__iot_enqueue (iot_conf_t *conf, call_stub_t *stub, int pri)
+static const char *
+iot_adapt_action_name (iot_adapt_action_t action)
 {
-        client_t                *client = stub->frame->root->client;
-        iot_client_ctx_t        *ctx;
+        switch (action) {
+        case IOT_ADAPT_GROW:
+                return "grow";
+        case IOT_ADAPT_SHRINK:
+                return "shrink";
+        default:
+                return "hold";
+        }
+}
 
-        if (pri < 0 || pri >= IOT_PRI_MAX)
-                pri = IOT_PRI_MAX-1;
 
-        if (client) {
-                ctx = iot_get_ctx (THIS, client);
-                if (ctx) {
-                        ctx = &ctx[pri];
+/*
+ * The latency controller. Every IOT_ADAPT_WINDOW it looks at how long the
+ * requests served meanwhile sat in the queues and how busy that kept the
+ * workers:
+ *
+ * - waits above latency-target while the workers are mostly busy mean
+ *   there are too few of them, add half as many again; if that does not
+ *   raise the throughput by IOT_ADAPT_GAIN the CPUs or the disks are the
+ *   limit, so go back and do not try again for IOT_ADAPT_BACKOFF windows
+ * - waits well below the target with the workers mostly idle mean there
+ *   are more than needed, drop an eighth; the surplus exits as soon as it
+ *   runs out of work
+ *
+ * Long waits with idle workers come from the per priority limits rather
+ * than from the thread count, that is left alone. So is least priority,
+ * which is throttled on purpose.
+ */
+static void
+__iot_adapt (iot_conf_t *conf, uint64_t now)
+{
+        iot_stats_t     total[IOT_PRI_MAX];
+        iot_worker_t   *worker  = NULL;
+        uint64_t        window  = 0;
+        uint64_t        served  = 0;
+        uint64_t        busy    = 0;
+        uint64_t        done    = 0;
+        uint64_t        wait    = 0;
+        int32_t         target  = 0;
+        int32_t         step    = 0;
+        int             i       = 0;
+
+        GF_ATOMIC_INIT (conf->adapt_next, now + IOT_ADAPT_WINDOW);
+
+        window = now - conf->adapt_last;
+        conf->adapt_last = now;
+
+        memcpy (total, conf->retired, sizeof (total));
+        list_for_each_entry (worker, &conf->workers, list) {
+                for (i = 0; i < IOT_PRI_MAX; i++) {
+                        total[i].served += worker->stats[i].served;
+                        total[i].wait_ns += worker->stats[i].wait_ns;
+                        total[i].busy_ns += worker->stats[i].busy_ns;
                 }
-        } else {
-                ctx = NULL;
         }
-        if (!ctx) {
-                ctx = &conf->no_client[pri];
+
+        for (i = 0; i < IOT_PRI_MAX; i++) {
+                served = total[i].served - conf->adapt_seen[i].served;
+                done += served;
+                busy += total[i].busy_ns - conf->adapt_seen[i].busy_ns;
+                if (served) {
+                        conf->wait_usec[i] = (total[i].wait_ns -
+                                              conf->adapt_seen[i].wait_ns) /
+                                             served / 1000;
+                        conf->service_usec[i] = (total[i].busy_ns -
+                                                 conf->adapt_seen[i].busy_ns) /
+                                                served / 1000;
+                } else {
+                        conf->wait_usec[i] = 0;
+                        conf->service_usec[i] = 0;
+                }
+
+                if (i != IOT_PRI_LEAST && conf->wait_usec[i] > wait)
+                        wait = conf->wait_usec[i];
         }
+        memcpy (conf->adapt_seen, total, sizeof (total));
 
-        if (list_empty (&ctx->reqs)) {
-                list_add_tail (&ctx->clients, &conf->clients[pri]);
+        if (!window || !conf->curr_count)
+                return;
+
+        conf->utilization = min (busy * 100 / (window * conf->curr_count),
+                                 100);
+        conf->rate = done * GIGA / window;
+
+        if (conf->backoff)
+                conf->backoff--;
+
+        target = conf->target_count;
+        if (conf->grow_from && conf->rate * 100 <
+            conf->grow_rate * (100 + IOT_ADAPT_GAIN)) {
+                target = conf->grow_from;
+                conf->backoff = IOT_ADAPT_BACKOFF;
+        } else if (wait > (uint64_t)conf->latency_target &&
+                   conf->utilization >= IOT_ADAPT_BUSY && !conf->backoff) {
+                step = max (target / 2, 1);
+                target = min (target + step, conf->max_count);
+        } else if (wait < (uint64_t)conf->latency_target / 4 &&
+                   conf->utilization < IOT_ADAPT_IDLE) {
+                step = max (target / 8, 1);
+                target = max (target - step, conf->min_count);
         }
-        list_add_tail (&stub->list, &ctx->reqs);
 
-        conf->queue_size++;
-        conf->queue_sizes[pri]++;
+        conf->grow_from = 0;
+        if (target > conf->target_count) {
+                conf->grow_from = conf->target_count;
+                conf->grow_rate = conf->rate;
+        }
+
+        if (target == conf->target_count) {
+                conf->adapt_action = IOT_ADAPT_HOLD;
+                return;
+        }
+
+        if (target > conf->target_count) {
+                conf->adapt_action = IOT_ADAPT_GROW;
+                conf->grown++;
+        } else {
+                conf->adapt_action = IOT_ADAPT_SHRINK;
+                conf->shrunk++;
+        }
+        snprintf (conf->adapt_reason, sizeof (conf->adapt_reason),
+                  "%d -> %d threads, queue wait %"PRIu64"us with %d%% "
+                  "busy (target %dus), %"PRIu64" req/s%s",
+                  conf->target_count, target, wait, conf->utilization,
+                  conf->latency_target, conf->rate,
+                  conf->backoff == IOT_ADAPT_BACKOFF ? ", no gain" : "");
+        gf_msg_debug (conf->this->name, 0, "%s: %s",
+                      iot_adapt_action_name (conf->adapt_action),
+                      conf->adapt_reason);
+
+        conf->target_count = target;
+        if (conf->adapt_action == IOT_ADAPT_GROW)
+                __iot_workers_scale (conf);
+}
+
+
+/* Runs @stub and, when sizing adaptively, accounts how long it waited and
+ * kept us busy. */
+static void
+iot_run (iot_worker_t *worker, call_stub_t *stub, int pri)
+{
+        iot_conf_t      *conf   = worker->conf;
+        iot_stats_t     *stats  = &worker->stats[pri];
+        struct timespec  ts     = {0, };
+        uint64_t         queued = stub->enqueued;
+        uint64_t         start  = 0;
+        uint64_t         now    = 0;
+
+        if (!conf->adaptive || !queued) {
+                call_resume (stub);
+                GF_ATOMIC_DEC (conf->ac_iot_count[pri]);
+                return;
+        }
+
+        timespec_now (&ts);
+        start = TS (ts);
+        if (start > queued)
+                stats->wait_ns += start - queued;
+
+        call_resume (stub);
+        GF_ATOMIC_DEC (conf->ac_iot_count[pri]);
+
+        timespec_now (&ts);
+        now = TS (ts);
+        stats->busy_ns += now - start;
+        stats->served++;
+
+        if (now < GF_ATOMIC_GET (conf->adapt_next))
+                return;
+
+        /* whoever gets there first runs it, the others go on working */
+        if (pthread_mutex_trylock (&conf->mutex) == 0) {
+                if (now >= GF_ATOMIC_GET (conf->adapt_next))
+                        __iot_adapt (conf, now);
+                pthread_mutex_unlock (&conf->mutex);
+        }
 }
 
 
 void *
 iot_worker (void *data)
 {
+        iot_worker_t     *worker = NULL;
         iot_conf_t       *conf = NULL;
         xlator_t         *this = NULL;
         call_stub_t      *stub = NULL;
         struct timespec   sleep_till = {0, };
         int               ret = 0;
         int               pri = -1;
+        int               i = 0;
         gf_boolean_t      bye = _gf_false;
 
-        conf = data;
+        worker = data;
+        conf = worker->conf;
         this = conf->this;
         THIS = this;
 
         for (;;) {
+                stub = NULL;
+                if (conf->curr_count <= iot_thread_cap (conf))
+                        stub = iot_dequeue (conf, worker->home, &pri);
+                if (stub) {
+                        iot_run (worker, stub, pri);
+                        continue;
+                }
+
                 pthread_mutex_lock (&conf->mutex);
                 {
-                        if (pri != -1) {
-                                conf->ac_iot_count[pri]--;
-                                pri = -1;
-                        }
-                        while (conf->queue_size == 0) {
+                        /* Count ourselves as sleeping before looking once
+                         * more, so that a request queued meanwhile is
+                         * either seen here or wakes us up. */
+                        GF_ATOMIC_INC (conf->sleep_count);
+                        for (;;) {
+                                /* the controller wants fewer of us */
+                                if (conf->curr_count > iot_thread_cap (conf)) {
+                                        bye = _gf_true;
+                                        break;
+                                }
+
+                                stub = iot_dequeue (conf, worker->home, &pri);
+                                if (stub)
+                                        break;
+
                                 if (conf->down) {
-                                        bye = _gf_true;/*Avoid sleep*/
+                                        bye = _gf_true;
                                         break;
                                 }
 
@@ -190,45 +469,57 @@ iot_worker (void *data)
                                                &sleep_till);
                                 sleep_till.tv_sec += conf->idle_time;
 
-                                conf->sleep_count++;
-                                ret = pthread_cond_timedwait (&conf->cond,
-                                                              &conf->mutex,
-                                                              &sleep_till);
-                                conf->sleep_count--;
-
-                                if (conf->down || ret == ETIMEDOUT) {
+                                worker->woken = _gf_false;
+                                list_add (&worker->idle, &conf->idle_workers);
+                                ret = 0;
+                                while (!worker->woken && !conf->down &&
+                                       ret != ETIMEDOUT)
+                                        ret = pthread_cond_timedwait (
+                                                &worker->cond, &conf->mutex,
+                                                &sleep_till);
+                                list_del_init (&worker->idle);
+
+                                if (!worker->woken && ret == ETIMEDOUT &&
+                                    conf->curr_count > IOT_MIN_THREADS) {
                                         bye = _gf_true;
                                         break;
                                 }
                         }
+                        GF_ATOMIC_DEC (conf->sleep_count);
 
                         if (bye) {
-                                if (conf->down || conf->curr_count > IOT_MIN_THREADS) {
-                                        conf->curr_count--;
-                                        if (conf->curr_count == 0)
-                                           pthread_cond_broadcast (&conf->cond);
-                                        gf_msg_debug (conf->this->name, 0,
-                                                      "terminated. "
-                                                      "conf->curr_count=%d",
-                                                      conf->curr_count);
-                                } else {
-                                        bye = _gf_false;
+                                for (i = 0; i < IOT_PRI_MAX; i++) {
+                                        conf->retired[i].served +=
+                                                worker->stats[i].served;
+                                        conf->retired[i].wait_ns +=
+                                                worker->stats[i].wait_ns;
+                                        conf->retired[i].busy_ns +=
+                                                worker->stats[i].busy_ns;
                                 }
+                                list_del_init (&worker->list);
+                                conf->curr_count--;
+                                if (conf->curr_count == 0)
+                                        pthread_cond_broadcast (&conf->cond);
+                                gf_msg_debug (conf->this->name, 0,
+                                              "terminated. "
+                                              "conf->curr_count=%d",
+                                              conf->curr_count);
                         }
-
-                        if (!bye)
-                                stub = __iot_dequeue (conf, &pri);
                 }
                 pthread_mutex_unlock (&conf->mutex);
 
-                if (stub) /* guard against spurious wakeups */
-                        call_resume (stub);
-                stub = NULL;
+                if (stub) {
+                        iot_run (worker, stub, pri);
+                        stub = NULL;
+                }
 
                 if (bye)
                         break;
         }
 
+        pthread_cond_destroy (&worker->cond);
+        GF_FREE (worker);
+
         return NULL;
 }
 
@@ -236,17 +527,41 @@ iot_worker (void *data)
 int
 do_iot_schedule (iot_conf_t *conf, call_stub_t *stub, int pri)
 {
-        int   ret = 0;
+        client_t                *client = stub->frame->root->client;
+        iot_client_ctx_t        *ctx    = NULL;
+        iot_queue_t             *queue  = NULL;
+        struct timespec          now    = {0, };
+        int                      ret    = 0;
 
-        pthread_mutex_lock (&conf->mutex);
-        {
-                __iot_enqueue (conf, stub, pri);
+        if (pri < 0 || pri >= IOT_PRI_MAX)
+                pri = IOT_PRI_MAX-1;
 
-                pthread_cond_signal (&conf->cond);
+        if (client) {
+                ctx = iot_get_ctx (THIS, client);
+                if (ctx) {
+                        ctx = &ctx[pri];
+                        queue = ctx->queue;
+                }
+        }
+        if (!ctx) {
+                queue = iot_next_queue (conf);
+                ctx = &queue->no_client[pri];
+        }
 
-                ret = __iot_workers_scale (conf);
+        if (conf->adaptive) {
+                timespec_now (&now);
+                stub->enqueued = TS (now);
         }
-        pthread_mutex_unlock (&conf->mutex);
+
+        pthread_mutex_lock (&queue->lock);
+        {
+                __iot_enqueue (conf, queue, ctx, stub, pri);
+        }
+        pthread_mutex_unlock (&queue->lock);
+
+        if (!iot_wake_worker (conf, queue) &&
+            conf->curr_count < iot_thread_cap (conf))
+                ret = iot_workers_scale (conf);
 
         return ret;
 }
@@ -786,21 +1101,23 @@ iot_setactivelk (call_frame_t *frame, xlator_t *this, loc_t *loc,
 int
 __iot_workers_scale (iot_conf_t *conf)
 {
-        int       scale = 0;
-        int       diff = 0;
-        pthread_t thread;
-        int       ret = 0;
-        int       i = 0;
-        char      thread_name[GF_THREAD_NAMEMAX] = {0,};
+        int           scale = 0;
+        int           diff = 0;
+        pthread_t     thread;
+        iot_worker_t *worker = NULL;
+        int           ret = 0;
+        int           i = 0;
+        char          thread_name[GF_THREAD_NAMEMAX] = {0,};
 
         for (i = 0; i < IOT_PRI_MAX; i++)
-                scale += min (conf->queue_sizes[i], conf->ac_iot_limit[i]);
+                scale += min (GF_ATOMIC_GET (conf->queue_sizes[i]),
+                              conf->ac_iot_limit[i]);
 
         if (scale < IOT_MIN_THREADS)
                 scale = IOT_MIN_THREADS;
 
-        if (scale > conf->max_count)
-                scale = conf->max_count;
+        if (scale > iot_thread_cap (conf))
+                scale = iot_thread_cap (conf);
 
         if (conf->curr_count < scale) {
                 diff = scale - conf->curr_count;
@@ -809,17 +1126,32 @@ __iot_workers_scale (iot_conf_t *conf)
         while (diff) {
                 diff --;
 
+                worker = GF_CALLOC (1, sizeof (*worker), gf_iot_mt_worker_t);
+                if (!worker)
+                        break;
+
+                INIT_LIST_HEAD (&worker->list);
+                INIT_LIST_HEAD (&worker->idle);
+                pthread_cond_init (&worker->cond, NULL);
+                worker->conf = conf;
+                worker->home = &conf->queues[conf->curr_count %
+                                             conf->queue_count];
+
                 snprintf (thread_name, sizeof(thread_name),
                           "%s%d", "iotwr", conf->curr_count);
                 ret = gf_thread_create (&thread, &conf->w_attr, iot_worker,
-                                        conf, thread_name);
+                                        worker, thread_name);
                 if (ret == 0) {
+                        list_add_tail (&worker->list, &conf->workers);
                         conf->curr_count++;
                         gf_msg_debug (conf->this->name, 0,
-                                      "scaled threads to %d (queue_size=%d/%d)",
-                                      conf->curr_count,
-                                      conf->queue_size, scale);
+                                      "scaled threads to %d (queue_size=%"
+                                      PRId64"/%d)", conf->curr_count,
+                                      GF_ATOMIC_GET (conf->queue_size),
+                                      scale);
                 } else {
+                        pthread_cond_destroy (&worker->cond);
+                        GF_FREE (worker);
                         break;
                 }
         }
@@ -901,7 +1233,10 @@ int
 iot_priv_dump (xlator_t *this)
 {
         iot_conf_t     *conf   =   NULL;
+        iot_queue_t    *queue  =   NULL;
         char           key_prefix[GF_DUMP_MAX_BUF_LEN];
+        char           key[GF_DUMP_MAX_BUF_LEN];
+        int            i       =   0;
 
         if (!this)
                 return 0;
@@ -917,7 +1252,8 @@ iot_priv_dump (xlator_t *this)
 
         gf_proc_dump_write("maximum_threads_count", "%d", conf->max_count);
         gf_proc_dump_write("current_threads_count", "%d", conf->curr_count);
-        gf_proc_dump_write("sleep_count", "%d", conf->sleep_count);
+        gf_proc_dump_write("sleep_count", "%"PRId64,
+                           GF_ATOMIC_GET (conf->sleep_count));
         gf_proc_dump_write("idle_time", "%d", conf->idle_time);
         gf_proc_dump_write("stack_size", "%zd", conf->stack_size);
         gf_proc_dump_write("high_priority_threads", "%d",
@@ -928,10 +1264,144 @@ iot_priv_dump (xlator_t *this)
                            conf->ac_iot_limit[IOT_PRI_LO]);
         gf_proc_dump_write("least_priority_threads", "%d",
                            conf->ac_iot_limit[IOT_PRI_LEAST]);
+        gf_proc_dump_write("queue_size", "%"PRId64,
+                           GF_ATOMIC_GET (conf->queue_size));
+        gf_proc_dump_write("queue_count", "%d", conf->queue_count);
+        gf_proc_dump_write("adaptive", "%d", conf->adaptive);
+
+        /* the statedump should not wait for the workers, skip what is
+           busy */
+        if (conf->adaptive && pthread_mutex_trylock (&conf->mutex) == 0) {
+                gf_proc_dump_write ("minimum_threads_count", "%d",
+                                    conf->min_count);
+                gf_proc_dump_write ("target_threads_count", "%d",
+                                    conf->target_count);
+                gf_proc_dump_write ("latency_target_usec", "%d",
+                                    conf->latency_target);
+                gf_proc_dump_write ("queue_wait_usec",
+                                    "%"PRIu64"/%"PRIu64"/%"PRIu64"/%"PRIu64,
+                                    conf->wait_usec[IOT_PRI_HI],
+                                    conf->wait_usec[IOT_PRI_NORMAL],
+                                    conf->wait_usec[IOT_PRI_LO],
+                                    conf->wait_usec[IOT_PRI_LEAST]);
+                gf_proc_dump_write ("service_usec",
+                                    "%"PRIu64"/%"PRIu64"/%"PRIu64"/%"PRIu64,
+                                    conf->service_usec[IOT_PRI_HI],
+                                    conf->service_usec[IOT_PRI_NORMAL],
+                                    conf->service_usec[IOT_PRI_LO],
+                                    conf->service_usec[IOT_PRI_LEAST]);
+                gf_proc_dump_write ("utilization", "%d%%", conf->utilization);
+                gf_proc_dump_write ("requests_per_sec", "%"PRIu64, conf->rate);
+                gf_proc_dump_write ("last_action", "%s",
+                                    iot_adapt_action_name (conf->adapt_action));
+                gf_proc_dump_write ("last_change", "%s", conf->adapt_reason);
+                gf_proc_dump_write ("grown", "%"PRIu64, conf->grown);
+                gf_proc_dump_write ("shrunk", "%"PRIu64, conf->shrunk);
+                pthread_mutex_unlock (&conf->mutex);
+        }
+
+        for (i = 0; i < conf->queue_count; i++) {
+                queue = &conf->queues[i];
+
+                if (pthread_mutex_trylock (&queue->lock))
+                        continue;
+
+                gf_proc_dump_build_key (key, "queue", "%d.size", i);
+                gf_proc_dump_write (key, "%d/%d/%d/%d",
+                                    queue->sizes[IOT_PRI_HI],
+                                    queue->sizes[IOT_PRI_NORMAL],
+                                    queue->sizes[IOT_PRI_LO],
+                                    queue->sizes[IOT_PRI_LEAST]);
+                gf_proc_dump_build_key (key, "queue", "%d.dequeued", i);
+                gf_proc_dump_write (key, "%"PRIu64, queue->dequeued);
+                gf_proc_dump_build_key (key, "queue", "%d.stolen", i);
+                gf_proc_dump_write (key, "%"PRIu64, queue->stolen);
+                pthread_mutex_unlock (&queue->lock);
+        }
 
         return 0;
 }
 
+/* The adaptive sizing state, for io-stats to log along with its own. */
+int
+iot_priv_to_dict (xlator_t *this, dict_t *dict)
+{
+        iot_conf_t     *conf   = NULL;
+        char            key[32];
+        int             ret    = -1;
+        int             i      = 0;
+
+        conf = this->private;
+        if (!conf)
+                return 0;
+
+        pthread_mutex_lock (&conf->mutex);
+        {
+                ret = dict_set_int32 (dict, "current_threads_count",
+                                      conf->curr_count);
+                if (ret || !conf->adaptive)
+                        goto unlock;
+
+                ret = dict_set_int32 (dict, "target_threads_count",
+                                      conf->target_count);
+                if (ret)
+                        goto unlock;
+
+                for (i = 0; i < IOT_PRI_MAX; i++) {
+                        snprintf (key, sizeof (key), "%s.queue_wait_usec",
+                                  iot_get_pri_meaning (i));
+                        ret = dict_set_uint64 (dict, key, conf->wait_usec[i]);
+                        if (ret)
+                                goto unlock;
+
+                        snprintf (key, sizeof (key), "%s.service_usec",
+                                  iot_get_pri_meaning (i));
+                        ret = dict_set_uint64 (dict, key,
+                                               conf->service_usec[i]);
+                        if (ret)
+                                goto unlock;
+                }
+
+                ret = dict_set_int32 (dict, "utilization", conf->utilization);
+                if (ret)
+                        goto unlock;
+
+                ret = dict_set_uint64 (dict, "requests_per_sec", conf->rate);
+                if (ret)
+                        goto unlock;
+
+                ret = dict_set_str (dict, "last_action",
+                                    (char *)iot_adapt_action_name (
+                                            conf->adapt_action));
+                if (ret)
+                        goto unlock;
+
+                ret = dict_set_dynstr_with_alloc (dict, "last_change",
+                                                  conf->adapt_reason);
+        }
+unlock:
+        pthread_mutex_unlock (&conf->mutex);
+
+        return ret;
+}
+
+static void
+iot_adapt_reset (iot_conf_t *conf)
+{
+        if (conf->min_count > conf->max_count)
+                conf->min_count = conf->max_count;
+
+        if (!conf->adaptive) {
+                conf->target_count = conf->max_count;
+                return;
+        }
+
+        if (conf->target_count < conf->min_count)
+                conf->target_count = conf->min_count;
+        if (conf->target_count > conf->max_count)
+                conf->target_count = conf->max_count;
+}
+
 int
 reconfigure (xlator_t *this, dict_t *options)
 {
@@ -960,18 +1430,81 @@ reconfigure (xlator_t *this, dict_t *options)
         GF_OPTION_RECONF ("enable-least-priority", conf->least_priority,
                           options, bool, out);
 
+        GF_OPTION_RECONF ("adaptive-threads", conf->adaptive, options, bool,
+                          out);
+        GF_OPTION_RECONF ("min-thread-count", conf->min_count, options,
+                          int32, out);
+        GF_OPTION_RECONF ("latency-target", conf->latency_target, options,
+                          int32, out);
+
+        pthread_mutex_lock (&conf->mutex);
+        {
+                iot_adapt_reset (conf);
+        }
+        pthread_mutex_unlock (&conf->mutex);
+
 	ret = 0;
 out:
 	return ret;
 }
 
 
+/* About one queue per CPU, more queues than workers would only make
+ * them steal all the time. */
+static int
+iot_queues_init (iot_conf_t *conf)
+{
+        iot_queue_t *queue = NULL;
+        long         cpus  = 0;
+        int          i     = 0;
+        int          j     = 0;
+
+        cpus = sysconf (_SC_NPROCESSORS_ONLN);
+        if (cpus < 1)
+                cpus = 1;
+
+        conf->queue_count = min (cpus, conf->max_count);
+        conf->queues = GF_CALLOC (conf->queue_count, sizeof (*conf->queues),
+                                  gf_iot_mt_queue_t);
+        if (!conf->queues)
+                return -1;
+
+        for (i = 0; i < conf->queue_count; i++) {
+                queue = &conf->queues[i];
+
+                pthread_mutex_init (&queue->lock, NULL);
+                for (j = 0; j < IOT_PRI_MAX; j++) {
+                        INIT_LIST_HEAD (&queue->clients[j]);
+                        INIT_LIST_HEAD (&queue->no_client[j].clients);
+                        INIT_LIST_HEAD (&queue->no_client[j].reqs);
+                        queue->no_client[j].queue = queue;
+                }
+        }
+
+        return 0;
+}
+
+static void
+iot_queues_fini (iot_conf_t *conf)
+{
+        int i = 0;
+
+        if (!conf->queues)
+                return;
+
+        for (i = 0; i < conf->queue_count; i++)
+                pthread_mutex_destroy (&conf->queues[i].lock);
+
+        GF_FREE (conf->queues);
+        conf->queues = NULL;
+}
+
 int
 init (xlator_t *this)
 {
-        iot_conf_t *conf = NULL;
-        int         ret  = -1;
-        int         i    = 0;
+        iot_conf_t      *conf = NULL;
+        struct timespec  now  = {0, };
+        int              ret  = -1;
 
 	if (!this->children || this->children->next) {
 		gf_msg ("io-threads", GF_LOG_ERROR, 0,
@@ -1031,12 +1564,24 @@ init (xlator_t *this)
         GF_OPTION_INIT ("enable-least-priority", conf->least_priority,
                         bool, out);
 
+        GF_OPTION_INIT ("adaptive-threads", conf->adaptive, bool, out);
+        GF_OPTION_INIT ("min-thread-count", conf->min_count, int32, out);
+        GF_OPTION_INIT ("latency-target", conf->latency_target, int32, out);
+        conf->target_count = conf->min_count;
+        iot_adapt_reset (conf);
+        timespec_now (&now);
+        conf->adapt_last = TS (now);
+        GF_ATOMIC_INIT (conf->adapt_next, conf->adapt_last + IOT_ADAPT_WINDOW);
+
         conf->this = this;
+        INIT_LIST_HEAD (&conf->workers);
+        INIT_LIST_HEAD (&conf->idle_workers);
 
-        for (i = 0; i < IOT_PRI_MAX; i++) {
-                INIT_LIST_HEAD (&conf->clients[i]);
-                INIT_LIST_HEAD (&conf->no_client[i].clients);
-                INIT_LIST_HEAD (&conf->no_client[i].reqs);
+        ret = iot_queues_init (conf);
+        if (ret) {
+                gf_msg (this->name, GF_LOG_ERROR, ENOMEM,
+                        IO_THREADS_MSG_NO_MEMORY, "out of memory");
+                goto out;
         }
 
 	ret = iot_workers_scale (conf);
@@ -1051,8 +1596,10 @@ init (xlator_t *this)
 	this->private = conf;
         ret = 0;
 out:
-        if (ret)
+        if (ret && conf) {
+                iot_queues_fini (conf);
                 GF_FREE (conf);
+        }
 
 	return ret;
 }
@@ -1060,11 +1607,14 @@ out:
 static void
 iot_exit_threads (iot_conf_t *conf)
 {
+        iot_worker_t *worker = NULL;
+
         pthread_mutex_lock (&conf->mutex);
         {
                 conf->down = _gf_true;
                 /*Let all the threads know that xl is going down*/
-                pthread_cond_broadcast (&conf->cond);
+                list_for_each_entry (worker, &conf->idle_workers, idle)
+                        pthread_cond_signal (&worker->cond);
                 while (conf->curr_count)/*Wait for threads to exit*/
                         pthread_cond_wait (&conf->cond, &conf->mutex);
         }
@@ -1102,6 +1652,7 @@ fini (xlator_t *this)
         if (conf->mutex_inited)
                 pthread_mutex_destroy (&conf->mutex);
 
+        iot_queues_fini (conf);
 	GF_FREE (conf);
 
 	this->private = NULL;
@@ -1123,6 +1674,7 @@ iot_client_destroy (xlator_t *this, client_t *client)
 
 struct xlator_dumpops dumpops = {
         .priv    = iot_priv_dump,
+        .priv_to_dict = iot_priv_to_dict,
 };
 
 struct xlator_fops fops = {
@@ -1255,6 +1807,39 @@ struct volume_options options[] = {
          .max   = 0x7fffffff,
          .default_value = "120",
         },
+        { .key  = {"adaptive-threads"},
+          .type = GF_OPTION_TYPE_BOOL,
+          .default_value = "off",
+          .op_version = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .tags = {"io-threads"},
+          .description = "Size the thread pool by queueing latency: start "
+                         "with min-thread-count threads and add or remove "
+                         "them, up to thread-count, to keep the time "
+                         "requests wait for a thread under latency-target"
+        },
+        { .key  = {"min-thread-count"},
+          .type = GF_OPTION_TYPE_INT,
+          .min  = IOT_MIN_THREADS,
+          .max  = IOT_MAX_THREADS,
+          .default_value = "1",
+          .op_version = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .tags = {"io-threads"},
+          .description = "Number of threads adaptive-threads does not go "
+                         "below"
+        },
+        { .key  = {"latency-target"},
+          .type = GF_OPTION_TYPE_INT,
+          .min  = 1,
+          .max  = 10000000,
+          .default_value = "1000",
+          .op_version = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .tags = {"io-threads"},
+          .description = "Time in microseconds requests should at most wait "
+                         "for a thread when adaptive-threads is on"
+        },
 	{ .key  = {NULL},
         },
 };
@@ -39,6 +39,13 @@ struct iot_conf;
 
 #define IOT_THREAD_STACK_SIZE   ((size_t)(256*1024))
 
+#define IOT_ADAPT_WINDOW        (200 * 1000 * 1000)     /* In nsecs. */
+#define IOT_ADAPT_BUSY          75      /* % busy before adding threads */
+#define IOT_ADAPT_IDLE          50      /* % busy before removing them */
+#define IOT_ADAPT_GAIN          5       /* % more throughput a grow must buy */
+#define IOT_ADAPT_BACKOFF       25      /* windows not to grow after one that
+                                           did not pay off */
+
 
 typedef enum {
         IOT_PRI_HI = 0, /* low latency */
@@ -48,37 +55,106 @@ typedef enum {
         IOT_PRI_MAX,
 } iot_pri_t;
 
+struct iot_queue;
+
 typedef struct {
         struct list_head        clients;
         struct list_head        reqs;
+        struct iot_queue       *queue;  /* where this client's requests go */
 } iot_client_ctx_t;
 
+/*
+ * Requests are spread over a few queues, about one per CPU, each with a
+ * lock of its own. Every client sticks to one queue so the round robin
+ * between clients still holds. A worker serves the queue it was started
+ * on and steals from the others, highest priority first, when there is
+ * nothing left at home.
+ */
+typedef struct iot_queue {
+        pthread_mutex_t      lock;
+        struct list_head     clients[IOT_PRI_MAX];
+        /*
+         * It turns out that there are several ways a frame can get to us
+         * without having an associated client (server_first_lookup was the
+         * first one I hit).  Instead of trying to update all such callers,
+         * we use this to queue them.
+         */
+        iot_client_ctx_t     no_client[IOT_PRI_MAX];
+        int32_t              sizes[IOT_PRI_MAX];
+        uint64_t             dequeued;
+        uint64_t             stolen;    /* taken by workers from elsewhere */
+} iot_queue_t;
+
+/* What a worker accounts per priority for the adaptive sizing. Only the
+ * worker writes it, the controller reads it without locking. */
+typedef struct {
+        uint64_t             served;
+        uint64_t             wait_ns;   /* queued until picked up */
+        uint64_t             busy_ns;   /* spent in call_resume() */
+} iot_stats_t;
+
+typedef enum {
+        IOT_ADAPT_HOLD = 0,
+        IOT_ADAPT_GROW,
+        IOT_ADAPT_SHRINK,
+} iot_adapt_action_t;
+
+typedef struct iot_worker {
+        struct list_head     list;      /* on conf->workers */
+        struct list_head     idle;      /* on conf->idle_workers */
+        pthread_cond_t       cond;
+        struct iot_conf     *conf;
+        iot_queue_t         *home;
+        gf_boolean_t         woken;
+        iot_stats_t          stats[IOT_PRI_MAX];
+} iot_worker_t;
+
 struct iot_conf {
+        /* guards the thread counts and the idle workers */
         pthread_mutex_t      mutex;
         pthread_cond_t       cond;
 
         int32_t              max_count;   /* configured maximum */
         int32_t              curr_count;  /* actual number of threads running */
-        int32_t              sleep_count;
+        gf_atomic_t          sleep_count;
+        struct list_head     workers;
+        struct list_head     idle_workers;
 
         int32_t              idle_time;   /* in seconds */
 
-        struct list_head     clients[IOT_PRI_MAX];
-        /*
-         * It turns out that there are several ways a frame can get to us
-         * without having an associated client (server_first_lookup was the
-         * first one I hit).  Instead of trying to update all such callers,
-         * we use this to queue them.
-         */
-        iot_client_ctx_t     no_client[IOT_PRI_MAX];
+        iot_queue_t         *queues;
+        int32_t              queue_count;
+        gf_atomic_t          next_queue;
 
         int32_t              ac_iot_limit[IOT_PRI_MAX];
-        int32_t              ac_iot_count[IOT_PRI_MAX];
-        int                  queue_sizes[IOT_PRI_MAX];
-        int                  queue_size;
+        gf_atomic_t          ac_iot_count[IOT_PRI_MAX];
+        gf_atomic_t          queue_sizes[IOT_PRI_MAX];
+        gf_atomic_t          queue_size;
         pthread_attr_t       w_attr;
         gf_boolean_t         least_priority; /*Enable/Disable least-priority */
 
+        /* Adaptive sizing, see iot_adapt(). curr_count is kept within
+         * target_count, which moves between min_count and max_count. */
+        gf_boolean_t         adaptive;
+        int32_t              min_count;
+        int32_t              target_count;
+        int32_t              latency_target;    /* in usecs */
+        gf_atomic_t          adapt_next;        /* when to run it again */
+        uint64_t             adapt_last;
+        iot_stats_t          retired[IOT_PRI_MAX];  /* of exited workers */
+        iot_stats_t          adapt_seen[IOT_PRI_MAX];
+        uint64_t             wait_usec[IOT_PRI_MAX];    /* last window */
+        uint64_t             service_usec[IOT_PRI_MAX];
+        int32_t              utilization;       /* in % */
+        uint64_t             rate;              /* requests/s */
+        uint64_t             grow_rate;         /* rate before growing */
+        int32_t              grow_from;
+        int32_t              backoff;
+        iot_adapt_action_t   adapt_action;
+        char                 adapt_reason[128];
+        uint64_t             grown;
+        uint64_t             shrunk;
+
         xlator_t            *this;
         size_t               stack_size;
         gf_boolean_t         down; /*PARENT_DOWN event is notified*/
@@ -25,6 +25,7 @@
 #include "md-cache-messages.h"
 #include "statedump.h"
 #include "atomic.h"
+#include "hashfn.h"
 
 /* TODO:
    - cache symlink() link names and nuke symlink-cache
@@ -60,6 +61,21 @@ struct mdc_statistics {
                                     xlators requested for explicit lookup */
 };
 
+#define MDC_XATTR_BUCKETS 4096
+
+/*
+ * mdc_xattr_table - the cached xattr values. Equal values are stored once,
+ * the same posix ACL or selinux label is usually set on a great many files.
+ */
+struct mdc_xattr_table {
+        gf_lock_t          lock;
+        struct list_head  *buckets;
+        uint64_t           count;   /* values stored */
+        uint64_t           bytes;   /* memory they take */
+        uint64_t           shared;  /* bytes not stored again thanks to
+                                       sharing */
+};
+
 struct mdc_conf {
 	int  timeout;
 	gf_boolean_t cache_posix_acl;
@@ -75,6 +91,16 @@ struct mdc_conf {
         struct mdc_statistics mdc_counter;
         gf_boolean_t cache_statfs;
         struct mdc_statfs_cache statfs_cache;
+
+        /* xattrs cached for all the inodes are limited to cache_size bytes,
+         * those of the least recently used inodes are dropped first */
+        uint64_t cache_size;
+        gf_atomic_t cache_used;
+        gf_atomic_t evictions;
+        gf_lock_t lru_lock;
+        struct list_head lru;
+        uint64_t lru_count;
+        struct mdc_xattr_table xattrs;
 };
 
 
@@ -175,6 +201,8 @@ static struct mdc_key {
         }
 };
 
+#define MDC_KEY_COUNT (sizeof (mdc_keys) / sizeof (mdc_keys[0]) - 1)
+
 struct mdc_local;
 typedef struct mdc_local mdc_local_t;
 
@@ -205,8 +233,12 @@ struct md_cache {
         uint64_t      md_rdev;
         uint64_t      md_size;
         uint64_t      md_blocks;
-        dict_t       *xattr;
-        char         *linkname;
+        struct mdc_xattr **xattr;       /* by index in mdc_keys, allocated
+                                           only when a value is cached */
+        dict_t       *xattr_extra;      /* keys matched by prefix */
+        size_t        xa_size;          /* bytes against cache_size */
+        gf_boolean_t  xa_referenced;    /* used since the LRU scan passed */
+        struct list_head lru;
 	time_t        ia_time;
 	time_t        xa_time;
         gf_boolean_t  need_lookup;
@@ -214,6 +246,15 @@ struct md_cache {
 };
 
 
+/* one shared value, see struct mdc_xattr_table */
+struct mdc_xattr {
+        struct list_head  hash;
+        uint32_t          hashval;
+        uint32_t          refcount;
+        data_t           *value;
+};
+
+
 struct mdc_local {
         loc_t   loc;
         loc_t   loc2;
@@ -327,12 +368,239 @@ mdc_local_wipe (xlator_t *this, mdc_local_t *local)
 }
 
 
+#define MDC_XATTR_SIZE(len) (sizeof (struct mdc_xattr) + sizeof (data_t) + (len))
+
+/*
+ * mdc_xattr_get - the shared copy of @value, taking a reference on it.
+ */
+static struct mdc_xattr *
+mdc_xattr_get (xlator_t *this, data_t *value)
+{
+        struct mdc_conf  *conf    = this->private;
+        struct mdc_xattr *xattr   = NULL;
+        struct mdc_xattr *tmp     = NULL;
+        struct list_head *bucket  = NULL;
+        uint32_t          hashval = 0;
+        void             *copy    = NULL;
+
+        hashval = SuperFastHash (value->data, value->len);
+        bucket = &conf->xattrs.buckets[hashval % MDC_XATTR_BUCKETS];
+
+        LOCK (&conf->xattrs.lock);
+        {
+                list_for_each_entry (tmp, bucket, hash) {
+                        if ((tmp->hashval == hashval) &&
+                            (tmp->value->len == value->len) &&
+                            (tmp->value->data_type == value->data_type) &&
+                            (memcmp (tmp->value->data, value->data,
+                                     value->len) == 0)) {
+                                xattr = tmp;
+                                xattr->refcount++;
+                                conf->xattrs.shared += value->len;
+                                goto unlock;
+                        }
+                }
+
+                xattr = GF_CALLOC (1, sizeof (*xattr), gf_mdc_mt_mdc_xattr_t);
+                if (!xattr)
+                        goto unlock;
+
+                /* a copy of its own, value may point into a whole reply */
+                copy = gf_memdup (value->data, value->len);
+                if (copy)
+                        xattr->value = data_from_dynptr (copy, value->len);
+                if (!xattr->value) {
+                        GF_FREE (copy);
+                        GF_FREE (xattr);
+                        xattr = NULL;
+                        goto unlock;
+                }
+
+                xattr->value->data_type = value->data_type;
+                data_ref (xattr->value);
+
+                xattr->hashval = hashval;
+                xattr->refcount = 1;
+                list_add (&xattr->hash, bucket);
+
+                conf->xattrs.count++;
+                conf->xattrs.bytes += MDC_XATTR_SIZE (value->len);
+                GF_ATOMIC_ADD (conf->cache_used, MDC_XATTR_SIZE (value->len));
+        }
+unlock:
+        UNLOCK (&conf->xattrs.lock);
+
+        return xattr;
+}
+
+
+static void
+mdc_xattr_put (xlator_t *this, struct mdc_xattr *xattr)
+{
+        struct mdc_conf *conf    = this->private;
+        gf_boolean_t     destroy = _gf_false;
+
+        LOCK (&conf->xattrs.lock);
+        {
+                if (--xattr->refcount == 0) {
+                        list_del_init (&xattr->hash);
+                        conf->xattrs.count--;
+                        conf->xattrs.bytes -= MDC_XATTR_SIZE (xattr->value->len);
+                        GF_ATOMIC_SUB (conf->cache_used,
+                                       MDC_XATTR_SIZE (xattr->value->len));
+                        destroy = _gf_true;
+                } else {
+                        conf->xattrs.shared -= xattr->value->len;
+                }
+        }
+        UNLOCK (&conf->xattrs.lock);
+
+        if (destroy) {
+                data_unref (xattr->value);
+                GF_FREE (xattr);
+        }
+}
+
+
+static void
+mdc_xattr_slots_free (xlator_t *this, struct mdc_xattr **slots)
+{
+        int i = 0;
+
+        if (!slots)
+                return;
+
+        for (i = 0; i < MDC_KEY_COUNT; i++) {
+                if (slots[i])
+                        mdc_xattr_put (this, slots[i]);
+        }
+
+        GF_FREE (slots);
+}
+
+
+/* To be called with mdc->lock held, or when nobody else can see mdc */
+static void
+__mdc_xattr_drop (xlator_t *this, struct md_cache *mdc)
+{
+        mdc_xattr_slots_free (this, mdc->xattr);
+        mdc->xattr = NULL;
+
+        if (mdc->xattr_extra) {
+                dict_unref (mdc->xattr_extra);
+                mdc->xattr_extra = NULL;
+        }
+}
+
+
+/*
+ * __mdc_xattr_account - charge the memory now taken by the xattrs of mdc to
+ *                       the cache, and keep mdc in the LRU list when it has
+ *                       any. Returns whether the cache has grown too large.
+ *
+ * To be called with mdc->lock held.
+ */
+static gf_boolean_t
+__mdc_xattr_account (xlator_t *this, struct md_cache *mdc)
+{
+        struct mdc_conf *conf   = this->private;
+        size_t           size   = 0;
+        int              i      = 0;
+
+        if (mdc->xattr) {
+                for (i = 0; i < MDC_KEY_COUNT; i++) {
+                        if (mdc->xattr[i])
+                                break;
+                }
+                if (i == MDC_KEY_COUNT) {
+                        GF_FREE (mdc->xattr);
+                        mdc->xattr = NULL;
+                } else {
+                        size += MDC_KEY_COUNT * sizeof (*mdc->xattr);
+                }
+        }
+
+        if (mdc->xattr_extra) {
+                if (mdc->xattr_extra->count == 0) {
+                        dict_unref (mdc->xattr_extra);
+                        mdc->xattr_extra = NULL;
+                } else {
+                        size += sizeof (dict_t)
+                                + dict_serialized_length (mdc->xattr_extra);
+                }
+        }
+
+        GF_ATOMIC_ADD (conf->cache_used, (int64_t)size - mdc->xa_size);
+        mdc->xa_size = size;
+
+        LOCK (&conf->lru_lock);
+        {
+                if (size && list_empty (&mdc->lru)) {
+                        list_add_tail (&mdc->lru, &conf->lru);
+                        conf->lru_count++;
+                } else if (!size && !list_empty (&mdc->lru)) {
+                        list_del_init (&mdc->lru);
+                        conf->lru_count--;
+                }
+        }
+        UNLOCK (&conf->lru_lock);
+
+        return (conf->cache_size &&
+                (GF_ATOMIC_GET (conf->cache_used) > conf->cache_size));
+}
+
+
+/*
+ * mdc_lru_prune - drop the xattrs of the least recently used inodes until
+ *                 the cache fits cache_size again. An inode used since the
+ *                 last pass gets a second chance, the iatts stay cached.
+ */
+static void
+mdc_lru_prune (xlator_t *this)
+{
+        struct mdc_conf *conf = this->private;
+        struct md_cache *mdc  = NULL;
+        uint64_t         scan = 0;
+
+        LOCK (&conf->lru_lock);
+        {
+                scan = 2 * conf->lru_count;
+                while (scan-- && !list_empty (&conf->lru) &&
+                       (GF_ATOMIC_GET (conf->cache_used) > conf->cache_size)) {
+                        mdc = list_first_entry (&conf->lru, struct md_cache,
+                                                lru);
+
+                        if (mdc->xa_referenced || TRY_LOCK (&mdc->lock)) {
+                                mdc->xa_referenced = _gf_false;
+                                list_move_tail (&mdc->lru, &conf->lru);
+                                continue;
+                        }
+
+                        list_del_init (&mdc->lru);
+                        conf->lru_count--;
+
+                        __mdc_xattr_drop (this, mdc);
+                        mdc->xa_time = 0;
+
+                        GF_ATOMIC_SUB (conf->cache_used, mdc->xa_size);
+                        mdc->xa_size = 0;
+
+                        UNLOCK (&mdc->lock);
+
+                        GF_ATOMIC_INC (conf->evictions);
+                }
+        }
+        UNLOCK (&conf->lru_lock);
+}
+
+
 int
 mdc_inode_wipe (xlator_t *this, inode_t *inode)
 {
         int              ret = 0;
         uint64_t         mdc_int = 0;
         struct md_cache *mdc = NULL;
+        struct mdc_conf *conf = this->private;
 
         ret = inode_ctx_del (inode, this, &mdc_int);
         if (ret != 0)
@@ -340,10 +608,17 @@ mdc_inode_wipe (xlator_t *this, inode_t *inode)
 
         mdc = (void *) (long) mdc_int;
 
-        if (mdc->xattr)
-                dict_unref (mdc->xattr);
+        LOCK (&conf->lru_lock);
+        {
+                if (!list_empty (&mdc->lru)) {
+                        list_del_init (&mdc->lru);
+                        conf->lru_count--;
+                }
+        }
+        UNLOCK (&conf->lru_lock);
 
-        GF_FREE (mdc->linkname);
+        __mdc_xattr_drop (this, mdc);
+        GF_ATOMIC_SUB (conf->cache_used, mdc->xa_size);
 
         GF_FREE (mdc);
 
@@ -373,6 +648,7 @@ mdc_inode_prep (xlator_t *this, inode_t *inode)
                 }
 
                 LOCK_INIT (&mdc->lock);
+                INIT_LIST_HEAD (&mdc->lru);
 
                 ret = __mdc_inode_ctx_set (this, inode, mdc);
                 if (ret) {
@@ -632,7 +908,8 @@ out:
 }
 
 struct updatedict {
-	dict_t *dict;
+        xlator_t *this;
+	struct md_cache *mdc;
 	int ret;
 };
 
@@ -640,6 +917,8 @@ static int
 updatefn(dict_t *dict, char *key, data_t *value, void *data)
 {
 	struct updatedict *u = data;
+        struct md_cache *mdc = u->mdc;
+        struct mdc_xattr *xattr = NULL;
 	const char *mdc_key;
 	int i = 0;
 
@@ -655,14 +934,6 @@ updatefn(dict_t *dict, char *key, data_t *value, void *data)
 				continue;
 		}
 
-		if (!u->dict) {
-			u->dict = dict_new();
-			if (!u->dict) {
-				u->ret = -1;
-				return -1;
-			}
-		}
-
                 /* posix xlator as part of listxattr will send both names
                  * and values of the xattrs in the dict. But as per man page
                  * listxattr is mainly supposed to send names of the all the
@@ -682,45 +953,102 @@ updatefn(dict_t *dict, char *key, data_t *value, void *data)
                 if (value->len == 1 && value->data[0] == '\0')
                         continue;
 
-		if (dict_set(u->dict, key, value) < 0) {
+                if (mdc_keys[i].prefix_match) {
+                        /* the names vary, these keep a dict */
+                        if (!mdc->xattr_extra) {
+                                mdc->xattr_extra = dict_new ();
+                                if (!mdc->xattr_extra) {
+                                        u->ret = -1;
+                                        return -1;
+                                }
+                        }
+
+                        if (dict_set (mdc->xattr_extra, key, value) < 0) {
+                                u->ret = -1;
+                                return -1;
+                        }
+
+                        break;
+                }
+
+                if (!mdc->xattr) {
+                        mdc->xattr = GF_CALLOC (MDC_KEY_COUNT,
+                                                sizeof (*mdc->xattr),
+                                                gf_mdc_mt_mdc_xattr_slots);
+                        if (!mdc->xattr) {
+                                u->ret = -1;
+                                return -1;
+                        }
+                }
+
+                xattr = mdc_xattr_get (u->this, value);
+                if (!xattr) {
 			u->ret = -1;
 			return -1;
 		}
 
+                if (mdc->xattr[i])
+                        mdc_xattr_put (u->this, mdc->xattr[i]);
+                mdc->xattr[i] = xattr;
+
 		break;
 	}
         return 0;
 }
 
+/* To be called with mdc->lock held */
 static int
-mdc_dict_update(dict_t **tgt, dict_t *src)
+__mdc_xattr_update (xlator_t *this, struct md_cache *mdc, dict_t *src)
 {
 	struct updatedict u = {
-		.dict = *tgt,
+                .this = this,
+		.mdc = mdc,
 		.ret = 0,
 	};
 
 	dict_foreach(src, updatefn, &u);
 
-	if (*tgt)
-		return u.ret;
+	return u.ret;
+}
 
-	if ((u.ret < 0) && u.dict) {
-		dict_unref(u.dict);
-		return u.ret;
-	}
+/* To be called with mdc->lock held */
+static dict_t *
+__mdc_xattr_dict (struct md_cache *mdc)
+{
+        dict_t *dict = NULL;
+        int     i    = 0;
 
-	*tgt = u.dict;
+        dict = dict_new ();
+        if (!dict)
+                return NULL;
 
-	return u.ret;
+        for (i = 0; mdc->xattr && (i < MDC_KEY_COUNT); i++) {
+                if (!mdc->xattr[i])
+                        continue;
+
+                /* the value is shared, not copied */
+                if (dict_set (dict, (char *)mdc_keys[i].name,
+                              mdc->xattr[i]->value) < 0)
+                        goto err;
+        }
+
+        if (mdc->xattr_extra)
+                dict_copy (mdc->xattr_extra, dict);
+
+        return dict;
+err:
+        dict_unref (dict);
+        return NULL;
 }
 
 int
 mdc_inode_xatt_set (xlator_t *this, inode_t *inode, dict_t *dict)
 {
-        int              ret = -1;
-        struct md_cache *mdc = NULL;
-	dict_t		*newdict = NULL;
+        int                ret = -1;
+        struct md_cache   *mdc = NULL;
+        struct mdc_xattr **old = NULL;
+        dict_t            *old_extra = NULL;
+        gf_boolean_t       prune = _gf_false;
 
         mdc = mdc_inode_prep (this, inode);
         if (!mdc)
@@ -734,28 +1062,43 @@ mdc_inode_xatt_set (xlator_t *this, inode_t *inode, dict_t *dict)
 
         LOCK (&mdc->lock);
         {
-                if (mdc->xattr) {
+                if (mdc->xattr || mdc->xattr_extra) {
                         gf_msg_trace ("md-cache", 0, "deleting the old xattr "
                               "cache (%s)", uuid_utoa (inode->gfid));
-                        dict_unref (mdc->xattr);
-			mdc->xattr = NULL;
+                        /* released once the new values hold their
+                         * references, most of them are the same */
+                        old = mdc->xattr;
+                        old_extra = mdc->xattr_extra;
+                        mdc->xattr = NULL;
+                        mdc->xattr_extra = NULL;
 		}
 
-		ret = mdc_dict_update(&newdict, dict);
+		ret = __mdc_xattr_update (this, mdc, dict);
 		if (ret < 0) {
-			UNLOCK(&mdc->lock);
-			goto out;
-		}
-
-		if (newdict)
-			mdc->xattr = newdict;
-
-                time (&mdc->xa_time);
-                gf_msg_trace ("md-cache", 0, "xatt cache set for (%s) time:%lld",
-                              uuid_utoa (inode->gfid), (long long)mdc->xa_time);
+                        __mdc_xattr_drop (this, mdc);
+                        mdc->xa_time = 0;
+                } else {
+                        time (&mdc->xa_time);
+                        gf_msg_trace ("md-cache", 0, "xatt cache set for (%s) "
+                                      "time:%lld", uuid_utoa (inode->gfid),
+                                      (long long)mdc->xa_time);
+                }
 
+                mdc->xa_referenced = _gf_true;
+                prune = __mdc_xattr_account (this, mdc);
         }
         UNLOCK (&mdc->lock);
+
+        mdc_xattr_slots_free (this, old);
+        if (old_extra)
+                dict_unref (old_extra);
+
+        if (prune)
+                mdc_lru_prune (this);
+
+        if (ret < 0)
+                goto out;
+
         ret = 0;
 out:
         return ret;
@@ -767,6 +1110,7 @@ mdc_inode_xatt_update (xlator_t *this, inode_t *inode, dict_t *dict)
 {
         int              ret = -1;
         struct md_cache *mdc = NULL;
+        gf_boolean_t     prune = _gf_false;
 
         mdc = mdc_inode_prep (this, inode);
         if (!mdc)
@@ -777,14 +1121,20 @@ mdc_inode_xatt_update (xlator_t *this, inode_t *inode, dict_t *dict)
 
         LOCK (&mdc->lock);
         {
-		ret = mdc_dict_update(&mdc->xattr, dict);
-		if (ret < 0) {
-			UNLOCK(&mdc->lock);
-			goto out;
-		}
+		ret = __mdc_xattr_update (this, mdc, dict);
+		if (ret < 0)
+                        mdc->xa_time = 0;
+
+                prune = __mdc_xattr_account (this, mdc);
         }
         UNLOCK (&mdc->lock);
 
+        if (prune)
+                mdc_lru_prune (this);
+
+        if (ret < 0)
+                goto out;
+
         ret = 0;
 out:
         return ret;
@@ -796,21 +1146,41 @@ mdc_inode_xatt_unset (xlator_t *this, inode_t *inode, char *name)
 {
         int              ret = -1;
         struct md_cache *mdc = NULL;
+        int              i   = 0;
 
         mdc = mdc_inode_prep (this, inode);
         if (!mdc)
                 goto out;
 
-        if (!name || !mdc->xattr)
+        if (!name)
                 goto out;
 
         LOCK (&mdc->lock);
         {
-		dict_del (mdc->xattr, name);
+                if (!mdc->xattr && !mdc->xattr_extra)
+                        goto unlock;
+
+                for (i = 0; mdc_keys[i].name; i++) {
+                        if (!mdc_keys[i].prefix_match &&
+                            (strcmp (mdc_keys[i].name, name) == 0))
+                                break;
+                }
+
+                if (mdc_keys[i].name) {
+                        if (mdc->xattr && mdc->xattr[i]) {
+                                mdc_xattr_put (this, mdc->xattr[i]);
+                                mdc->xattr[i] = NULL;
+                        }
+                } else if (mdc->xattr_extra) {
+                        dict_del (mdc->xattr_extra, name);
+                }
+
+                (void) __mdc_xattr_account (this, mdc);
+                ret = 0;
         }
+unlock:
         UNLOCK (&mdc->lock);
 
-        ret = 0;
 out:
         return ret;
 }
@@ -840,14 +1210,19 @@ mdc_inode_xatt_get (xlator_t *this, inode_t *inode, dict_t **dict)
 		/* Missing xattr only means no keys were there, i.e
 		   a negative cache for the "loaded" keys
 		*/
-                if (!mdc->xattr) {
+                if (!mdc->xattr && !mdc->xattr_extra) {
                         gf_msg_trace ("md-cache", 0, "xattr not present (%s)",
                                       uuid_utoa (inode->gfid));
                         goto unlock;
                 }
 
-                if (dict)
-                        *dict = dict_ref (mdc->xattr);
+                mdc->xa_referenced = _gf_true;
+
+                if (dict) {
+                        *dict = __mdc_xattr_dict (mdc);
+                        if (!*dict)
+                                ret = -1;
+                }
         }
 unlock:
         UNLOCK (&mdc->lock);
@@ -2759,6 +3134,28 @@ mdc_priv_dump (xlator_t *this)
         gf_proc_dump_write("xattr_invalidations_received", "%"PRId64,
                            GF_ATOMIC_GET(conf->mdc_counter.xattr_invals));
 
+        gf_proc_dump_write("cache_size", "%"PRIu64, conf->cache_size);
+        gf_proc_dump_write("cache_used", "%"PRId64,
+                           GF_ATOMIC_GET(conf->cache_used));
+        gf_proc_dump_write("xattr_evictions", "%"PRId64,
+                           GF_ATOMIC_GET(conf->evictions));
+
+        if (TRY_LOCK(&conf->lru_lock) == 0) {
+                gf_proc_dump_write("inodes_with_xattrs", "%"PRIu64,
+                                   conf->lru_count);
+                UNLOCK(&conf->lru_lock);
+        }
+
+        if (TRY_LOCK(&conf->xattrs.lock) == 0) {
+                gf_proc_dump_write("xattr_values", "%"PRIu64,
+                                   conf->xattrs.count);
+                gf_proc_dump_write("xattr_value_bytes", "%"PRIu64,
+                                   conf->xattrs.bytes);
+                gf_proc_dump_write("xattr_bytes_shared", "%"PRIu64,
+                                   conf->xattrs.shared);
+                UNLOCK(&conf->xattrs.lock);
+        }
+
         return 0;
 }
 
@@ -3076,6 +3473,12 @@ reconfigure (xlator_t *this, dict_t *options)
         GF_OPTION_RECONF ("md-cache-statfs", conf->cache_statfs, options,
                           bool, out);
 
+        GF_OPTION_RECONF ("md-cache-size", conf->cache_size, options,
+                          size_uint64, out);
+        if (conf->cache_size &&
+            (GF_ATOMIC_GET (conf->cache_used) > conf->cache_size))
+                mdc_lru_prune (this);
+
 
 
         /* If timeout is greater than 60s (default before the patch that added
@@ -3108,6 +3511,7 @@ init (xlator_t *this)
 {
 	struct mdc_conf *conf = NULL;
         int    timeout = 0;
+        int    i = 0;
 
 	conf = GF_CALLOC (sizeof (*conf), 1, gf_mdc_mt_mdc_conf_t);
 	if (!conf) {
@@ -3160,6 +3564,26 @@ init (xlator_t *this)
         pthread_mutex_init (&conf->statfs_cache.lock, NULL);
         GF_OPTION_INIT ("md-cache-statfs", conf->cache_statfs, bool, out);
 
+        GF_OPTION_INIT ("md-cache-size", conf->cache_size, size_uint64, out);
+
+        LOCK_INIT (&conf->lru_lock);
+        INIT_LIST_HEAD (&conf->lru);
+        GF_ATOMIC_INIT (conf->cache_used, 0);
+        GF_ATOMIC_INIT (conf->evictions, 0);
+
+        LOCK_INIT (&conf->xattrs.lock);
+        conf->xattrs.buckets = GF_CALLOC (MDC_XATTR_BUCKETS,
+                                          sizeof (*conf->xattrs.buckets),
+                                          gf_common_mt_list_head);
+        if (!conf->xattrs.buckets) {
+                gf_msg (this->name, GF_LOG_ERROR, ENOMEM,
+                        MD_CACHE_MSG_NO_MEMORY, "out of memory");
+                GF_FREE (conf);
+                return -1;
+        }
+        for (i = 0; i < MDC_XATTR_BUCKETS; i++)
+                INIT_LIST_HEAD (&conf->xattrs.buckets[i]);
+
         LOCK_INIT (&conf->lock);
         time (&conf->last_child_down);
         /* initialize gf_atomic_t counters */
@@ -3242,6 +3666,11 @@ notify (xlator_t *this, int event, void *data, ...)
 void
 fini (xlator_t *this)
 {
+        struct mdc_conf *conf = this->private;
+
+        if (conf)
+                GF_FREE (conf->xattrs.buckets);
+
         GF_FREE (this->private);
 }
 
@@ -3346,5 +3775,16 @@ struct volume_options options[] = {
       .op_version = {GD_OP_VERSION_4_0_0},
       .flags = OPT_FLAG_SETTABLE,
     },
+        { .key = {"md-cache-size"},
+          .type = GF_OPTION_TYPE_SIZET,
+          .min = 0,
+          .max = 32 * GF_UNIT_GB,
+          .default_value = "64MB",
+          .op_version = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_CLIENT_OPT | OPT_FLAG_DOC,
+          .description = "Memory the cached xattrs of all the inodes may "
+                         "take. Past it, the xattrs of the least recently "
+                         "used inodes are dropped. 0 means no limit.",
+        },
     { .key = {NULL} },
 };
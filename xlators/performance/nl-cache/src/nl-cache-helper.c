@@ -11,6 +11,7 @@
 #include "nl-cache.h"
 #include "timer-wheel.h"
 #include "statedump.h"
+#include "syscall.h"
 
 /* Caching guidelines:
  * This xlator serves negative lookup(ENOENT lookups) from the cache,
@@ -228,6 +229,7 @@ __nlc_inode_clear_entries (xlator_t *this, nlc_ctx_t *nlc_ctx)
 
         nlc_ctx->cache_time = 0;
         nlc_ctx->state = 0;
+        nlc_ctx->stamp_state = NLC_STAMP_NONE;
         GF_ASSERT (nlc_ctx->cache_size == sizeof (*nlc_ctx));
         GF_ASSERT (nlc_ctx->refd_inodes == 0);
 out:
@@ -401,6 +403,61 @@ __nlc_set_dir_state (nlc_ctx_t *nlc_ctx, uint64_t new_state)
 }
 
 
+static gf_boolean_t
+nlc_stamp_match (nlc_stamp_t *stamp, struct iatt *buf)
+{
+        return ((stamp->ctime == buf->ia_ctime) &&
+                (stamp->ctime_nsec == buf->ia_ctime_nsec) &&
+                (stamp->mtime == buf->ia_mtime) &&
+                (stamp->mtime_nsec == buf->ia_mtime_nsec));
+}
+
+
+/* The entries of a directory can be saved in the snapshot only if they are
+ * known to be correct for the times they are saved with. Only the iatt from
+ * a lookup of the directory itself is trusted for that, cluster xlators
+ * merge it across their subvolumes (see dht_iatt_merge), unlike the parent
+ * iatts in replies of the entries. Hence the times are taken when no entry
+ * is cached yet, and the entries stay good for them as long as every later
+ * lookup of the directory returns the same ones. Anything else, a change
+ * made by this client included, means the entries are not saved till they
+ * are cleared. */
+void
+nlc_dir_stamp (xlator_t *this, inode_t *inode, struct iatt *buf)
+{
+        nlc_conf_t       *conf    = NULL;
+        nlc_ctx_t        *nlc_ctx = NULL;
+
+        conf = this->private;
+
+        /* Needs a ctx for every directory looked up, not worth it unless
+         * there is a snapshot to save */
+        if (!conf->snapshot_dir)
+                goto out;
+
+        nlc_inode_ctx_get_set (this, inode, &nlc_ctx, NULL);
+        if (!nlc_ctx)
+                goto out;
+
+        LOCK (&nlc_ctx->lock);
+        {
+                if (nlc_ctx->state == NLC_INVALID) {
+                        nlc_ctx->stamp.ctime = buf->ia_ctime;
+                        nlc_ctx->stamp.ctime_nsec = buf->ia_ctime_nsec;
+                        nlc_ctx->stamp.mtime = buf->ia_mtime;
+                        nlc_ctx->stamp.mtime_nsec = buf->ia_mtime_nsec;
+                        nlc_ctx->stamp_state = NLC_STAMP_VALID;
+                } else if ((nlc_ctx->stamp_state != NLC_STAMP_VALID) ||
+                           !nlc_stamp_match (&nlc_ctx->stamp, buf)) {
+                        nlc_ctx->stamp_state = NLC_STAMP_STALE;
+                }
+        }
+        UNLOCK (&nlc_ctx->lock);
+out:
+        return;
+}
+
+
 void
 nlc_set_dir_state (xlator_t *this, inode_t *inode, uint64_t state)
 {
@@ -941,6 +998,7 @@ nlc_dir_remove_pe (xlator_t *this, inode_t *parent, inode_t *entry_ino,
                 __nlc_del_pe (this, nlc_ctx, entry_ino, name, multilink);
                 __nlc_add_ne (this, nlc_ctx, name);
                 __nlc_set_dir_state (nlc_ctx, NLC_NE_VALID);
+                nlc_ctx->stamp_state = NLC_STAMP_STALE;
         }
 unlock:
         UNLOCK (&nlc_ctx->lock);
@@ -971,6 +1029,8 @@ nlc_dir_add_pe (xlator_t *this, inode_t *inode, inode_t *entry_ino,
                 __nlc_add_pe (this, nlc_ctx, entry_ino, name);
                 if (!IS_PE_VALID (nlc_ctx->state))
                         __nlc_set_dir_state (nlc_ctx, NLC_PE_PARTIAL);
+                /* the directory changed after its times were taken */
+                nlc_ctx->stamp_state = NLC_STAMP_STALE;
         }
         UNLOCK (&nlc_ctx->lock);
 out:
@@ -1195,6 +1255,7 @@ nlc_dump_inodectx (xlator_t *this, inode_t *inode)
                 gf_proc_dump_write ("cache-time", "%lld", nlc_ctx->cache_time);
                 gf_proc_dump_write ("cache-size", "%zu", nlc_ctx->cache_size);
                 gf_proc_dump_write ("refd-inodes", "%"PRIu64, nlc_ctx->refd_inodes);
+                gf_proc_dump_write ("stamp-state", "%d", nlc_ctx->stamp_state);
 
                 if (IS_PE_VALID (nlc_ctx->state))
                         list_for_each_entry_safe (pe, tmp, &nlc_ctx->pe, list) {
@@ -1217,3 +1278,522 @@ nlc_dump_inodectx (xlator_t *this, inode_t *inode)
 out:
         return;
 }
+
+
+/* Snapshot of the cache:
+ * On a graceful unmount (PARENT_DOWN) the negative and positive entries of
+ * every directory are written to a file in nl-cache-snapshot-dir, together
+ * with the ctime and mtime of the directory they are correct for (see
+ * nlc_dir_stamp). The next mount of the volume loads the file at init,
+ * and when a directory is looked up for the first time, the iatt of the
+ * reply revalidates all its saved entries at once: if the times are still
+ * the same nothing was created in or removed from the directory since, and
+ * the entries are cached again as if they were just looked up. Otherwise
+ * they are dropped. Either way no fop is sent for it that would not have
+ * been sent anyway.
+ *
+ * The file is in host byte order, it is only read back on the same client.
+ */
+
+static void
+nlc_snapshot_path (xlator_t *this, char *dir, char *path, size_t size)
+{
+        char    *mount_point = NULL;
+        char     tag[PATH_MAX] = {0, };
+        int      i           = 0;
+
+        /* Mounts of the same volume keep their own snapshot */
+        mount_point = this->ctx->cmd_args.mount_point;
+        for (i = 0; mount_point && mount_point[i] && i < PATH_MAX - 1; i++)
+                tag[i] = (mount_point[i] == '/') ? '-' : mount_point[i];
+
+        snprintf (path, size, "%s/%s%s.snapshot", dir, this->name, tag);
+
+        return;
+}
+
+
+static struct list_head *
+nlc_snapshot_bucket (nlc_snapshot_t *snapshot, uuid_t gfid)
+{
+        return &snapshot->buckets[((gfid[14] << 8) | gfid[15])
+                                  % NLC_SNAPSHOT_BUCKETS];
+}
+
+
+static int
+nlc_snapshot_name_add (char **names, size_t *size, uint32_t *len,
+                       const char *name)
+{
+        size_t   name_len = 0;
+        size_t   new_size = 0;
+        char    *tmp      = NULL;
+
+        name_len = strlen (name) + 1;
+        if (*len + name_len > *size) {
+                new_size = max (*size * 2, *len + name_len);
+                tmp = GF_REALLOC (*names, new_size);
+                if (!tmp)
+                        return -1;
+                *names = tmp;
+                *size = new_size;
+        }
+
+        memcpy (*names + *len, name, name_len);
+        *len += name_len;
+
+        return 0;
+}
+
+
+/* Name of @entry_ino in the directory @parent, under table lock */
+static const char *
+__nlc_snapshot_dentry_name (inode_t *parent, inode_t *entry_ino)
+{
+        dentry_t    *dentry = NULL;
+
+        list_for_each_entry (dentry, &entry_ino->dentry_list, inode_list) {
+                if (dentry->parent == parent)
+                        return dentry->name;
+        }
+
+        return NULL;
+}
+
+
+/* Returns 1 if the directory was saved, 0 if it was not worth saving, and
+ * -1 on write failure */
+static int
+nlc_snapshot_save_dir (xlator_t *this, FILE *fp, inode_t *inode,
+                       char **names, size_t *size)
+{
+        nlc_ctx_t           *nlc_ctx = NULL;
+        nlc_pe_t            *pe      = NULL;
+        nlc_ne_t            *ne      = NULL;
+        nlc_snapshot_rec_t   rec     = {{0, }, };
+        const char          *name    = NULL;
+        gf_boolean_t         save    = _gf_false;
+        int                  ret     = 0;
+
+        if (gf_uuid_is_null (inode->gfid))
+                goto out;
+
+        nlc_inode_ctx_get (this, inode, &nlc_ctx, NULL);
+        if (!nlc_ctx)
+                goto out;
+
+        LOCK (&nlc_ctx->lock);
+        {
+                if (!__nlc_is_cache_valid (this, nlc_ctx) ||
+                    (nlc_ctx->stamp_state != NLC_STAMP_VALID) ||
+                    (nlc_ctx->state == NLC_INVALID))
+                        goto unlock;
+
+                gf_uuid_copy (rec.gfid, inode->gfid);
+                rec.state = nlc_ctx->state;
+                rec.stamp = nlc_ctx->stamp;
+
+                if (IS_NE_VALID (nlc_ctx->state)) {
+                        list_for_each_entry (ne, &nlc_ctx->ne, list) {
+                                if (nlc_snapshot_name_add (names, size,
+                                                           &rec.names_len,
+                                                           ne->name))
+                                        goto unlock;
+                                rec.ne_count++;
+                        }
+                }
+
+                if (IS_PE_VALID (nlc_ctx->state)) {
+                        list_for_each_entry (pe, &nlc_ctx->pe, list) {
+                                ret = 0;
+                                pthread_mutex_lock (&inode->table->lock);
+                                {
+                                        name = pe->name;
+                                        if (!name && pe->inode)
+                                                name = __nlc_snapshot_dentry_name
+                                                          (inode, pe->inode);
+                                        if (name)
+                                                ret = nlc_snapshot_name_add
+                                                        (names, size,
+                                                         &rec.names_len, name);
+                                }
+                                pthread_mutex_unlock (&inode->table->lock);
+
+                                if (ret)
+                                        goto unlock;
+
+                                /* Without all the names, the positive
+                                 * entries are no longer the full list */
+                                if (!name) {
+                                        rec.state &= ~NLC_PE_FULL;
+                                        rec.state |= NLC_PE_PARTIAL;
+                                        continue;
+                                }
+                                rec.pe_count++;
+                        }
+                }
+
+                save = _gf_true;
+        }
+unlock:
+        UNLOCK (&nlc_ctx->lock);
+
+        ret = 0;
+        if (!save)
+                goto out;
+
+        if ((fwrite (&rec, sizeof (rec), 1, fp) != 1) ||
+            (rec.names_len &&
+             (fwrite (*names, rec.names_len, 1, fp) != 1))) {
+                ret = -1;
+                goto out;
+        }
+
+        ret = 1;
+out:
+        return ret;
+}
+
+
+void
+nlc_snapshot_save (xlator_t *this)
+{
+        nlc_conf_t          *conf           = NULL;
+        nlc_lru_node_t      *lru_node       = NULL;
+        inode_t            **inodes         = NULL;
+        FILE                *fp             = NULL;
+        char                *names          = NULL;
+        size_t               size           = 0;
+        char                 path[PATH_MAX] = {0, };
+        char                 tmp[PATH_MAX]  = {0, };
+        int                  count          = 0;
+        int                  saved          = 0;
+        int                  fd             = -1;
+        int                  op_errno       = 0;
+        int                  ret            = 0;
+        int                  i              = 0;
+
+        conf = this->private;
+
+        LOCK (&conf->lock);
+        {
+                if (conf->snapshot_dir)
+                        nlc_snapshot_path (this, conf->snapshot_dir, path,
+                                           sizeof (path));
+        }
+        UNLOCK (&conf->lock);
+
+        if (!path[0])
+                goto out;
+
+        snprintf (tmp, sizeof (tmp), "%s.XXXXXX", path);
+        fd = mkstemp (tmp);
+        if (fd < 0) {
+                op_errno = errno;
+                tmp[0] = '\0';
+                goto err;
+        }
+
+        fp = fdopen (fd, "w");
+        if (!fp) {
+                op_errno = errno;
+                sys_close (fd);
+                goto err;
+        }
+
+        if (fwrite (NLC_SNAPSHOT_MAGIC, NLC_SNAPSHOT_MAGIC_LEN, 1, fp) != 1) {
+                op_errno = errno;
+                goto err;
+        }
+
+        /* The cache of a directory is looked at without conf->lock, which
+         * must not be taken within inode->lock, see nlc_inode_ctx_get_set */
+        LOCK (&conf->lock);
+        {
+                list_for_each_entry (lru_node, &conf->lru, list)
+                        count++;
+
+                inodes = GF_CALLOC (count, sizeof (*inodes),
+                                    gf_common_mt_pointer);
+                if (inodes) {
+                        i = 0;
+                        list_for_each_entry (lru_node, &conf->lru, list)
+                                inodes[i++] = inode_ref (lru_node->inode);
+                }
+        }
+        UNLOCK (&conf->lock);
+
+        if (!inodes) {
+                op_errno = ENOMEM;
+                goto err;
+        }
+
+        for (i = 0; i < count; i++) {
+                ret = nlc_snapshot_save_dir (this, fp, inodes[i], &names,
+                                             &size);
+                if (ret < 0) {
+                        op_errno = errno;
+                        goto err;
+                }
+                saved += ret;
+        }
+
+        ret = fclose (fp);
+        fp = NULL;
+        if (ret) {
+                op_errno = errno;
+                goto err;
+        }
+
+        if (sys_rename (tmp, path)) {
+                op_errno = errno;
+                goto err;
+        }
+
+        gf_msg (this->name, GF_LOG_INFO, 0, NLC_MSG_SNAPSHOT_SAVE,
+                "saved the cached entries of %d directories to %s", saved,
+                path);
+        goto out;
+
+err:
+        gf_msg (this->name, GF_LOG_WARNING, op_errno, NLC_MSG_SNAPSHOT_SAVE,
+                "failed to save the cache snapshot %s", path);
+        if (fp)
+                fclose (fp);
+        if (tmp[0])
+                sys_unlink (tmp);
+out:
+        if (inodes) {
+                for (i = 0; i < count; i++)
+                        inode_unref (inodes[i]);
+                GF_FREE (inodes);
+        }
+        GF_FREE (names);
+
+        return;
+}
+
+
+static gf_boolean_t
+nlc_snapshot_dir_valid (nlc_snapshot_dir_t *dir)
+{
+        uint32_t    count = 0;
+        uint32_t    i     = 0;
+
+        if (dir->rec.names_len == 0)
+                return (dir->rec.ne_count + dir->rec.pe_count == 0);
+
+        if (dir->names[dir->rec.names_len - 1] != '\0')
+                return _gf_false;
+
+        for (i = 0; i < dir->rec.names_len; i++) {
+                if (dir->names[i] == '\0')
+                        count++;
+        }
+
+        return (count == dir->rec.ne_count + dir->rec.pe_count);
+}
+
+
+int
+nlc_snapshot_load (xlator_t *this)
+{
+        nlc_conf_t          *conf                         = NULL;
+        nlc_snapshot_t      *snapshot                     = NULL;
+        nlc_snapshot_dir_t  *dir                          = NULL;
+        nlc_snapshot_rec_t   rec                          = {{0, }, };
+        FILE                *fp                           = NULL;
+        char                 magic[NLC_SNAPSHOT_MAGIC_LEN] = {0, };
+        char                 path[PATH_MAX]               = {0, };
+        int                  loaded                       = 0;
+        int                  ret                          = -1;
+        int                  i                            = 0;
+
+        conf = this->private;
+
+        snapshot = GF_CALLOC (1, sizeof (*snapshot), gf_nlc_mt_nlc_snapshot_t);
+        if (!snapshot)
+                goto out;
+
+        for (i = 0; i < NLC_SNAPSHOT_BUCKETS; i++)
+                INIT_LIST_HEAD (&snapshot->buckets[i]);
+        GF_ATOMIC_INIT (snapshot->pending, 0);
+        LOCK_INIT (&snapshot->lock);
+        conf->snapshot = snapshot;
+
+        /* A missing or damaged snapshot only means a cold cache */
+        ret = 0;
+
+        nlc_snapshot_path (this, conf->snapshot_dir, path, sizeof (path));
+        fp = fopen (path, "r");
+        if (!fp) {
+                if (errno != ENOENT)
+                        gf_msg (this->name, GF_LOG_WARNING, errno,
+                                NLC_MSG_SNAPSHOT_LOAD, "failed to open the "
+                                "cache snapshot %s", path);
+                goto out;
+        }
+
+        if ((fread (magic, sizeof (magic), 1, fp) != 1) ||
+            memcmp (magic, NLC_SNAPSHOT_MAGIC, NLC_SNAPSHOT_MAGIC_LEN)) {
+                gf_msg (this->name, GF_LOG_WARNING, 0, NLC_MSG_SNAPSHOT_LOAD,
+                        "%s is not a cache snapshot, ignoring it", path);
+                goto out;
+        }
+
+        while (fread (&rec, sizeof (rec), 1, fp) == 1) {
+                if (rec.names_len > NLC_SNAPSHOT_MAX_NAMES)
+                        break;
+
+                dir = GF_MALLOC (sizeof (*dir) + rec.names_len,
+                                 gf_nlc_mt_nlc_snapshot_dir_t);
+                if (!dir)
+                        break;
+
+                dir->rec = rec;
+                if ((rec.names_len &&
+                     (fread (dir->names, rec.names_len, 1, fp) != 1)) ||
+                    !nlc_snapshot_dir_valid (dir)) {
+                        GF_FREE (dir);
+                        break;
+                }
+
+                list_add (&dir->list, nlc_snapshot_bucket (snapshot,
+                                                           rec.gfid));
+                GF_ATOMIC_INC (snapshot->pending);
+                loaded++;
+        }
+
+        if (!feof (fp))
+                gf_msg (this->name, GF_LOG_WARNING, 0, NLC_MSG_SNAPSHOT_LOAD,
+                        "cache snapshot %s is truncated or damaged, using the "
+                        "first %d directories", path, loaded);
+
+        GF_ATOMIC_ADD (conf->nlc_counter.snapshot_loaded, loaded);
+        gf_msg (this->name, GF_LOG_INFO, 0, NLC_MSG_SNAPSHOT_LOAD,
+                "loaded the cached entries of %d directories from %s",
+                loaded, path);
+out:
+        if (fp)
+                fclose (fp);
+
+        return ret;
+}
+
+
+void
+nlc_snapshot_seed (xlator_t *this, inode_t *inode, struct iatt *buf)
+{
+        nlc_conf_t          *conf     = NULL;
+        nlc_snapshot_t      *snapshot = NULL;
+        nlc_snapshot_dir_t  *dir      = NULL;
+        nlc_snapshot_dir_t  *tmp      = NULL;
+        nlc_ctx_t           *nlc_ctx  = NULL;
+        struct list_head    *bucket   = NULL;
+        char                *name     = NULL;
+        gf_boolean_t         reused   = _gf_false;
+        uint32_t             i        = 0;
+
+        conf = this->private;
+        snapshot = conf->snapshot;
+
+        if (!snapshot || !inode || !buf || (buf->ia_type != IA_IFDIR) ||
+            (GF_ATOMIC_GET (snapshot->pending) == 0))
+                goto out;
+
+        bucket = nlc_snapshot_bucket (snapshot, buf->ia_gfid);
+
+        LOCK (&snapshot->lock);
+        {
+                list_for_each_entry (tmp, bucket, list) {
+                        if (gf_uuid_compare (tmp->rec.gfid,
+                                             buf->ia_gfid) == 0) {
+                                list_del_init (&tmp->list);
+                                dir = tmp;
+                                break;
+                        }
+                }
+        }
+        UNLOCK (&snapshot->lock);
+
+        if (!dir)
+                goto out;
+
+        GF_ATOMIC_DEC (snapshot->pending);
+
+        if (!nlc_stamp_match (&dir->rec.stamp, buf))
+                goto discard;
+
+        nlc_inode_ctx_get_set (this, inode, &nlc_ctx, NULL);
+        if (!nlc_ctx)
+                goto discard;
+
+        LOCK (&nlc_ctx->lock);
+        {
+                /* What was cached since the mount is newer */
+                if (nlc_ctx->state != NLC_INVALID)
+                        goto unlock;
+
+                name = dir->names;
+                for (i = 0; i < dir->rec.ne_count; i++) {
+                        __nlc_add_ne (this, nlc_ctx, name);
+                        name += strlen (name) + 1;
+                }
+                for (i = 0; i < dir->rec.pe_count; i++) {
+                        __nlc_add_pe (this, nlc_ctx, NULL, name);
+                        name += strlen (name) + 1;
+                }
+
+                __nlc_set_dir_state (nlc_ctx, dir->rec.state &
+                                     (NLC_PE_FULL | NLC_PE_PARTIAL |
+                                      NLC_NE_VALID));
+                nlc_ctx->stamp = dir->rec.stamp;
+                nlc_ctx->stamp_state = NLC_STAMP_VALID;
+                reused = _gf_true;
+        }
+unlock:
+        UNLOCK (&nlc_ctx->lock);
+
+        if (reused) {
+                GF_ATOMIC_INC (conf->nlc_counter.snapshot_reused);
+                nlc_lru_prune (this, NULL);
+                goto out;
+        }
+
+discard:
+        GF_ATOMIC_INC (conf->nlc_counter.snapshot_discarded);
+out:
+        GF_FREE (dir);
+
+        return;
+}
+
+
+void
+nlc_snapshot_free (xlator_t *this)
+{
+        nlc_conf_t          *conf     = NULL;
+        nlc_snapshot_t      *snapshot = NULL;
+        nlc_snapshot_dir_t  *dir      = NULL;
+        nlc_snapshot_dir_t  *tmp      = NULL;
+        int                  i        = 0;
+
+        conf = this->private;
+        snapshot = conf->snapshot;
+        if (!snapshot)
+                goto out;
+
+        for (i = 0; i < NLC_SNAPSHOT_BUCKETS; i++) {
+                list_for_each_entry_safe (dir, tmp, &snapshot->buckets[i],
+                                          list) {
+                        list_del (&dir->list);
+                        GF_FREE (dir);
+                }
+        }
+
+        LOCK_DESTROY (&snapshot->lock);
+        GF_FREE (snapshot);
+        conf->snapshot = NULL;
+out:
+        return;
+}
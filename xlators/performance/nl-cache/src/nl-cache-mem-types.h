@@ -23,6 +23,8 @@ enum gf_nlc_mem_types_ {
         gf_nlc_mt_nlc_ne_t,
         gf_nlc_mt_nlc_timer_data_t,
         gf_nlc_mt_nlc_lru_node,
+        gf_nlc_mt_nlc_snapshot_t,
+        gf_nlc_mt_nlc_snapshot_dir_t,
         gf_nlc_mt_end
 };
 
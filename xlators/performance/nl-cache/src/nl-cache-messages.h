@@ -27,7 +27,9 @@ GLFS_MSGID(NLC,
         NLC_MSG_NO_MEMORY,
         NLC_MSG_EINVAL,
         NLC_MSG_NO_TIMER_WHEEL,
-        NLC_MSG_DICT_FAILURE
+        NLC_MSG_DICT_FAILURE,
+        NLC_MSG_SNAPSHOT_SAVE,
+        NLC_MSG_SNAPSHOT_LOAD
 );
 
 #endif /* __NL_CACHE_MESSAGES_H__ */
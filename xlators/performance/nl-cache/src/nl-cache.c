@@ -198,6 +198,15 @@ nlc_lookup_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
         local = frame->local;
         conf = this->private;
 
+        /* Only the reply to a lookup of the directory itself carries its
+         * iatt merged across the subvolumes of DHT. The postparent of a
+         * child comes from the hashed subvolume alone, hence it neither
+         * revalidates the snapshot nor stamps the cached entries */
+        if (op_ret == 0 && inode && buf && buf->ia_type == IA_IFDIR) {
+                nlc_snapshot_seed (this, inode, buf);
+                nlc_dir_stamp (this, inode, buf);
+        }
+
         if (!local)
                 goto out;
 
@@ -561,6 +570,7 @@ notify (xlator_t *this, int event, void *data, ...)
                 break;
         case GF_EVENT_PARENT_DOWN:
                 nlc_disable_cache (this);
+                nlc_snapshot_save (this);
                 nlc_clear_all_cache (this);
         default:
                 break;
@@ -633,6 +643,12 @@ nlc_priv_dump (xlator_t *this)
                            GF_ATOMIC_GET(conf->nlc_counter.ne_inode_cnt));
         gf_proc_dump_write("dentry_invalidations_recieved", "%"PRId64,
                            GF_ATOMIC_GET(conf->nlc_counter.nlc_invals));
+        gf_proc_dump_write("snapshot_dirs_loaded", "%"PRId64,
+                           GF_ATOMIC_GET(conf->nlc_counter.snapshot_loaded));
+        gf_proc_dump_write("snapshot_dirs_reused", "%"PRId64,
+                           GF_ATOMIC_GET(conf->nlc_counter.snapshot_reused));
+        gf_proc_dump_write("snapshot_dirs_discarded", "%"PRId64,
+                        GF_ATOMIC_GET(conf->nlc_counter.snapshot_discarded));
         gf_proc_dump_write("cache_limit", "%"PRIu64,
                            conf->cache_size);
         gf_proc_dump_write("consumed_cache_size", "%"PRId64,
@@ -652,6 +668,8 @@ fini (xlator_t *this)
         nlc_conf_t      *conf       = NULL;
 
         conf = this->private;
+        nlc_snapshot_free (this);
+        GF_FREE (conf->snapshot_dir);
         GF_FREE (conf);
 
         glusterfs_ctx_tw_put (this->ctx);
@@ -673,7 +691,9 @@ mem_acct_init (xlator_t *this)
 int32_t
 reconfigure (xlator_t *this, dict_t *options)
 {
-        nlc_conf_t *conf = NULL;
+        nlc_conf_t *conf         = NULL;
+        char       *snapshot_dir = NULL;
+        char       *tmp          = NULL;
 
         conf = this->private;
 
@@ -683,6 +703,19 @@ reconfigure (xlator_t *this, dict_t *options)
                           options, bool, out);
         GF_OPTION_RECONF ("nl-cache-limit", conf->cache_size, options,
                           size_uint64, out);
+        GF_OPTION_RECONF ("nl-cache-snapshot-dir", snapshot_dir, options,
+                          path, out);
+
+        /* Takes effect on the next unmount, loading needs a remount */
+        if (snapshot_dir)
+                snapshot_dir = gf_strdup (snapshot_dir);
+        LOCK (&conf->lock);
+        {
+                tmp = conf->snapshot_dir;
+                conf->snapshot_dir = snapshot_dir;
+        }
+        UNLOCK (&conf->lock);
+        GF_FREE (tmp);
 
 out:
         return 0;
@@ -692,9 +725,10 @@ out:
 int32_t
 init (xlator_t *this)
 {
-        nlc_conf_t      *conf       = NULL;
-        int              ret        = -1;
-        inode_table_t   *itable     = NULL;
+        nlc_conf_t      *conf         = NULL;
+        int              ret          = -1;
+        inode_table_t   *itable       = NULL;
+        char            *snapshot_dir = NULL;
 
         conf = GF_CALLOC (sizeof (*conf), 1, gf_nlc_mt_nlc_conf_t);
         if (!conf)
@@ -704,6 +738,12 @@ init (xlator_t *this)
         GF_OPTION_INIT ("nl-cache-positive-entry", conf->positive_entry_cache,
                         bool, out);
         GF_OPTION_INIT ("nl-cache-limit", conf->cache_size, size_uint64, out);
+        GF_OPTION_INIT ("nl-cache-snapshot-dir", snapshot_dir, path, out);
+        if (snapshot_dir) {
+                conf->snapshot_dir = gf_strdup (snapshot_dir);
+                if (!conf->snapshot_dir)
+                        goto out;
+        }
 
         /* Since the positive entries are stored as list of refs on
          * existing inodes, we should not overflow the inode lru_limit.
@@ -727,6 +767,9 @@ init (xlator_t *this)
         GF_ATOMIC_INIT (conf->nlc_counter.pe_inode_cnt, 0);
         GF_ATOMIC_INIT (conf->nlc_counter.ne_inode_cnt, 0);
         GF_ATOMIC_INIT (conf->nlc_counter.nlc_invals, 0);
+        GF_ATOMIC_INIT (conf->nlc_counter.snapshot_loaded, 0);
+        GF_ATOMIC_INIT (conf->nlc_counter.snapshot_reused, 0);
+        GF_ATOMIC_INIT (conf->nlc_counter.snapshot_discarded, 0);
 
         INIT_LIST_HEAD (&conf->lru);
         time (&conf->last_child_down);
@@ -740,6 +783,12 @@ init (xlator_t *this)
 
         this->private = conf;
 
+        if (conf->snapshot_dir) {
+                ret = nlc_snapshot_load (this);
+                if (ret)
+                        goto out;
+        }
+
         ret = 0;
 out:
         return ret;
@@ -795,5 +844,12 @@ struct volume_options options[] = {
           .default_value = "60",
           .description = "Time period after which cache has to be refreshed",
         },
+        { .key = {"nl-cache-snapshot-dir"},
+          .type = GF_OPTION_TYPE_PATH,
+          .description = "Directory to save the cache in on unmount, so that "
+                         "the next mount starts with it. Entries of the "
+                         "directories changed in the meantime are dropped "
+                         "when they are looked up again",
+        },
         { .key = {NULL} },
 };
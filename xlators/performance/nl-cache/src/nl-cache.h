@@ -27,6 +27,15 @@
                             (state & (NLC_PE_FULL | NLC_PE_PARTIAL)))
 #define IS_NE_VALID(state) ((state != NLC_INVALID) && (state & NLC_NE_VALID))
 
+#define NLC_STAMP_NONE 0
+#define NLC_STAMP_VALID 1
+#define NLC_STAMP_STALE 2
+
+#define NLC_SNAPSHOT_BUCKETS 1024
+#define NLC_SNAPSHOT_MAGIC "GFNLCSN1"
+#define NLC_SNAPSHOT_MAGIC_LEN 8
+#define NLC_SNAPSHOT_MAX_NAMES (64 * GF_UNIT_MB)
+
 #define IS_PEC_ENABLED(conf) (conf->positive_entry_cache)
 #define IS_CACHE_ENABLED(conf) ((!conf->cache_disabled))
 
@@ -72,10 +81,23 @@ struct nlc_lru_node {
 };
 typedef struct nlc_lru_node nlc_lru_node_t;
 
+/* Times of a directory, which change whenever an entry is added to or
+ * removed from it */
+struct nlc_stamp {
+        int64_t          ctime;
+        int64_t          mtime;
+        uint32_t         ctime_nsec;
+        uint32_t         mtime_nsec;
+};
+typedef struct nlc_stamp nlc_stamp_t;
+
 struct nlc_ctx {
         struct list_head         pe;   /* list of positive entries */
         struct list_head         ne;   /* list of negative entries */
         uint64_t                 state;
+        nlc_stamp_t              stamp; /* dir times the entries are
+                                           known to be correct for */
+        int                      stamp_state;
         time_t                   cache_time;
         struct gf_tw_timer_list *timer;
         nlc_timer_data_t         *timer_data;
@@ -106,7 +128,38 @@ struct nlc_statistics {
         gf_atomic_t pe_inode_cnt;
         gf_atomic_t ne_inode_cnt;
         gf_atomic_t nlc_invals; /* No. of invalidates recieved from upcall*/
+        gf_atomic_t snapshot_loaded; /* dirs read from the snapshot */
+        gf_atomic_t snapshot_reused; /* dirs whose entries were reused */
+        gf_atomic_t snapshot_discarded; /* dirs changed since the snapshot */
+};
+
+/* On-disk record of a directory in the snapshot, followed by the NUL
+ * terminated names of its negative and then its positive entries */
+struct nlc_snapshot_rec {
+        unsigned char    gfid[16];
+        uint64_t         state;
+        nlc_stamp_t      stamp;
+        uint32_t         ne_count;
+        uint32_t         pe_count;
+        uint32_t         names_len;
+        uint32_t         pad;
+};
+typedef struct nlc_snapshot_rec nlc_snapshot_rec_t;
+
+struct nlc_snapshot_dir {
+        struct list_head    list;
+        nlc_snapshot_rec_t  rec;
+        char                names[];
+};
+typedef struct nlc_snapshot_dir nlc_snapshot_dir_t;
+
+/* Directories of the snapshot loaded at init, not looked up yet */
+struct nlc_snapshot {
+        struct list_head  buckets[NLC_SNAPSHOT_BUCKETS];
+        gf_atomic_t       pending;
+        gf_lock_t         lock;
 };
+typedef struct nlc_snapshot nlc_snapshot_t;
 
 struct nlc_conf {
         int32_t              cache_timeout;
@@ -121,6 +174,8 @@ struct nlc_conf {
         time_t               last_child_down;
         struct list_head     lru;
         gf_lock_t            lock;
+        char                *snapshot_dir;
+        nlc_snapshot_t      *snapshot;
         struct nlc_statistics nlc_counter;
 };
 typedef struct nlc_conf nlc_conf_t;
@@ -146,6 +201,9 @@ nlc_dir_remove_pe (xlator_t *this, inode_t *inode, inode_t *entry_ino,
 void
 nlc_dir_add_ne (xlator_t *this, inode_t *inode, const char *name);
 
+void
+nlc_dir_stamp (xlator_t *this, inode_t *inode, struct iatt *buf);
+
 void
 nlc_local_wipe (xlator_t *this, nlc_local_t *local);
 
@@ -172,4 +230,16 @@ nlc_disable_cache (xlator_t *this);
 void
 nlc_lru_prune (xlator_t *this, inode_t *inode);
 
+int
+nlc_snapshot_load (xlator_t *this);
+
+void
+nlc_snapshot_save (xlator_t *this);
+
+void
+nlc_snapshot_seed (xlator_t *this, inode_t *inode, struct iatt *buf);
+
+void
+nlc_snapshot_free (xlator_t *this);
+
 #endif /* __NL_CACHE_H__ */
@@ -13,9 +13,12 @@
 #include "statedump.h"
 #include "quick-read-messages.h"
 #include "upcall-utils.h"
+#ifdef HAVE_LIB_Z
+#include <zlib.h>
+#endif
 
 qr_inode_t *qr_inode_ctx_get (xlator_t *this, inode_t *inode);
-void __qr_inode_prune (qr_inode_table_t *table, qr_inode_t *qr_inode);
+void __qr_inode_prune (qr_inode_t *qr_inode);
 
 
 int
@@ -86,9 +89,6 @@ qr_inode_ctx_get_or_new (xlator_t *this, inode_t *inode)
 {
 	qr_inode_t   *qr_inode = NULL;
 	int           ret = -1;
-	qr_private_t *priv = NULL;
-
-	priv = this->private;
 
 	LOCK (&inode->lock);
 	{
@@ -102,7 +102,7 @@ qr_inode_ctx_get_or_new (xlator_t *this, inode_t *inode)
 
 		ret = __qr_inode_ctx_set (this, inode, qr_inode);
 		if (ret) {
-			__qr_inode_prune (&priv->table, qr_inode);
+			__qr_inode_prune (qr_inode);
 			GF_FREE (qr_inode);
                         qr_inode = NULL;
 		}
@@ -129,19 +129,108 @@ qr_get_priority (qr_conf_t *conf, const char *path)
 }
 
 
+qr_shard_t *
+qr_shard_get (qr_inode_table_t *table, uuid_t gfid)
+{
+        return &table->shards[gfid[15] % QR_SHARD_COUNT];
+}
+
+
+static uint32_t
+qr_sketch_index (uuid_t gfid, int row)
+{
+        uint64_t h1 = 0;
+        uint64_t h2 = 0;
+
+        memcpy (&h1, &gfid[0], sizeof (h1));
+        memcpy (&h2, &gfid[8], sizeof (h2));
+
+        return (h1 + row * (h2 | 1)) & (QR_SKETCH_WIDTH - 1);
+}
+
+
+/* To be called with shard->lock held */
+void
+__qr_sketch_add (qr_shard_t *shard, uuid_t gfid)
+{
+        uint8_t *counter = NULL;
+        int      i       = 0;
+        int      j       = 0;
+
+        for (i = 0; i < QR_SKETCH_DEPTH; i++) {
+                counter = &shard->sketch[i][qr_sketch_index (gfid, i)];
+                if (*counter < QR_SKETCH_MAX)
+                        (*counter)++;
+        }
+
+        /* age the counts, so that what was popular once does not stay in
+         * the cache for ever */
+        if (++shard->samples >= QR_SKETCH_WIDTH * 8) {
+                for (i = 0; i < QR_SKETCH_DEPTH; i++) {
+                        for (j = 0; j < QR_SKETCH_WIDTH; j++)
+                                shard->sketch[i][j] >>= 1;
+                }
+                shard->samples /= 2;
+        }
+}
+
+
+/* To be called with shard->lock held */
+uint32_t
+__qr_sketch_estimate (qr_shard_t *shard, uuid_t gfid)
+{
+        uint32_t count = QR_SKETCH_MAX;
+        int      i     = 0;
+
+        for (i = 0; i < QR_SKETCH_DEPTH; i++)
+                count = min (count, shard->sketch[i][qr_sketch_index (gfid,
+                                                                      i)]);
+
+        return count;
+}
+
+
+void
+qr_inode_access (xlator_t *this, struct iatt *buf)
+{
+        qr_private_t *priv  = NULL;
+        qr_shard_t   *shard = NULL;
+
+        priv = this->private;
+        shard = qr_shard_get (&priv->table, buf->ia_gfid);
+
+        LOCK (&shard->lock);
+        {
+                __qr_sketch_add (shard, buf->ia_gfid);
+        }
+        UNLOCK (&shard->lock);
+}
+
+
+/* To be called with qr_inode->shard->lock held */
 void
-__qr_inode_register (qr_inode_table_t *table, qr_inode_t *qr_inode)
+__qr_inode_register (qr_inode_t *qr_inode)
 {
+        qr_shard_t *shard = qr_inode->shard;
+
 	if (!qr_inode->data)
 		return;
 
-	if (list_empty (&qr_inode->lru))
+	if (list_empty (&qr_inode->lru)) {
 		/* first time addition of this qr_inode into table */
-		table->cache_used += qr_inode->size;
-	else
+		shard->cache_used += qr_inode->stored;
+                GF_ATOMIC_ADD (shard->table->cache_used, qr_inode->stored);
+                shard->file_count++;
+                if (qr_inode->compressed) {
+                        shard->compressed++;
+                        shard->bytes_saved += qr_inode->size
+                                              - qr_inode->stored;
+                }
+        } else {
 		list_del_init (&qr_inode->lru);
+        }
 
-	list_add_tail (&qr_inode->lru, &table->lru[qr_inode->priority]);
+	list_add_tail (&qr_inode->lru, &shard->lru[qr_inode->priority]);
 }
 
 
@@ -149,17 +238,16 @@ void
 qr_inode_set_priority (xlator_t *this, inode_t *inode, const char *path)
 {
 	uint32_t          priority = 0;
-	qr_inode_table_t *table = NULL;
 	qr_inode_t       *qr_inode = NULL;
         qr_private_t     *priv = NULL;
 	qr_conf_t        *conf = NULL;
+        qr_shard_t       *shard = NULL;
 
 	qr_inode = qr_inode_ctx_get (this, inode);
 	if (!qr_inode)
 		return;
 
 	priv = this->private;
-	table = &priv->table;
 	conf = &priv->conf;
 
 	if (path)
@@ -168,26 +256,44 @@ qr_inode_set_priority (xlator_t *this, inode_t *inode, const char *path)
 		/* retain existing priority, just bump LRU */
 		priority = qr_inode->priority;
 
-	LOCK (&table->lock);
+        shard = qr_inode->shard;
+        if (!shard) {
+                /* never cached */
+                qr_inode->priority = priority;
+                return;
+        }
+
+	LOCK (&shard->lock);
 	{
 		qr_inode->priority = priority;
 
-		__qr_inode_register (table, qr_inode);
+		__qr_inode_register (qr_inode);
 	}
-	UNLOCK (&table->lock);
+	UNLOCK (&shard->lock);
 }
 
 
-/* To be called with priv->table.lock held */
+/* To be called with qr_inode->shard->lock held */
 void
-__qr_inode_prune (qr_inode_table_t *table, qr_inode_t *qr_inode)
+__qr_inode_prune (qr_inode_t *qr_inode)
 {
+        qr_shard_t *shard = qr_inode->shard;
+
 	GF_FREE (qr_inode->data);
 	qr_inode->data = NULL;
 
 	if (!list_empty (&qr_inode->lru)) {
-		table->cache_used -= qr_inode->size;
+		shard->cache_used -= qr_inode->stored;
+                GF_ATOMIC_SUB (shard->table->cache_used, qr_inode->stored);
+                shard->file_count--;
+                if (qr_inode->compressed) {
+                        shard->compressed--;
+                        shard->bytes_saved -= qr_inode->size
+                                              - qr_inode->stored;
+                }
 		qr_inode->size = 0;
+                qr_inode->stored = 0;
+                qr_inode->compressed = _gf_false;
 
 		list_del_init (&qr_inode->lru);
 	}
@@ -199,67 +305,118 @@ __qr_inode_prune (qr_inode_table_t *table, qr_inode_t *qr_inode)
 void
 qr_inode_prune (xlator_t *this, inode_t *inode)
 {
-        qr_private_t     *priv          = NULL;
-        qr_inode_table_t *table         = NULL;
 	qr_inode_t       *qr_inode      = NULL;
+        qr_shard_t       *shard         = NULL;
 
 	qr_inode = qr_inode_ctx_get (this, inode);
 	if (!qr_inode)
 		return;
 
-	priv = this->private;
-	table = &priv->table;
+        shard = qr_inode->shard;
+        if (!shard)
+                /* never cached */
+                return;
 
-	LOCK (&table->lock);
+	LOCK (&shard->lock);
 	{
-		__qr_inode_prune (table, qr_inode);
+		__qr_inode_prune (qr_inode);
 	}
-	UNLOCK (&table->lock);
+	UNLOCK (&shard->lock);
 }
 
 
-/* To be called with priv->table.lock held */
-void
-__qr_cache_prune (qr_inode_table_t *table, qr_conf_t *conf)
+/*
+ * __qr_shard_victim - least recently used file of the lowest priority
+ *                     cached in the shard, other than @keep.
+ *
+ * To be called with shard->lock held.
+ */
+qr_inode_t *
+__qr_shard_victim (qr_shard_t *shard, qr_conf_t *conf, qr_inode_t *keep)
 {
-        qr_inode_t        *curr = NULL;
-	qr_inode_t        *next = NULL;
-        int                index = 0;
-	size_t             size_pruned = 0;
+        qr_inode_t *curr  = NULL;
+        int         index = 0;
 
         for (index = 0; index < conf->max_pri; index++) {
-                list_for_each_entry_safe (curr, next, &table->lru[index], lru) {
-
-                        size_pruned += curr->size;
-
-                        __qr_inode_prune (table, curr);
-
-                        if (table->cache_used < conf->cache_size)
-				return;
+                list_for_each_entry (curr, &shard->lru[index], lru) {
+                        if (curr != keep)
+                                return curr;
                 }
         }
 
-        return;
+        return NULL;
 }
 
 
+/*
+ * qr_cache_prune - evicts files until the cache is back under cache-size,
+ *                  one from each shard in turn starting with @shard, so
+ *                  that the shards keep even shares of it. @keep, which
+ *                  was just cached, is left alone.
+ */
 void
-qr_cache_prune (xlator_t *this)
+qr_cache_prune (qr_conf_t *conf, qr_shard_t *shard, qr_inode_t *keep)
 {
-        qr_private_t      *priv = NULL;
-        qr_conf_t         *conf = NULL;
-        qr_inode_table_t  *table = NULL;
+        qr_inode_table_t  *table  = shard->table;
+        qr_inode_t        *victim = NULL;
+        gf_boolean_t       pruned = _gf_false;
+        int                start  = 0;
+        int                i      = 0;
+
+        start = shard - table->shards;
+
+        do {
+                pruned = _gf_false;
+
+                for (i = 0; i < QR_SHARD_COUNT; i++) {
+                        if (GF_ATOMIC_GET (table->cache_used)
+                            <= conf->cache_size)
+                                return;
+
+                        shard = &table->shards[(start + i) % QR_SHARD_COUNT];
+
+                        LOCK (&shard->lock);
+                        {
+                                victim = __qr_shard_victim (shard, conf, keep);
+                                if (victim) {
+                                        __qr_inode_prune (victim);
+                                        pruned = _gf_true;
+                                }
+                        }
+                        UNLOCK (&shard->lock);
+                }
+        } while (pruned);
+}
 
-        priv = this->private;
-        table = &priv->table;
-        conf = &priv->conf;
 
-	LOCK (&table->lock);
-	{
-		if (table->cache_used > conf->cache_size)
-			__qr_cache_prune (table, conf);
-	}
-	UNLOCK (&table->lock);
+/*
+ * __qr_admit - TinyLFU admission. A file which fits in the cache is always
+ *              cached. Otherwise it has to be looked up more often than the
+ *              file it would evict in its shard, unless it has a higher
+ *              priority.
+ *
+ * To be called with shard->lock held.
+ */
+gf_boolean_t
+__qr_admit (qr_shard_t *shard, qr_conf_t *conf, int priority,
+            struct iatt *buf)
+{
+        qr_inode_t *victim = NULL;
+
+        if (!conf->admission_filter)
+                return _gf_true;
+
+        if (GF_ATOMIC_GET (shard->table->cache_used) + buf->ia_size
+            <= conf->cache_size)
+                return _gf_true;
+
+        victim = __qr_shard_victim (shard, conf, NULL);
+
+        if (!victim || (victim->priority < priority))
+                return _gf_true;
+
+        return (__qr_sketch_estimate (shard, buf->ia_gfid)
+                > __qr_sketch_estimate (shard, victim->buf.ia_gfid));
 }
 
 
@@ -285,22 +442,110 @@ out:
 }
 
 
+/*
+ * qr_content_compress - compressed copy of @data, or NULL when that would
+ *                       not save at least an eighth of it.
+ */
+void *
+qr_content_compress (void *data, size_t size, size_t *stored)
+{
+#ifdef HAVE_LIB_Z
+        void   *content = NULL;
+        void   *shrunk  = NULL;
+        uLongf  length  = 0;
+
+        length = compressBound (size);
+        content = GF_MALLOC (length, gf_qr_mt_content_t);
+        if (!content)
+                return NULL;
+
+        if ((compress2 (content, &length, data, size, Z_BEST_SPEED) != Z_OK)
+            || (length > size - size / 8)) {
+                GF_FREE (content);
+                return NULL;
+        }
+
+        shrunk = GF_REALLOC (content, length);
+        if (shrunk)
+                content = shrunk;
+
+        *stored = length;
+        return content;
+#else
+        return NULL;
+#endif
+}
+
+
+int
+qr_content_uncompress (qr_inode_t *qr_inode, char *buf)
+{
+#ifdef HAVE_LIB_Z
+        uLongf length = qr_inode->size;
+
+        if ((uncompress ((Bytef *)buf, &length, qr_inode->data,
+                         qr_inode->stored) != Z_OK)
+            || (length != qr_inode->size))
+                return -1;
+
+        return 0;
+#else
+        return -1;
+#endif
+}
+
+
 void
 qr_content_update (xlator_t *this, qr_inode_t *qr_inode, void *data,
 		   struct iatt *buf)
 {
         qr_private_t      *priv = NULL;
-        qr_inode_table_t  *table = NULL;
+        qr_conf_t         *conf = NULL;
+        qr_shard_t        *shard = NULL;
+        void              *content = NULL;
+        size_t             stored = 0;
+        gf_boolean_t       admit = _gf_false;
 
         priv = this->private;
-        table = &priv->table;
+        conf = &priv->conf;
 
-	LOCK (&table->lock);
+        shard = qr_shard_get (&priv->table, buf->ia_gfid);
+        qr_inode->shard = shard;
+
+        LOCK (&shard->lock);
+        {
+                /* new content of a cached file is always taken */
+                admit = qr_inode->data
+                        || __qr_admit (shard, conf, qr_inode->priority, buf);
+                if (admit)
+                        shard->admitted++;
+                else
+                        shard->rejected++;
+        }
+        UNLOCK (&shard->lock);
+
+        if (!admit) {
+                GF_FREE (data);
+                return;
+        }
+
+        stored = buf->ia_size;
+        if (conf->compression) {
+                content = qr_content_compress (data, buf->ia_size, &stored);
+                if (content) {
+                        GF_FREE (data);
+                        data = content;
+                }
+        }
+
+	LOCK (&shard->lock);
 	{
-		__qr_inode_prune (table, qr_inode);
+		__qr_inode_prune (qr_inode);
 
 		qr_inode->data = data;
 		qr_inode->size = buf->ia_size;
+                qr_inode->stored = stored;
+                qr_inode->compressed = (content != NULL);
 
 		qr_inode->ia_mtime = buf->ia_mtime;
 		qr_inode->ia_mtime_nsec = buf->ia_mtime_nsec;
@@ -309,11 +554,11 @@ qr_content_update (xlator_t *this, qr_inode_t *qr_inode, void *data,
 
 		gettimeofday (&qr_inode->last_refresh, NULL);
 
-		__qr_inode_register (table, qr_inode);
+		__qr_inode_register (qr_inode);
 	}
-	UNLOCK (&table->lock);
+	UNLOCK (&shard->lock);
 
-	qr_cache_prune (this);
+        qr_cache_prune (conf, shard, qr_inode);
 }
 
 
@@ -332,15 +577,14 @@ qr_mtime_equal (qr_inode_t *qr_inode, struct iatt *buf)
 }
 
 
+/* To be called with qr_inode->shard->lock held */
 void
 __qr_content_refresh (xlator_t *this, qr_inode_t *qr_inode, struct iatt *buf)
 {
         qr_private_t      *priv = NULL;
-        qr_inode_table_t  *table = NULL;
 	qr_conf_t         *conf = NULL;
 
         priv = this->private;
-        table = &priv->table;
 	conf = &priv->conf;
 
 	if (qr_size_fits (conf, buf) && qr_mtime_equal (qr_inode, buf)) {
@@ -348,9 +592,9 @@ __qr_content_refresh (xlator_t *this, qr_inode_t *qr_inode, struct iatt *buf)
 
 		gettimeofday (&qr_inode->last_refresh, NULL);
 
-		__qr_inode_register (table, qr_inode);
+		__qr_inode_register (qr_inode);
 	} else {
-		__qr_inode_prune (table, qr_inode);
+		__qr_inode_prune (qr_inode);
 	}
 
 	return;
@@ -360,17 +604,18 @@ __qr_content_refresh (xlator_t *this, qr_inode_t *qr_inode, struct iatt *buf)
 void
 qr_content_refresh (xlator_t *this, qr_inode_t *qr_inode, struct iatt *buf)
 {
-        qr_private_t      *priv = NULL;
-        qr_inode_table_t  *table = NULL;
+        qr_shard_t        *shard = NULL;
 
-        priv = this->private;
-        table = &priv->table;
+        shard = qr_inode->shard;
+        if (!shard)
+                /* never cached */
+                return;
 
-	LOCK (&table->lock);
+	LOCK (&shard->lock);
 	{
 		__qr_content_refresh (this, qr_inode, buf);
 	}
-	UNLOCK (&table->lock);
+	UNLOCK (&shard->lock);
 }
 
 
@@ -407,6 +652,9 @@ qr_lookup_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
         void             *content  = NULL;
         qr_inode_t       *qr_inode = NULL;
 	inode_t          *inode    = NULL;
+        qr_private_t     *priv     = NULL;
+
+        priv = this->private;
 
 	inode = frame->local;
 	frame->local = NULL;
@@ -426,6 +674,9 @@ qr_lookup_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 		goto out;
 	}
 
+        if ((buf->ia_type == IA_IFREG) && qr_size_fits (&priv->conf, buf))
+                qr_inode_access (this, buf);
+
 	content = qr_content_extract (xdata);
 
 	if (content) {
@@ -546,18 +797,24 @@ qr_readv_cached (call_frame_t *frame, qr_inode_t *qr_inode, size_t size,
 {
 	xlator_t         *this = NULL;
 	qr_private_t     *priv = NULL;
-	qr_inode_table_t *table = NULL;
+        qr_shard_t       *shard = NULL;
 	int               op_ret = -1;
 	struct iobuf     *iobuf = NULL;
 	struct iobref    *iobref = NULL;
 	struct iovec      iov = {0, };
 	struct iatt       buf = {0, };
+        char             *base = NULL;
 
 	this = frame->this;
 	priv = this->private;
-	table = &priv->table;
 
-	LOCK (&table->lock);
+        shard = qr_inode->shard;
+        if (!shard) {
+                GF_ATOMIC_INC (priv->qr_counter.cache_miss);
+                return -1;
+        }
+
+	LOCK (&shard->lock);
 	{
 		if (!qr_inode->data)
 			goto unlock;
@@ -570,7 +827,10 @@ qr_readv_cached (call_frame_t *frame, qr_inode_t *qr_inode, size_t size,
 
 		op_ret = min (size, (qr_inode->size - offset));
 
-		iobuf = iobuf_get2 (this->ctx->iobuf_pool, op_ret);
+                /* a compressed file is uncompressed whole */
+		iobuf = iobuf_get2 (this->ctx->iobuf_pool,
+                                    qr_inode->compressed ? qr_inode->size
+                                                         : op_ret);
 		if (!iobuf) {
 			op_ret = -1;
 			goto unlock;
@@ -584,18 +844,29 @@ qr_readv_cached (call_frame_t *frame, qr_inode_t *qr_inode, size_t size,
 
 		iobref_add (iobref, iobuf);
 
-		memcpy (iobuf->ptr, qr_inode->data + offset, op_ret);
+                if (qr_inode->compressed) {
+                        if (qr_content_uncompress (qr_inode,
+                                                   iobuf->ptr) != 0) {
+                                __qr_inode_prune (qr_inode);
+                                op_ret = -1;
+                                goto unlock;
+                        }
+                        base = (char *)iobuf->ptr + offset;
+                } else {
+                        memcpy (iobuf->ptr, qr_inode->data + offset, op_ret);
+                        base = iobuf->ptr;
+                }
 
 		buf = qr_inode->buf;
 
 		/* bump LRU */
-		__qr_inode_register (table, qr_inode);
+		__qr_inode_register (qr_inode);
 	}
 unlock:
-	UNLOCK (&table->lock);
+	UNLOCK (&shard->lock);
 
 	if (op_ret >= 0) {
-		iov.iov_base = iobuf->ptr;
+		iov.iov_base = base;
 		iov.iov_len = op_ret;
 
                 GF_ATOMIC_INC (priv->qr_counter.cache_hit);
@@ -760,6 +1031,12 @@ qr_inodectx_dump (xlator_t *this, inode_t *inode)
 
         gf_proc_dump_write ("entire-file-cached", "%s", qr_inode->data ? "yes" : "no");
 
+        if (qr_inode->data) {
+                gf_proc_dump_write ("compressed", "%s",
+                                    qr_inode->compressed ? "yes" : "no");
+                gf_proc_dump_write ("stored-size", "%zu", qr_inode->stored);
+        }
+
         if (qr_inode->last_refresh.tv_sec) {
                 gf_time_fmt (buf, sizeof buf, qr_inode->last_refresh.tv_sec,
                              gf_timefmt_FT);
@@ -778,13 +1055,16 @@ out:
 int
 qr_priv_dump (xlator_t *this)
 {
-        qr_conf_t        *conf       = NULL;
-        qr_private_t     *priv       = NULL;
-        qr_inode_table_t *table      = NULL;
-        uint32_t          file_count = 0;
-        uint32_t          i          = 0;
-        qr_inode_t       *curr       = NULL;
-        uint64_t          total_size = 0;
+        qr_conf_t        *conf        = NULL;
+        qr_private_t     *priv        = NULL;
+        qr_shard_t       *shard       = NULL;
+        uint32_t          file_count  = 0;
+        uint32_t          compressed  = 0;
+        uint32_t          i           = 0;
+        uint64_t          total_size  = 0;
+        uint64_t          bytes_saved = 0;
+        uint64_t          admitted    = 0;
+        uint64_t          rejected    = 0;
         char              key_prefix[GF_DUMP_MAX_BUF_LEN];
 
         if (!this) {
@@ -792,12 +1072,10 @@ qr_priv_dump (xlator_t *this)
         }
 
         priv = this->private;
-        conf = &priv->conf;
-
-        if (!conf)
+        if (!priv)
                 return -1;
 
-        table = &priv->table;
+        conf = &priv->conf;
 
         gf_proc_dump_build_key (key_prefix, "xlator.performance.quick-read",
                                 "priv");
@@ -806,28 +1084,41 @@ qr_priv_dump (xlator_t *this)
 
         gf_proc_dump_write ("max_file_size", "%d", conf->max_file_size);
         gf_proc_dump_write ("cache_timeout", "%d", conf->cache_timeout);
-
-        if (!table) {
-                goto out;
-        } else {
-                for (i = 0; i < conf->max_pri; i++) {
-                        list_for_each_entry (curr, &table->lru[i], lru) {
-                                file_count++;
-                                total_size += curr->size;
-                        }
+        gf_proc_dump_write ("cache_compression", "%s",
+                            conf->compression ? "on" : "off");
+        gf_proc_dump_write ("admission_filter", "%s",
+                            conf->admission_filter ? "on" : "off");
+
+        for (i = 0; i < QR_SHARD_COUNT; i++) {
+                shard = &priv->table.shards[i];
+
+                /* never held for long, so the dump can wait for it and
+                   count every shard */
+                LOCK (&shard->lock);
+                {
+                        file_count += shard->file_count;
+                        total_size += shard->cache_used;
+                        compressed += shard->compressed;
+                        bytes_saved += shard->bytes_saved;
+                        admitted += shard->admitted;
+                        rejected += shard->rejected;
                 }
+                UNLOCK (&shard->lock);
         }
 
-        gf_proc_dump_write ("total_files_cached", "%d", file_count);
-        gf_proc_dump_write ("total_cache_used", "%d", total_size);
-        gf_proc_dump_write ("cache-hit", "%"PRId64,
-                            priv->qr_counter.cache_hit);
+        gf_proc_dump_write ("total_files_cached", "%u", file_count);
+        gf_proc_dump_write ("total_cache_used", "%"PRIu64, total_size);
+        gf_proc_dump_write ("files_compressed", "%u", compressed);
+        gf_proc_dump_write ("bytes_saved", "%"PRIu64, bytes_saved);
+        gf_proc_dump_write ("files_admitted", "%"PRIu64, admitted);
+        gf_proc_dump_write ("files_rejected", "%"PRIu64, rejected);
         gf_proc_dump_write ("cache-hit", "%"PRId64,
-                            priv->qr_counter.cache_miss);
-        gf_proc_dump_write ("cache-hit", "%"PRId64,
-                            priv->qr_counter.file_data_invals);
+                            GF_ATOMIC_GET (priv->qr_counter.cache_hit));
+        gf_proc_dump_write ("cache-miss", "%"PRId64,
+                            GF_ATOMIC_GET (priv->qr_counter.cache_miss));
+        gf_proc_dump_write ("file-data-invals", "%"PRId64,
+                            GF_ATOMIC_GET (priv->qr_counter.file_data_invals));
 
-out:
         return 0;
 }
 
@@ -916,6 +1207,12 @@ reconfigure (xlator_t *this, dict_t *options)
         GF_OPTION_RECONF ("cache-invalidation", conf->qr_invalidation, options,
                           bool, out);
 
+        GF_OPTION_RECONF ("cache-compression", conf->compression, options,
+                          bool, out);
+
+        GF_OPTION_RECONF ("admission-filter", conf->admission_filter, options,
+                          bool, out);
+
         GF_OPTION_RECONF ("cache-size", cache_size_new, options, size_uint64, out);
         if (!check_cache_size_ok (this, cache_size_new)) {
                 ret = -1;
@@ -1032,9 +1329,10 @@ out:
 int32_t
 init (xlator_t *this)
 {
-        int32_t       ret  = -1, i = 0;
-        qr_private_t *priv = NULL;
-        qr_conf_t    *conf = NULL;
+        int32_t       ret   = -1, i = 0, j = 0;
+        qr_private_t *priv  = NULL;
+        qr_conf_t    *conf  = NULL;
+        qr_shard_t   *shard = NULL;
 
         if (!this->children || this->children->next) {
                 gf_msg (this->name, GF_LOG_ERROR, 0,
@@ -1056,7 +1354,6 @@ init (xlator_t *this)
                 goto out;
         }
 
-        LOCK_INIT (&priv->table.lock);
         conf = &priv->conf;
 
         GF_OPTION_INIT ("max-file-size", conf->max_file_size, size_uint64, out);
@@ -1065,6 +1362,10 @@ init (xlator_t *this)
 
         GF_OPTION_INIT ("cache-invalidation", conf->qr_invalidation, bool, out);
 
+        GF_OPTION_INIT ("cache-compression", conf->compression, bool, out);
+
+        GF_OPTION_INIT ("admission-filter", conf->admission_filter, bool, out);
+
         GF_OPTION_INIT ("cache-size", conf->cache_size, size_uint64, out);
         if (!check_cache_size_ok (this, conf->cache_size)) {
                 ret = -1;
@@ -1088,17 +1389,26 @@ init (xlator_t *this)
                 conf->max_pri ++;
         }
 
-        priv->table.lru = GF_CALLOC (conf->max_pri, sizeof (*priv->table.lru),
-                                     gf_common_mt_list_head);
-        if (priv->table.lru == NULL) {
-                ret = -1;
-                goto out;
-        }
+        for (i = 0; i < QR_SHARD_COUNT; i++) {
+                shard = &priv->table.shards[i];
+
+                shard->lru = GF_CALLOC (conf->max_pri, sizeof (*shard->lru),
+                                        gf_common_mt_list_head);
+                if (shard->lru == NULL) {
+                        ret = -1;
+                        goto out;
+                }
+
+                for (j = 0; j < conf->max_pri; j++) {
+                        INIT_LIST_HEAD (&shard->lru[j]);
+                }
 
-        for (i = 0; i < conf->max_pri; i++) {
-                INIT_LIST_HEAD (&priv->table.lru[i]);
+                LOCK_INIT (&shard->lock);
+                shard->table = &priv->table;
         }
 
+        GF_ATOMIC_INIT (priv->table.cache_used, 0);
+
         ret = 0;
 
         time (&priv->last_child_down);
@@ -1106,6 +1416,12 @@ init (xlator_t *this)
         this->private = priv;
 out:
         if ((ret == -1) && priv) {
+                for (i = 0; i < QR_SHARD_COUNT; i++) {
+                        if (priv->table.shards[i].lru == NULL)
+                                break;
+                        GF_FREE (priv->table.shards[i].lru);
+                        LOCK_DESTROY (&priv->table.shards[i].lock);
+                }
                 GF_FREE (priv);
         }
 
@@ -1116,23 +1432,31 @@ out:
 void
 qr_inode_table_destroy (qr_private_t *priv)
 {
-        int        i    = 0;
-        qr_conf_t *conf = NULL;
+        int         i     = 0;
+        int         j     = 0;
+        qr_conf_t  *conf  = NULL;
+        qr_shard_t *shard = NULL;
 
         conf = &priv->conf;
 
-        for (i = 0; i < conf->max_pri; i++) {
-                /* There is a known leak of inodes, hence until
-                 * that is fixed, log the assert as warning.
-                GF_ASSERT (list_empty (&priv->table.lru[i]));*/
-                if (!list_empty (&priv->table.lru[i])) {
-                        gf_msg ("quick-read", GF_LOG_INFO, 0,
-                                QUICK_READ_MSG_LRU_NOT_EMPTY,
-                                "quick read inode table lru not empty");
+        for (i = 0; i < QR_SHARD_COUNT; i++) {
+                shard = &priv->table.shards[i];
+
+                for (j = 0; j < conf->max_pri; j++) {
+                        /* There is a known leak of inodes, hence until
+                         * that is fixed, log the assert as warning.
+                        GF_ASSERT (list_empty (&shard->lru[j]));*/
+                        if (!list_empty (&shard->lru[j])) {
+                                gf_msg ("quick-read", GF_LOG_INFO, 0,
+                                        QUICK_READ_MSG_LRU_NOT_EMPTY,
+                                        "quick read inode table lru not "
+                                        "empty");
+                        }
                 }
-        }
 
-        LOCK_DESTROY (&priv->table.lock);
+                GF_FREE (shard->lru);
+                LOCK_DESTROY (&shard->lock);
+        }
 
         return;
 }
@@ -1312,5 +1636,23 @@ struct volume_options options[] = {
           .description = "When \"on\", invalidates/updates the metadata cache,"
                          " on receiving the cache-invalidation notifications",
         },
+        { .key = {"cache-compression"},
+          .type = GF_OPTION_TYPE_BOOL,
+          .default_value = "off",
+          .op_version = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_CLIENT_OPT | OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .description = "Keep cached files compressed when that saves at "
+                         "least an eighth of their size. More files fit in "
+                         "cache-size, at the cost of CPU on every cached read."
+        },
+        { .key = {"admission-filter"},
+          .type = GF_OPTION_TYPE_BOOL,
+          .default_value = "on",
+          .op_version = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_CLIENT_OPT | OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .description = "When the cache is full, only cache a file if it is "
+                         "looked up more often than the file it would evict."
+                         " Keeps scans of many files from flushing the cache."
+        },
         { .key  = {NULL} }
 };
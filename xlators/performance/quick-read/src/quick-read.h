@@ -30,14 +30,26 @@
 #include "quick-read-mem-types.h"
 
 
+#define QR_SHARD_COUNT   16
+#define QR_SKETCH_DEPTH  4
+#define QR_SKETCH_WIDTH  4096  /* counters in a row, a power of 2 */
+#define QR_SKETCH_MAX    15    /* counters saturate here */
+
+struct qr_shard;
+struct qr_inode_table;
+
 struct qr_inode {
 	void             *data;
 	size_t            size;
+        size_t            stored; /* bytes of data, smaller than size when
+                                     the content is compressed */
+        gf_boolean_t      compressed;
         int               priority;
 	uint32_t          ia_mtime;
 	uint32_t          ia_mtime_nsec;
 	struct iatt       buf;
         struct timeval    last_refresh;
+        struct qr_shard  *shard;
         struct list_head  lru;
 };
 typedef struct qr_inode qr_inode_t;
@@ -56,14 +68,37 @@ struct qr_conf {
         uint64_t         cache_size;
         int              max_pri;
         gf_boolean_t     qr_invalidation;
+        gf_boolean_t     compression;
+        gf_boolean_t     admission_filter;
         struct list_head priority_list;
 };
 typedef struct qr_conf qr_conf_t;
 
-struct qr_inode_table {
+/*
+ * The cache is split by gfid in shards, each one with its own lock and
+ * LRU lists. cache-size bounds the files cached by all of them together.
+ * A shard counts how often the files hashed to it are accessed, cached or
+ * not, in a count-min sketch which decides whether a file is worth
+ * evicting another one (TinyLFU).
+ */
+struct qr_shard {
+        gf_lock_t         lock;
+        struct qr_inode_table *table;
         uint64_t          cache_used;
+        uint32_t          file_count;
+        uint32_t          compressed;  /* files cached compressed */
+        uint64_t          bytes_saved; /* by compression, in the cache now */
+        uint64_t          admitted;
+        uint64_t          rejected;    /* less popular than the victim */
         struct list_head *lru;
-        gf_lock_t         lock;
+        uint32_t          samples;     /* counted since the last aging */
+        uint8_t           sketch[QR_SKETCH_DEPTH][QR_SKETCH_WIDTH];
+};
+typedef struct qr_shard qr_shard_t;
+
+struct qr_inode_table {
+        gf_atomic_t       cache_used;  /* by the files of all the shards */
+        struct qr_shard   shards[QR_SHARD_COUNT];
 };
 typedef struct qr_inode_table qr_inode_table_t;
 
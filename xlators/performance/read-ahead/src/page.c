@@ -126,6 +126,67 @@ ra_waitq_return (ra_waitq_t *waitq)
 }
 
 
+/*
+ * ra_page_fill - give a page its part of the reply to a fault. @start is
+ *                the offset of the page from the start of the fault.
+ */
+static int
+ra_page_fill (ra_page_t *page, struct iovec *vector, int32_t count,
+              struct iobref *iobref, off_t start)
+{
+        size_t  length    = 0;
+        int32_t sub_count = 0;
+
+        length = iov_length (vector, count);
+        if (start >= length) {
+                /* end of file */
+                start = length;
+        }
+
+        sub_count = iov_subset (vector, count, start,
+                                min (start + page->file->page_size, length),
+                                NULL);
+
+        if (page->vector) {
+                iobref_unref (page->iobref);
+                GF_FREE (page->vector);
+        }
+
+        page->vector = GF_CALLOC (max (sub_count, 1), sizeof (struct iovec),
+                                  gf_ra_mt_iovec);
+        if (page->vector == NULL)
+                return -1;
+
+        page->count = iov_subset (vector, count, start,
+                                  min (start + page->file->page_size, length),
+                                  page->vector);
+        page->iobref = iobref_ref (iobref);
+        page->ready = 1;
+
+        page->size = iov_length (page->vector, page->count);
+
+        return 0;
+}
+
+
+/* moving average of the time the child takes to answer a fault */
+static void
+ra_file_update_latency (ra_file_t *file, struct timeval *wind_time)
+{
+        struct timeval now     = {0, };
+        uint64_t       latency = 0;
+
+        gettimeofday (&now, NULL);
+        latency = (now.tv_sec - wind_time->tv_sec) * 1000000
+                  + now.tv_usec - wind_time->tv_usec;
+
+        if (file->latency == 0)
+                file->latency = latency;
+        else
+                file->latency = (7 * file->latency + latency) / 8;
+}
+
+
 int
 ra_fault_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
               int32_t op_ret, int32_t op_errno, struct iovec *vector,
@@ -134,9 +195,12 @@ ra_fault_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 {
         ra_local_t   *local          = NULL;
         off_t         pending_offset = 0;
+        off_t         trav_offset    = 0;
         ra_file_t    *file           = NULL;
         ra_page_t    *page           = NULL;
         ra_waitq_t   *waitq          = NULL;
+        ra_waitq_t   *last           = NULL;
+        ra_waitq_t   *page_waitq     = NULL;
         fd_t         *fd             = NULL;
         uint64_t      tmp_file       = 0;
         gf_boolean_t  stale          = _gf_false;
@@ -165,69 +229,81 @@ ra_fault_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
                 if (op_ret >= 0)
                         file->stbuf = *stbuf;
 
-                page = ra_page_get (file, pending_offset);
-
-                if (!page) {
-                        gf_msg_trace (this->name, 0,
-                                      "wasted copy: "
-                                      "%"PRId64"[+%"PRId64"] file=%p",
-                                      pending_offset, file->page_size, file);
-                        goto unlock;
-                }
+                ra_file_update_latency (file, &local->wind_time);
+
+                /* a fault covers one or more consecutive pages */
+                for (trav_offset = pending_offset;
+                     trav_offset < pending_offset + local->pending_size;
+                     trav_offset += file->page_size) {
+                        page = ra_page_get (file, trav_offset);
+
+                        if (!page) {
+                                gf_msg_trace (this->name, 0,
+                                              "wasted copy: "
+                                              "%"PRId64"[+%"PRId64"] file=%p",
+                                              trav_offset, file->page_size,
+                                              file);
+                                continue;
+                        }
 
-                if (page->stale) {
-                        page->stale = 0;
-                        page->ready = 0;
-                        stale = 1;
-                        goto unlock;
-                }
+                        if (page->stale) {
+                                page->stale = 0;
+                                page->ready = 0;
+                                stale = 1;
+                                continue;
+                        }
 
-                /*
-                 * "Dirty" means that the request was a pure read-ahead; it's
-                 * set for requests we issue ourselves, and cleared when user
-                 * requests are issued or put on the waitq.  "Poisoned" means
-                 * that we got a write while a read was still in flight, and we
-                 * couldn't stop it so we marked it instead.  If it's both
-                 * dirty and poisoned by the time we get here, we cancel its
-                 * effect so that a subsequent user read doesn't get data that
-                 * we know is stale (because we made it stale ourselves).  We
-                 * can't use ESTALE because that has special significance.
-                 * ECANCELED has no such special meaning, and is close to what
-                 * we're trying to indicate.
-                 */
-                if (page->dirty && page->poisoned) {
-                        op_ret = -1;
-                        op_errno = ECANCELED;
-                }
+                        /*
+                         * "Dirty" means that the request was a pure
+                         * read-ahead; it's set for requests we issue
+                         * ourselves, and cleared when user requests are
+                         * issued or put on the waitq.  "Poisoned" means that
+                         * we got a write while a read was still in flight,
+                         * and we couldn't stop it so we marked it instead.
+                         * If it's both dirty and poisoned by the time we get
+                         * here, we cancel its effect so that a subsequent
+                         * user read doesn't get data that we know is stale
+                         * (because we made it stale ourselves).  We can't
+                         * use ESTALE because that has special significance.
+                         * ECANCELED has no such special meaning, and is
+                         * close to what we're trying to indicate.
+                         */
+                        if (page->dirty && page->poisoned) {
+                                page_waitq = ra_page_error (page, -1,
+                                                            ECANCELED);
+                        } else if (op_ret < 0) {
+                                page_waitq = ra_page_error (page, op_ret,
+                                                            op_errno);
+                        } else if (ra_page_fill (page, vector, count, iobref,
+                                                 trav_offset
+                                                 - pending_offset) != 0) {
+                                page_waitq = ra_page_error (page, -1, ENOMEM);
+                        } else {
+                                page_waitq = ra_page_wakeup (page);
+                        }
 
-                if (op_ret < 0) {
-                        waitq = ra_page_error (page, op_ret, op_errno);
-                        goto unlock;
-                }
+                        /* chain the waiters of all the pages */
+                        if (page_waitq == NULL)
+                                continue;
 
-                if (page->vector) {
-                        iobref_unref (page->iobref);
-                        GF_FREE (page->vector);
-                }
+                        if (waitq == NULL)
+                                waitq = page_waitq;
+                        else
+                                last->next = page_waitq;
 
-                page->vector = iov_dup (vector, count);
-                if (page->vector == NULL) {
-                        waitq = ra_page_error (page, -1, ENOMEM);
-                        goto unlock;
+                        for (last = page_waitq; last->next; last = last->next)
+                                ;
                 }
-
-                page->count = count;
-                page->iobref = iobref_ref (iobref);
-                page->ready = 1;
-
-                page->size = iov_length (vector, count);
-
-                waitq = ra_page_wakeup (page);
         }
-unlock:
         ra_file_unlock (file);
 
+        ra_waitq_return (waitq);
+
         if (stale) {
+                /* pages written to while they were read are read again,
+                 * the others are simply filled once more */
+                gettimeofday (&local->wind_time, NULL);
+
                 STACK_WIND (frame, ra_fault_cbk,
                             FIRST_CHILD (frame->this),
                             FIRST_CHILD (frame->this)->fops->readv,
@@ -237,8 +313,6 @@ unlock:
                 return 0;
         }
 
-        ra_waitq_return (waitq);
-
         fd_unref (local->fd);
 
         mem_put (frame->local);
@@ -250,14 +324,20 @@ out:
 }
 
 
+/*
+ * ra_page_fault - read @count consecutive pages from the child, with a
+ *                 single read.
+ */
 void
-ra_page_fault (ra_file_t *file, call_frame_t *frame, off_t offset)
+ra_page_fault (ra_file_t *file, call_frame_t *frame, off_t offset,
+               uint32_t count)
 {
         call_frame_t *fault_frame = NULL;
         ra_local_t   *fault_local = NULL;
         ra_page_t    *page        = NULL;
         ra_waitq_t   *waitq       = NULL;
         int32_t       op_ret      = -1, op_errno = -1;
+        uint32_t      i           = 0;
 
         GF_VALIDATE_OR_GOTO ("read-ahead", frame, out);
         GF_VALIDATE_OR_GOTO (frame->this->name, file, out);
@@ -279,29 +359,34 @@ ra_page_fault (ra_file_t *file, call_frame_t *frame, off_t offset)
 
         fault_frame->local = fault_local;
         fault_local->pending_offset = offset;
-        fault_local->pending_size = file->page_size;
+        fault_local->pending_size = file->page_size * count;
 
         fault_local->fd = fd_ref (file->fd);
+        gettimeofday (&fault_local->wind_time, NULL);
 
         STACK_WIND (fault_frame, ra_fault_cbk,
                     FIRST_CHILD (fault_frame->this),
                     FIRST_CHILD (fault_frame->this)->fops->readv,
-                    file->fd, file->page_size, offset, 0, NULL);
+                    file->fd, fault_local->pending_size, offset, 0, NULL);
 
         return;
 
 err:
-        ra_file_lock (file);
-        {
-                page = ra_page_get (file, offset);
-                if (page)
-                        waitq = ra_page_error (page, op_ret,
-                                               op_errno);
-        }
-        ra_file_unlock (file);
+        for (i = 0; i < count; i++) {
+                ra_file_lock (file);
+                {
+                        page = ra_page_get (file,
+                                            offset + i * file->page_size);
+                        if (page)
+                                waitq = ra_page_error (page, op_ret,
+                                                       op_errno);
+                }
+                ra_file_unlock (file);
 
-        if (waitq != NULL) {
-                ra_waitq_return (waitq);
+                if (waitq != NULL) {
+                        ra_waitq_return (waitq);
+                        waitq = NULL;
+                }
         }
 
 out:
@@ -541,6 +626,13 @@ ra_page_purge (ra_page_t *page)
         page->prev->next = page->next;
         page->next->prev = page->prev;
 
+        /* read ahead, and never read */
+        if (page->dirty) {
+                GF_ATOMIC_ADD (page->file->conf->wasted,
+                               page->ready ? page->size
+                                           : page->file->page_size);
+        }
+
         if (page->iobref) {
                 iobref_unref (page->iobref);
         }
@@ -26,7 +26,7 @@
 #include "read-ahead-messages.h"
 
 static void
-read_ahead (call_frame_t *frame, ra_file_t *file);
+read_ahead (call_frame_t *frame, ra_file_t *file, int index);
 
 
 int
@@ -58,7 +58,6 @@ ra_open_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
         if ((fd->flags & O_DIRECT) || ((fd->flags & O_ACCMODE) == O_WRONLY))
                 file->disabled = 1;
 
-        file->offset = (unsigned long long) 0;
         file->conf = conf;
         file->pages.next = &file->pages;
         file->pages.prev = &file->pages;
@@ -75,13 +74,12 @@ ra_open_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
         ra_conf_unlock (conf);
 
         file->fd = fd;
-        file->page_count = conf->page_count;
         file->page_size = conf->page_size;
         pthread_mutex_init (&file->file_lock, NULL);
 
-        if (!file->disabled) {
-                file->page_count = 1;
-        }
+        /* a file is expected to be read from its start */
+        file->streams[0].active = _gf_true;
+        gettimeofday (&file->streams[0].last, NULL);
 
         ret = fd_ctx_set (fd, this, (uint64_t)(long)file);
         if (ret == -1) {
@@ -135,8 +133,6 @@ ra_create_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
         if ((fd->flags & O_DIRECT) || ((fd->flags & O_ACCMODE) == O_WRONLY))
                 file->disabled = 1;
 
-        file->offset = (unsigned long long) 0;
-        //file->size = fd->inode->buf.ia_size;
         file->conf = conf;
         file->pages.next = &file->pages;
         file->pages.prev = &file->pages;
@@ -153,10 +149,13 @@ ra_create_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
         ra_conf_unlock (conf);
 
         file->fd = fd;
-        file->page_count = conf->page_count;
         file->page_size = conf->page_size;
         pthread_mutex_init (&file->file_lock, NULL);
 
+        /* a file is expected to be read from its start */
+        file->streams[0].active = _gf_true;
+        gettimeofday (&file->streams[0].last, NULL);
+
         ret = fd_ctx_set (fd, this, (uint64_t)(long)file);
         if (ret == -1) {
                 gf_msg (this->name, GF_LOG_WARNING,
@@ -218,9 +217,16 @@ flush_region (call_frame_t *frame, ra_file_t *file, off_t offset, off_t size,
 {
         ra_page_t *trav = NULL;
         ra_page_t *next = NULL;
+        int        i    = 0;
 
         ra_file_lock (file);
         {
+                /* what was read ahead in the region is read again */
+                for (i = 0; i < RA_MAX_STREAMS; i++) {
+                        if (file->streams[i].ra_end > offset)
+                                file->streams[i].ra_end = offset;
+                }
+
                 trav = file->pages.next;
                 while (trav != &file->pages
                        && trav->offset < (offset + size)) {
@@ -265,82 +271,326 @@ out:
 }
 
 
-void
-read_ahead (call_frame_t *frame, ra_file_t *file)
+/*
+ * ra_stream_match - find the stream a read of @size bytes at @offset follows,
+ *                   and move it to that read. A read that follows no stream
+ *                   replaces the stream that was read the longest time ago.
+ *                   Returns the index of the stream.
+ */
+static int
+ra_stream_match (ra_file_t *file, off_t offset, size_t size)
 {
-        off_t      ra_offset   = 0;
-        size_t     ra_size     = 0;
-        off_t      trav_offset = 0;
-        ra_page_t *trav        = NULL;
-        off_t      cap         = 0;
-        char       fault       = 0;
+        ra_stream_t    *stream = NULL;
+        struct timeval  now    = {0, };
+        uint64_t        usecs  = 0;
+        uint64_t        rate   = 0;
+        int             victim = -1;
+        int             i      = 0;
+
+        gettimeofday (&now, NULL);
+
+        /* sequential, or the same distance after the last read */
+        for (i = 0; i < RA_MAX_STREAMS; i++) {
+                stream = &file->streams[i];
+                if (!stream->active)
+                        continue;
+
+                if ((offset == stream->offset + stream->size)
+                    || (stream->step
+                        && (offset == stream->offset + stream->step)))
+                        goto hit;
+        }
 
-        GF_VALIDATE_OR_GOTO ("read-ahead", frame, out);
-        GF_VALIDATE_OR_GOTO (frame->this->name, file, out);
+        /* a read shortly after the first read of a stream guesses its
+         * stride, the next one confirms it */
+        for (i = 0; i < RA_MAX_STREAMS; i++) {
+                stream = &file->streams[i];
+                if (stream->active && (stream->expected == 0)
+                    && (offset > stream->offset + stream->size)
+                    && (offset - stream->offset <= RA_MAX_STRIDE)) {
+                        stream->step = offset - stream->offset;
+                        goto update;
+                }
+        }
 
-        if (!file->page_count) {
-                goto out;
+        for (i = 0; i < RA_MAX_STREAMS; i++) {
+                stream = &file->streams[i];
+                if (!stream->active) {
+                        victim = i;
+                        break;
+                }
+
+                if ((victim < 0)
+                    || timercmp (&stream->last, &file->streams[victim].last,
+                                 <))
+                        victim = i;
         }
 
-        ra_size   = file->page_size * file->page_count;
-        ra_offset = floor (file->offset, file->page_size);
-        cap       = file->size ? file->size : file->offset + ra_size;
+        i = victim;
+        stream = &file->streams[i];
+        memset (stream, 0, sizeof (*stream));
+        stream->active = _gf_true;
+        goto update;
+
+hit:
+        stream->step = offset - stream->offset;
+        if (stream->step == 0) {
+                /* first read of the file */
+                stream->step = size;
+        }
+        stream->expected += size;
 
-        while (ra_offset < min (file->offset + ra_size, cap)) {
+        usecs = (now.tv_sec - stream->last.tv_sec) * 1000000
+                + now.tv_usec - stream->last.tv_usec;
+        rate = size * 1000000 / max (usecs, 1);
+        stream->rate = stream->rate ? (3 * stream->rate + rate) / 4 : rate;
 
-                ra_file_lock (file);
-                {
-                        trav = ra_page_get (file, ra_offset);
+update:
+        stream->offset = offset;
+        stream->size = size;
+        stream->last = now;
+
+        return i;
+}
+
+
+/*
+ * ra_stream_window - the number of pages a stream keeps read ahead: what it
+ *                    reads during two round trips to the child, doubled
+ *                    each time the reader has to wait for a page that is
+ *                    being read ahead, and shrunk slowly when it reads less.
+ */
+static void
+ra_stream_window (ra_conf_t *conf, ra_file_t *file, ra_stream_t *stream,
+                  gf_boolean_t waited)
+{
+        uint64_t target = 0;
+
+        target = stream->rate * file->latency * 2 / 1000000;
+        target = roof (target, file->page_size) / file->page_size;
+        target = min (max (target, 1), conf->page_count);
+
+        if (stream->window == 0) {
+                stream->window = max (stream->expected / file->page_size,
+                                      target);
+        } else if (waited) {
+                stream->window *= 2;
+        } else if (stream->window < target) {
+                stream->window = target;
+        } else if (stream->window > 2 * target) {
+                stream->window--;
+        }
+
+        stream->window = min (max (stream->window, 1), conf->page_count);
+}
+
+
+static void
+ra_ahead_fault (call_frame_t *frame, ra_file_t *file, off_t offset,
+                uint32_t count)
+{
+        gf_msg_trace (frame->this->name, 0,
+                      "RA at offset=%"PRId64" for %u pages", offset, count);
+
+        GF_ATOMIC_ADD (file->conf->prefetched, count * file->page_size);
+        ra_page_fault (file, frame, offset, count);
+}
+
+
+/*
+ * read_ahead - keep the window of the stream followed by the current read
+ *              filled. Nothing is read until a part of the window has been
+ *              consumed, and then all of it at once: consecutive missing
+ *              pages are read together, up to RA_MAX_IO_SIZE at a time. A
+ *              strided stream only gets the pages of its next records.
+ */
+static void
+read_ahead (call_frame_t *frame, ra_file_t *file, int index)
+{
+        ra_local_t   *local       = NULL;
+        ra_conf_t    *conf        = NULL;
+        ra_stream_t  *stream      = NULL;
+        ra_page_t    *trav        = NULL;
+        off_t         next        = 0;
+        off_t         start       = 0;
+        off_t         end         = 0;
+        off_t         record      = 0;
+        off_t         step        = 0;
+        off_t         trav_offset = 0;
+        off_t         run_offset  = 0;
+        size_t        size        = 0;
+        uint32_t      records     = 0;
+        uint32_t      run_count   = 0;
+        uint32_t      max_run     = 0;
+        char          fault       = 0;
+        gf_boolean_t  ahead       = _gf_false;
+
+        GF_VALIDATE_OR_GOTO ("read-ahead", frame, out);
+        GF_VALIDATE_OR_GOTO (frame->this->name, file, out);
+
+        local   = frame->local;
+        conf    = file->conf;
+        max_run = max (RA_MAX_IO_SIZE / file->page_size, 1);
+
+        ra_file_lock (file);
+        {
+                stream = &file->streams[index];
+
+                /* a stream is read ahead once it has been followed, unless
+                 * another read took it over meanwhile */
+                if (!stream->active || (stream->expected == 0)
+                    || (stream->offset != local->offset))
+                        goto unlock;
+
+                ra_stream_window (conf, file, stream, local->waited);
+
+                size = stream->size;
+                step = max (stream->step, size);
+                next = stream->offset + size;
+
+                if (step > size) {
+                        records = stream->window
+                                  / (size / file->page_size + 1);
+                        records = max (records, 1);
+                        end = stream->offset + records * step + size;
+                        record = stream->offset + step;
+                } else {
+                        end = floor (next, file->page_size)
+                              + stream->window * file->page_size;
                 }
-                ra_file_unlock (file);
 
-                if (!trav)
-                        break;
+                if (file->stbuf.ia_size)
+                        end = min (end, roof ((off_t)file->stbuf.ia_size,
+                                              file->page_size));
 
-                ra_offset += file->page_size;
+                /* comfortable enough until a quarter of the window, or
+                 * a full read, is missing */
+                start = max (stream->ra_end, next);
+                if ((start >= end)
+                    || (end - start < min (max (stream->window / 4, 1),
+                                           max_run) * file->page_size))
+                        goto unlock;
+
+                stream->ra_end = end;
+                ahead = _gf_true;
         }
+unlock:
+        ra_file_unlock (file);
 
-        if (trav) {
-                /* comfortable enough */
+        if (!ahead)
                 goto out;
+
+        if (step > size) {
+                /* skip the records which are already read ahead */
+                if (start > record + (off_t)size)
+                        record += roof (start - record - (off_t)size, step);
+        } else {
+                /* all of it is one record */
+                record = start;
+                size = step = end - start;
         }
 
-        trav_offset = ra_offset;
+        trav_offset = floor (start, file->page_size);
 
-        cap  = file->size ? file->size : ra_offset + ra_size;
+        for (; record < end; record += step) {
+                trav_offset = max (trav_offset,
+                                   floor (record, file->page_size));
+
+                for (; trav_offset < min (record + (off_t)size, end);
+                     trav_offset += file->page_size) {
+                        fault = 0;
+                        ra_file_lock (file);
+                        {
+                                trav = ra_page_get (file, trav_offset);
+                                if (!trav) {
+                                        trav = ra_page_create (file,
+                                                               trav_offset);
+                                        if (trav) {
+                                                trav->dirty = 1;
+                                                fault = 1;
+                                        }
+                                }
+                        }
+                        ra_file_unlock (file);
 
-        while (trav_offset < min(ra_offset + ra_size, cap)) {
-                fault = 0;
-                ra_file_lock (file);
-                {
-                        trav = ra_page_get (file, trav_offset);
                         if (!trav) {
-                                fault = 1;
-                                trav = ra_page_create (file, trav_offset);
-                                if (trav)
-                                        trav->dirty = 1;
+                                /* OUT OF MEMORY */
+                                goto fault;
                         }
-                }
-                ra_file_unlock (file);
 
-                if (!trav) {
-                        /* OUT OF MEMORY */
-                        break;
-                }
+                        if (run_count
+                            && (!fault || (run_count == max_run)
+                                || (run_offset + run_count * file->page_size
+                                    != trav_offset))) {
+                                ra_ahead_fault (frame, file, run_offset,
+                                                run_count);
+                                run_count = 0;
+                        }
 
-                if (fault) {
-                        gf_msg_trace (frame->this->name, 0,
-                                      "RA at offset=%"PRId64, trav_offset);
-                        ra_page_fault (file, frame, trav_offset);
+                        if (fault) {
+                                if (run_count == 0)
+                                        run_offset = trav_offset;
+                                run_count++;
+                        }
                 }
-                trav_offset += file->page_size;
         }
 
+fault:
+        if (run_count)
+                ra_ahead_fault (frame, file, run_offset, run_count);
+
 out:
         return;
 }
 
 
+/*
+ * ra_prune - drop the cached pages no stream needs: those behind the last
+ *            read of every stream, or beyond what it has read ahead.
+ */
+static void
+ra_prune (ra_file_t *file)
+{
+        ra_page_t    *trav   = NULL;
+        ra_page_t    *next   = NULL;
+        ra_stream_t  *stream = NULL;
+        off_t         end    = 0;
+        gf_boolean_t  keep   = _gf_false;
+        int           i      = 0;
+
+        ra_file_lock (file);
+        {
+                for (trav = file->pages.next; trav != &file->pages;
+                     trav = next) {
+                        next = trav->next;
+
+                        if (!trav->ready || trav->waitq)
+                                continue;
+
+                        keep = _gf_false;
+                        for (i = 0; i < RA_MAX_STREAMS; i++) {
+                                stream = &file->streams[i];
+                                if (!stream->active)
+                                        continue;
+
+                                end = max (stream->ra_end,
+                                           stream->offset + stream->size);
+                                if ((trav->offset >= floor (stream->offset,
+                                                            file->page_size))
+                                    && (trav->offset < end)) {
+                                        keep = _gf_true;
+                                        break;
+                                }
+                        }
+
+                        if (!keep)
+                                ra_page_purge (trav);
+                }
+        }
+        ra_file_unlock (file);
+}
+
+
 int
 ra_need_atime_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
                    int32_t op_ret, int32_t op_errno, struct iovec *vector,
@@ -361,6 +611,9 @@ dispatch_requests (call_frame_t *frame, ra_file_t *file)
         off_t         rounded_offset    = 0;
         off_t         rounded_end       = 0;
         off_t         trav_offset       = 0;
+        off_t         run_offset        = 0;
+        uint32_t      run_count         = 0;
+        uint32_t      max_run           = 0;
         ra_page_t    *trav              = NULL;
         call_frame_t *ra_frame          = NULL;
         char          need_atime_update = 1;
@@ -374,6 +627,7 @@ dispatch_requests (call_frame_t *frame, ra_file_t *file)
 
         rounded_offset = floor (local->offset, file->page_size);
         rounded_end    = roof (local->offset + local->size, file->page_size);
+        max_run        = max (RA_MAX_IO_SIZE / file->page_size, 1);
 
         trav_offset = rounded_offset;
 
@@ -392,6 +646,13 @@ dispatch_requests (call_frame_t *frame, ra_file_t *file)
                                 }
                                 fault = 1;
                                 need_atime_update = 0;
+                        } else if (trav->dirty) {
+                                /* read ahead, and now read */
+                                GF_ATOMIC_ADD (conf->consumed, trav->ready
+                                               ? trav->size
+                                               : file->page_size);
+                                if (!trav->ready)
+                                        local->waited = _gf_true;
                         }
                         trav->dirty = 0;
 
@@ -413,19 +674,35 @@ dispatch_requests (call_frame_t *frame, ra_file_t *file)
                 ra_file_unlock (file);
 
                 if (local->op_ret == -1) {
-                        goto out;
+                        break;
+                }
+
+                /* the missing pages are read together */
+                if (run_count && (!fault || (run_count == max_run))) {
+                        ra_page_fault (file, frame, run_offset, run_count);
+                        run_count = 0;
                 }
 
                 if (fault) {
                         gf_msg_trace (frame->this->name, 0,
                                       "MISS at offset=%"PRId64".",
                                       trav_offset);
-                        ra_page_fault (file, frame, trav_offset);
+                        if (run_count == 0)
+                                run_offset = trav_offset;
+                        run_count++;
                 }
 
                 trav_offset += file->page_size;
         }
 
+        if (run_count) {
+                ra_page_fault (file, frame, run_offset, run_count);
+        }
+
+        if (local->op_ret == -1) {
+                goto out;
+        }
+
         if (need_atime_update && conf->force_atime_update) {
                 /* TODO: use untimens() since readv() can confuse underlying
                    io-cache and others */
@@ -466,17 +743,14 @@ ra_readv (call_frame_t *frame, xlator_t *this, fd_t *fd, size_t size,
 {
         ra_file_t   *file            = NULL;
         ra_local_t  *local           = NULL;
-        ra_conf_t   *conf            = NULL;
         int          op_errno        = EINVAL;
-        char         expected_offset = 1;
+        int          index           = 0;
         uint64_t     tmp_file        = 0;
 
         GF_ASSERT (frame);
         GF_VALIDATE_OR_GOTO (frame->this->name, this, unwind);
         GF_VALIDATE_OR_GOTO (frame->this->name, fd, unwind);
 
-        conf = this->private;
-
         gf_msg_trace (this->name, 0,
                       "NEW REQ at offset=%"PRId64" for size=%"GF_PRI_SIZET"",
                       offset, size);
@@ -488,29 +762,17 @@ ra_readv (call_frame_t *frame, xlator_t *this, fd_t *fd, size_t size,
                 goto disabled;
         }
 
-        if (file->offset != offset) {
-                gf_msg_trace (this->name, 0,
-                              "unexpected offset (%"PRId64" != %"PRId64") "
-                              "resetting",
-                              file->offset, offset);
+        ra_file_lock (file);
+        {
+                index = ra_stream_match (file, offset, size);
 
-                expected_offset = file->expected = file->page_count = 0;
-        } else {
                 gf_msg_trace (this->name, 0,
-                              "expected offset (%"PRId64") when page_count=%d",
-                              offset, file->page_count);
-
-                if (file->expected < (file->page_size * conf->page_count)) {
-                        file->expected += size;
-                        file->page_count = min ((file->expected
-                                                 / file->page_size),
-                                                conf->page_count);
-                }
-        }
-
-        if (!expected_offset) {
-                flush_region (frame, file, 0, file->pages.prev->offset + 1, 0);
+                              "stream %d at offset=%"PRId64" step=%"PRId64
+                              " window=%u", index, offset,
+                              file->streams[index].step,
+                              file->streams[index].window);
         }
+        ra_file_unlock (file);
 
         local = mem_get0 (this->local_pool);
         if (!local) {
@@ -532,14 +794,12 @@ ra_readv (call_frame_t *frame, xlator_t *this, fd_t *fd, size_t size,
 
         dispatch_requests (frame, file);
 
-        flush_region (frame, file, 0, floor (offset, file->page_size), 0);
+        ra_prune (file);
 
-        read_ahead (frame, file);
+        read_ahead (frame, file, index);
 
         ra_frame_return (frame);
 
-        file->offset = offset + size;
-
         return 0;
 
 unwind:
@@ -677,8 +937,12 @@ ra_writev (call_frame_t *frame, xlator_t *this, fd_t *fd, struct iovec *vector,
         if (file) {
                 flush_region (frame, file, 0, file->pages.prev->offset+1, 1);
                 frame->local = file;
-                /* reset the read-ahead counters too */
-                file->expected = file->page_count = 0;
+                /* reset the access patterns too */
+                ra_file_lock (file);
+                {
+                        memset (file->streams, 0, sizeof (file->streams));
+                }
+                ra_file_unlock (file);
         }
 
         STACK_WIND (frame, ra_writev_cbk,
@@ -805,7 +1069,8 @@ ra_fdctx_dump (xlator_t *this, fd_t *fd)
 {
 	ra_file_t    *file     = NULL;
         ra_page_t    *page     = NULL;
-        int32_t       ret      = 0, i = 0;
+        ra_stream_t  *stream   = NULL;
+        int32_t       ret      = 0, i = 0, j = 0;
         uint64_t      tmp_file = 0;
         char         *path     = NULL;
         char          key[GF_DUMP_MAX_BUF_LEN]        = {0, };
@@ -842,10 +1107,22 @@ ra_fdctx_dump (xlator_t *this, fd_t *fd)
 
         gf_proc_dump_write ("page-size", "%"PRId64, file->page_size);
 
-        gf_proc_dump_write ("page-count", "%u", file->page_count);
-
-        gf_proc_dump_write ("next-expected-offset-for-sequential-reads",
-                            "%"PRId64, file->offset);
+        gf_proc_dump_write ("latency-usecs", "%"PRIu64, file->latency);
+
+        for (j = 0; j < RA_MAX_STREAMS; j++) {
+                stream = &file->streams[j];
+                if (!stream->active)
+                        continue;
+
+                sprintf (key, "stream[%d]", j);
+                gf_proc_dump_write (key, "offset=%"PRId64", size=%"
+                                    GF_PRI_SIZET", step=%"PRId64", "
+                                    "read-ahead-end=%"PRId64", window=%u, "
+                                    "rate=%"PRIu64, stream->offset,
+                                    stream->size, stream->step,
+                                    stream->ra_end, stream->window,
+                                    stream->rate);
+        }
 
         for (page = file->pages.next; page != &file->pages;
              page = page->next) {
@@ -1079,6 +1356,12 @@ ra_priv_dump (xlator_t *this)
                 gf_proc_dump_write ("page_count", "%d", conf->page_count);
                 gf_proc_dump_write ("force_atime_update", "%d",
                                     conf->force_atime_update);
+                gf_proc_dump_write ("prefetched_bytes", "%"PRId64,
+                                    GF_ATOMIC_GET (conf->prefetched));
+                gf_proc_dump_write ("consumed_bytes", "%"PRId64,
+                                    GF_ATOMIC_GET (conf->consumed));
+                gf_proc_dump_write ("wasted_bytes", "%"PRId64,
+                                    GF_ATOMIC_GET (conf->wasted));
         }
         pthread_mutex_unlock (&conf->conf_lock);
 
@@ -1177,6 +1460,10 @@ init (xlator_t *this)
 
         pthread_mutex_init (&conf->conf_lock, NULL);
 
+        GF_ATOMIC_INIT (conf->prefetched, 0);
+        GF_ATOMIC_INIT (conf->consumed, 0);
+        GF_ATOMIC_INIT (conf->wasted, 0);
+
         this->local_pool = mem_pool_new (ra_local_t, 64);
         if (!this->local_pool) {
                 ret = -1;
@@ -1262,9 +1549,11 @@ struct volume_options options[] = {
         { .key  = {"page-count"},
           .type = GF_OPTION_TYPE_INT,
           .min  = 1,
-          .max  = 16,
+          .max  = 64,
           .default_value = "4",
-          .description = "Number of pages that will be pre-fetched"
+          .description = "Maximum number of pages that will be pre-fetched "
+                         "for each stream of sequential or strided reads "
+                         "on a file"
         },
 	{ .key = {"page-size"},
 	  .type = GF_OPTION_TYPE_SIZET,
@@ -19,6 +19,10 @@
 #include "common-utils.h"
 #include "read-ahead-mem-types.h"
 
+#define RA_MAX_STREAMS   8              /* access patterns tracked per fd */
+#define RA_MAX_IO_SIZE   (1024 * 1024)  /* largest read sent to the child */
+#define RA_MAX_STRIDE    (1024 * 1024)  /* largest gap of a strided stream */
+
 struct ra_conf;
 struct ra_local;
 struct ra_page;
@@ -55,6 +59,8 @@ struct ra_local {
         fd_t             *fd;
         int32_t           wait_count;
         pthread_mutex_t   local_lock;
+        struct timeval    wind_time;      /* when a fault was sent */
+        gf_boolean_t      waited;         /* waited on a read-ahead page */
 };
 
 
@@ -75,21 +81,36 @@ struct ra_page {
 };
 
 
+/*
+ * ra_stream - one access pattern of an fd: a sequential stream, or reads of
+ *             the same size a fixed distance (the step) apart.
+ */
+struct ra_stream {
+        off_t             offset;   /* start of the last read */
+        size_t            size;     /* size of the last read */
+        off_t             step;     /* distance between reads, 0 if unknown */
+        off_t             ra_end;   /* end of what has been read ahead */
+        size_t            expected; /* bytes read following the pattern */
+        uint32_t          window;   /* pages to keep read ahead */
+        uint64_t          rate;     /* bytes per second, moving average */
+        struct timeval    last;     /* time of the last read */
+        gf_boolean_t      active;
+};
+
+
 struct ra_file {
         struct ra_file    *next;
         struct ra_file    *prev;
         struct ra_conf    *conf;
         fd_t              *fd;
         int                disabled;
-        size_t             expected;
         struct ra_page     pages;
-        off_t              offset;
-        size_t             size;
+        struct ra_stream   streams[RA_MAX_STREAMS];
+        uint64_t           latency; /* usecs of a read, moving average */
         int32_t            refcount;
         pthread_mutex_t    file_lock;
         struct iatt        stbuf;
         uint64_t           page_size;
-        uint32_t           page_count;
 };
 
 
@@ -100,6 +121,9 @@ struct ra_conf {
         struct ra_file    files;
         gf_boolean_t      force_atime_update;
         pthread_mutex_t   conf_lock;
+        gf_atomic_t       prefetched;  /* bytes requested by read-ahead */
+        gf_atomic_t       consumed;    /* read-ahead bytes then read */
+        gf_atomic_t       wasted;      /* read-ahead bytes dropped unread */
 };
 
 
@@ -109,6 +133,7 @@ typedef struct ra_page ra_page_t;
 typedef struct ra_file ra_file_t;
 typedef struct ra_waitq ra_waitq_t;
 typedef struct ra_fill ra_fill_t;
+typedef struct ra_stream ra_stream_t;
 
 ra_page_t *
 ra_page_get (ra_file_t *file,
@@ -121,7 +146,8 @@ ra_page_create (ra_file_t *file,
 void
 ra_page_fault (ra_file_t *file,
                call_frame_t *frame,
-               off_t offset);
+               off_t offset,
+               uint32_t count);
 void
 ra_wait_on_page (ra_page_t *page,
                  call_frame_t *frame);
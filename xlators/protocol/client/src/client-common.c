@@ -1690,10 +1690,11 @@ client_post_getxattr (xlator_t *this, gfs3_getxattr_rsp *rsp, dict_t **dict,
         int     ret      = 0;
 
         if (-1 != rsp->op_ret) {
-                GF_PROTOCOL_DICT_UNSERIALIZE (this, *dict,
-                                              (rsp->dict.dict_val),
-                                              (rsp->dict.dict_len), rsp->op_ret,
-                                               op_errno, out);
+                GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (this, *dict,
+                                                    (rsp->dict.dict_val),
+                                                    (rsp->dict.dict_len),
+                                                    rsp->op_ret, op_errno,
+                                                    out);
         }
         GF_PROTOCOL_DICT_UNSERIALIZE (this, *xdata, (rsp->xdata.xdata_val),
                                       (rsp->xdata.xdata_len), ret,
@@ -1919,10 +1920,11 @@ client_post_xattrop (xlator_t *this, gfs3_xattrop_rsp *rsp, dict_t **dict,
         int     ret      = 0;
 
         if (-1 != rsp->op_ret) {
-                GF_PROTOCOL_DICT_UNSERIALIZE (this, *dict,
-                                              (rsp->dict.dict_val),
-                                              (rsp->dict.dict_len), rsp->op_ret,
-                                               op_errno, out);
+                GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (this, *dict,
+                                                    (rsp->dict.dict_val),
+                                                    (rsp->dict.dict_len),
+                                                    rsp->op_ret, op_errno,
+                                                    out);
         }
         GF_PROTOCOL_DICT_UNSERIALIZE (this, *xdata, (rsp->xdata.xdata_val),
                                       (rsp->xdata.xdata_len), ret,
@@ -1940,10 +1942,11 @@ client_post_fxattrop (xlator_t *this, gfs3_fxattrop_rsp *rsp, dict_t **dict,
         int     ret      = 0;
 
         if (-1 != rsp->op_ret) {
-                GF_PROTOCOL_DICT_UNSERIALIZE (this, *dict,
-                                              (rsp->dict.dict_val),
-                                              (rsp->dict.dict_len), rsp->op_ret,
-                                               op_errno, out);
+                GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (this, *dict,
+                                                    (rsp->dict.dict_val),
+                                                    (rsp->dict.dict_len),
+                                                    rsp->op_ret, op_errno,
+                                                    out);
         }
         GF_PROTOCOL_DICT_UNSERIALIZE (this, *xdata, (rsp->xdata.xdata_val),
                                       (rsp->xdata.xdata_len), ret,
@@ -1961,10 +1964,11 @@ client_post_fgetxattr (xlator_t *this, gfs3_fgetxattr_rsp *rsp, dict_t **dict,
         int     ret      = 0;
 
         if (-1 != rsp->op_ret) {
-                GF_PROTOCOL_DICT_UNSERIALIZE (this, *dict,
-                                              (rsp->dict.dict_val),
-                                              (rsp->dict.dict_len), rsp->op_ret,
-                                               op_errno, out);
+                GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (this, *dict,
+                                                    (rsp->dict.dict_val),
+                                                    (rsp->dict.dict_len),
+                                                    rsp->op_ret, op_errno,
+                                                    out);
         }
         GF_PROTOCOL_DICT_UNSERIALIZE (this, *xdata, (rsp->xdata.xdata_val),
                                       (rsp->xdata.xdata_len), ret,
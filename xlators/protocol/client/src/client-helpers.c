@@ -185,7 +185,6 @@ unserialize_rsp_direntp (xlator_t *this, fd_t *fd,
                          struct gfs3_readdirp_rsp *rsp, gf_dirent_t *entries)
 {
         struct gfs3_dirplist *trav      = NULL;
-        char                 *buf       = NULL;
 	gf_dirent_t          *entry     = NULL;
         inode_table_t        *itable    = NULL;
         int                   entry_len = 0;
@@ -219,22 +218,22 @@ unserialize_rsp_direntp (xlator_t *this, fd_t *fd,
 
                 if (trav->dict.dict_val) {
                         /* Dictionary is sent along with response */
-                        buf = memdup (trav->dict.dict_val, trav->dict.dict_len);
-                        if (!buf)
-                                goto out;
-
                         entry->dict = dict_new ();
+                        if (!entry->dict)
+                                goto out;
 
-                        ret = dict_unserialize (buf, trav->dict.dict_len,
-                                                &entry->dict);
+                        /* the values point into the buffer the rpc lib
+                         * allocated, the dict frees it from now on */
+                        ret = dict_unserialize_owned (trav->dict.dict_val,
+                                                      trav->dict.dict_len,
+                                                      &entry->dict);
+                        trav->dict.dict_val = NULL;
                         if (ret < 0) {
                                 gf_msg (THIS->name, GF_LOG_WARNING, EINVAL,
                                         PC_MSG_DICT_UNSERIALIZE_FAIL,
                                         "failed to unserialize xattr dict");
                                 goto out;
                         }
-                        GF_FREE (buf);
-                        buf = NULL;
                 }
 
                 entry->inode = inode_find (itable, entry->d_stat.ia_gfid);
@@ -853,7 +853,6 @@ serialize_rsp_direntp (gf_dirent_t *entries, gfs3_readdirp_rsp *rsp)
         gfs3_dirplist       *trav  = NULL;
         gfs3_dirplist       *prev  = NULL;
         int                  ret   = -1;
-        int                  temp  = 0;
 
         GF_VALIDATE_OR_GOTO ("server", entries, out);
         GF_VALIDATE_OR_GOTO ("server", rsp, out);
@@ -873,27 +872,9 @@ serialize_rsp_direntp (gf_dirent_t *entries, gfs3_readdirp_rsp *rsp)
 
                 /* if 'dict' is present, pack it */
                 if (entry->dict) {
-                        temp = dict_serialized_length (entry->dict);
-
-                        if (temp < 0) {
-                                gf_msg (THIS->name, GF_LOG_ERROR, EINVAL,
-                                        PS_MSG_INVALID_ENTRY, "failed to get "
-                                        "serialized length of reply dict");
-                                errno = EINVAL;
-                                trav->dict.dict_len = 0;
-                                goto out;
-                        }
-                        trav->dict.dict_len = temp;
-
-                        trav->dict.dict_val = GF_CALLOC (1, trav->dict.dict_len,
-                                                         gf_server_mt_rsp_buf_t);
-                        if (!trav->dict.dict_val) {
-                                errno = ENOMEM;
-                                trav->dict.dict_len = 0;
-                                goto out;
-                        }
-
-                        ret = dict_serialize (entry->dict, trav->dict.dict_val);
+                        ret = dict_allocate_and_serialize (entry->dict,
+                                                           &trav->dict.dict_val,
+                                                           &trav->dict.dict_len);
                         if (ret < 0) {
                                 gf_msg (THIS->name, GF_LOG_ERROR, 0,
                                         PS_MSG_DICT_SERIALIZE_FAIL,
@@ -1627,10 +1608,10 @@ server_populate_compound_request (gfs3_compound_req *req, call_frame_t *frame,
                                               xdata, args->xdata.xdata_val,
                                               args->xdata.xdata_len, ret,
                                               op_errno, out);
-                GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
-                                              xattr, args->dict.dict_val,
-                                              args->dict.dict_len, ret,
-                                              op_errno, out);
+                GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (frame->root->client->bound_xl,
+                                                    xattr, args->dict.dict_val,
+                                                    args->dict.dict_len, ret,
+                                                    op_errno, out);
                 args_setxattr_store (this_args, &state->loc, xattr, args->flags,
                                      xdata);
                 break;
@@ -1979,10 +1960,10 @@ server_populate_compound_request (gfs3_compound_req *req, call_frame_t *frame,
                                               args->xdata.xdata_len, ret,
                                               op_errno, out);
 
-                GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
-                                              xattr, (args->dict.dict_val),
-                                              (args->dict.dict_len), ret,
-                                               op_errno, out);
+                GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (frame->root->client->bound_xl,
+                                                    xattr, (args->dict.dict_val),
+                                                    (args->dict.dict_len), ret,
+                                                     op_errno, out);
                 args_xattrop_store (this_args, &state->loc, args->flags,
                                     xattr, xdata);
                 break;
@@ -1993,10 +1974,10 @@ server_populate_compound_request (gfs3_compound_req *req, call_frame_t *frame,
 
                 args = &this_req->compound_req_u.compound_fxattrop_req;
 
-                GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
-                                              xattr, (args->dict.dict_val),
-                                              (args->dict.dict_len), ret,
-                                              op_errno, out);
+                GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (frame->root->client->bound_xl,
+                                                    xattr, (args->dict.dict_val),
+                                                    (args->dict.dict_len), ret,
+                                                    op_errno, out);
 
                 GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
                                               xdata, args->xdata.xdata_val,
@@ -2027,10 +2008,10 @@ server_populate_compound_request (gfs3_compound_req *req, call_frame_t *frame,
 
                 args = &this_req->compound_req_u.compound_fsetxattr_req;
 
-                GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
-                                              xattr, (args->dict.dict_val),
-                                              (args->dict.dict_len), ret,
-                                              op_errno, out);
+                GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (frame->root->client->bound_xl,
+                                                    xattr, (args->dict.dict_val),
+                                                    (args->dict.dict_len), ret,
+                                                    op_errno, out);
 
                 GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
                                               xdata, args->xdata.xdata_val,
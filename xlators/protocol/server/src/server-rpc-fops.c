@@ -4631,8 +4631,6 @@ server3_3_setxattr (rpcsvc_request_t *req)
         if (!req)
                 return ret;
 
-        args.dict.dict_val = alloca (req->msg[0].iov_len);
-
         ret = rpc_receive_common (req, &frame, &state, NULL, &args,
                                   xdr_gfs3_setxattr_req, GF_FOP_SETXATTR);
         if (ret != 0) {
@@ -4643,11 +4641,11 @@ server3_3_setxattr (rpcsvc_request_t *req)
         state->flags            = args.flags;
         set_resolve_gfid (frame->root->client, state->resolve.gfid, args.gfid);
 
-        GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
-                                      dict,
-                                      (args.dict.dict_val),
-                                      (args.dict.dict_len), ret,
-                                      op_errno, out);
+        GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (frame->root->client->bound_xl,
+                                            dict,
+                                            (args.dict.dict_val),
+                                            (args.dict.dict_len), ret,
+                                            op_errno, out);
 
         state->dict = dict;
 
@@ -4667,6 +4665,7 @@ server3_3_setxattr (rpcsvc_request_t *req)
         dict = NULL;
 
 out:
+        free (args.dict.dict_val);
         free (args.xdata.xdata_val);
 
         if (op_errno)
@@ -4693,8 +4692,6 @@ server3_3_fsetxattr (rpcsvc_request_t *req)
         if (!req)
                 return ret;
 
-        args.dict.dict_val = alloca (req->msg[0].iov_len);
-
         ret = rpc_receive_common (req, &frame, &state, NULL, &args,
                                   xdr_gfs3_fsetxattr_req, GF_FOP_FSETXATTR);
         if (ret != 0) {
@@ -4706,11 +4703,11 @@ server3_3_fsetxattr (rpcsvc_request_t *req)
         state->flags             = args.flags;
         set_resolve_gfid (frame->root->client, state->resolve.gfid, args.gfid);
 
-        GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
-                                      dict,
-                                      (args.dict.dict_val),
-                                      (args.dict.dict_len), ret,
-                                      op_errno, out);
+        GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (frame->root->client->bound_xl,
+                                            dict,
+                                            (args.dict.dict_val),
+                                            (args.dict.dict_len), ret,
+                                            op_errno, out);
 
         state->dict = dict;
 
@@ -4727,6 +4724,7 @@ server3_3_fsetxattr (rpcsvc_request_t *req)
         dict = NULL;
 
 out:
+        free (args.dict.dict_val);
         free (args.xdata.xdata_val);
 
         if (op_errno)
@@ -4753,8 +4751,6 @@ server3_3_fxattrop (rpcsvc_request_t *req)
         if (!req)
                 return ret;
 
-        args.dict.dict_val = alloca (req->msg[0].iov_len);
-
         ret = rpc_receive_common (req, &frame, &state, NULL, &args,
                                   xdr_gfs3_fxattrop_req, GF_FOP_FXATTROP);
         if (ret != 0) {
@@ -4766,11 +4762,11 @@ server3_3_fxattrop (rpcsvc_request_t *req)
         state->flags           = args.flags;
         set_resolve_gfid (frame->root->client, state->resolve.gfid, args.gfid);
 
-        GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
-                                      dict,
-                                      (args.dict.dict_val),
-                                      (args.dict.dict_len), ret,
-                                      op_errno, out);
+        GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (frame->root->client->bound_xl,
+                                            dict,
+                                            (args.dict.dict_val),
+                                            (args.dict.dict_len), ret,
+                                            op_errno, out);
 
         state->dict = dict;
 
@@ -4787,6 +4783,7 @@ server3_3_fxattrop (rpcsvc_request_t *req)
         dict = NULL;
 
 out:
+        free (args.dict.dict_val);
         free (args.xdata.xdata_val);
 
         if (op_errno)
@@ -4813,8 +4810,6 @@ server3_3_xattrop (rpcsvc_request_t *req)
         if (!req)
                 return ret;
 
-        args.dict.dict_val = alloca (req->msg[0].iov_len);
-
         ret = rpc_receive_common (req, &frame, &state, NULL, &args,
                                   xdr_gfs3_xattrop_req, GF_FOP_XATTROP);
         if (ret != 0) {
@@ -4825,11 +4820,11 @@ server3_3_xattrop (rpcsvc_request_t *req)
         state->flags           = args.flags;
         set_resolve_gfid (frame->root->client, state->resolve.gfid, args.gfid);
 
-        GF_PROTOCOL_DICT_UNSERIALIZE (frame->root->client->bound_xl,
-                                      dict,
-                                      (args.dict.dict_val),
-                                      (args.dict.dict_len), ret,
-                                      op_errno, out);
+        GF_PROTOCOL_DICT_UNSERIALIZE_OWNED (frame->root->client->bound_xl,
+                                            dict,
+                                            (args.dict.dict_val),
+                                            (args.dict.dict_len), ret,
+                                            op_errno, out);
 
         state->dict = dict;
 
@@ -4846,6 +4841,7 @@ server3_3_xattrop (rpcsvc_request_t *req)
         dict = NULL;
 
 out:
+        free (args.dict.dict_val);
         free (args.xdata.xdata_val);
 
         if (op_errno)
@@ -335,6 +335,8 @@ server_priv (xlator_t *this)
         gf_proc_dump_build_key(key, "server", "total-bytes-write");
         gf_proc_dump_write(key, "%"PRIu64, total_write);
 
+        rpcsvc_dispatch_dump (conf->rpc);
+
         ret = 0;
 out:
         if (ret)
@@ -965,6 +967,13 @@ do_rpc:
                 goto out;
         }
 
+        ret = rpcsvc_set_dispatch_threads (rpc_conf, options);
+        if (ret < 0) {
+                gf_msg (this->name, GF_LOG_ERROR, 0, PS_MSG_RPC_CONF_ERROR,
+                        "Failed to reconfigure dispatch-threads");
+                goto out;
+        }
+
         list_for_each_entry (listeners, &(rpc_conf->listeners), list) {
                 if (listeners->trans != NULL) {
                         if (listeners->trans->reconfigure )
@@ -1172,6 +1181,13 @@ server_init (xlator_t *this)
                 goto out;
         }
 
+        ret = rpcsvc_set_dispatch_threads (conf->rpc, this->options);
+        if (ret < 0) {
+                gf_msg (this->name, GF_LOG_ERROR, 0, PS_MSG_RPC_CONF_ERROR,
+                        "Failed to configure dispatch-threads");
+                goto out;
+        }
+
         /*
          * This is the only place where we want secure_srvr to reflect
          * the data-plane setting.
@@ -1794,6 +1810,29 @@ struct volume_options server_options[] = {
           .op_version = {1},
           .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC | OPT_FLAG_GLOBAL
         },
+        { .key  = {"rpc.dispatch-threads"},
+          .type = GF_OPTION_TYPE_INT,
+          .min  = 0,
+          .max  = RPCSVC_MAX_DISPATCH_THREADS,
+          .default_value = TOSTRING(RPCSVC_DEFAULT_DISPATCH_THREADS),
+          .description = "Number of threads that run requests taken from "
+                         "per-client queues in deficit round-robin order, "
+                         "so that a busy client cannot starve the others. "
+                         "0 runs requests on the thread that read them.",
+          .op_version = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC
+        },
+        { .key  = {"rpc.dispatch-quantum"},
+          .type = GF_OPTION_TYPE_SIZET,
+          .min  = RPCSVC_MIN_DISPATCH_QUANTUM,
+          .max  = RPCSVC_MAX_DISPATCH_QUANTUM,
+          .default_value = "128KB",
+          .description = "Bytes of requests a client may have dispatched "
+                         "per round before the next client is served. Each "
+                         "request is charged its payload plus 1KB.",
+          .op_version = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC
+        },
         { .key   = {"manage-gids"},
           .type  = GF_OPTION_TYPE_BOOL,
           .default_value = "off",
@@ -55,6 +55,7 @@
 #include "glusterfs3-xdr.h"
 #include "hashfn.h"
 #include "posix-aio.h"
+#include "posix-io-uring.h"
 #include "glusterfs-acl.h"
 #include "posix-messages.h"
 #include "events.h"
@@ -128,6 +129,10 @@ posix_priv (xlator_t *this)
         gf_proc_dump_write("max_read", "%d", priv->read_value);
         gf_proc_dump_write("max_write", "%d", priv->write_value);
         gf_proc_dump_write("nr_files", "%ld", priv->nr_files);
+        posix_dirfd_cache_dump (this);
+        gf_proc_dump_write("readdirp_threads", "%u", priv->readdirp_running);
+        posix_uring_dump (this);
+        posix_fsyncer_dump (this);
 
         return 0;
 }
@@ -264,6 +269,8 @@ set_batch_fsync_mode (struct posix_private *priv, const char *str)
                 priv->batch_fsync_mode = BATCH_SYNCFS_REVERSE_FSYNC;
         else if (strcmp (str, "reverse-fsync") == 0)
                 priv->batch_fsync_mode = BATCH_REVERSE_FSYNC;
+        else if (strcmp (str, "group-commit") == 0)
+                priv->batch_fsync_mode = BATCH_GROUP_COMMIT;
         else
                 return -1;
 
@@ -301,6 +308,8 @@ posix_reconfigure (xlator_t *this, dict_t *options)
         int32_t              force_directory_mode = -1;
         int32_t              create_mask = -1;
         int32_t              create_directory_mask = -1;
+        uint32_t             dirfd_cache_size = 0;
+        uint32_t             readdirp_threads = 0;
 
         priv = this->private;
 
@@ -353,6 +362,20 @@ posix_reconfigure (xlator_t *this, dict_t *options)
         else
                 posix_aio_off (this);
 
+        /* the size and polling of a ring that is set up already only
+           change with a restart of the brick */
+        GF_OPTION_RECONF ("io-uring-queue-depth", priv->uring_depth,
+                          options, uint32, out);
+        GF_OPTION_RECONF ("io-uring-sqpoll", priv->uring_sqpoll,
+                          options, bool, out);
+        GF_OPTION_RECONF ("io-uring", priv->uring_configured,
+                          options, bool, out);
+
+        if (priv->uring_configured)
+                posix_uring_on (this);
+        else if (priv->uring)
+                posix_uring_off (this);
+
         GF_OPTION_RECONF ("update-link-count-parent", priv->update_pgfid_nlinks,
                           options, bool, out);
 
@@ -414,6 +437,14 @@ posix_reconfigure (xlator_t *this, dict_t *options)
 
         GF_OPTION_RECONF ("max-hardlinks", priv->max_hardlinks,
                           options, uint32, out);
+
+        GF_OPTION_RECONF ("dirfd-cache-size", dirfd_cache_size,
+                          options, uint32, out);
+        posix_dirfd_cache_resize (this, dirfd_cache_size);
+
+        GF_OPTION_RECONF ("readdirp-threads", readdirp_threads,
+                          options, uint32, out);
+        posix_readdirp_threads_scale (this, readdirp_threads);
         ret = 0;
 out:
         return ret;
@@ -560,6 +591,8 @@ posix_init (xlator_t *this)
         int                  force_directory = -1;
         int                  create_mask  = -1;
         int                  create_directory_mask = -1;
+        uint32_t             dirfd_cache_size = 0;
+        uint32_t             readdirp_threads = 0;
 
         dir_data = dict_get (this->options, "directory");
 
@@ -1000,6 +1033,13 @@ posix_init (xlator_t *this)
                 }
         }
 
+        GF_OPTION_INIT ("io-uring-queue-depth", _private->uring_depth,
+                        uint32, out);
+        GF_OPTION_INIT ("io-uring-sqpoll", _private->uring_sqpoll, bool, out);
+        GF_OPTION_INIT ("io-uring", _private->uring_configured, bool, out);
+        if (_private->uring_configured)
+                posix_uring_on (this);
+
         GF_OPTION_INIT ("node-uuid-pathinfo",
                         _private->node_uuid_pathinfo, bool, out);
         if (_private->node_uuid_pathinfo &&
@@ -1030,6 +1070,11 @@ posix_init (xlator_t *this)
 
         posix_spawn_janitor_thread (this);
 
+        pthread_mutex_init (&_private->readdirp_lock, NULL);
+        pthread_cond_init (&_private->readdirp_cond, NULL);
+        pthread_cond_init (&_private->readdirp_done, NULL);
+        INIT_LIST_HEAD (&_private->readdirp_jobs);
+
         pthread_mutex_init (&_private->fsync_mutex, NULL);
         pthread_cond_init (&_private->fsync_cond, NULL);
         INIT_LIST_HEAD (&_private->fsyncs);
@@ -1103,6 +1148,17 @@ posix_init (xlator_t *this)
         _private->create_directory_mask = create_directory_mask;
 
         GF_OPTION_INIT ("max-hardlinks", _private->max_hardlinks, uint32, out);
+
+        GF_OPTION_INIT ("dirfd-cache-size", dirfd_cache_size, uint32, out);
+        ret = posix_dirfd_cache_init (this, dirfd_cache_size);
+        if (ret) {
+                gf_msg (this->name, GF_LOG_ERROR, 0, P_MSG_HANDLE_CREATE,
+                        "directory fd cache setup failed");
+                goto out;
+        }
+
+        GF_OPTION_INIT ("readdirp-threads", readdirp_threads, uint32, out);
+        posix_readdirp_threads_scale (this, readdirp_threads);
 out:
         if (ret) {
                 if (_private) {
@@ -1126,6 +1182,12 @@ posix_fini (xlator_t *this)
         struct posix_private *priv = this->private;
         if (!priv)
                 return;
+
+        /* these look at this->private */
+        posix_readdirp_threads_fini (this);
+        posix_dirfd_cache_fini (this);
+        posix_uring_fini (this);
+
         this->private = NULL;
         /*unlock brick dir*/
         if (priv->mount_lock)
@@ -1176,6 +1238,43 @@ struct volume_options options[] = {
           .op_version = {1},
           .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC
         },
+        {
+          .key  = {"io-uring"},
+          .type = GF_OPTION_TYPE_BOOL,
+          .default_value = "off",
+          .op_version  = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .tags = {"posix"},
+          .description = "Serve readv, writev, fsync and fallocate through "
+                         "an io_uring, for buffered as well as O_DIRECT "
+                         "fds. Takes precedence over linux-aio."
+        },
+        {
+          .key  = {"io-uring-queue-depth"},
+          .type = GF_OPTION_TYPE_INT,
+          .min = 8,
+          .max = 4096,
+          .default_value = "256",
+          .op_version  = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .tags = {"posix"},
+          .validate = GF_OPT_VALIDATE_BOTH,
+          .description = "Number of requests the io_uring keeps in flight, "
+                         "more are served synchronously. Changes take "
+                         "effect when the brick restarts."
+        },
+        {
+          .key  = {"io-uring-sqpoll"},
+          .type = GF_OPTION_TYPE_BOOL,
+          .default_value = "off",
+          .op_version  = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .tags = {"posix"},
+          .description = "Have a kernel thread poll the io_uring for "
+                         "requests instead of entering the kernel for each "
+                         "one, trading a busy CPU for latency. Changes take "
+                         "effect when the brick restarts."
+        },
         {
           .key = {"brick-uid"},
           .type = GF_OPTION_TYPE_INT,
@@ -1249,7 +1348,13 @@ struct volume_options options[] = {
           " of fsyncs and fsync() each file in the batch in reverse order.\n"
           " in reverse order.\n"
           "\t- reverse-fsync: Perform fsync() of each file in the batch in"
-          " reverse order.",
+          " reverse order.\n"
+          "\t- group-commit: Send every fsync through the batch, not only"
+          " the ones AFR marks. All fsyncs of a file in the batch share one"
+          " fsync(); a batch touching several files starts writeback with"
+          " sync_file_range() and ends with one syncfs(). The batch is"
+          " held open for about half the time a flush takes, at most"
+          " batch-fsync-delay-usec (2ms when that is 0).",
           .op_version = {3},
           .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC
         },
@@ -1371,5 +1476,33 @@ struct volume_options options[] = {
           .description = "max number of hardlinks allowed on any one inode.\n"
                          "0 is unlimited, 1 prevents any hardlinking at all."
         },
+        {
+          .key = {"dirfd-cache-size"},
+          .type = GF_OPTION_TYPE_INT,
+          .min = 0,
+          .default_value = "1024",
+          .op_version  = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .tags = {"posix"},
+          .validate = GF_OPT_VALIDATE_MIN,
+          .description = "Number of directories kept open to resolve gfid "
+                         "handles without walking the handle symlinks, "
+                         "0 disables the cache."
+        },
+        {
+          .key = {"readdirp-threads"},
+          .type = GF_OPTION_TYPE_INT,
+          .min = 0,
+          .max = 32,
+          .default_value = "0",
+          .op_version  = {GD_OP_VERSION_4_0_0},
+          .flags = OPT_FLAG_SETTABLE | OPT_FLAG_DOC,
+          .tags = {"posix"},
+          .validate = GF_OPT_VALIDATE_BOTH,
+          .description = "Number of threads that stat and read the xattrs "
+                         "of the entries of large readdirp replies in "
+                         "parallel, 0 has the thread serving the readdirp "
+                         "do all of them."
+        },
         { .key  = {NULL} }
 };
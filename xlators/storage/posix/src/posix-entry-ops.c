@@ -532,6 +532,7 @@ posix_mkdir (call_frame_t *frame, xlator_t *this,
         char                 value_buf[4096]  = {0,};
         gf_boolean_t         have_val         = _gf_false;
         mode_t               mode_bit         = 0;
+        struct posix_dirfd  *dirfd            = NULL;
 
         DECLARE_OLD_FS_ID_VAR;
 
@@ -743,7 +744,13 @@ posix_mkdir (call_frame_t *frame, xlator_t *this,
                 dict_del (xdata, GF_PREOP_PARENT_KEY);
         }
 
-        op_ret = sys_mkdir (real_path, mode);
+        dirfd = posix_dirfd_get (this, loc->pargfid);
+        if (dirfd) {
+                op_ret = sys_mkdirat (dirfd->fd, loc->name, mode);
+                posix_dirfd_put (this, dirfd);
+        } else {
+                op_ret = sys_mkdir (real_path, mode);
+        }
         if (op_ret == -1) {
                 op_errno = errno;
                 gf_msg (this->name, GF_LOG_ERROR, errno, P_MSG_MKDIR_FAILED,
@@ -893,6 +900,7 @@ posix_unlink_gfid_handle_and_entry (xlator_t *this, const char *real_path,
         int32_t                ret      = 0;
         struct iatt            prebuf   = {0,};
         gf_boolean_t           locked   = _gf_false;
+        struct posix_dirfd    *dirfd    = NULL;
 
         /*  Unlink the gfid_handle_first */
         if (stbuf && stbuf->ia_nlink == 1) {
@@ -928,7 +936,13 @@ posix_unlink_gfid_handle_and_entry (xlator_t *this, const char *real_path,
         }
 
         /* Unlink the actual file */
-        ret = sys_unlink (real_path);
+        dirfd = posix_dirfd_get (this, loc->pargfid);
+        if (dirfd) {
+                ret = sys_unlinkat (dirfd->fd, loc->name, 0);
+                posix_dirfd_put (this, dirfd);
+        } else {
+                ret = sys_unlink (real_path);
+        }
         if (ret == -1) {
                 if (op_errno)
                         *op_errno = errno;
@@ -1231,6 +1245,7 @@ posix_rmdir (call_frame_t *frame, xlator_t *this,
         struct iatt           stbuf      = {0,};
         struct posix_private *priv       = NULL;
         char                  tmp_path[PATH_MAX] = {0,};
+        struct posix_dirfd   *dirfd      = NULL;
 
         DECLARE_OLD_FS_ID_VAR;
 
@@ -1287,7 +1302,14 @@ posix_rmdir (call_frame_t *frame, xlator_t *this,
                         pthread_cond_signal (&priv->janitor_cond);
                 }
         } else {
-                op_ret = sys_rmdir (real_path);
+                dirfd = posix_dirfd_get (this, loc->pargfid);
+                if (dirfd) {
+                        op_ret = sys_unlinkat (dirfd->fd, loc->name,
+                                               AT_REMOVEDIR);
+                        posix_dirfd_put (this, dirfd);
+                } else {
+                        op_ret = sys_rmdir (real_path);
+                }
         }
         op_errno = errno;
 
@@ -1955,6 +1977,7 @@ posix_create (call_frame_t *frame, xlator_t *this,
         char *                 pgfid_xattr_key = NULL;
         gf_boolean_t           entry_created   = _gf_false, gfid_set = _gf_false;
         mode_t                 mode_bit        = 0;
+        struct posix_dirfd *   dirfd           = NULL;
 
         DECLARE_OLD_FS_ID_VAR;
 
@@ -2011,7 +2034,13 @@ posix_create (call_frame_t *frame, xlator_t *this,
 
         mode_bit = (priv->create_mask & mode) | priv->force_create_mode;
         mode = posix_override_umask (mode, mode_bit);
-        _fd = sys_open (real_path, _flags, mode);
+        dirfd = posix_dirfd_get (this, loc->pargfid);
+        if (dirfd) {
+                _fd = sys_openat (dirfd->fd, loc->name, _flags, mode);
+                posix_dirfd_put (this, dirfd);
+        } else {
+                _fd = sys_open (real_path, _flags, mode);
+        }
 
         if (_fd == -1) {
                 op_errno = errno;
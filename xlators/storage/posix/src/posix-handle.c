@@ -22,6 +22,7 @@
 #include "posix.h"
 #include "xlator.h"
 #include "syscall.h"
+#include "statedump.h"
 #include "posix-messages.h"
 
 #include "compat-errno.h"
@@ -376,6 +377,420 @@ err:
 }
 
 
+/*
+  The dirfd cache keeps O_PATH fds of recently resolved directories. A
+  directory handle is a symlink to "../../<pargfid>/<name>", so building the
+  path of a directory N levels deep takes N readlink()/lstat() pairs through
+  posix_handle_pump(). With the directory open, the kernel already tracks
+  where it lives and the path is a single readlink() of /proc/self/fd/<fd>.
+
+  Entries are found by gfid and dropped with posix_dirfd_forget() when the
+  handle of the directory goes away. Only unreferenced entries are evicted,
+  so the cache can grow past its limit while many directories are in use.
+  Changes made to the brick behind the back of this process are not seen.
+*/
+
+static struct list_head *
+__posix_dirfd_bucket (struct posix_dirfd_cache *cache, uuid_t gfid)
+{
+        uint32_t hash = 0;
+
+        memcpy (&hash, &gfid[12], sizeof (hash));
+
+        return &cache->buckets[hash % POSIX_DIRFD_BUCKETS];
+}
+
+
+static struct posix_dirfd *
+__posix_dirfd_find (struct posix_dirfd_cache *cache, uuid_t gfid)
+{
+        struct posix_dirfd *dirfd = NULL;
+
+        list_for_each_entry (dirfd, __posix_dirfd_bucket (cache, gfid), hash) {
+                if (gf_uuid_compare (dirfd->gfid, gfid) == 0)
+                        return dirfd;
+        }
+
+        return NULL;
+}
+
+
+static void
+__posix_dirfd_unhash (struct posix_dirfd_cache *cache,
+                      struct posix_dirfd *dirfd)
+{
+        list_del_init (&dirfd->hash);
+        list_del_init (&dirfd->lru);
+        dirfd->unhashed = _gf_true;
+        cache->count--;
+}
+
+
+static void
+posix_dirfd_destroy (struct posix_dirfd *dirfd)
+{
+        sys_close (dirfd->fd);
+        GF_FREE (dirfd);
+}
+
+
+/* moves unused entries over the limit to @reap, to be closed unlocked */
+static void
+__posix_dirfd_trim (struct posix_dirfd_cache *cache, struct list_head *reap)
+{
+        struct posix_dirfd *dirfd = NULL;
+        struct posix_dirfd *tmp = NULL;
+
+        list_for_each_entry_safe_reverse (dirfd, tmp, &cache->lru, lru) {
+                if (cache->count <= cache->limit)
+                        break;
+                if (dirfd->ref)
+                        continue;
+
+                __posix_dirfd_unhash (cache, dirfd);
+                list_add (&dirfd->lru, reap);
+                GF_ATOMIC_INC (cache->evictions);
+        }
+}
+
+
+static void
+posix_dirfd_reap (struct list_head *reap)
+{
+        struct posix_dirfd *dirfd = NULL;
+        struct posix_dirfd *tmp = NULL;
+
+        list_for_each_entry_safe (dirfd, tmp, reap, lru) {
+                list_del_init (&dirfd->lru);
+                posix_dirfd_destroy (dirfd);
+        }
+}
+
+
+struct posix_dirfd *
+posix_dirfd_get (xlator_t *this, uuid_t gfid)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_dirfd_cache *cache = NULL;
+        struct posix_dirfd       *dirfd = NULL;
+
+        priv = this->private;
+        cache = priv->dirfd_cache;
+        if (!cache || !cache->limit)
+                return NULL;
+
+        pthread_mutex_lock (&cache->lock);
+        {
+                dirfd = __posix_dirfd_find (cache, gfid);
+                if (dirfd) {
+                        dirfd->ref++;
+                        list_move (&dirfd->lru, &cache->lru);
+                }
+        }
+        pthread_mutex_unlock (&cache->lock);
+
+        return dirfd;
+}
+
+
+void
+posix_dirfd_put (xlator_t *this, struct posix_dirfd *dirfd)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_dirfd_cache *cache = NULL;
+        gf_boolean_t              destroy = _gf_false;
+        int                       op_errno = errno;
+
+        priv = this->private;
+        cache = priv->dirfd_cache;
+
+        pthread_mutex_lock (&cache->lock);
+        {
+                if (--dirfd->ref == 0 && dirfd->unhashed)
+                        destroy = _gf_true;
+        }
+        pthread_mutex_unlock (&cache->lock);
+
+        if (destroy)
+                posix_dirfd_destroy (dirfd);
+
+        /* callers look at errno of the *at() call made with the fd */
+        errno = op_errno;
+}
+
+
+void
+posix_dirfd_forget (xlator_t *this, uuid_t gfid)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_dirfd_cache *cache = NULL;
+        struct posix_dirfd       *dirfd = NULL;
+        gf_boolean_t              destroy = _gf_false;
+
+        priv = this->private;
+        cache = priv->dirfd_cache;
+        if (!cache)
+                return;
+
+        pthread_mutex_lock (&cache->lock);
+        {
+                dirfd = __posix_dirfd_find (cache, gfid);
+                if (dirfd) {
+                        __posix_dirfd_unhash (cache, dirfd);
+                        destroy = (dirfd->ref == 0);
+                }
+        }
+        pthread_mutex_unlock (&cache->lock);
+
+        if (!dirfd)
+                return;
+
+        GF_ATOMIC_INC (cache->invalidations);
+        if (destroy)
+                posix_dirfd_destroy (dirfd);
+}
+
+
+/* opens the directory behind the symlink @handle and caches it for @gfid */
+static struct posix_dirfd *
+posix_dirfd_open (xlator_t *this, uuid_t gfid, const char *handle)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_dirfd_cache *cache = NULL;
+        struct posix_dirfd       *dirfd = NULL;
+        struct posix_dirfd       *new = NULL;
+        struct list_head          reap;
+        int                       fd = -1;
+
+        priv = this->private;
+        cache = priv->dirfd_cache;
+        if (!cache || !cache->limit)
+                return NULL;
+
+        GF_ATOMIC_INC (cache->misses);
+
+#ifdef POSIX_DIRFD_FLAGS
+        /* more than 40 levels deep this fails with ELOOP and the path is
+           left to posix_handle_pump() */
+        fd = sys_open (handle, POSIX_DIRFD_FLAGS, 0);
+#endif
+        if (fd == -1)
+                return NULL;
+
+        new = GF_CALLOC (1, sizeof (*new), gf_posix_mt_dirfd_t);
+        if (!new) {
+                sys_close (fd);
+                return NULL;
+        }
+
+        INIT_LIST_HEAD (&new->hash);
+        INIT_LIST_HEAD (&new->lru);
+        gf_uuid_copy (new->gfid, gfid);
+        new->fd = fd;
+        new->ref = 1;
+
+        INIT_LIST_HEAD (&reap);
+
+        pthread_mutex_lock (&cache->lock);
+        {
+                dirfd = __posix_dirfd_find (cache, gfid);
+                if (dirfd) {
+                        dirfd->ref++;
+                        list_move (&dirfd->lru, &cache->lru);
+                } else {
+                        dirfd = new;
+                        new = NULL;
+                        list_add (&dirfd->hash,
+                                  __posix_dirfd_bucket (cache, gfid));
+                        list_add (&dirfd->lru, &cache->lru);
+                        cache->count++;
+                        __posix_dirfd_trim (cache, &reap);
+                }
+        }
+        pthread_mutex_unlock (&cache->lock);
+
+        if (new)
+                posix_dirfd_destroy (new);
+        posix_dirfd_reap (&reap);
+
+        return dirfd;
+}
+
+
+/* fills @buf with the current path of @dirfd and drops the ref on it,
+   returns -1 when the path has to be built the slow way and
+   -ENAMETOOLONG when it does not fit in PATH_MAX */
+static int
+posix_dirfd_path (xlator_t *this, struct posix_dirfd *dirfd,
+                  const char *basename, char *buf, int maxlen)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_dirfd_cache *cache = NULL;
+        char                      proc[64];
+        char                      path[PATH_MAX];
+        struct stat               stbuf;
+        ssize_t                   size = 0;
+        int                       len = -1;
+
+        priv = this->private;
+        cache = priv->dirfd_cache;
+
+        snprintf (proc, sizeof (proc), "/proc/self/fd/%d", dirfd->fd);
+        size = sys_readlink (proc, path, sizeof (path));
+        if (size <= 0)
+                goto out;
+        if (size == sizeof (path)) {
+                /* truncated */
+                len = -ENAMETOOLONG;
+                goto out;
+        }
+        path[size] = '\0';
+
+        if (size > SLEN (" (deleted)") &&
+            strcmp (path + size - SLEN (" (deleted)"), " (deleted)") == 0 &&
+            (sys_fstat (dirfd->fd, &stbuf) != 0 || stbuf.st_nlink == 0)) {
+                posix_dirfd_forget (this, dirfd->gfid);
+                goto out;
+        }
+
+        if (strncmp (path, cache->real_base, cache->real_base_len) != 0 ||
+            (path[cache->real_base_len] != '/' &&
+             path[cache->real_base_len] != '\0'))
+                goto out;
+
+        len = snprintf (buf, maxlen, "%s%s%s%s", priv->base_path,
+                        path + cache->real_base_len, basename ? "/" : "",
+                        basename ? basename : "");
+out:
+        posix_dirfd_put (this, dirfd);
+        return len;
+}
+
+
+int
+posix_dirfd_cache_init (xlator_t *this, uint32_t limit)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_dirfd_cache *cache = NULL;
+        char                      real_base[PATH_MAX];
+        int                       i = 0;
+
+        priv = this->private;
+
+#ifndef POSIX_DIRFD_FLAGS
+        gf_msg_debug (this->name, 0, "O_PATH is not supported, directory "
+                      "handles are resolved without the dirfd cache");
+        return 0;
+#endif
+
+        if (!realpath (priv->base_path, real_base)) {
+                gf_msg (this->name, GF_LOG_ERROR, errno, P_MSG_HANDLE_CREATE,
+                        "realpath on %s failed", priv->base_path);
+                return -1;
+        }
+
+        cache = GF_CALLOC (1, sizeof (*cache), gf_posix_mt_dirfd_cache_t);
+        if (!cache)
+                return -1;
+
+        cache->real_base = gf_strdup (real_base);
+        if (!cache->real_base) {
+                GF_FREE (cache);
+                return -1;
+        }
+        cache->real_base_len = strlen (real_base);
+
+        pthread_mutex_init (&cache->lock, NULL);
+        for (i = 0; i < POSIX_DIRFD_BUCKETS; i++)
+                INIT_LIST_HEAD (&cache->buckets[i]);
+        INIT_LIST_HEAD (&cache->lru);
+        cache->limit = limit;
+        GF_ATOMIC_INIT (cache->hits, 0);
+        GF_ATOMIC_INIT (cache->misses, 0);
+        GF_ATOMIC_INIT (cache->evictions, 0);
+        GF_ATOMIC_INIT (cache->invalidations, 0);
+
+        priv->dirfd_cache = cache;
+
+        return 0;
+}
+
+
+void
+posix_dirfd_cache_resize (xlator_t *this, uint32_t limit)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_dirfd_cache *cache = NULL;
+        struct list_head          reap;
+
+        priv = this->private;
+        cache = priv->dirfd_cache;
+        if (!cache)
+                return;
+
+        INIT_LIST_HEAD (&reap);
+
+        pthread_mutex_lock (&cache->lock);
+        {
+                cache->limit = limit;
+                __posix_dirfd_trim (cache, &reap);
+        }
+        pthread_mutex_unlock (&cache->lock);
+
+        posix_dirfd_reap (&reap);
+}
+
+
+void
+posix_dirfd_cache_fini (xlator_t *this)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_dirfd_cache *cache = NULL;
+        struct posix_dirfd       *dirfd = NULL;
+        struct posix_dirfd       *tmp = NULL;
+
+        priv = this->private;
+        cache = priv->dirfd_cache;
+        if (!cache)
+                return;
+
+        priv->dirfd_cache = NULL;
+
+        list_for_each_entry_safe (dirfd, tmp, &cache->lru, lru) {
+                list_del_init (&dirfd->hash);
+                list_del_init (&dirfd->lru);
+                posix_dirfd_destroy (dirfd);
+        }
+
+        pthread_mutex_destroy (&cache->lock);
+        GF_FREE (cache->real_base);
+        GF_FREE (cache);
+}
+
+
+void
+posix_dirfd_cache_dump (xlator_t *this)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_dirfd_cache *cache = NULL;
+
+        priv = this->private;
+        cache = priv->dirfd_cache;
+        if (!cache)
+                return;
+
+        gf_proc_dump_write ("dirfd_cache_limit", "%u", cache->limit);
+        gf_proc_dump_write ("dirfd_cache_count", "%u", cache->count);
+        gf_proc_dump_write ("dirfd_cache_hits", "%"PRId64,
+                            GF_ATOMIC_GET (cache->hits));
+        gf_proc_dump_write ("dirfd_cache_misses", "%"PRId64,
+                            GF_ATOMIC_GET (cache->misses));
+        gf_proc_dump_write ("dirfd_cache_evictions", "%"PRId64,
+                            GF_ATOMIC_GET (cache->evictions));
+        gf_proc_dump_write ("dirfd_cache_invalidations", "%"PRId64,
+                            GF_ATOMIC_GET (cache->invalidations));
+}
+
 /*
   posix_handle_path differs from posix_handle_gfid_path in the way that the
   path filled in @buf by posix_handle_path will return type IA_IFDIR when
@@ -399,6 +814,7 @@ posix_handle_path (xlator_t *this, uuid_t gfid, const char *basename,
         int                   pfx_len;
         int                   maxlen;
         char                 *buf;
+        struct posix_dirfd   *dirfd = NULL;
 
         priv = this->private;
 
@@ -426,11 +842,52 @@ posix_handle_path (xlator_t *this, uuid_t gfid, const char *basename,
                 len = snprintf (buf, maxlen, "%s", base_str);
         }
 
+        dirfd = posix_dirfd_get (this, gfid);
+        if (dirfd) {
+                /* callers size @ubuf with a first call, only the one that
+                   fills it is counted */
+                if (ubuf)
+                        GF_ATOMIC_INC (priv->dirfd_cache->hits);
+                ret = posix_dirfd_path (this, dirfd, basename, buf, maxlen);
+                if (ret >= 0) {
+                        len = ret;
+                        goto out;
+                }
+                if (ret == -ENAMETOOLONG) {
+                        errno = ENAMETOOLONG;
+                        len = -1;
+                        goto out;
+                }
+                /* stale, or outside of the brick, go the slow way */
+                len = snprintf (buf, maxlen, "%s%s%s", base_str,
+                                basename ? "/" : "", basename ? basename : "");
+                dirfd = NULL;
+        }
+
         ret = sys_lstat (base_str, &stat);
 
         if (!(ret == 0 && S_ISLNK(stat.st_mode) && stat.st_nlink == 1))
                 goto out;
 
+        /* sizing calls don't populate the cache, the miss is counted
+           once when the caller comes back with its buffer */
+        if (ubuf)
+                dirfd = posix_dirfd_open (this, gfid, base_str);
+        if (dirfd) {
+                ret = posix_dirfd_path (this, dirfd, basename, buf, maxlen);
+                if (ret >= 0) {
+                        len = ret;
+                        goto out;
+                }
+                if (ret == -ENAMETOOLONG) {
+                        errno = ENAMETOOLONG;
+                        len = -1;
+                        goto out;
+                }
+                len = snprintf (buf, maxlen, "%s%s%s", base_str,
+                                basename ? "/" : "", basename ? basename : "");
+        }
+
         do {
                 errno = 0;
                 ret = posix_handle_pump (this, buf, len, maxlen,
@@ -853,6 +1310,9 @@ posix_handle_soft (xlator_t *this, const char *real_path, loc_t *loc,
                         return -1;
                 }
 
+                /* a directory that had this gfid before may still be open */
+                posix_dirfd_forget (this, gfid);
+
                 ret = sys_lstat (newpath, &newbuf);
                 if (ret) {
                         gf_msg (this->name, GF_LOG_WARNING, errno,
@@ -897,6 +1357,8 @@ posix_handle_unset_gfid (xlator_t *this, uuid_t gfid)
 
         MAKE_HANDLE_GFID_PATH (path, this, gfid, NULL);
 
+        posix_dirfd_forget (this, gfid);
+
         ret = sys_lstat (path, &stat);
 
         if (ret == -1) {
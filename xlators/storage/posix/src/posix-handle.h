@@ -12,6 +12,42 @@
 
 #include "posix-inode-handle.h"
 
+/* Directories are opened with these flags for the dirfd cache. The cache is
+ * left disabled where O_PATH is not available. */
+#ifdef O_PATH
+#define POSIX_DIRFD_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+#endif
+
+#define POSIX_DIRFD_BUCKETS 1024
+
+/* An O_PATH fd of a directory, keyed by the directory's gfid. It stays
+ * valid across renames of the directory and its ancestors, so the current
+ * path can be read back from /proc/self/fd and entry operations can be done
+ * relative to it with the *at() syscalls. */
+struct posix_dirfd {
+        struct list_head   hash;
+        struct list_head   lru;
+        uuid_t             gfid;
+        int                fd;
+        int                ref;
+        gf_boolean_t       unhashed;    /* forgotten while still in use */
+};
+
+struct posix_dirfd_cache {
+        pthread_mutex_t    lock;
+        struct list_head   buckets[POSIX_DIRFD_BUCKETS];
+        struct list_head   lru;
+        uint32_t           limit;
+        uint32_t           count;
+        /* the brick directory the way the kernel reports it */
+        char              *real_base;
+        int                real_base_len;
+        gf_atomic_t        hits;
+        gf_atomic_t        misses;
+        gf_atomic_t        evictions;
+        gf_atomic_t        invalidations;
+};
+
 #define HANDLE_ABSPATH_LEN(this) (POSIX_BASE_PATH_LEN(this) + \
                                   SLEN("/" GF_HIDDEN_PATH "/00/00/" \
                                   UUID0_STR) + 1)
@@ -186,4 +222,25 @@ int
 posix_create_link_if_gfid_exists (xlator_t *this, uuid_t gfid,
                                   char *real_path, inode_table_t *itable);
 
+int
+posix_dirfd_cache_init (xlator_t *this, uint32_t limit);
+
+void
+posix_dirfd_cache_fini (xlator_t *this);
+
+void
+posix_dirfd_cache_resize (xlator_t *this, uint32_t limit);
+
+void
+posix_dirfd_cache_dump (xlator_t *this);
+
+struct posix_dirfd *
+posix_dirfd_get (xlator_t *this, uuid_t gfid);
+
+void
+posix_dirfd_put (xlator_t *this, struct posix_dirfd *dirfd);
+
+void
+posix_dirfd_forget (xlator_t *this, uuid_t gfid);
+
 #endif /* !_POSIX_HANDLE_H */
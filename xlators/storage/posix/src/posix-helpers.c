@@ -50,6 +50,7 @@
 #include "statedump.h"
 #include "locking.h"
 #include "timer.h"
+#include "timespec.h"
 #include "glusterfs3-xdr.h"
 #include "hashfn.h"
 #include "glusterfs-acl.h"
@@ -640,6 +641,7 @@ posix_istat (xlator_t *this, uuid_t gfid, const char *basename,
         struct iatt  stbuf = {0, };
         int          ret = 0;
         struct posix_private *priv = NULL;
+        struct posix_dirfd   *dirfd = NULL;
 
         priv = this->private;
 
@@ -654,7 +656,14 @@ posix_istat (xlator_t *this, uuid_t gfid, const char *basename,
                 goto out;
         }
 
-        ret = sys_lstat (real_path, &lstatbuf);
+        dirfd = basename ? posix_dirfd_get (this, gfid) : NULL;
+        if (dirfd) {
+                ret = sys_fstatat (dirfd->fd, basename, &lstatbuf,
+                                   AT_SYMLINK_NOFOLLOW);
+                posix_dirfd_put (this, dirfd);
+        } else {
+                ret = sys_lstat (real_path, &lstatbuf);
+        }
 
         if (ret != 0) {
                 if (ret == -1) {
@@ -2201,6 +2210,138 @@ unlock:
         UNLOCK (&priv->lock);
 }
 
+
+static void *
+posix_readdirp_thread_proc (void *data)
+{
+        xlator_t                  *this = data;
+        struct posix_private      *priv = NULL;
+        struct posix_readdirp_job *job  = NULL;
+
+        THIS = this;
+        priv = this->private;
+
+        pthread_mutex_lock (&priv->readdirp_lock);
+        for (;;) {
+                while (list_empty (&priv->readdirp_jobs) &&
+                       priv->readdirp_running <= priv->readdirp_threads)
+                        pthread_cond_wait (&priv->readdirp_cond,
+                                           &priv->readdirp_lock);
+
+                if (priv->readdirp_running > priv->readdirp_threads)
+                        break;
+
+                job = list_first_entry (&priv->readdirp_jobs,
+                                        struct posix_readdirp_job, list);
+                job->workers++;
+                pthread_mutex_unlock (&priv->readdirp_lock);
+
+                posix_readdirp_job_work (job);
+
+                pthread_mutex_lock (&priv->readdirp_lock);
+                /* every entry is taken, nobody else needs to pick it up */
+                list_del_init (&job->list);
+                if (--job->workers == 0)
+                        pthread_cond_broadcast (&priv->readdirp_done);
+        }
+        priv->readdirp_running--;
+        pthread_cond_broadcast (&priv->readdirp_done);
+        pthread_mutex_unlock (&priv->readdirp_lock);
+
+        return NULL;
+}
+
+
+/* starts or stops readdirp threads until @threads of them are running */
+void
+posix_readdirp_threads_scale (xlator_t *this, uint32_t threads)
+{
+        struct posix_private *priv   = NULL;
+        pthread_t             thread;
+        int                   ret    = 0;
+
+        priv = this->private;
+
+        pthread_mutex_lock (&priv->readdirp_lock);
+        {
+                priv->readdirp_threads = threads;
+
+                while (priv->readdirp_running < priv->readdirp_threads) {
+                        ret = gf_thread_create_detached (&thread,
+                                                posix_readdirp_thread_proc,
+                                                this, "posixrdp");
+                        if (ret) {
+                                gf_msg (this->name, GF_LOG_WARNING, errno,
+                                        P_MSG_THREAD_FAILED, "starting "
+                                        "readdirp thread failed, running "
+                                        "with %u", priv->readdirp_running);
+                                priv->readdirp_threads =
+                                        priv->readdirp_running;
+                                break;
+                        }
+                        priv->readdirp_running++;
+                }
+
+                /* the ones over the limit exit when they wake up */
+                pthread_cond_broadcast (&priv->readdirp_cond);
+        }
+        pthread_mutex_unlock (&priv->readdirp_lock);
+}
+
+
+void
+posix_readdirp_threads_fini (xlator_t *this)
+{
+        struct posix_private *priv = NULL;
+
+        priv = this->private;
+
+        pthread_mutex_lock (&priv->readdirp_lock);
+        {
+                priv->readdirp_threads = 0;
+                pthread_cond_broadcast (&priv->readdirp_cond);
+                while (priv->readdirp_running)
+                        pthread_cond_wait (&priv->readdirp_done,
+                                           &priv->readdirp_lock);
+        }
+        pthread_mutex_unlock (&priv->readdirp_lock);
+}
+
+
+/* Fills all entries of @job, with help from the readdirp threads when there
+   are any. Returns once every entry is done. */
+void
+posix_readdirp_job_run (xlator_t *this, struct posix_readdirp_job *job)
+{
+        struct posix_private *priv = NULL;
+
+        priv = this->private;
+
+        INIT_LIST_HEAD (&job->list);
+        GF_ATOMIC_INIT (job->next, 0);
+        job->workers = 0;
+
+        pthread_mutex_lock (&priv->readdirp_lock);
+        {
+                if (priv->readdirp_running) {
+                        list_add_tail (&job->list, &priv->readdirp_jobs);
+                        pthread_cond_broadcast (&priv->readdirp_cond);
+                }
+        }
+        pthread_mutex_unlock (&priv->readdirp_lock);
+
+        posix_readdirp_job_work (job);
+
+        pthread_mutex_lock (&priv->readdirp_lock);
+        {
+                list_del_init (&job->list);
+                while (job->workers)
+                        pthread_cond_wait (&priv->readdirp_done,
+                                           &priv->readdirp_lock);
+        }
+        pthread_mutex_unlock (&priv->readdirp_lock);
+}
+
 int
 posix_fsyncer_pick (xlator_t *this, struct list_head *head)
 {
@@ -2262,6 +2403,24 @@ posix_fsyncer_process (xlator_t *this, call_stub_t *stub, gf_boolean_t do_fsync)
 }
 
 
+static int
+posix_syncfs (int fd)
+{
+#ifdef GF_LINUX_HOST_OS
+        /* syncfs() is not "declared" in RHEL's glibc even though
+           the kernel has support.
+        */
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef SYS_syncfs
+        return syscall (SYS_syncfs, fd);
+#endif
+#endif
+        sync ();
+        return 0;
+}
+
+
 static void
 posix_fsyncer_syncfs (xlator_t *this, struct list_head *head)
 {
@@ -2274,23 +2433,278 @@ posix_fsyncer_syncfs (xlator_t *this, struct list_head *head)
         if (ret)
                 return;
 
-#ifdef GF_LINUX_HOST_OS
-        /* syncfs() is not "declared" in RHEL's glibc even though
-           the kernel has support.
-        */
-#include <sys/syscall.h>
-#include <unistd.h>
-#ifdef SYS_syncfs
-        syscall (SYS_syncfs, pfd->fd);
-#else
-        sync();
-#endif
+        (void) posix_syncfs (pfd->fd);
+}
+
+
+gf_boolean_t
+posix_fsync_batched (struct posix_private *priv, dict_t *xdata)
+{
+        if (priv->batch_fsync_mode == BATCH_GROUP_COMMIT)
+                return _gf_true;
+
+        if (priv->batch_fsync_mode && xdata && dict_get (xdata, "batch-fsync"))
+                return _gf_true;
+
+        return _gf_false;
+}
+
+
+/* The fsyncs of one inode within a group-commit batch, they are all
+   answered by a single flush. */
+struct posix_fsync_group {
+        inode_t      *inode;
+        int           fd;
+        gf_boolean_t  datasync;    /* nobody in the group asked for more */
+        uint32_t      count;
+        int           op_errno;
+        struct iatt   buf;
+        dict_t       *rsp;
+};
+
+
+static int
+posix_fsyncer_gather (xlator_t *this, struct list_head *head)
+{
+        struct posix_private *priv = NULL;
+        int count = 0;
+
+        priv = this->private;
+        pthread_mutex_lock (&priv->fsync_mutex);
+        {
+                count = priv->fsync_queue_count;
+                priv->fsync_queue_count = 0;
+                list_splice_init (&priv->fsyncs, head->prev);
+        }
+        pthread_mutex_unlock (&priv->fsync_mutex);
+
+        return count;
+}
+
+
+/* A lone fsync goes to disk right away. Once fsyncs have been seen to
+   arrive together, the batch is held open for about half a flush so the
+   stragglers can ride along with it. */
+static uint32_t
+posix_fsyncer_delay (struct posix_private *priv)
+{
+        uint64_t cap = 0;
+
+        if (priv->fsync_last_batch < 2)
+                return 0;
+
+        cap = priv->batch_fsync_delay_usec;
+        if (!cap)
+                cap = POSIX_GROUP_COMMIT_MAX_DELAY_USEC;
+
+        return min (priv->fsync_flush_usec / 2, cap);
+}
+
+
+/* Flush every group with one syncfs(): writeback is started on all the
+   files first, then waited for one file at a time so that an error lands
+   on the right group, and the syncfs() commits the metadata and empties
+   the disk cache once for all of them. Returns false if the backend can't
+   do this and the groups have to be fsync()ed on their own. */
+static gf_boolean_t
+posix_fsyncer_flush_shared (xlator_t *this, struct posix_fsync_group *groups,
+                            int ngroups)
+{
+#if defined(GF_LINUX_HOST_OS) && defined(SYNC_FILE_RANGE_WRITE)
+        struct posix_private *priv = NULL;
+        int ret = 0;
+        int i = 0;
+
+        priv = this->private;
+
+        for (i = 0; i < ngroups; i++) {
+                ret = sync_file_range (groups[i].fd, 0, 0,
+                                       SYNC_FILE_RANGE_WRITE);
+                if (ret == 0)
+                        continue;
+
+                if (errno == ENOSYS || errno == EINVAL ||
+                    errno == EOPNOTSUPP) {
+                        gf_msg (this->name, GF_LOG_INFO, errno,
+                                P_MSG_FSYNC_FAILED, "sync_file_range() is "
+                                "not supported, group-commit will fsync() "
+                                "every file");
+                        priv->fsync_no_sfr = _gf_true;
+                        return _gf_false;
+                }
+                groups[i].op_errno = errno;
+        }
+
+        for (i = 0; i < ngroups; i++) {
+                if (groups[i].op_errno)
+                        continue;
+                ret = sync_file_range (groups[i].fd, 0, 0,
+                                       SYNC_FILE_RANGE_WAIT_BEFORE |
+                                       SYNC_FILE_RANGE_WRITE |
+                                       SYNC_FILE_RANGE_WAIT_AFTER);
+                if (ret)
+                        groups[i].op_errno = errno;
+        }
+
+        priv->fsync_flushes++;
+        ret = posix_syncfs (groups[0].fd);
+        if (ret) {
+                for (i = 0; i < ngroups; i++) {
+                        if (!groups[i].op_errno)
+                                groups[i].op_errno = errno;
+                }
+        }
+
+        return _gf_true;
 #else
-        sync();
+        return _gf_false;
 #endif
 }
 
 
+static void
+posix_fsyncer_group_commit (xlator_t *this, struct list_head *head, int count)
+{
+        struct posix_private     *priv = NULL;
+        struct posix_fsync_group *groups = NULL;
+        struct posix_fsync_group *group = NULL;
+        struct posix_fd          *pfd = NULL;
+        call_stub_t              *stub = NULL;
+        call_stub_t              *tmp = NULL;
+        struct timespec           begin = {0, };
+        struct timespec           end = {0, };
+        struct timespec           elapsed = {0, };
+        gf_boolean_t              shared = _gf_false;
+        uint32_t                  requests = 0;
+        uint64_t                  usec = 0;
+        int                       ngroups = 0;
+        int                       op_errno = 0;
+        int                       ret = -1;
+        int                       i = 0;
+
+        priv = this->private;
+
+        groups = GF_CALLOC (count, sizeof (*groups), gf_posix_mt_fsync_group);
+        if (!groups) {
+                list_for_each_entry_safe (stub, tmp, head, list) {
+                        list_del_init (&stub->list);
+                        posix_fsyncer_process (this, stub, _gf_true);
+                }
+                return;
+        }
+
+        list_for_each_entry_safe (stub, tmp, head, list) {
+                ret = posix_fd_ctx_get (stub->args.fd, this, &pfd, &op_errno);
+                if (ret < 0) {
+                        gf_msg (this->name, GF_LOG_ERROR, op_errno,
+                                P_MSG_GET_FDCTX_FAILED,
+                                "could not get fdctx for fd(%s)",
+                                uuid_utoa (stub->args.fd->inode->gfid));
+                        list_del_init (&stub->list);
+                        call_unwind_error (stub, -1, op_errno);
+                        continue;
+                }
+
+                for (i = 0; i < ngroups; i++) {
+                        if (groups[i].inode == stub->args.fd->inode)
+                                break;
+                }
+                if (i == ngroups) {
+                        groups[i].inode = stub->args.fd->inode;
+                        groups[i].fd = pfd->fd;
+                        groups[i].datasync = _gf_true;
+                        ngroups++;
+                }
+                if (!stub->args.datasync)
+                        groups[i].datasync = _gf_false;
+                groups[i].count++;
+                requests++;
+        }
+
+        if (!ngroups)
+                goto out;
+
+        timespec_now (&begin);
+
+        if (ngroups > 1 && !priv->fsync_no_sfr)
+                shared = posix_fsyncer_flush_shared (this, groups, ngroups);
+
+        if (!shared) {
+                for (i = 0; i < ngroups; i++) {
+                        if (groups[i].datasync)
+                                ret = sys_fdatasync (groups[i].fd);
+                        else
+                                ret = sys_fsync (groups[i].fd);
+                        if (ret)
+                                groups[i].op_errno = errno;
+                }
+                priv->fsync_flushes += ngroups;
+        }
+
+        timespec_now (&end);
+        timespec_sub (&begin, &end, &elapsed);
+        usec = elapsed.tv_sec * 1000000 + elapsed.tv_nsec / 1000;
+        priv->fsync_flush_usec = (priv->fsync_flush_usec * 7 + usec) / 8;
+        priv->fsync_last_batch = requests;
+        priv->fsync_requests += requests;
+        priv->fsync_batches++;
+
+        gf_msg_debug (this->name, 0, "flushed %u fsyncs on %d files in "
+                      "%"PRIu64"us", requests, ngroups, usec);
+
+        for (i = 0; i < ngroups; i++) {
+                group = &groups[i];
+                if (group->op_errno) {
+                        gf_msg (this->name, GF_LOG_ERROR, group->op_errno,
+                                P_MSG_FSYNC_FAILED, "fsync on %s failed",
+                                uuid_utoa (group->inode->gfid));
+                        continue;
+                }
+
+                ret = posix_fdstat (this, group->fd, &group->buf);
+                if (ret) {
+                        group->op_errno = errno;
+                        continue;
+                }
+
+                group->rsp = dict_new ();
+                if (group->rsp &&
+                    dict_set_uint32 (group->rsp, GLUSTERFS_FSYNC_BATCH_SIZE,
+                                     shared ? requests : group->count)) {
+                        dict_unref (group->rsp);
+                        group->rsp = NULL;
+                }
+        }
+
+        list_for_each_entry_safe (stub, tmp, head, list) {
+                list_del_init (&stub->list);
+
+                for (i = 0; i < ngroups; i++) {
+                        if (groups[i].inode == stub->args.fd->inode)
+                                break;
+                }
+                group = &groups[i];
+
+                if (group->op_errno) {
+                        call_unwind_error (stub, -1, group->op_errno);
+                        continue;
+                }
+
+                /* fsync doesn't change the attributes */
+                STACK_UNWIND_STRICT (fsync, stub->frame, 0, 0, &group->buf,
+                                     &group->buf, group->rsp);
+                call_stub_destroy (stub);
+        }
+
+        for (i = 0; i < ngroups; i++) {
+                if (groups[i].rsp)
+                        dict_unref (groups[i].rsp);
+        }
+out:
+        GF_FREE (groups);
+}
+
+
 void *
 posix_fsyncer (void *d)
 {
@@ -2300,6 +2714,7 @@ posix_fsyncer (void *d)
         call_stub_t *tmp = NULL;
         struct list_head list;
         int count = 0;
+        uint32_t delay = 0;
         gf_boolean_t do_fsync = _gf_true;
 
         priv = this->private;
@@ -2309,6 +2724,16 @@ posix_fsyncer (void *d)
 
                 count = posix_fsyncer_pick (this, &list);
 
+                if (priv->batch_fsync_mode == BATCH_GROUP_COMMIT) {
+                        delay = posix_fsyncer_delay (priv);
+                        if (delay) {
+                                usleep (delay);
+                                count += posix_fsyncer_gather (this, &list);
+                        }
+                        posix_fsyncer_group_commit (this, &list, count);
+                        continue;
+                }
+
                 usleep (priv->batch_fsync_delay_usec);
 
                 gf_msg_debug (this->name, 0,
@@ -2317,6 +2742,7 @@ posix_fsyncer (void *d)
                 switch (priv->batch_fsync_mode) {
                 case BATCH_NONE:
                 case BATCH_REVERSE_FSYNC:
+                case BATCH_GROUP_COMMIT:
                         break;
                 case BATCH_SYNCFS:
                 case BATCH_SYNCFS_SINGLE_FSYNC:
@@ -2341,6 +2767,26 @@ posix_fsyncer (void *d)
         }
 }
 
+
+void
+posix_fsyncer_dump (xlator_t *this)
+{
+        struct posix_private *priv = NULL;
+
+        priv = this->private;
+        if (priv->batch_fsync_mode != BATCH_GROUP_COMMIT)
+                return;
+
+        gf_proc_dump_write ("fsync_batches", "%"PRIu64, priv->fsync_batches);
+        gf_proc_dump_write ("fsync_requests", "%"PRIu64,
+                            priv->fsync_requests);
+        gf_proc_dump_write ("fsync_flushes", "%"PRIu64, priv->fsync_flushes);
+        gf_proc_dump_write ("fsync_flush_usec", "%"PRIu64,
+                            priv->fsync_flush_usec);
+        gf_proc_dump_write ("fsync_sync_file_range", "%s",
+                            priv->fsync_no_sfr ? "no" : "yes");
+}
+
 /**
  * TODO: move fd/inode interfaces into a single routine..
  */
@@ -1894,7 +1894,8 @@ posix_fsync (call_frame_t *frame, xlator_t *this,
 
         priv = this->private;
 
-        if (priv->batch_fsync_mode && xdata && dict_get (xdata, "batch-fsync")) {
+        if (posix_fsync_batched (priv, xdata)) {
+                SET_TO_OLD_FS_ID ();
                 posix_batch_fsync (frame, this, fd, datasync, xdata);
                 return 0;
         }
@@ -4641,22 +4642,99 @@ posix_d_type_from_ia_type (ia_type_t type)
 #endif
 
 
-int
-posix_readdirp_fill (xlator_t *this, fd_t *fd, gf_dirent_t *entries, dict_t *dict)
+/* stats the entry at @hpath, which ends in the name of @entry, and fills
+   in its inode, iatt and the xattrs asked for in @dict */
+static void
+posix_readdirp_fill_entry (xlator_t *this, fd_t *fd, gf_dirent_t *entry,
+                           dict_t *dict, char *hpath)
 {
-        gf_dirent_t     *entry    = NULL;
         inode_table_t   *itable   = NULL;
         inode_t         *inode    = NULL;
-        char            *hpath    = NULL;
-        int              len      = 0;
         struct iatt      stbuf    = {0, };
         uuid_t           gfid;
         int              ret      = -1;
 
+        itable = fd->inode->table;
+
+        memset (gfid, 0, 16);
+        inode = inode_grep (itable, fd->inode, entry->d_name);
+        if (inode)
+                gf_uuid_copy (gfid, inode->gfid);
+
+        ret = posix_pstat (this, gfid, hpath, &stbuf);
+
+        if (ret == -1) {
+                if (inode)
+                        inode_unref (inode);
+                return;
+        }
+
+        if (!inode)
+                inode = inode_find (itable, stbuf.ia_gfid);
+
+        if (!inode)
+                inode = inode_new (itable);
+
+        entry->inode = inode;
+
+        if (dict) {
+                entry->dict =
+                        posix_entry_xattr_fill (this, entry->inode,
+                                                fd, hpath,
+                                                dict, &stbuf);
+        }
+
+        entry->d_stat = stbuf;
+        if (stbuf.ia_ino)
+                entry->d_ino = stbuf.ia_ino;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (entry->d_type == DT_UNKNOWN && !IA_ISINVAL(stbuf.ia_type)) {
+                /* The platform supports d_type but the underlying
+                   filesystem doesn't. We set d_type to the correct
+                   value from ia_type */
+                entry->d_type =
+                        posix_d_type_from_ia_type (stbuf.ia_type);
+        }
+#endif
+}
+
+
+void
+posix_readdirp_job_work (struct posix_readdirp_job *job)
+{
+        char             hpath[PATH_MAX + NAME_MAX + 2];
+        int              idx = 0;
+
+        if (job->dir_len + 1 >= PATH_MAX)
+                return;
+
+        memcpy (hpath, job->dir_path, job->dir_len);
+        hpath[job->dir_len] = '/';
+
+        while ((idx = GF_ATOMIC_INC (job->next) - 1) < job->count) {
+                strcpy (&hpath[job->dir_len + 1], job->entries[idx]->d_name);
+                posix_readdirp_fill_entry (job->this, job->fd,
+                                           job->entries[idx], job->dict,
+                                           hpath);
+        }
+}
+
+
+int
+posix_readdirp_fill (xlator_t *this, fd_t *fd, gf_dirent_t *entries, dict_t *dict)
+{
+        struct posix_private      *priv     = NULL;
+        struct posix_readdirp_job  job      = {{0, }, };
+        gf_dirent_t               *entry    = NULL;
+        char                      *hpath    = NULL;
+        int                        len      = 0;
+        int                        count    = 0;
+
         if (list_empty(&entries->list))
                 return 0;
 
-        itable = fd->inode->table;
+        priv = this->private;
 
         len = posix_handle_path (this, fd->inode->gfid, NULL, NULL, 0);
         if (len <= 0)
@@ -4665,55 +4743,40 @@ posix_readdirp_fill (xlator_t *this, fd_t *fd, gf_dirent_t *entries, dict_t *dic
         if (posix_handle_path (this, fd->inode->gfid, NULL, hpath, len) <= 0)
                 return -1;
         len = strlen (hpath);
-        hpath[len] = '/';
 
-        list_for_each_entry (entry, &entries->list, list) {
-                memset (gfid, 0, 16);
-                inode = inode_grep (fd->inode->table, fd->inode,
-                                    entry->d_name);
-                if (inode)
-                        gf_uuid_copy (gfid, inode->gfid);
-
-                strcpy (&hpath[len+1], entry->d_name);
+        list_for_each_entry (entry, &entries->list, list)
+                count++;
 
-                ret = posix_pstat (this, gfid, hpath, &stbuf);
-
-                if (ret == -1) {
-                        if (inode)
-                                inode_unref (inode);
-                      continue;
-                }
-
-                if (!inode)
-                        inode = inode_find (itable, stbuf.ia_gfid);
+        /* "list-xattr" is consumed by the first entry that sees it, keep
+           that deterministic by filling such replies in order */
+        if (priv->readdirp_threads && count >= POSIX_READDIRP_PARALLEL_MIN &&
+            !(dict && dict_get (dict, "list-xattr"))) {
+                job.entries = GF_MALLOC (count * sizeof (*job.entries),
+                                         gf_posix_mt_readdirp_entries);
+        }
 
-                if (!inode)
-                        inode = inode_new (itable);
+        if (job.entries) {
+                job.count = 0;
+                list_for_each_entry (entry, &entries->list, list)
+                        job.entries[job.count++] = entry;
 
-                entry->inode = inode;
+                job.this = this;
+                job.fd = fd;
+                job.dict = dict;
+                job.dir_path = hpath;
+                job.dir_len = len;
 
-                if (dict) {
-                        entry->dict =
-                                posix_entry_xattr_fill (this, entry->inode,
-                                                        fd, hpath,
-                                                        dict, &stbuf);
-                }
+                posix_readdirp_job_run (this, &job);
 
-                entry->d_stat = stbuf;
-                if (stbuf.ia_ino)
-                        entry->d_ino = stbuf.ia_ino;
+                GF_FREE (job.entries);
+                return 0;
+        }
 
-#ifdef _DIRENT_HAVE_D_TYPE
-                if (entry->d_type == DT_UNKNOWN && !IA_ISINVAL(stbuf.ia_type)) {
-                        /* The platform supports d_type but the underlying
-                           filesystem doesn't. We set d_type to the correct
-                           value from ia_type */
-                        entry->d_type =
-                                posix_d_type_from_ia_type (stbuf.ia_type);
-                }
-#endif
+        hpath[len] = '/';
 
-                inode = NULL;
+        list_for_each_entry (entry, &entries->list, list) {
+                strcpy (&hpath[len+1], entry->d_name);
+                posix_readdirp_fill_entry (this, fd, entry, dict, hpath);
         }
 
         return 0;
@@ -0,0 +1,1329 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+#include "xlator.h"
+#include "glusterfs.h"
+#include "posix.h"
+#include <sys/uio.h>
+#include "posix-messages.h"
+#include "posix-aio.h"
+#include "posix-io-uring.h"
+#include "statedump.h"
+#include "syscall.h"
+
+#ifdef HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/*
+ * An io_uring engine for readv, writev, fsync and fallocate.
+ *
+ * Unlike linux-aio, io_uring is asynchronous for buffered IO as well, so
+ * fds do not have to be switched to O_DIRECT. One ring is shared by the
+ * whole brick: fops fill submission entries under sq_lock and a single
+ * reaper thread waits for completions and unwinds them, the same way
+ * posix_aio_thread() does for libaio.
+ *
+ * At most queue-depth requests are in flight. A fop that finds the ring
+ * full is served synchronously by the regular posix fop, so nothing ever
+ * waits for ring space and the completion queue (twice the size of the
+ * submission queue) cannot overflow. The same happens when a submission
+ * fails: the entry is taken back and the fop goes the synchronous way.
+ *
+ * If io_uring_enter() fails for good, in the reaper or on submission, the
+ * ring is marked dead. From then on every fop is served synchronously, and
+ * once the reaper is gone the requests it left behind fail with EIO.
+ *
+ * Reads go into iobufs. The first time an iobuf of an arena is read into,
+ * the arena is pinned (see iobuf_arena_pin()) and registered as a fixed
+ * buffer, after that reads into and single vector writes from that arena
+ * use READ_FIXED and WRITE_FIXED and skip mapping the pages on every IO.
+ *
+ * The requests run with the credentials of the brick process, as with
+ * linux-aio.
+ *
+ * liburing is not required, the three system calls are made directly.
+ */
+
+#define POSIX_URING_ALIGN 4096
+
+struct posix_uring {
+        int                  fd;
+        unsigned             entries;
+        gf_boolean_t         sqpoll;
+
+        /* submission side, under sq_lock */
+        gf_lock_t            sq_lock;
+        unsigned            *sq_head;
+        unsigned            *sq_tail;
+        unsigned            *sq_mask;
+        unsigned            *sq_flags;
+        unsigned            *sq_array;
+        struct io_uring_sqe *sqes;
+        struct iovec         fixed[POSIX_URING_MAX_FIXED];
+        int                  nr_fixed;
+        int                  max_fixed;   /* 0 if the kernel cannot */
+
+        /* completion side, only the reaper touches it */
+        unsigned            *cq_head;
+        unsigned            *cq_tail;
+        unsigned            *cq_mask;
+        struct io_uring_cqe *cqes;
+
+        void                *sq_ring;
+        size_t               sq_ring_size;
+        void                *cq_ring;
+        size_t               cq_ring_size;
+        size_t               sqes_size;
+
+        pthread_t            reaper;
+        gf_boolean_t         reaper_running;  /* under sq_lock */
+        gf_boolean_t         dead;            /* under sq_lock */
+        struct list_head     cbs;             /* in flight, under sq_lock */
+
+        gf_atomic_t          inflight;
+        gf_atomic_t          submitted;
+        gf_atomic_t          fixed_ios;
+        gf_atomic_t          sync_fallbacks;
+};
+
+struct posix_uring_cb {
+        struct list_head list;
+        call_frame_t    *frame;
+        fd_t            *fd;
+        int              _fd;
+        glusterfs_fop_t  op;
+        off_t            offset;
+        struct iobuf    *iobuf;
+        struct iobref   *iobref;
+        struct iovec     iov;
+        struct iovec    *vector;        /* writev, the fop's own goes away */
+        int              count;
+        struct iatt      prebuf;
+};
+
+
+static int
+posix_uring_enter (int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags)
+{
+        return syscall (__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+
+/* Returns the next free submission entry, or NULL if queue-depth requests
+ * are in flight already. Must be called with sq_lock held.
+ */
+static struct io_uring_sqe *
+__posix_uring_slot (struct posix_uring *ring)
+{
+        struct io_uring_sqe *sqe  = NULL;
+        unsigned             tail = 0;
+        unsigned             head = 0;
+
+        if (GF_ATOMIC_GET (ring->inflight) >= ring->entries)
+                return NULL;
+
+        tail = *ring->sq_tail;
+        head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= ring->entries)
+                return NULL;
+
+        sqe = &ring->sqes[tail & *ring->sq_mask];
+        memset (sqe, 0, sizeof (*sqe));
+        ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+
+        return sqe;
+}
+
+
+/* As __posix_uring_slot(), but NULL once the ring is dead, so that fops
+ * fall back to the regular ones.
+ */
+static struct io_uring_sqe *
+__posix_uring_sqe (struct posix_uring *ring)
+{
+        if (ring->dead)
+                return NULL;
+
+        return __posix_uring_slot (ring);
+}
+
+
+/* io_uring_enter() failures worth trying again, everything else means the
+ * ring is unusable.
+ */
+static gf_boolean_t
+posix_uring_transient (int err)
+{
+        return (err == EINTR || err == EAGAIN || err == EBUSY);
+}
+
+
+/* Hands the entry returned by __posix_uring_sqe() to the kernel. Must be
+ * called with sq_lock held.
+ *
+ * On failure the entry is taken back from the ring and -1 is returned,
+ * the caller still owns @cb then. Otherwise @cb is in flight until the
+ * reaper completes it.
+ */
+static int
+__posix_uring_push (xlator_t *this, struct posix_uring *ring,
+                    struct posix_uring_cb *cb)
+{
+        unsigned tail    = 0;
+        unsigned pending = 0;
+        int      ret     = 0;
+
+        tail = *ring->sq_tail + 1;
+        __atomic_store_n (ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+        do {
+                if (ring->sqpoll) {
+                        /* the kernel thread picks the entry up by itself,
+                           unless it went idle */
+                        ret = 0;
+                        if (__atomic_load_n (ring->sq_flags,
+                                             __ATOMIC_ACQUIRE) &
+                            IORING_SQ_NEED_WAKEUP)
+                                ret = posix_uring_enter (ring->fd, 0, 0,
+                                                IORING_ENTER_SQ_WAKEUP);
+                } else {
+                        pending = tail - __atomic_load_n (ring->sq_head,
+                                                          __ATOMIC_ACQUIRE);
+                        ret = posix_uring_enter (ring->fd, pending, 0, 0);
+                }
+        } while (ret < 0 && errno == EINTR);
+
+        /* without SQ polling only io_uring_enter() takes entries, and it
+           may have stopped short of ours */
+        if (ret >= 0 && (ring->sqpoll ||
+                         __atomic_load_n (ring->sq_head,
+                                          __ATOMIC_ACQUIRE) == tail))
+                goto done;
+
+        if (ret >= 0)
+                errno = EAGAIN;
+
+        /* entries are taken in order, so if the kernel has not got to ours
+           nothing after it is on the ring either. With SQ polling the enter
+           only fails once the kernel thread is gone. */
+        if (__atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE) != tail) {
+                __atomic_store_n (ring->sq_tail, tail - 1, __ATOMIC_RELEASE);
+                if (posix_uring_transient (errno)) {
+                        gf_msg_debug (this->name, errno, "io_uring_enter() "
+                                      "failed, serving the request "
+                                      "synchronously");
+                } else {
+                        gf_msg (this->name, GF_LOG_ERROR, errno,
+                                P_MSG_IO_URING_FAILED, "io_uring_enter() "
+                                "failed, serving requests synchronously "
+                                "from now on");
+                        ring->dead = _gf_true;
+                }
+                return -1;
+        }
+
+        /* the kernel has the entry after all */
+        if (!posix_uring_transient (errno)) {
+                gf_msg (this->name, GF_LOG_ERROR, errno, P_MSG_IO_URING_FAILED,
+                        "io_uring_enter() failed, serving requests "
+                        "synchronously from now on");
+                ring->dead = _gf_true;
+        }
+done:
+        GF_ATOMIC_INC (ring->inflight);
+        GF_ATOMIC_INC (ring->submitted);
+        if (cb)
+                list_add_tail (&cb->list, &ring->cbs);
+
+        return 0;
+}
+
+
+/* Index of the fixed buffer covering [ptr, ptr + size) of @iobuf, or -1.
+ * Registers the arena of @iobuf if there is room. Must be called with
+ * sq_lock held.
+ */
+static int
+__posix_uring_fixed (xlator_t *this, struct posix_uring *ring,
+                     struct iobuf *iobuf, void *ptr, size_t size)
+{
+#ifdef IORING_RSRC_REGISTER_SPARSE
+        struct io_uring_rsrc_update2 update = {0, };
+        struct iovec                 region = {0, };
+        char                        *base   = NULL;
+        int                          i      = 0;
+        int                          ret    = -1;
+
+        for (;;) {
+                for (; i < ring->nr_fixed; i++) {
+                        base = ring->fixed[i].iov_base;
+                        if ((char *)ptr >= base &&
+                            (char *)ptr + size <= base +
+                                                  ring->fixed[i].iov_len)
+                                return i;
+                }
+
+                if (!iobuf || ring->nr_fixed >= ring->max_fixed)
+                        return -1;
+
+                if (iobuf_arena_pin (this->ctx->iobuf_pool, iobuf, &region))
+                        return -1;
+
+                update.offset = ring->nr_fixed;
+                update.data = (uintptr_t) &region;
+                update.nr = 1;
+                ret = syscall (__NR_io_uring_register, ring->fd,
+                               IORING_REGISTER_BUFFERS_UPDATE, &update,
+                               sizeof (update));
+                if (ret < 0) {
+                        /* most likely RLIMIT_MEMLOCK, keep what is
+                           registered */
+                        gf_msg (this->name, GF_LOG_INFO, errno,
+                                P_MSG_IO_URING_FAILED, "registering %zu "
+                                "bytes of iobufs failed, %d arenas stay "
+                                "registered", region.iov_len,
+                                ring->nr_fixed);
+                        ring->max_fixed = ring->nr_fixed;
+                        return -1;
+                }
+
+                ring->fixed[ring->nr_fixed++] = region;
+                /* only the new one is left to check */
+                iobuf = NULL;
+        }
+#else
+        return -1;
+#endif
+}
+
+
+/* O_DIRECT fds only take sector aligned IO, __posix_writev() copies the
+ * rest into an aligned buffer, so those are left to the regular fops.
+ */
+static gf_boolean_t
+posix_uring_direct_ok (struct posix_fd *pfd, struct iovec *vector, int count,
+                       off_t offset)
+{
+        int i = 0;
+
+        if (!(pfd->flags & O_DIRECT) && !pfd->odirect)
+                return _gf_true;
+
+        if (offset & (POSIX_URING_ALIGN - 1))
+                return _gf_false;
+
+        for (i = 0; i < count; i++) {
+                if (((uintptr_t) vector[i].iov_base |
+                     vector[i].iov_len) & (POSIX_URING_ALIGN - 1))
+                        return _gf_false;
+        }
+
+        return _gf_true;
+}
+
+
+static void
+posix_uring_readv_complete (xlator_t *this, struct posix_uring_cb *cb,
+                            int res)
+{
+        struct posix_private *priv     = NULL;
+        struct iatt           postbuf  = {0,};
+        struct iovec          iov      = {0,};
+        struct iobref        *iobref   = NULL;
+        int                   op_ret   = -1;
+        int                   op_errno = 0;
+        int                   ret      = 0;
+
+        priv = this->private;
+
+        if (res < 0) {
+                op_errno = -res;
+                gf_msg (this->name, GF_LOG_ERROR, op_errno,
+                        P_MSG_READV_FAILED,
+                        "readv(io_uring) failed fd=%d,offset=%llu (%d)",
+                        cb->_fd, (unsigned long long) cb->offset, res);
+                goto out;
+        }
+
+        ret = posix_fdstat (this, cb->_fd, &postbuf);
+        if (ret != 0) {
+                op_errno = errno;
+                gf_msg (this->name, GF_LOG_ERROR, op_errno, P_MSG_FSTAT_FAILED,
+                        "fstat failed on fd=%d", cb->_fd);
+                goto out;
+        }
+
+        op_ret = res;
+        op_errno = 0;
+
+        iobref = iobref_new ();
+        if (!iobref) {
+                op_ret = -1;
+                op_errno = ENOMEM;
+                goto out;
+        }
+
+        iobref_add (iobref, cb->iobuf);
+
+        iov.iov_base = cb->iobuf->ptr;
+        iov.iov_len = op_ret;
+
+        /* Hack to notify higher layers of EOF. */
+        if (!postbuf.ia_size || (cb->offset + iov.iov_len) >= postbuf.ia_size)
+                op_errno = ENOENT;
+
+        LOCK (&priv->lock);
+        {
+                priv->read_value += op_ret;
+        }
+        UNLOCK (&priv->lock);
+
+out:
+        STACK_UNWIND_STRICT (readv, cb->frame, op_ret, op_errno, &iov, 1,
+                             &postbuf, iobref, NULL);
+        if (iobref)
+                iobref_unref (iobref);
+        iobuf_unref (cb->iobuf);
+}
+
+
+static void
+posix_uring_writev_complete (xlator_t *this, struct posix_uring_cb *cb,
+                             int res)
+{
+        struct posix_private *priv     = NULL;
+        struct iatt           postbuf  = {0,};
+        int                   op_ret   = -1;
+        int                   op_errno = 0;
+        int                   ret      = 0;
+
+        priv = this->private;
+
+        if (res < 0) {
+                op_errno = -res;
+                gf_msg (this->name, GF_LOG_ERROR, op_errno,
+                        P_MSG_WRITEV_FAILED,
+                        "writev(io_uring) failed fd=%d,offset=%llu (%d)",
+                        cb->_fd, (unsigned long long) cb->offset, res);
+                goto out;
+        }
+
+        ret = posix_fdstat (this, cb->_fd, &postbuf);
+        if (ret != 0) {
+                op_errno = errno;
+                gf_msg (this->name, GF_LOG_ERROR, op_errno, P_MSG_FSTAT_FAILED,
+                        "fstat failed on fd=%d", cb->_fd);
+                goto out;
+        }
+
+        op_ret = res;
+        op_errno = 0;
+
+        LOCK (&priv->lock);
+        {
+                priv->write_value += op_ret;
+        }
+        UNLOCK (&priv->lock);
+
+out:
+        STACK_UNWIND_STRICT (writev, cb->frame, op_ret, op_errno, &cb->prebuf,
+                             &postbuf, NULL);
+        iobref_unref (cb->iobref);
+        GF_FREE (cb->vector);
+}
+
+
+static void
+posix_uring_fsync_complete (xlator_t *this, struct posix_uring_cb *cb,
+                            int res)
+{
+        struct iatt postbuf  = {0,};
+        int         op_ret   = -1;
+        int         op_errno = 0;
+
+        if (res < 0) {
+                op_errno = -res;
+                gf_msg (this->name, GF_LOG_ERROR, op_errno,
+                        P_MSG_FSYNC_FAILED, "fsync(io_uring) on fd=%d failed",
+                        cb->_fd);
+                goto out;
+        }
+
+        op_ret = posix_fdstat (this, cb->_fd, &postbuf);
+        if (op_ret == -1) {
+                op_errno = errno;
+                gf_msg (this->name, GF_LOG_WARNING, errno, P_MSG_FSTAT_FAILED,
+                        "post-operation fstat failed on fd=%d", cb->_fd);
+                goto out;
+        }
+
+        op_ret = 0;
+out:
+        STACK_UNWIND_STRICT (fsync, cb->frame, op_ret, op_errno, &cb->prebuf,
+                             &postbuf, NULL);
+}
+
+
+static void
+posix_uring_fallocate_complete (xlator_t *this, struct posix_uring_cb *cb,
+                                int res)
+{
+        struct iatt postbuf  = {0,};
+        int         op_ret   = -1;
+        int         op_errno = 0;
+
+        if (res < 0) {
+                op_errno = -res;
+                gf_msg (this->name, GF_LOG_ERROR, op_errno,
+                        P_MSG_FALLOCATE_FAILED,
+                        "fallocate(io_uring) failed on %s offset: %jd",
+                        uuid_utoa (cb->fd->inode->gfid), cb->offset);
+                goto out;
+        }
+
+        op_ret = posix_fdstat (this, cb->_fd, &postbuf);
+        if (op_ret == -1) {
+                op_errno = errno;
+                gf_msg (this->name, GF_LOG_ERROR, errno, P_MSG_FSTAT_FAILED,
+                        "fallocate (fstat) failed on fd=%p", cb->fd);
+                goto out;
+        }
+
+        op_ret = 0;
+out:
+        if (op_ret == 0)
+                STACK_UNWIND_STRICT (fallocate, cb->frame, 0, 0, &cb->prebuf,
+                                     &postbuf, NULL);
+        else
+                STACK_UNWIND_STRICT (fallocate, cb->frame, -1, op_errno, NULL,
+                                     NULL, NULL);
+}
+
+
+static void
+posix_uring_complete (xlator_t *this, struct posix_uring_cb *cb, int res)
+{
+        switch (cb->op) {
+        case GF_FOP_READ:
+                posix_uring_readv_complete (this, cb, res);
+                break;
+        case GF_FOP_WRITE:
+                posix_uring_writev_complete (this, cb, res);
+                break;
+        case GF_FOP_FSYNC:
+                posix_uring_fsync_complete (this, cb, res);
+                break;
+        case GF_FOP_FALLOCATE:
+                posix_uring_fallocate_complete (this, cb, res);
+                break;
+        default:
+                gf_msg (this->name, GF_LOG_ERROR, 0, P_MSG_UNKNOWN_OP,
+                        "unknown op %d found in io_uring cb", cb->op);
+                break;
+        }
+
+        GF_FREE (cb);
+}
+
+
+static void *
+posix_uring_reaper (void *data)
+{
+        xlator_t              *this = NULL;
+        struct posix_private  *priv = NULL;
+        struct posix_uring    *ring = NULL;
+        struct io_uring_cqe   *cqe  = NULL;
+        struct posix_uring_cb *cb   = NULL;
+        struct posix_uring_cb *tmp  = NULL;
+        struct list_head       left;
+        unsigned               head = 0;
+        unsigned               tail = 0;
+        int                    res  = 0;
+        int                    ret  = 0;
+
+        this = data;
+        THIS = this;
+        priv = this->private;
+        ring = priv->uring;
+
+        INIT_LIST_HEAD (&left);
+
+        for (;;) {
+                head = *ring->cq_head;
+                tail = __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE);
+                if (head == tail) {
+                        ret = posix_uring_enter (ring->fd, 0, 1,
+                                                 IORING_ENTER_GETEVENTS);
+                        if (ret < 0 && !posix_uring_transient (errno)) {
+                                gf_msg (this->name, GF_LOG_ERROR, errno,
+                                        P_MSG_IO_URING_FAILED,
+                                        "io_uring_enter() failed waiting "
+                                        "for completions, serving requests "
+                                        "synchronously from now on");
+                                break;
+                        }
+                        continue;
+                }
+
+                cqe = &ring->cqes[head & *ring->cq_mask];
+                cb = (void *)(uintptr_t) cqe->user_data;
+                res = cqe->res;
+                __atomic_store_n (ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+                /* the NOP of posix_uring_fini() */
+                if (!cb)
+                        break;
+
+                LOCK (&ring->sq_lock);
+                {
+                        list_del_init (&cb->list);
+                }
+                UNLOCK (&ring->sq_lock);
+
+                GF_ATOMIC_DEC (ring->inflight);
+                posix_uring_complete (this, cb, res);
+        }
+
+        /* nobody waits for completions any more, so nothing new may go to
+           the ring and what is still on it will not be heard of again */
+        LOCK (&ring->sq_lock);
+        {
+                ring->dead = _gf_true;
+                ring->reaper_running = _gf_false;
+                list_splice_init (&ring->cbs, &left);
+        }
+        UNLOCK (&ring->sq_lock);
+
+        list_for_each_entry_safe (cb, tmp, &left, list) {
+                list_del_init (&cb->list);
+                GF_ATOMIC_DEC (ring->inflight);
+                posix_uring_complete (this, cb, -EIO);
+        }
+
+        return NULL;
+}
+
+
+int
+posix_uring_readv (call_frame_t *frame, xlator_t *this, fd_t *fd, size_t size,
+                   off_t offset, uint32_t flags, dict_t *xdata)
+{
+        int32_t                op_errno = EINVAL;
+        struct posix_private  *priv     = NULL;
+        struct posix_uring    *ring     = NULL;
+        struct posix_fd       *pfd      = NULL;
+        struct posix_uring_cb *cb       = NULL;
+        struct iobuf          *iobuf    = NULL;
+        struct io_uring_sqe   *sqe      = NULL;
+        int                    idx      = -1;
+        int                    ret      = -1;
+
+        VALIDATE_OR_GOTO (frame, err);
+        VALIDATE_OR_GOTO (this, err);
+        VALIDATE_OR_GOTO (fd, err);
+
+        priv = this->private;
+        ring = priv->uring;
+
+        ret = posix_fd_ctx_get (fd, this, &pfd, &op_errno);
+        if (ret < 0) {
+                gf_msg (this->name, GF_LOG_WARNING, op_errno, P_MSG_PFD_NULL,
+                        "pfd is NULL from fd=%p", fd);
+                goto err;
+        }
+
+        if (!size) {
+                op_errno = EINVAL;
+                gf_msg (this->name, GF_LOG_WARNING, EINVAL,
+                        P_MSG_INVALID_ARGUMENT, "size=%"GF_PRI_SIZET, size);
+                goto err;
+        }
+
+        if (((pfd->flags & O_DIRECT) || pfd->odirect) &&
+            ((offset | size) & (POSIX_URING_ALIGN - 1)))
+                goto sync;
+
+        iobuf = iobuf_get_page_aligned (this->ctx->iobuf_pool, size,
+                                        POSIX_URING_ALIGN);
+        if (!iobuf) {
+                op_errno = ENOMEM;
+                goto err;
+        }
+
+        cb = GF_CALLOC (1, sizeof (*cb), gf_posix_mt_uring_cb);
+        if (!cb) {
+                op_errno = ENOMEM;
+                goto err;
+        }
+
+        cb->frame = frame;
+        cb->fd = fd;
+        cb->_fd = pfd->fd;
+        cb->op = GF_FOP_READ;
+        cb->offset = offset;
+        cb->iobuf = iobuf;
+        cb->iov.iov_base = iobuf->ptr;
+        cb->iov.iov_len = size;
+
+        LOCK (&ring->sq_lock);
+        {
+                sqe = __posix_uring_sqe (ring);
+                if (sqe) {
+                        idx = __posix_uring_fixed (this, ring, iobuf,
+                                                   iobuf->ptr, size);
+                        if (idx >= 0) {
+                                sqe->opcode = IORING_OP_READ_FIXED;
+                                sqe->addr = (uintptr_t) iobuf->ptr;
+                                sqe->len = size;
+                                sqe->buf_index = idx;
+                                GF_ATOMIC_INC (ring->fixed_ios);
+                        } else {
+                                sqe->opcode = IORING_OP_READV;
+                                sqe->addr = (uintptr_t) &cb->iov;
+                                sqe->len = 1;
+                        }
+                        sqe->fd = cb->_fd;
+                        sqe->off = offset;
+                        sqe->user_data = (uintptr_t) cb;
+                        if (__posix_uring_push (this, ring, cb))
+                                sqe = NULL;
+                }
+        }
+        UNLOCK (&ring->sq_lock);
+
+        if (sqe)
+                return 0;
+
+        iobuf_unref (iobuf);
+        GF_FREE (cb);
+sync:
+        GF_ATOMIC_INC (ring->sync_fallbacks);
+        return posix_readv (frame, this, fd, size, offset, flags, xdata);
+
+err:
+        STACK_UNWIND_STRICT (readv, frame, -1, op_errno, 0, 0, 0, 0, 0);
+        if (iobuf)
+                iobuf_unref (iobuf);
+        GF_FREE (cb);
+
+        return 0;
+}
+
+
+int
+posix_uring_writev (call_frame_t *frame, xlator_t *this, fd_t *fd,
+                    struct iovec *iov, int count, off_t offset,
+                    uint32_t flags, struct iobref *iobref, dict_t *xdata)
+{
+        int32_t                op_errno = EINVAL;
+        struct posix_private  *priv     = NULL;
+        struct posix_uring    *ring     = NULL;
+        struct posix_fd       *pfd      = NULL;
+        struct posix_uring_cb *cb       = NULL;
+        struct io_uring_sqe   *sqe      = NULL;
+        int                    idx      = -1;
+        int                    ret      = -1;
+
+        VALIDATE_OR_GOTO (frame, err);
+        VALIDATE_OR_GOTO (this, err);
+        VALIDATE_OR_GOTO (fd, err);
+
+        priv = this->private;
+        ring = priv->uring;
+
+        /* appends, atomic updates and O_SYNC writes need the locking and
+           extra steps of posix_writev() */
+        if ((flags & (O_SYNC|O_DSYNC)) ||
+            (xdata && (dict_get (xdata, GLUSTERFS_WRITE_IS_APPEND) ||
+                       dict_get (xdata, GLUSTERFS_WRITE_UPDATE_ATOMIC) ||
+                       dict_get (xdata, GLUSTERFS_OPEN_FD_COUNT))))
+                goto sync;
+
+        DISK_SPACE_CHECK_AND_GOTO (frame, priv, xdata, op_errno, op_errno, err);
+
+        ret = posix_fd_ctx_get (fd, this, &pfd, &op_errno);
+        if (ret < 0) {
+                gf_msg (this->name, GF_LOG_WARNING, op_errno, P_MSG_PFD_NULL,
+                        "pfd is NULL from fd=%p", fd);
+                goto err;
+        }
+
+        if (!posix_uring_direct_ok (pfd, iov, count, offset))
+                goto sync;
+
+        cb = GF_CALLOC (1, sizeof (*cb), gf_posix_mt_uring_cb);
+        if (!cb) {
+                op_errno = ENOMEM;
+                goto err;
+        }
+
+        cb->frame = frame;
+        cb->fd = fd;
+        cb->_fd = pfd->fd;
+        cb->op = GF_FOP_WRITE;
+        cb->offset = offset;
+
+        ret = posix_fdstat (this, cb->_fd, &cb->prebuf);
+        if (ret != 0) {
+                op_errno = errno;
+                gf_msg (this->name, GF_LOG_ERROR, op_errno, P_MSG_FSTAT_FAILED,
+                        "fstat failed on fd=%p", fd);
+                goto err;
+        }
+
+        /* the kernel may read the vector after this fop has returned, with
+           SQ polling or when the entry waits for the next submission */
+        cb->vector = iov_dup (iov, count);
+        if (!cb->vector) {
+                op_errno = ENOMEM;
+                goto err;
+        }
+        cb->count = count;
+
+        cb->iobref = iobref_ref (iobref);
+
+        LOCK (&ring->sq_lock);
+        {
+                sqe = __posix_uring_sqe (ring);
+                if (sqe) {
+                        if (count == 1)
+                                idx = __posix_uring_fixed (this, ring, NULL,
+                                                           iov[0].iov_base,
+                                                           iov[0].iov_len);
+                        if (idx >= 0) {
+                                sqe->opcode = IORING_OP_WRITE_FIXED;
+                                sqe->addr = (uintptr_t) iov[0].iov_base;
+                                sqe->len = iov[0].iov_len;
+                                sqe->buf_index = idx;
+                                GF_ATOMIC_INC (ring->fixed_ios);
+                        } else {
+                                sqe->opcode = IORING_OP_WRITEV;
+                                sqe->addr = (uintptr_t) cb->vector;
+                                sqe->len = cb->count;
+                        }
+                        sqe->fd = cb->_fd;
+                        sqe->off = offset;
+                        sqe->user_data = (uintptr_t) cb;
+                        if (__posix_uring_push (this, ring, cb))
+                                sqe = NULL;
+                }
+        }
+        UNLOCK (&ring->sq_lock);
+
+        if (sqe)
+                return 0;
+
+        iobref_unref (cb->iobref);
+        GF_FREE (cb->vector);
+        GF_FREE (cb);
+sync:
+        GF_ATOMIC_INC (ring->sync_fallbacks);
+        return posix_writev (frame, this, fd, iov, count, offset, flags,
+                             iobref, xdata);
+
+err:
+        STACK_UNWIND_STRICT (writev, frame, -1, op_errno, 0, 0, 0);
+        if (cb && cb->iobref)
+                iobref_unref (cb->iobref);
+        if (cb)
+                GF_FREE (cb->vector);
+        GF_FREE (cb);
+
+        return 0;
+}
+
+
+int
+posix_uring_fsync (call_frame_t *frame, xlator_t *this, fd_t *fd,
+                   int32_t datasync, dict_t *xdata)
+{
+        int32_t                op_errno = EINVAL;
+        struct posix_private  *priv     = NULL;
+        struct posix_uring    *ring     = NULL;
+        struct posix_fd       *pfd      = NULL;
+        struct posix_uring_cb *cb       = NULL;
+        struct io_uring_sqe   *sqe      = NULL;
+        int                    ret      = -1;
+
+        VALIDATE_OR_GOTO (frame, err);
+        VALIDATE_OR_GOTO (this, err);
+        VALIDATE_OR_GOTO (fd, err);
+
+        priv = this->private;
+        ring = priv->uring;
+
+        if (posix_fsync_batched (priv, xdata))
+                goto sync;
+
+        ret = posix_fd_ctx_get (fd, this, &pfd, &op_errno);
+        if (ret < 0) {
+                gf_msg (this->name, GF_LOG_WARNING, op_errno, P_MSG_PFD_NULL,
+                        "pfd not found in fd's ctx");
+                goto err;
+        }
+
+        cb = GF_CALLOC (1, sizeof (*cb), gf_posix_mt_uring_cb);
+        if (!cb) {
+                op_errno = ENOMEM;
+                goto err;
+        }
+
+        cb->frame = frame;
+        cb->fd = fd;
+        cb->_fd = pfd->fd;
+        cb->op = GF_FOP_FSYNC;
+
+        ret = posix_fdstat (this, cb->_fd, &cb->prebuf);
+        if (ret != 0) {
+                op_errno = errno;
+                gf_msg (this->name, GF_LOG_WARNING, errno, P_MSG_FSTAT_FAILED,
+                        "pre-operation fstat failed on fd=%p", fd);
+                goto err;
+        }
+
+        LOCK (&ring->sq_lock);
+        {
+                sqe = __posix_uring_sqe (ring);
+                if (sqe) {
+                        sqe->opcode = IORING_OP_FSYNC;
+                        sqe->fd = cb->_fd;
+                        if (datasync)
+                                sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+                        sqe->user_data = (uintptr_t) cb;
+                        if (__posix_uring_push (this, ring, cb))
+                                sqe = NULL;
+                }
+        }
+        UNLOCK (&ring->sq_lock);
+
+        if (sqe)
+                return 0;
+
+        GF_FREE (cb);
+sync:
+        GF_ATOMIC_INC (ring->sync_fallbacks);
+        return posix_fsync (frame, this, fd, datasync, xdata);
+
+err:
+        STACK_UNWIND_STRICT (fsync, frame, -1, op_errno, NULL, NULL, NULL);
+        GF_FREE (cb);
+
+        return 0;
+}
+
+
+int
+posix_uring_fallocate (call_frame_t *frame, xlator_t *this, fd_t *fd,
+                       int32_t keep_size, off_t offset, size_t len,
+                       dict_t *xdata)
+{
+        int32_t                op_errno = EINVAL;
+        struct posix_private  *priv     = NULL;
+        struct posix_uring    *ring     = NULL;
+        struct posix_fd       *pfd      = NULL;
+        struct posix_uring_cb *cb       = NULL;
+        struct io_uring_sqe   *sqe      = NULL;
+        int                    ret      = -1;
+
+        VALIDATE_OR_GOTO (frame, err);
+        VALIDATE_OR_GOTO (this, err);
+        VALIDATE_OR_GOTO (fd, err);
+
+        priv = this->private;
+        ring = priv->uring;
+
+        if (xdata && dict_get (xdata, GLUSTERFS_WRITE_UPDATE_ATOMIC))
+                goto sync;
+
+        DISK_SPACE_CHECK_AND_GOTO (frame, priv, xdata, op_errno, op_errno, err);
+
+        ret = posix_fd_ctx_get (fd, this, &pfd, &op_errno);
+        if (ret < 0) {
+                gf_msg_debug (this->name, 0, "pfd is NULL from fd=%p", fd);
+                goto err;
+        }
+
+        cb = GF_CALLOC (1, sizeof (*cb), gf_posix_mt_uring_cb);
+        if (!cb) {
+                op_errno = ENOMEM;
+                goto err;
+        }
+
+        cb->frame = frame;
+        cb->fd = fd;
+        cb->_fd = pfd->fd;
+        cb->op = GF_FOP_FALLOCATE;
+        cb->offset = offset;
+
+        ret = posix_fdstat (this, cb->_fd, &cb->prebuf);
+        if (ret != 0) {
+                op_errno = errno;
+                gf_msg (this->name, GF_LOG_ERROR, errno, P_MSG_FSTAT_FAILED,
+                        "fallocate (fstat) failed on fd=%p", fd);
+                goto err;
+        }
+
+        LOCK (&ring->sq_lock);
+        {
+                sqe = __posix_uring_sqe (ring);
+                if (sqe) {
+                        sqe->opcode = IORING_OP_FALLOCATE;
+                        sqe->fd = cb->_fd;
+                        sqe->off = offset;
+                        sqe->addr = len;
+#ifdef FALLOC_FL_KEEP_SIZE
+                        if (keep_size)
+                                sqe->len = FALLOC_FL_KEEP_SIZE;
+#endif /* FALLOC_FL_KEEP_SIZE */
+                        sqe->user_data = (uintptr_t) cb;
+                        if (__posix_uring_push (this, ring, cb))
+                                sqe = NULL;
+                }
+        }
+        UNLOCK (&ring->sq_lock);
+
+        if (sqe)
+                return 0;
+
+        GF_FREE (cb);
+sync:
+        GF_ATOMIC_INC (ring->sync_fallbacks);
+        return posix_glfallocate (frame, this, fd, keep_size, offset, len,
+                                  xdata);
+
+err:
+        STACK_UNWIND_STRICT (fallocate, frame, -1, op_errno, NULL, NULL,
+                             NULL);
+        GF_FREE (cb);
+
+        return 0;
+}
+
+
+static void
+posix_uring_unmap (struct posix_uring *ring)
+{
+        if (ring->sqes)
+                munmap (ring->sqes, ring->sqes_size);
+        if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+                munmap (ring->cq_ring, ring->cq_ring_size);
+        if (ring->sq_ring)
+                munmap (ring->sq_ring, ring->sq_ring_size);
+        if (ring->fd >= 0)
+                sys_close (ring->fd);
+}
+
+
+static int
+posix_uring_init (xlator_t *this)
+{
+        struct posix_private          *priv   = NULL;
+        struct posix_uring            *ring   = NULL;
+        struct io_uring_params         params = {0, };
+#ifdef IORING_RSRC_REGISTER_SPARSE
+        struct io_uring_rsrc_register  fixed  = {0, };
+#endif
+        char                          *sq     = NULL;
+        char                          *cq     = NULL;
+        int                            ret    = -1;
+
+        priv = this->private;
+
+        ring = GF_CALLOC (1, sizeof (*ring), gf_posix_mt_uring_t);
+        if (!ring)
+                goto out;
+
+        ring->fd = -1;
+        LOCK_INIT (&ring->sq_lock);
+        INIT_LIST_HEAD (&ring->cbs);
+        GF_ATOMIC_INIT (ring->inflight, 0);
+        GF_ATOMIC_INIT (ring->submitted, 0);
+        GF_ATOMIC_INIT (ring->fixed_ios, 0);
+        GF_ATOMIC_INIT (ring->sync_fallbacks, 0);
+
+        if (priv->uring_sqpoll) {
+                params.flags |= IORING_SETUP_SQPOLL;
+                params.sq_thread_idle = POSIX_URING_SQ_IDLE_MSEC;
+        }
+
+        ring->fd = syscall (__NR_io_uring_setup, priv->uring_depth, &params);
+        if (ring->fd < 0) {
+                gf_msg (this->name, GF_LOG_WARNING, errno,
+                        P_MSG_IO_URING_UNAVAILABLE,
+                        "io_uring_setup() with %u entries failed",
+                        priv->uring_depth);
+                goto out;
+        }
+
+        ring->sqpoll = priv->uring_sqpoll;
+        ring->entries = params.sq_entries;
+        ring->sq_ring_size = params.sq_off.array +
+                             params.sq_entries * sizeof (unsigned);
+        ring->cq_ring_size = params.cq_off.cqes +
+                             params.cq_entries * sizeof (struct io_uring_cqe);
+        ring->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                if (ring->cq_ring_size > ring->sq_ring_size)
+                        ring->sq_ring_size = ring->cq_ring_size;
+                ring->cq_ring_size = ring->sq_ring_size;
+        }
+
+        ring->sq_ring = mmap (NULL, ring->sq_ring_size,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring->fd,
+                              IORING_OFF_SQ_RING);
+        if (ring->sq_ring == MAP_FAILED) {
+                ring->sq_ring = NULL;
+                goto mmap_failed;
+        }
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                ring->cq_ring = ring->sq_ring;
+        } else {
+                ring->cq_ring = mmap (NULL, ring->cq_ring_size,
+                                      PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE, ring->fd,
+                                      IORING_OFF_CQ_RING);
+                if (ring->cq_ring == MAP_FAILED) {
+                        ring->cq_ring = NULL;
+                        goto mmap_failed;
+                }
+        }
+
+        ring->sqes = mmap (NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring->fd,
+                           IORING_OFF_SQES);
+        if (ring->sqes == MAP_FAILED) {
+                ring->sqes = NULL;
+                goto mmap_failed;
+        }
+
+        sq = ring->sq_ring;
+        ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+        ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+        ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+        ring->sq_flags = (unsigned *)(sq + params.sq_off.flags);
+        ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+
+        cq = ring->cq_ring;
+        ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+        ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+        ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+        ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+        /* an empty table, arenas are put in as reads come across them */
+        fixed.nr = POSIX_URING_MAX_FIXED;
+        fixed.flags = IORING_RSRC_REGISTER_SPARSE;
+        if (syscall (__NR_io_uring_register, ring->fd,
+                     IORING_REGISTER_BUFFERS2, &fixed, sizeof (fixed)) == 0)
+                ring->max_fixed = POSIX_URING_MAX_FIXED;
+#endif
+        if (!ring->max_fixed)
+                gf_msg (this->name, GF_LOG_INFO, errno,
+                        P_MSG_IO_URING_UNAVAILABLE,
+                        "no fixed buffers for io_uring, iobufs are mapped "
+                        "on every request");
+
+        priv->uring = ring;
+        /* before the thread, which clears it if it gives up */
+        ring->reaper_running = _gf_true;
+        ret = gf_thread_create (&ring->reaper, NULL, posix_uring_reaper,
+                                this, "posixurng");
+        if (ret != 0) {
+                priv->uring = NULL;
+                goto out;
+        }
+
+        gf_msg_debug (this->name, 0, "io_uring with %u entries%s",
+                      ring->entries, ring->sqpoll ? ", SQ polling" : "");
+        ret = 0;
+        goto out;
+
+mmap_failed:
+        gf_msg (this->name, GF_LOG_WARNING, errno, P_MSG_IO_URING_FAILED,
+                "mapping the io_uring failed");
+out:
+        if (ret && ring) {
+                posix_uring_unmap (ring);
+                LOCK_DESTROY (&ring->sq_lock);
+                GF_FREE (ring);
+        }
+        return ret;
+}
+
+
+int
+posix_uring_on (xlator_t *this)
+{
+        struct posix_private *priv = NULL;
+
+        priv = this->private;
+
+        if (!priv->uring && posix_uring_init (this) != 0) {
+                gf_msg (this->name, GF_LOG_WARNING, 0,
+                        P_MSG_IO_URING_UNAVAILABLE,
+                        "io_uring not available at run-time. Continuing "
+                        "without it");
+                return 0;
+        }
+
+        this->fops->readv     = posix_uring_readv;
+        this->fops->writev    = posix_uring_writev;
+        this->fops->fsync     = posix_uring_fsync;
+        this->fops->fallocate = posix_uring_fallocate;
+
+        return 0;
+}
+
+
+int
+posix_uring_off (xlator_t *this)
+{
+        struct posix_private *priv = NULL;
+
+        priv = this->private;
+
+        this->fops->fsync     = posix_fsync;
+        this->fops->fallocate = posix_glfallocate;
+
+        /* readv and writev go back to linux-aio if that is on */
+        if (priv->aio_configured) {
+                posix_aio_on (this);
+        } else {
+                this->fops->readv  = posix_readv;
+                this->fops->writev = posix_writev;
+        }
+
+        return 0;
+}
+
+
+void
+posix_uring_fini (xlator_t *this)
+{
+        struct posix_private *priv    = NULL;
+        struct posix_uring   *ring    = NULL;
+        struct io_uring_sqe  *sqe     = NULL;
+        gf_boolean_t          running = _gf_false;
+        int                   tries   = 0;
+
+        priv = this->private;
+        ring = priv->uring;
+        if (!ring)
+                return;
+
+        /* a NOP without a cb stops the reaper once everything submitted
+           before it has completed. It goes in even on a dead ring, the
+           reaper may still be waiting there. */
+        for (;;) {
+                sqe = NULL;
+                LOCK (&ring->sq_lock);
+                {
+                        running = ring->reaper_running;
+                        if (running)
+                                sqe = __posix_uring_slot (ring);
+                        if (sqe) {
+                                sqe->opcode = IORING_OP_NOP;
+                                sqe->flags = IOSQE_IO_DRAIN;
+                                if (__posix_uring_push (this, ring, NULL))
+                                        sqe = NULL;
+                        }
+                }
+                UNLOCK (&ring->sq_lock);
+
+                if (!running || sqe)
+                        break;
+
+                if (++tries == POSIX_URING_FINI_TRIES) {
+                        /* the reaper may still look at the ring, so it
+                           cannot be freed */
+                        gf_msg (this->name, GF_LOG_WARNING, 0,
+                                P_MSG_IO_URING_FAILED, "io_uring reaper "
+                                "cannot be stopped, leaving the ring "
+                                "behind");
+                        priv->uring = NULL;
+                        return;
+                }
+                usleep (1000);
+        }
+
+        /* also when the reaper gave up by itself, it has failed what was
+           left on the ring then */
+        pthread_join (ring->reaper, NULL);
+
+        priv->uring = NULL;
+        posix_uring_unmap (ring);
+        LOCK_DESTROY (&ring->sq_lock);
+        GF_FREE (ring);
+}
+
+
+void
+posix_uring_dump (xlator_t *this)
+{
+        struct posix_private *priv = NULL;
+        struct posix_uring   *ring = NULL;
+
+        priv = this->private;
+        ring = priv->uring;
+        if (!ring)
+                return;
+
+        gf_proc_dump_write ("io_uring.entries", "%u", ring->entries);
+        gf_proc_dump_write ("io_uring.sqpoll", "%d", ring->sqpoll);
+        gf_proc_dump_write ("io_uring.dead", "%d", ring->dead);
+        gf_proc_dump_write ("io_uring.inflight", "%"PRId64,
+                            GF_ATOMIC_GET (ring->inflight));
+        gf_proc_dump_write ("io_uring.submitted", "%"PRId64,
+                            GF_ATOMIC_GET (ring->submitted));
+        gf_proc_dump_write ("io_uring.fixed_ios", "%"PRId64,
+                            GF_ATOMIC_GET (ring->fixed_ios));
+        gf_proc_dump_write ("io_uring.sync_fallbacks", "%"PRId64,
+                            GF_ATOMIC_GET (ring->sync_fallbacks));
+        gf_proc_dump_write ("io_uring.fixed_buffers", "%d", ring->nr_fixed);
+}
+
+
+#else
+
+
+int
+posix_uring_on (xlator_t *this)
+{
+        gf_msg (this->name, GF_LOG_INFO, 0, P_MSG_IO_URING_UNAVAILABLE,
+                "io_uring not available at build-time. Continuing without "
+                "it");
+        return 0;
+}
+
+int
+posix_uring_off (xlator_t *this)
+{
+        return 0;
+}
+
+void
+posix_uring_fini (xlator_t *this)
+{
+        return;
+}
+
+void
+posix_uring_dump (xlator_t *this)
+{
+        return;
+}
+
+#endif
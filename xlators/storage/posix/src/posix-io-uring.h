@@ -0,0 +1,31 @@
+/*
+   Copyright (c) 2017 Red Hat, Inc. <http://www.redhat.com>
+   This file is part of GlusterFS.
+
+   This file is licensed to you under your choice of the GNU Lesser
+   General Public License, version 3 or any later version (LGPLv3 or
+   later), or the GNU General Public License, version 2 (GPLv2), in all
+   cases as published by the Free Software Foundation.
+*/
+#ifndef _POSIX_IO_URING_H
+#define _POSIX_IO_URING_H
+
+#include "xlator.h"
+#include "glusterfs.h"
+
+// Most iobuf arenas registered as fixed buffers with one ring
+#define POSIX_URING_MAX_FIXED 64
+
+// Milliseconds the SQ polling kernel thread spins before it goes idle
+#define POSIX_URING_SQ_IDLE_MSEC 100
+
+// Milliseconds fini waits for room for the NOP that stops the reaper
+#define POSIX_URING_FINI_TRIES 10000
+
+
+int posix_uring_on (xlator_t *this);
+int posix_uring_off (xlator_t *this);
+void posix_uring_fini (xlator_t *this);
+void posix_uring_dump (xlator_t *this);
+
+#endif /* !_POSIX_IO_URING_H */
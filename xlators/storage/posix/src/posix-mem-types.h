@@ -22,6 +22,12 @@ enum gf_posix_mem_types_ {
         gf_posix_mt_trash_path,
 	gf_posix_mt_paiocb,
         gf_posix_mt_inode_ctx_t,
+        gf_posix_mt_dirfd_cache_t,
+        gf_posix_mt_dirfd_t,
+        gf_posix_mt_readdirp_entries,
+        gf_posix_mt_uring_t,
+        gf_posix_mt_uring_cb,
+        gf_posix_mt_fsync_group,
         gf_posix_mt_end
 };
 #endif
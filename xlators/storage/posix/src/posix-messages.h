@@ -136,7 +136,9 @@ GLFS_MSGID(POSIX,
         P_MSG_LEASE_DISABLED,
         P_MSG_ANCESTORY_FAILED,
         P_MSG_DISK_SPACE_CHECK_FAILED,
-        P_MSG_FALLOCATE_FAILED
+        P_MSG_FALLOCATE_FAILED,
+        P_MSG_IO_URING_UNAVAILABLE,
+        P_MSG_IO_URING_FAILED
 );
 
 #endif /* !_GLUSTERD_MESSAGES_H_ */
@@ -200,10 +200,19 @@ struct posix_private {
 		BATCH_SYNCFS,
 		BATCH_SYNCFS_SINGLE_FSYNC,
 		BATCH_REVERSE_FSYNC,
-		BATCH_SYNCFS_REVERSE_FSYNC
+		BATCH_SYNCFS_REVERSE_FSYNC,
+		BATCH_GROUP_COMMIT
 	}               batch_fsync_mode;
 
 	uint32_t        batch_fsync_delay_usec;
+
+        /* group-commit: only touched by the fsyncer thread */
+        uint64_t        fsync_flush_usec;   /* moving average of a flush */
+        uint32_t        fsync_last_batch;
+        gf_boolean_t    fsync_no_sfr;       /* sync_file_range() failed */
+        uint64_t        fsync_batches;
+        uint64_t        fsync_requests;
+        uint64_t        fsync_flushes;
         gf_boolean_t    update_pgfid_nlinks;
         gf_boolean_t    gfid2path;
         char            gfid2path_sep[8];
@@ -243,6 +252,46 @@ struct posix_private {
         mode_t          create_mask;
         mode_t          create_directory_mask;
         uint32_t max_hardlinks;
+
+        /* O_PATH fds of recently used directories, see posix-handle.c */
+        struct posix_dirfd_cache *dirfd_cache;
+
+        /* threads helping posix_readdirp_fill() with large replies */
+        pthread_mutex_t   readdirp_lock;
+        pthread_cond_t    readdirp_cond;
+        pthread_cond_t    readdirp_done;
+        struct list_head  readdirp_jobs;
+        uint32_t          readdirp_threads;
+        uint32_t          readdirp_running;
+
+        /* io_uring engine, see posix-io-uring.c */
+        gf_boolean_t        uring_configured;
+        uint32_t            uring_depth;
+        gf_boolean_t        uring_sqpoll;
+        struct posix_uring *uring;
+};
+
+/* readdirp replies with fewer entries are filled by the calling thread */
+#define POSIX_READDIRP_PARALLEL_MIN 32
+
+/* group-commit never holds a batch open longer than this, unless
+   batch-fsync-delay-usec says otherwise */
+#define POSIX_GROUP_COMMIT_MAX_DELAY_USEC 2000
+
+/* The entries of one readdirp reply, stat()ed and getxattr()ed by the
+   calling thread together with whichever readdirp threads are idle. Every
+   entry is filled in place, the order of the reply does not change. */
+struct posix_readdirp_job {
+        struct list_head   list;
+        xlator_t          *this;
+        fd_t              *fd;
+        dict_t            *dict;
+        gf_dirent_t      **entries;
+        int                count;
+        gf_atomic_t        next;        /* next entry to fill */
+        int                workers;     /* readdirp threads on this job */
+        const char        *dir_path;
+        int                dir_len;
 };
 
 typedef struct {
@@ -341,6 +390,18 @@ void posix_spawn_health_check_thread (xlator_t *this);
 void posix_spawn_disk_space_check_thread (xlator_t *this);
 
 void *posix_fsyncer (void *);
+
+gf_boolean_t posix_fsync_batched (struct posix_private *priv, dict_t *xdata);
+
+void posix_fsyncer_dump (xlator_t *this);
+
+void posix_readdirp_threads_scale (xlator_t *this, uint32_t threads);
+
+void posix_readdirp_threads_fini (xlator_t *this);
+
+void posix_readdirp_job_run (xlator_t *this, struct posix_readdirp_job *job);
+
+void posix_readdirp_job_work (struct posix_readdirp_job *job);
 int
 posix_get_ancestry (xlator_t *this, inode_t *leaf_inode,
                     gf_dirent_t *head, char **path, int type, int32_t *op_errno,